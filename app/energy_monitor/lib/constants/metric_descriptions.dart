@@ -19,7 +19,7 @@ class MetricDescriptions {
     'Load Impedance':
         'The total opposition (resistance + reactance) to AC current flow, measured in ohms (Ω).\n\nCalculation: Z = V ÷ I\nWhere:\nZ = Load Impedance (Ω)\nV = Voltage (V)\nI = Current (A)',
     'THD':
-        'Total Harmonic Distortion - A measure of waveform distortion caused by harmonics.\n\nCalculation: THD = (D ÷ P) × 100%\nWhere:\nD = Distortion Power\nP = Fundamental Power',
+        'Total Harmonic Distortion - A measure of waveform distortion caused by harmonics.\n\nMeasured from the current waveform by FFT when the waveform inputs are fitted:\nTHD = √(I₂² + I₃² + … + I₄₀²) ÷ I₁ × 100%\nWhere:\nIₕ = RMS current of the h-th harmonic\n\nOtherwise estimated as (D ÷ P) × 100%, which counts all non-active power.',
     'Distortion Power':
         'The power lost due to harmonic distortion in a circuit.\n\nCalculation: D = √(S² - P² - Q²)\nWhere:\nD = Distortion Power (VA)\nS = Apparent Power (VA)\nP = Active Power (W)\nQ = Reactive Power (VAR)',
     'Power Quality':
@@ -3,10 +3,12 @@ import 'package:firebase_database/firebase_database.dart';
 import 'package:firebase_auth/firebase_auth.dart';
 import '../widgets/metric_cards.dart';
 import '../widgets/device_status.dart';
+import '../widgets/device_selector.dart';
 import '../utils/dashboard_utils.dart';
 import 'about_screen.dart';
 import 'dart:async';
 import '../services/metrics_service.dart';
+import '../services/device_service.dart';
 
 class DashboardScreen extends StatefulWidget {
   const DashboardScreen({super.key});
@@ -17,7 +19,7 @@ class DashboardScreen extends StatefulWidget {
 
 class _DashboardScreenState extends State<DashboardScreen>
     with SingleTickerProviderStateMixin {
-  final _database = FirebaseDatabase.instance.ref();
+  final _deviceService = DeviceService();
   final _metricsService = MetricsService();
   late AnimationController _animationController;
   Timer? _debounceTimer;
@@ -31,12 +33,20 @@ class _DashboardScreenState extends State<DashboardScreen>
       duration: const Duration(milliseconds: 1000),
     );
     _animationController.forward();
+    _deviceService.selected.addListener(_setupDataSubscription);
+    _deviceService.load();
     _setupDataSubscription();
   }
 
+  // (Re)subscribes to the selected meter's readings
   void _setupDataSubscription() {
-    _readingsSubscription = _database
-        .child('readings')
+    _debounceTimer?.cancel();
+    _readingsSubscription?.cancel();
+    _readingsSubscription = null;
+    _metricsService.updateReadings({});
+    if (_deviceService.selected.value == null) return;
+    _readingsSubscription = _deviceService
+        .ref('readings')
         .onValue
         .transform(
           StreamTransformer.fromHandlers(
@@ -63,6 +73,7 @@ class _DashboardScreenState extends State<DashboardScreen>
 
   @override
   void dispose() {
+    _deviceService.selected.removeListener(_setupDataSubscription);
     _debounceTimer?.cancel();
     _readingsSubscription?.cancel();
     _animationController.dispose();
@@ -70,12 +81,14 @@ class _DashboardScreenState extends State<DashboardScreen>
   }
 
   Future<void> _resetDevice() async {
-    await _database.child('reset').set(true);
+    if (_deviceService.selected.value == null) return;
+    await _deviceService.ref('commands/reset').set(true);
   }
 
   Future<void> _handleLogout() async {
     try {
       // First cancel all subscriptions and dispose resources
+      _deviceService.selected.removeListener(_setupDataSubscription);
       _debounceTimer?.cancel();
       _readingsSubscription?.cancel();
       _animationController.dispose();
@@ -375,6 +388,55 @@ class _DashboardScreenState extends State<DashboardScreen>
     );
   }
 
+  Widget _buildBattery() {
+    return StreamBuilder<DatabaseEvent>(
+      stream: _deviceService.ref('battery').onValue,
+      builder: (context, AsyncSnapshot<DatabaseEvent> batterySnapshot) {
+        if (!batterySnapshot.hasData) return const SizedBox();
+
+        return StreamBuilder<DatabaseEvent>(
+          stream: _deviceService.ref('readings/isCharging').onValue,
+          builder: (context, AsyncSnapshot<DatabaseEvent> chargingSnapshot) {
+            final battery = (batterySnapshot.data!.snapshot.value as num?) ?? 0;
+            final batteryInt = battery.toInt();
+            final isCharging =
+                (chargingSnapshot.data?.snapshot.value as bool?) ?? false;
+
+            WidgetsBinding.instance.addPostFrameCallback((_) {
+              DashboardUtils.showBatteryWarning(context, batteryInt);
+            });
+
+            return Row(
+              mainAxisSize: MainAxisSize.min,
+              children: [
+                Text(
+                  '$batteryInt%',
+                  style: TextStyle(
+                    color:
+                        batteryInt > 20
+                            ? Theme.of(context).colorScheme.primary
+                            : Theme.of(context).colorScheme.error,
+                    fontWeight: FontWeight.bold,
+                  ),
+                ),
+                const SizedBox(width: 4),
+                Icon(
+                  isCharging
+                      ? Icons.battery_charging_full
+                      : DashboardUtils.getBatteryIcon(batteryInt),
+                  color:
+                      batteryInt > 20
+                          ? Theme.of(context).colorScheme.primary
+                          : Theme.of(context).colorScheme.error,
+                ),
+              ],
+            );
+          },
+        );
+      },
+    );
+  }
+
   static final _basicMetricsHeader = const Text(
     'Basic Metrics',
     style: TextStyle(
@@ -398,60 +460,17 @@ class _DashboardScreenState extends State<DashboardScreen>
                 onPressed: () => Scaffold.of(context).openDrawer(),
               ),
         ),
-        title: const Text('Energy Monitor', style: TextStyle(fontSize: 16)),
+        title: const DeviceSelector(),
         actions: [
           const Padding(
             padding: EdgeInsets.symmetric(horizontal: 8.0),
             child: DeviceStatus(),
           ),
-          StreamBuilder<DatabaseEvent>(
-            stream: _database.child('battery').onValue,
-            builder: (context, AsyncSnapshot<DatabaseEvent> batterySnapshot) {
-              if (!batterySnapshot.hasData) return const SizedBox();
-
-              return StreamBuilder<DatabaseEvent>(
-                stream: _database.child('readings/isCharging').onValue,
-                builder: (
-                  context,
-                  AsyncSnapshot<DatabaseEvent> chargingSnapshot,
-                ) {
-                  final battery =
-                      (batterySnapshot.data!.snapshot.value as num?) ?? 0;
-                  final batteryInt = battery.toInt();
-                  final isCharging =
-                      (chargingSnapshot.data?.snapshot.value as bool?) ?? false;
-
-                  WidgetsBinding.instance.addPostFrameCallback((_) {
-                    DashboardUtils.showBatteryWarning(context, batteryInt);
-                  });
-
-                  return Row(
-                    mainAxisSize: MainAxisSize.min,
-                    children: [
-                      Text(
-                        '$batteryInt%',
-                        style: TextStyle(
-                          color:
-                              batteryInt > 20
-                                  ? Theme.of(context).colorScheme.primary
-                                  : Theme.of(context).colorScheme.error,
-                          fontWeight: FontWeight.bold,
-                        ),
-                      ),
-                      const SizedBox(width: 4),
-                      Icon(
-                        isCharging
-                            ? Icons.battery_charging_full
-                            : DashboardUtils.getBatteryIcon(batteryInt),
-                        color:
-                            batteryInt > 20
-                                ? Theme.of(context).colorScheme.primary
-                                : Theme.of(context).colorScheme.error,
-                      ),
-                    ],
-                  );
-                },
-              );
+          ValueListenableBuilder<String?>(
+            valueListenable: _deviceService.selected,
+            builder: (context, selected, _) {
+              if (selected == null) return const SizedBox();
+              return _buildBattery();
             },
           ),
           IconButton(
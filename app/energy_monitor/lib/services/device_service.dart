@@ -0,0 +1,60 @@
+import 'package:flutter/foundation.dart';
+import 'package:firebase_database/firebase_database.dart';
+import 'package:shared_preferences/shared_preferences.dart';
+
+// Which meter the dashboard shows. Each meter writes under devices/<id>,
+// and lists itself in fleet/<id> with its build, channel count and lastSeen.
+class DeviceService {
+  static final DeviceService _instance = DeviceService._internal();
+  factory DeviceService() => _instance;
+  DeviceService._internal();
+
+  static const _selectedKey = 'selectedDevice';
+
+  final _database = FirebaseDatabase.instance.ref();
+  final ValueNotifier<String?> _selected = ValueNotifier(null);
+  ValueNotifier<String?> get selected => _selected;
+
+  // The fleet index as id -> {build, channels, lastSeen}
+  Stream<Map<String, Map<String, dynamic>>> get devices =>
+      _database.child('fleet').onValue.map((event) {
+        final data = event.snapshot.value as Map<dynamic, dynamic>?;
+        if (data == null) return {};
+        return data.map(
+          (id, entry) => MapEntry(
+            id as String,
+            entry is Map ? Map<String, dynamic>.from(entry) : {},
+          ),
+        );
+      });
+
+  // The last meter picked on this phone, else the first one in the index
+  Future<void> load() async {
+    final prefs = await SharedPreferences.getInstance();
+    final saved = prefs.getString(_selectedKey);
+    if (saved != null) {
+      _selected.value = saved;
+      return;
+    }
+    final fleet = await _database.child('fleet').get();
+    final ids = (fleet.value as Map<dynamic, dynamic>?)?.keys.toList() ?? [];
+    if (ids.isNotEmpty) {
+      ids.sort();
+      await select(ids.first as String);
+    }
+  }
+
+  Future<void> select(String id) async {
+    if (_selected.value == id) return;
+    _selected.value = id;
+    final prefs = await SharedPreferences.getInstance();
+    await prefs.setString(_selectedKey, id);
+  }
+
+  // A node of the selected meter, e.g. ref('readings')
+  DatabaseReference ref(String path) =>
+      _database.child('devices/${_selected.value}/$path');
+
+  DatabaseReference lastSeen() =>
+      _database.child('fleet/${_selected.value}/lastSeen');
+}
@@ -0,0 +1,82 @@
+import 'package:flutter/material.dart';
+import '../services/device_service.dart';
+
+// App bar title listing the meters in the fleet index; picking one switches
+// the dashboard over to it.
+class DeviceSelector extends StatelessWidget {
+  const DeviceSelector({super.key});
+
+  // Same rule as DeviceStatus: two missed heartbeats mean offline
+  static bool _isOnline(Map<String, dynamic> entry) {
+    final lastSeen = entry['lastSeen'] as int?;
+    if (lastSeen == null) return false;
+    final now = DateTime.now().millisecondsSinceEpoch ~/ 1000;
+    return now - lastSeen <= 125;
+  }
+
+  @override
+  Widget build(BuildContext context) {
+    final service = DeviceService();
+
+    return StreamBuilder<Map<String, Map<String, dynamic>>>(
+      stream: service.devices,
+      builder: (context, snapshot) {
+        final devices = snapshot.data ?? {};
+        final ids = devices.keys.toList()..sort();
+
+        return ValueListenableBuilder<String?>(
+          valueListenable: service.selected,
+          builder: (context, selected, _) {
+            return PopupMenuButton<String>(
+              enabled: ids.isNotEmpty,
+              color: const Color(0xFF1A1A1A),
+              onSelected: service.select,
+              itemBuilder:
+                  (context) => [
+                    for (final id in ids)
+                      PopupMenuItem(
+                        value: id,
+                        child: Row(
+                          children: [
+                            Icon(
+                              Icons.circle,
+                              size: 10,
+                              color:
+                                  _isOnline(devices[id]!)
+                                      ? Colors.green
+                                      : Colors.red,
+                            ),
+                            const SizedBox(width: 8),
+                            Text(
+                              id,
+                              style: TextStyle(
+                                fontWeight:
+                                    id == selected
+                                        ? FontWeight.bold
+                                        : FontWeight.normal,
+                              ),
+                            ),
+                          ],
+                        ),
+                      ),
+                  ],
+              child: Row(
+                mainAxisSize: MainAxisSize.min,
+                children: [
+                  Flexible(
+                    child: Text(
+                      selected == null ? 'Energy Monitor' : 'Meter $selected',
+                      style: const TextStyle(fontSize: 16),
+                      overflow: TextOverflow.ellipsis,
+                    ),
+                  ),
+                  if (ids.length > 1) const Icon(Icons.arrow_drop_down),
+                ],
+              ),
+            );
+          },
+        );
+      },
+    );
+  }
+}
@@ -1,6 +1,7 @@
 import 'package:flutter/material.dart';
 import 'package:firebase_database/firebase_database.dart';
 import 'dart:async';
+import '../services/device_service.dart';
 
 class DeviceStatus extends StatefulWidget {
   const DeviceStatus({super.key});
@@ -22,7 +23,8 @@ class _DeviceStatusState extends State<DeviceStatus> {
       if (_lastSeen != null) {
         final now = DateTime.now().millisecondsSinceEpoch ~/ 1000;
         final difference = now - _lastSeen!;
-        final newStatus = difference <= 3;
+        // lastSeen is written every 60 s; two missed heartbeats mean offline
+        final newStatus = difference <= 125;
 
         if (newStatus != _isOnline && mounted) {
           setState(() => _isOnline = newStatus);
@@ -43,24 +45,35 @@ class _DeviceStatusState extends State<DeviceStatus> {
 
   @override
   Widget build(BuildContext context) {
-    final databaseRef = FirebaseDatabase.instance.ref();
+    final deviceService = DeviceService();
 
-    return StreamBuilder<DatabaseEvent>(
-      stream: databaseRef.child('deviceStatus/lastSeen').onValue,
-      builder: (context, AsyncSnapshot<DatabaseEvent> snapshot) {
-        if (!snapshot.hasData) {
+    // The selected meter's heartbeat, kept in the fleet index
+    return ValueListenableBuilder<String?>(
+      valueListenable: deviceService.selected,
+      builder: (context, selected, _) {
+        if (selected == null) {
+          _lastSeen = null;
           return const Icon(Icons.circle, size: 12, color: Colors.grey);
         }
 
-        _lastSeen = snapshot.data!.snapshot.value as int?;
-        if (_lastSeen == null) {
-          return const Icon(Icons.circle, size: 12, color: Colors.grey);
-        }
+        return StreamBuilder<DatabaseEvent>(
+          stream: deviceService.lastSeen().onValue,
+          builder: (context, AsyncSnapshot<DatabaseEvent> snapshot) {
+            if (!snapshot.hasData) {
+              return const Icon(Icons.circle, size: 12, color: Colors.grey);
+            }
+
+            _lastSeen = snapshot.data!.snapshot.value as int?;
+            if (_lastSeen == null) {
+              return const Icon(Icons.circle, size: 12, color: Colors.grey);
+            }
 
-        return Icon(
-          Icons.circle,
-          size: 12,
-          color: _isOnline ? Colors.green : Colors.red,
+            return Icon(
+              Icons.circle,
+              size: 12,
+              color: _isOnline ? Colors.green : Colors.red,
+            );
+          },
         );
       },
     );
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "hal.h"
+
+// Background sampling of the slow analog inputs (battery divider, charge
+// detect). The ADC runs continuously into DMA at SAMPLE_RATE_HZ, shared
+// round-robin by the watched pins, and a low-priority task pushes every
+// conversion through a per-pin filter chain:
+//
+//   OVERSAMPLE conversions -> mean without the block's min and max
+//   -> median of the last MEDIAN_WINDOW block means -> EMA (per-pin shift)
+//
+// The trimmed mean drops single rail spikes, the median rejects a block
+// that caught a burst, and the EMA sets the response time. Readers get the
+// latest filtered value at once from an atomic; nothing waits on the ADC.
+// If the backend can't run continuously the task falls back to one-shot
+// reads every millisecond through the same chain.
+//
+// In low-power mode the scan stops (the DMA keeps the CPU out of light
+// sleep) and the task wakes once per LOW_POWER_PERIOD_MS for a burst of
+// OVERSAMPLE one-shot reads per pin, one whole block, so the filtered values
+// keep their meaning at a slower pace.
+//
+// Tapped pins join the scan unfiltered: every drained batch is handed to the
+// tap as it came off the DMA ring (waveform capture). Taps get nothing in the
+// one-shot fallback.
+class AdcSampler {
+public:
+    static const uint32_t SAMPLE_RATE_HZ = 20000;  // Lowest the ESP32 digital controller runs at
+    static const uint8_t OVERSAMPLE = 64;
+    static const uint8_t MEDIAN_WINDOW = 5;
+    static const uint8_t MAX_PINS = 4;
+
+    typedef void (*Tap)(const AdcSample* samples, size_t count);
+
+    struct Stats {
+        uint32_t conversions = 0;
+        uint32_t blocks = 0;
+        bool continuous = false;
+    };
+
+    // Register before start(). A block is OVERSAMPLE / SAMPLE_RATE_HZ x pins
+    // long (6.4 ms for two pins); the EMA time constant is 2^shift blocks.
+    static bool watch(uint8_t pin, uint8_t smoothingShift);
+    static bool tap(uint8_t pin, Tap sink);  // One sink for all tapped pins
+    static void start();
+    static void service();  // Drains the DMA stream when there is no RTOS (native build)
+    static void setLowPower(bool enabled);  // Taken up by the task on its next wake
+    static bool lowPower() { return lowPowerActive; }
+
+    static bool ready(uint8_t pin);         // At least one block has been filtered
+    static float rawValue(uint8_t pin);     // Filtered, in fractional ADC counts
+    static float milliVolts(uint8_t pin);   // Calibrated, interpolated between counts
+    static Stats stats();
+    static uint32_t pinRateHz();  // Conversions per second of each scanned pin
+
+private:
+    static const uint8_t TASK_CORE = 0;
+    static const uint8_t TASK_PRIORITY = 2;  // Below the meter sampler
+    static const uint32_t TASK_STACK = 3072;
+    static const unsigned long DRAIN_PERIOD_MS = 10;
+    static const unsigned long LOW_POWER_PERIOD_MS = 1000;
+    static const uint8_t FRACTION_BITS = 12;  // Published values are Q12 counts
+
+    struct Channel {
+        uint8_t pin;
+        uint8_t shift;
+        uint32_t sum;
+        uint16_t low;
+        uint16_t high;
+        uint8_t n;
+        uint16_t window[MEDIAN_WINDOW];  // Block means in 1/16 counts
+        uint8_t filled;
+        uint8_t head;
+        int32_t ema;  // Q12
+        std::atomic<uint32_t> published;
+        std::atomic<bool> primed;
+    };
+
+    static void drain();
+    static void applyMode();
+    static unsigned long wakePeriod();
+    static void add(Channel& channel, uint16_t raw);
+    static void finishBlock(Channel& channel);
+    static Channel* find(uint8_t pin);
+#ifndef NATIVE_BUILD
+    static void taskLoop(void* arg);
+#endif
+
+    static Channel channels[MAX_PINS];
+    static uint8_t channelCount;
+    static uint8_t tappedPins[MAX_PINS];
+    static uint8_t tappedCount;
+    static Tap tapSink;
+    static bool continuous;
+    static std::atomic<bool> lowPowerRequested;
+    static bool lowPowerActive;
+    static std::atomic<uint32_t> conversions;
+    static std::atomic<uint32_t> blocks;
+#ifdef NATIVE_BUILD
+    static unsigned long steppedTo;
+#endif
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Standard base64 (RFC 4648, padded). Binary payloads travel to the
+// database as JSON strings.
+constexpr size_t base64Length(size_t bytes) { return (bytes + 2) / 3 * 4; }
+
+// Writes base64Length(len) characters plus a terminator; 0 if out is too small
+inline size_t base64Encode(const uint8_t* data, size_t len, char* out, size_t capacity) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t needed = base64Length(len);
+    if (needed + 1 > capacity) return 0;
+    char* p = out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t chunk = (uint32_t)data[i] << 16;
+        if (i + 1 < len) chunk |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) chunk |= data[i + 2];
+        *p++ = ALPHABET[(chunk >> 18) & 0x3F];
+        *p++ = ALPHABET[(chunk >> 12) & 0x3F];
+        *p++ = i + 1 < len ? ALPHABET[(chunk >> 6) & 0x3F] : '=';
+        *p++ = i + 2 < len ? ALPHABET[chunk & 0x3F] : '=';
+    }
+    *p = '\0';
+    return needed;
+}
+
+// Bytes written, or 0 on a malformed string or too small a buffer
+inline size_t base64Decode(const char* text, size_t len, uint8_t* out, size_t capacity) {
+    if (len % 4 != 0) return 0;
+    size_t written = 0;
+    for (size_t i = 0; i < len; i += 4) {
+        uint32_t chunk = 0;
+        int padding = 0;
+        for (int j = 0; j < 4; j++) {
+            char c = text[i + j];
+            uint32_t v;
+            if (c >= 'A' && c <= 'Z') v = c - 'A';
+            else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') v = c - '0' + 52;
+            else if (c == '+') v = 62;
+            else if (c == '/') v = 63;
+            else if (c == '=' && i + 4 == len && j >= 2) { v = 0; padding++; }
+            else return 0;
+            chunk = (chunk << 6) | v;
+        }
+        for (int j = 0; j < 3 - padding; j++) {
+            if (written >= capacity) return 0;
+            out[written++] = (uint8_t)(chunk >> (16 - 8 * j));
+        }
+    }
+    return written;
+}
@@ -7,11 +7,14 @@ public:
     static void setup();
     static uint8_t getBatteryPercentage();
     static float getBatteryVoltage();
+    static uint8_t percentageFor(float vBat);  // Discharge curve lookup
+
+    static const uint16_t CAPACITY_MAH = 2600;  // 18650 cell
 
 private:
     static const uint8_t BATTERY_PIN = 34;  // GPIO34 (ADC1_6)
     static const float R1;  // First resistor (kΩ)
     static const float R2;  // Second resistor (kΩ)
     static const float VOLTAGE_SCALER;  // Voltage divider factor
-    static const int SAMPLE_COUNT = 20;  // Number of ADC samples to average
+    static const uint8_t BATTERY_SMOOTHING = 5;  // EMA over ~32 ADC blocks (12.8 ms with 4 pins), about 0.4 s
 };
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Brings WiFi, NTP time and cloud sign-in up in the background while the
+// meter is already being sampled. Nothing here waits or restarts the device:
+// service() is called from loop(), checks where each step is and starts the
+// next one. A lost link drops back to WiFi; time and sign-in survive it.
+class BootSequence {
+public:
+    enum class State : uint8_t {
+        WifiConnecting,  // WifiLink is joining a network
+        Connecting,      // Link up; waiting for NTP and cloud sign-in
+        Online
+    };
+
+    // Milliseconds since boot at which each milestone was first reached, 0 = not yet
+    struct Metrics {
+        unsigned long firstSampleMs = 0;
+        unsigned long wifiMs = 0;
+        unsigned long timeMs = 0;
+        unsigned long cloudMs = 0;
+        unsigned long onlineMs = 0;
+        unsigned long firstUploadMs = 0;
+        uint32_t wifiAttempts = 0;  // Joins it took to get the first link
+    };
+
+    static void begin();
+    static void service();
+
+    static State state() { return current; }
+    static bool online() { return current == State::Online; }
+    static bool takeOnlineEdge();  // True once each time the device comes online
+
+    static void markFirstSample();  // From the sampling task
+    static void markFirstUpload();
+    static const Metrics& metrics() { return bootMetrics; }
+
+private:
+    static const unsigned long TIME_RESYNC_INTERVAL = 5000;
+    static const unsigned long CLOUD_WAIT_MS = 10000;  // Reported to WifiLink as a failure after this
+
+    static void enter(State next);
+
+    static State current;
+    static unsigned long timeRequestedAt;
+    static unsigned long waitingSince;
+    static bool cloudStarted;
+    static bool onlineEdge;
+    static Metrics bootMetrics;
+};
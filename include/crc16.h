@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-16/MODBUS (poly 0xA001 reflected, init 0xFFFF). Used on the PZEM wire
+// and for integrity checks on records kept in flash.
+inline uint16_t crc16(const void* data, size_t len, uint16_t crc = 0xFFFF) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
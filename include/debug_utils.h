@@ -1,15 +1,9 @@
 #pragma once
 
-#include <Arduino.h>
+#include "logger.h"
 
-#define DEBUG_ENABLED true
-
-#if DEBUG_ENABLED
-    #define DEBUG_PRINT(x) Serial.print(x)
-    #define DEBUG_PRINTLN(x) Serial.println(x)
-    #define DEBUG_PRINTF(format, ...) Serial.printf(format, __VA_ARGS__)
-#else
-    #define DEBUG_PRINT(x)
-    #define DEBUG_PRINTLN(x)
-    #define DEBUG_PRINTF(format, ...)
-#endif
+// Legacy debug macros, kept as debug-level records on the deferred logger.
+// New code uses LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG directly.
+#define DEBUG_PRINT(x) LOG_DEBUG(x)
+#define DEBUG_PRINTLN(x) LOG_DEBUG(x)
+#define DEBUG_PRINTF(format, ...) LOG_DEBUG(format, __VA_ARGS__)
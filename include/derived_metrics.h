@@ -0,0 +1,32 @@
+#pragma once
+
+#include "hal.h"
+#include "power_readings.h"
+
+// Derived power metrics straight from the meter's integer registers. Products
+// of registers are formed exactly in 64-bit integers and only the final
+// scaling, one sqrtf and two divisions use single-precision floats; nothing
+// is promoted to software double on the ESP32.
+//
+// Error bound against an exact evaluation of the original formulas over the
+// meter's register range (checked by `program --bench metrics`):
+//   apparent power, THD: relative error < 1e-6
+//   distortion power: < 1e-6 x apparent power (the float/pow version loses up
+//     to 1e-5 here, and 1e-3 of THD, to cancellation when PF is near 1)
+//   reactive power: < 1e-5 x apparent power (Q16 table, 8e-6 worst case)
+//   impedance: one single-precision division, < 1e-7 relative
+//   power quality: absolute error < 1e-6
+class DerivedMetrics {
+public:
+    // Fills every measured and derived field of readings from one sample
+    static void compute(const MeterSample& sample, PowerReadings& readings);
+
+    // THD and the power quality that follows from it. compute() can only
+    // estimate THD as D/P from the meter's registers, which counts all
+    // non-active power; the waveform FFT replaces it with the measured value.
+    static void setThd(PowerReadings& readings, float thd);
+
+private:
+    // sqrt(1 - pf^2) in Q16 for pf = 0.00 .. 1.00
+    static const uint32_t REACTIVE_FACTOR_Q16[101];
+};
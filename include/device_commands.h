@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include "spsc_ring.h"
+
+// Commands pushed from the app to devices/<id>/commands, through a persistent
+// RTDB stream or an MQTT subscription. The callback runs on the uplink's own
+// task; loop() drains the parsed commands with poll().
+struct DeviceCommand {
+    enum Type : uint8_t {
+        ResetEnergy,
+        SetUpdateInterval   // value = upload interval in ms
+    };
+    Type type;
+    uint32_t value;
+};
+
+class DeviceCommands {
+public:
+    static const char* COMMANDS_PATH;
+
+    static void maintain();  // (Re)opens the stream whenever it is down
+    static bool poll(DeviceCommand& command);
+    static bool isConnected();
+    static uint32_t reconnectCount();
+
+    // Parses one stream event, exposed for the native build
+    static void handleEvent(const char* path, const char* data);
+
+private:
+    static const unsigned long RETRY_INTERVAL = 5000;
+    static const uint32_t MIN_UPDATE_INTERVAL = 1000;
+    static const uint32_t MAX_UPDATE_INTERVAL = 600000;
+
+    static void handleField(const char* key, const char* value);
+    static bool findMember(const char* json, const char* key, char* value, size_t size);
+
+    static SpscRing<DeviceCommand, 8> queue;
+    static unsigned long lastAttempt;
+    static uint32_t reconnects;
+};
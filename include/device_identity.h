@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Where this unit lives in the database. Everything it writes goes under
+// devices/<id>/, the id being its WiFi station MAC as 12 lowercase hex
+// digits, so any number of units can share one project without writing to
+// each other's nodes. fleet/<id> is the index the app lists the units from.
+class DeviceIdentity {
+public:
+    static const size_t ID_LENGTH = 12;
+    static const char* const DEVICES_PATH;
+    static const char* const FLEET_PATH;
+
+    static void begin();  // Reads the MAC; before anything talks to the cloud
+    static const char* id() { return deviceId; }
+    static const char* root() { return rootPath; }    // "devices/<id>"
+    static const char* fleet() { return fleetPath; }  // "fleet/<id>"
+
+    // "devices/<id>/<leaf>"; false if it doesn't fit
+    static bool path(char* buffer, size_t size, const char* leaf);
+    // Relative to the device's node: channel 0 keeps the single-meter layout,
+    // every other meter on the bus lives under channels/<n>/
+    static void channelPath(char* buffer, size_t size, uint8_t channel, const char* leaf);
+    static void dayBucket(char* buffer, size_t size, uint32_t timestamp);  // UTC "YYYYMMDD"
+
+private:
+    static char deviceId[ID_LENGTH + 1];
+    static char rootPath[32];
+    static char fleetPath[32];
+};
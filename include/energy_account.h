@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+#include "hal.h"
+#include "power_readings.h"
+
+// Per-channel energy totals kept in 64-bit micro-watt-hours. The PZEM's own
+// Wh counter is authoritative: it keeps counting through any stall on our
+// side, so gaps between samples cost nothing. Between counter ticks the
+// software integral of the power register supplies the sub-Wh part, clamped
+// below the next whole Wh so the total never runs backwards when the counter
+// catches up.
+class EnergyAccount {
+public:
+    // The PZEM-004T counter wraps after 9999.99 kWh
+    static const uint32_t COUNTER_ROLLOVER_WH = 10000000UL;
+
+    struct Stats {
+        uint32_t counterSteps = 0;    // Samples in which the counter advanced
+        uint32_t rollovers = 0;
+        uint32_t counterResets = 0;   // Counter went backwards without wrapping
+        uint32_t rejected = 0;        // Jumps larger than the meter could measure
+        int64_t lastDriftMicroWh = 0; // Software integral minus counter at the last tick
+        int64_t maxDriftMicroWh = 0;  // Largest |drift| seen
+    };
+
+    // What a checkpoint needs to carry on exactly: the counter-aligned total
+    // and the counter value it corresponds to. Energy counted by the meter
+    // while we were down shows up as the first delta after resume().
+    struct Snapshot {
+        uint64_t baseMicroWh;
+        uint32_t counterWh;
+        bool haveCounter;
+    };
+
+    static void update(uint8_t channel, const MeterSample& sample, unsigned long now);
+
+    static uint64_t totalMicroWh(uint8_t channel);
+    static double totalWh(uint8_t channel) { return totalMicroWh(channel) / 1e6; }
+
+    static void restore(uint8_t channel, double wh);  // Continue from a saved total
+    static void addOffset(uint8_t channel, double wh); // Seed on top of what was counted since boot
+    static void reset(uint8_t channel);               // Zero the total and rebaseline
+    static Snapshot snapshot(uint8_t channel);
+    static void resume(uint8_t channel, const Snapshot& saved);
+    static const Stats& getStats(uint8_t channel) { return stats[channel]; }
+
+private:
+    static const uint64_t MICRO_WH_PER_WH = 1000000ULL;
+    static const uint32_t MAX_POWER_DECIWATTS = 260UL * 100 * 10;  // 260 V x 100 A
+
+    struct Channel {
+        uint64_t counterMicroWh = 0;  // Whole-Wh steps of the meter counter, plus restores
+        uint64_t residualMicroWh = 0; // Software integral since the last counter step
+        uint32_t lastCounterWh = 0;
+        unsigned long lastSampleMs = 0;
+        bool haveCounter = false;
+        bool resumed = false;  // Next counter delta spans a reboot, skip the rate check
+    };
+
+    static uint32_t counterDelta(Channel& ch, Stats& st, uint32_t counterWh, unsigned long elapsedMs);
+
+    static Channel channels[PowerReadings::MAX_CHANNELS];
+    static Stats stats[PowerReadings::MAX_CHANNELS];
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include "energy_account.h"
+
+// Periodic local copies of every channel's energy account, so a reboot knows
+// its totals before WiFi, NTP or Firebase are up. Two NVS slots are written
+// alternately, each with a sequence number and a CRC: a write torn by power
+// loss only ever damages the older copy. NVS spreads the writes over its
+// pages; the save policy keeps them to at most one a minute, and only after
+// the totals actually moved.
+class EnergyCheckpoint {
+public:
+    static const unsigned long SAVE_INTERVAL_MS = 60000;
+    static const uint64_t MIN_CHANGE_MICRO_WH = 1000000;  // 1 Wh
+
+    // Restores the newest valid slot into EnergyAccount; false if there is none
+    static bool begin(uint8_t channelCount);
+    static bool restored() { return restoredFromNvs; }
+
+    // Called from the sampling task; saves when due, at once after a reset
+    static void service(unsigned long now);
+    static bool save();
+
+    struct Stats {
+        uint32_t saves = 0;
+        uint32_t failedSaves = 0;
+        uint32_t corruptSlots = 0;     // Slots skipped at boot on bad magic/CRC
+        unsigned long restoreMicros = 0;
+        uint32_t sequence = 0;
+    };
+    static const Stats& getStats() { return stats; }
+
+private:
+    static const uint32_t MAGIC = 0x4B434E45;  // "ENCK"
+    static const uint8_t VERSION = 1;
+
+    struct __attribute__((packed)) Record {
+        uint32_t magic;
+        uint32_t sequence;
+        uint8_t version;
+        uint8_t channelCount;
+        struct __attribute__((packed)) {
+            uint64_t baseMicroWh;
+            uint32_t counterWh;
+            uint8_t haveCounter;
+        } channels[PowerReadings::MAX_CHANNELS];
+        uint16_t crc;  // CRC-16 over everything above
+    };
+
+    static bool readSlot(uint8_t slot, Record& record);
+    static uint64_t totalsSum();
+
+    static const char* const SLOT_KEYS[2];
+    static uint8_t channels;
+    static uint32_t sequence;
+    static unsigned long lastSaveMs;
+    static uint64_t savedSum;
+    static bool restoredFromNvs;
+    static Stats stats;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Arduino.h>
+#include "power_readings.h"
+#include "spsc_ring.h"
+
+// One appliance switching on or off: when the step started, and the mean
+// power, current and power factor of the channel before and after it.
+struct ApplianceEvent {
+    enum Kind : uint8_t { On, Off };
+
+    struct Signature {
+        float power;
+        float current;
+        float powerFactor;
+    };
+
+    uint32_t sequence;  // Since boot, 1-based
+    uint32_t atMs;      // millis() of the first sample of the step
+    uint8_t channel;
+    Kind kind;
+    float deltaPower;   // after.power - before.power
+    Signature before;
+    Signature after;
+};
+
+// Streaming step detection over every meter sample of every channel, O(1)
+// work and fixed memory per sample. A two-sided CUSUM on power runs against a
+// baseline that follows level and trend (Holt), with an EWMA noise scale, so
+// ramps don't accumulate and the thresholds follow the load's own noise:
+//
+//   e  = x - (level + trend)
+//   s+ = max(0, s+ + e - DRIFT_SIGMAS x sigma)    (and s- mirrored)
+//   alarm when s+ or s- > THRESHOLD_SIGMAS x sigma, and at least MIN_STEP_W
+//
+// The baseline only learns while both sums are zero and coasts on its trend
+// otherwise, so a step is not absorbed before it is detected. The change
+// point is the first sample after the alarming sum was last zero. After an
+// alarm the detector waits for SETTLE_SAMPLES in a row that stay within a
+// tolerance of their own mean (so a motor's inrush restarts the run) and
+// takes them as the "after" signature, giving up on stability after
+// MAX_SETTLE_SAMPLES. The event is kept if the step over the coasting
+// baseline is at least MIN_STEP_W and STEP_SIGMAS x sigma (a bump that
+// tripped the CUSUM is not), and the baseline restarts from the new level
+// either way.
+//
+// add() runs in the sampling task; events go through an SPSC ring to the
+// uploader, which pushes each one as soon as it is popped.
+class EventDetector {
+public:
+    static const uint8_t WARMUP_SAMPLES = 16;
+    static const uint8_t SETTLE_SAMPLES = 8;        // ~330 ms at 24 samples/s
+    static const uint8_t MAX_SETTLE_SAMPLES = 120;  // ~5 s of inrush or fluctuation
+    static const float DRIFT_SIGMAS;
+    static const float THRESHOLD_SIGMAS;
+    static const float STEP_SIGMAS;
+    static const float MIN_STEP_W;
+    static const float MIN_SIGMA_W;
+    static const float MIN_SIGMA_FRACTION;
+
+    struct Stats {
+        uint32_t samples = 0;
+        uint32_t events = 0;
+        uint32_t rejected = 0;  // Alarms that settled below the minimum step
+        uint32_t dropped = 0;   // Ring full
+    };
+
+    static void add(uint8_t channel, const PowerReadings& readings, unsigned long now);
+    static bool pop(ApplianceEvent& event);
+    static uint32_t pendingCount() { return events.depth(); }
+    static Stats stats();
+    static void reset();  // Forget every channel's baseline (replays)
+
+private:
+    static const size_t QUEUE_CAPACITY = 16;
+
+    enum Phase : uint8_t { Warmup, Watching, Settling };
+
+    struct ChannelState {
+        Phase phase = Warmup;
+        uint8_t count = 0;
+        float level = 0;         // Baseline power and its trend per sample
+        float trend = 0;
+        float sigma = 0;         // EWMA of |e| x 1.25
+        float current = 0;       // Baseline current and power factor, for the signature
+        float powerFactor = 0;
+        float high = 0;          // s+
+        float low = 0;           // s-
+        unsigned long highStartAt = 0;
+        unsigned long lowStartAt = 0;
+        ApplianceEvent pending;
+        uint8_t waited = 0;      // Samples since the alarm
+        float sumPower = 0, sumBaseline = 0, sumCurrent = 0, sumPowerFactor = 0;  // Current stable run
+    };
+
+    static void watch(ChannelState& state, uint8_t channel, const PowerReadings& readings, unsigned long now);
+    static void settle(ChannelState& state, const PowerReadings& readings);
+    static void finish(ChannelState& state);
+    static float noise(const ChannelState& state);
+
+    static ChannelState channels[PowerReadings::MAX_CHANNELS];
+    static SpscRing<ApplianceEvent, QUEUE_CAPACITY> events;
+    static uint32_t sequence;
+    static uint32_t samples;
+    static uint32_t emitted;
+    static uint32_t rejected;
+};
@@ -1,26 +1,70 @@
 #pragma once
 
 #include <Arduino.h>
-#include <Firebase_ESP_Client.h>
 #include "power_readings.h"
+#include "offline_log.h"
+#include "boot_sequence.h"
+#include "wifi_link.h"
+#include "window_aggregator.h"
+#include "harmonic_analyzer.h"
+#include "event_detector.h"
+#include "job_scheduler.h"
+#include "device_identity.h"
+#include "uplink.h"
 
+// What goes out to the backend and when it counts as delivered: every status
+// entry is formatted here and handed to the active Uplink, which carries it
+// (FirebaseUplink by default, MqttUplink when the build names a broker).
 class FirebaseManager {
-private:
-    static FirebaseData fbdo;
-    static FirebaseAuth auth;
-    static FirebaseConfig config;
-    static const char* DEVICE_STATUS_PATH;
-    static void tokenStatusCallback(TokenInfo info);
-    static void syncTime();
-    static void setupHeartbeat();
-
 public:
-    static bool setup();
-    static bool updateReadings(const PowerReadings& readings);
-    static bool updateBattery(uint8_t level);
-    static bool checkResetFlag();
-    static bool clearResetFlag();
-    static void updateHeartbeat();
-    static bool updateChargingStatus(bool isCharging);
-    static bool loadSavedEnergy();
+    // Finished aggregation windows sent along with each cycle, under
+    // [channels/<n>/]aggregates/<1m|15m|1h>/<day>/<window start>
+    static const size_t SUMMARIES_PER_CYCLE = 4;
+    // Largest status entries, reserved for by the uplinks' cycle buffers
+    static const size_t TELEMETRY_BYTES = 1024;
+    static const size_t JOB_STATS_BYTES = JobScheduler::MAX_JOBS * 160;
+    static const size_t HARMONICS_BYTES = 320;
+    static const size_t POWER_BYTES = 192;
+
+    static void setUplink(Uplink* uplink);  // Before setup(), like the Hal backends
+    static Uplink& uplink() { return *active; }
+
+    static void begin();
+    static void onAuthenticated();
+    static bool authenticated();
+    static bool ready();
+    static void service();  // The uplink's connection, where its client has no task
+    static bool reconcileSavedEnergy(uint8_t channelCount, bool restoredLocally);
+
+    // One unit per cycle: a single atomic update on Firebase, a burst of QoS 1
+    // publishes on MQTT. A fleet cycle may also write fleet/<id>
+    typedef Uplink::Stats BatchStats;
+    static void beginCycle(bool fleet = false);
+    static bool queueReadings(const PowerReadings& readings);
+    static bool queueBattery(uint8_t level);
+    static bool queueHeartbeat();  // fleet/<id>/lastSeen, in a fleet cycle only
+    static bool queueResetClear();
+    static bool queueBootMetrics(const BootSequence::Metrics& metrics);
+    static bool queueWifiStats(const WifiLink::Stats& stats);
+    static bool queueSummary(const WindowSummary& summary);
+    static bool queueTelemetry();  // Histograms and counters under deviceStatus/telemetry
+    static bool queueJobStats();   // Per-job scheduler counters under deviceStatus/jobs
+    static bool queuePower(uint8_t channels, bool lightSleepAvailable);  // Mode and runtime estimate, deviceStatus/power
+    static bool queueHarmonics(const HarmonicSpectrum& spectrum);  // Waveform FFT of the first channel
+    static bool commitCycle();
+    static const BatchStats& getBatchStats();
+
+    // Appliance on/off event, written on its own as soon as it is detected
+    // under events/<day>/<timestamp>_<sequence>; timestamp is when the step began
+    static bool pushEvent(const ApplianceEvent& event, uint32_t timestamp);
+
+    // Store-and-forward backlog: one HistoryCodec block per channel, under
+    // [channels/<n>/]historyBlocks/<day>/<first timestamp> (base64) on Firebase
+    static const size_t HISTORY_BATCH = 96;
+    static bool uploadHistory(const LogRecord* records, size_t count);
+
+private:
+    static Uplink* active;
+    static char jsonBuffer[512];  // Reused for every outgoing payload
+    static void registerDevice();
 };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "uplink.h"
+#include "firebase_manager.h"
+#include "history_codec.h"
+#include "base64.h"
+
+// Realtime Database over HTTPS through Hal::cloud(). A cycle is one atomic
+// multi-location update at devices/<id>; a fleet cycle goes to the root with
+// every device key prefixed, so it can touch fleet/<id> in the same request.
+// Readings go as "readings/<field>" keys while that is shorter than the
+// whole object.
+class FirebaseUplink : public Uplink {
+public:
+    const char* name() override { return "firebase"; }
+    void begin() override;
+    bool authenticated() override;
+    bool ready() override;
+
+    void beginCycle(bool fleet) override;
+    bool publishReadings(const PowerReadings& readings) override;
+    bool publishStatus(const char* path, const char* json, bool deviceScoped = true) override;
+    bool commitCycle() override;
+    Reach lastReach() override { return reach; }
+
+    bool publish(const char* path, const char* json) override;
+    bool publishHistory(const LogRecord* records, size_t count) override;
+    bool readFloat(const char* path, float* value) override;
+
+    bool subscribeCommands(const char* path, CommandCallback callback) override;
+    bool commandsConnected() override;
+    const char* errorReason() override;
+    const Stats& stats() override { return batchStats; }
+
+    // Per-request cost avoided by batching: request line with the ~1 KB auth
+    // token, HTTP headers and TLS record framing
+    static const uint32_t REQUEST_OVERHEAD_BYTES = 1200;
+
+private:
+    // Room for every channel's readings, a few window summaries and the
+    // largest status entries, plus battery, heartbeat and reset ack
+    static const size_t KEY_PREFIX_BYTES = 9 + DeviceIdentity::ID_LENGTH;  // "devices/<id>/" in a fleet cycle
+    static const size_t OTHER_ENTRIES = 12;
+    static const size_t BATCH_BUFFER_SIZE =
+        PowerReadings::MAX_CHANNELS * 352 + FirebaseManager::SUMMARIES_PER_CYCLE * 320 +
+        FirebaseManager::TELEMETRY_BYTES + FirebaseManager::JOB_STATS_BYTES + FirebaseManager::HARMONICS_BYTES +
+        FirebaseManager::POWER_BYTES + 256 +
+        (PowerReadings::MAX_CHANNELS + FirebaseManager::SUMMARIES_PER_CYCLE + OTHER_ENTRIES) * KEY_PREFIX_BYTES;
+    static const size_t HISTORY_BATCH = FirebaseManager::HISTORY_BATCH;
+
+    char readingsJson[512];
+    char batchBuffer[BATCH_BUFFER_SIZE];
+    int batchLength = 0;
+    int batchEntries = 0;
+    uint32_t batchUnbatchedBytes = 0;
+    bool fleetCycle = false;
+    Reach reach = Reach::NothingSent;
+    Stats batchStats;
+
+    uint8_t historyBlock[HistoryCodec::maxEncodedSize(HISTORY_BATCH)];
+    // Every channel's block in the worst case, plus a path and padding per channel
+    char historyBuffer[base64Length(HistoryCodec::maxEncodedSize(HISTORY_BATCH)) + PowerReadings::MAX_CHANNELS * 96];
+};
+
+extern FirebaseUplink firebaseUplink;
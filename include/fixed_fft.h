@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+// In-place radix-2 complex FFT in fixed point: 32-bit integer data, Q15
+// twiddles from a table built once, 64-bit products rounded back to the data
+// scale. Nothing is scaled between stages, so an input bounded by 2^15 grows
+// to at most 2^15 x N x sqrt(2) and N up to 8192 stays inside int32.
+//
+// Two real signals of the same length go through one transform as the real
+// and imaginary parts (x + jy); split() separates their spectra afterwards,
+// which costs half of two separate transforms.
+template <size_t N>
+class FixedFft {
+    static_assert(N >= 4 && (N & (N - 1)) == 0, "FixedFft size must be a power of two");
+    static_assert(N <= 8192, "FixedFft data would overflow int32");
+
+public:
+    struct Complex {
+        int32_t re;
+        int32_t im;
+    };
+
+    FixedFft() {
+        for (size_t k = 0; k < N / 2; k++) {
+            double angle = 2.0 * M_PI * k / N;
+            cosTable[k] = (int16_t)lround(cos(angle) * 32767.0);
+            sinTable[k] = (int16_t)lround(sin(angle) * 32767.0);
+        }
+    }
+
+    void transform(Complex* data) const {
+        // Bit-reversed reordering
+        for (size_t i = 1, j = 0; i < N; i++) {
+            size_t bit = N >> 1;
+            for (; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+            if (i < j) {
+                Complex t = data[i];
+                data[i] = data[j];
+                data[j] = t;
+            }
+        }
+
+        for (size_t len = 2; len <= N; len <<= 1) {
+            size_t half = len >> 1;
+            size_t step = N / len;
+            // Twiddle 1: no multiplies
+            for (size_t i = 0; i < N; i += len) {
+                Complex a = data[i];
+                Complex b = data[i + half];
+                data[i].re = a.re + b.re;
+                data[i].im = a.im + b.im;
+                data[i + half].re = a.re - b.re;
+                data[i + half].im = a.im - b.im;
+            }
+            // Twiddle in the outer loop so each one is loaded once per stage
+            for (size_t k = 1; k < half; k++) {
+                int32_t wr = cosTable[k * step];
+                int32_t wi = sinTable[k * step];
+                for (size_t i = k; i < N; i += len) {
+                    Complex& a = data[i];
+                    Complex& b = data[i + half];
+                    // b x (cos - j sin)
+                    int32_t tr = (int32_t)(((int64_t)b.re * wr + (int64_t)b.im * wi + ROUND) >> 15);
+                    int32_t ti = (int32_t)(((int64_t)b.im * wr - (int64_t)b.re * wi + ROUND) >> 15);
+                    b.re = a.re - tr;
+                    b.im = a.im - ti;
+                    a.re += tr;
+                    a.im += ti;
+                }
+            }
+        }
+    }
+
+    // Bin k (0 < k < N) of each input after transform() of x + jy, times two
+    static void split(const Complex* data, size_t k, Complex& x2, Complex& y2) {
+        const Complex& a = data[k];
+        const Complex& b = data[N - k];
+        x2.re = a.re + b.re;
+        x2.im = a.im - b.im;
+        y2.re = a.im + b.im;
+        y2.im = b.re - a.re;
+    }
+
+private:
+    static const int64_t ROUND = 1 << 14;
+
+    int16_t cosTable[N / 2];
+    int16_t sinTable[N / 2];
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Thin seams between the firmware logic and the hardware/cloud libraries.
+// The ESP32 implementations live in src/hal_esp32.cpp, the host fakes used by
+// the native environment live in src/native/.
+
+// Byte-level UART. Reads and writes only touch the driver buffers and never wait.
+class SerialPort {
+public:
+    virtual ~SerialPort() {}
+    virtual void begin(uint32_t baud) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual size_t write(const uint8_t* data, size_t len) = 0;
+};
+
+// One PZEM-004T input-register block in the meter's own integer units;
+// DerivedMetrics turns it into engineering units
+struct MeterSample {
+    uint16_t voltage;    // 0.1 V
+    uint32_t current;    // 1 mA
+    uint32_t power;      // 0.1 W
+    uint32_t energy;     // 1 Wh, the meter's own counter
+    uint16_t frequency;  // 0.1 Hz
+    uint16_t pf;         // 0.01
+    uint16_t alarm;
+};
+
+// Wire-level counters kept by the meter link
+struct LinkStats {
+    uint32_t transactions = 0;
+    uint32_t completed = 0;
+    uint32_t failed = 0;
+    uint32_t timeouts = 0;
+    uint32_t crcErrors = 0;
+    uint32_t mismatched = 0;    // Wrong slave or function in an intact frame
+    uint32_t exceptions = 0;    // Slave answered with an exception code
+    uint32_t retries = 0;
+};
+
+// Meter access as an asynchronous transaction: request() starts a block read
+// from the meter at a bus address, poll() advances it without blocking until
+// it reports Ready or Failed. One transaction is in flight at a time.
+class MeterBackend {
+public:
+    enum class Status : uint8_t { Busy, Ready, Failed };
+
+    virtual ~MeterBackend() {}
+    virtual void begin() = 0;
+    virtual bool request(uint8_t address) = 0;
+    virtual Status poll(MeterSample& sample) = 0;
+    virtual bool resetEnergy(uint8_t address) = 0;  // Same transaction model; poll() leaves the sample alone
+    virtual const LinkStats& linkStats() = 0;
+};
+
+// One conversion from the continuous ADC stream
+struct AdcSample {
+    uint8_t pin;
+    uint16_t raw;
+};
+
+// ADC on the battery, charging and mains waveform pins: one-shot reads, or a continuous
+// DMA-fed scan of a fixed pin set that is drained without blocking.
+class AdcBackend {
+public:
+    virtual ~AdcBackend() {}
+    virtual void begin() = 0;
+    virtual uint16_t readRaw(uint8_t pin) = 0;
+    virtual uint32_t rawToMilliVolts(uint32_t raw) = 0;  // Calibrated conversion
+    // Total conversion rate, shared round-robin by the pins
+    virtual bool startContinuous(const uint8_t* pins, uint8_t count, uint32_t sampleRateHz) = 0;
+    virtual size_t readContinuous(AdcSample* out, size_t max) = 0;  // What has arrived since the last call
+    virtual void stopContinuous() = 0;
+};
+
+// Realtime Database primitives used by FirebaseManager. Payloads are JSON text.
+class CloudBackend {
+public:
+    // Stream events: path relative to the stream root, data as JSON text
+    typedef void (*StreamCallback)(const char* path, const char* data);
+
+    virtual ~CloudBackend() {}
+    virtual void begin() = 0;           // Starts sign-in and returns at once
+    virtual bool authenticated() = 0;   // Sign-in has completed at least once
+    virtual bool ready() = 0;
+    virtual bool setJSON(const char* path, const char* json) = 0;
+    virtual bool updateJSON(const char* path, const char* json) = 0;  // Multi-location, atomic
+    virtual bool setInt(const char* path, int value) = 0;
+    virtual bool setBool(const char* path, bool value) = 0;
+    virtual bool getBool(const char* path, bool* value) = 0;
+    virtual bool getFloat(const char* path, float* value) = 0;
+    virtual bool beginStream(const char* path, StreamCallback callback) = 0;
+    virtual bool streamConnected() = 0;
+    virtual const char* errorReason() = 0;
+    // The server answered the last request, whatever it said; false when it
+    // never got there (no connection, socket error)
+    virtual bool answered() = 0;
+};
+
+// MQTT 3.1.1 client with one persistent session to the configured broker:
+// clean session off, so the broker keeps the subscriptions and the QoS 1
+// messages in flight across reconnects. publish() only queues; flush()
+// waits until the broker has acknowledged everything queued so far.
+class MqttBackend {
+public:
+    typedef void (*MessageCallback)(const char* topic, const uint8_t* payload, size_t length);
+
+    virtual ~MqttBackend() {}
+    virtual void begin(const char* clientId, MessageCallback callback) = 0;  // Connects and reconnects in the background
+    virtual bool connected() = 0;
+    virtual bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) = 0;
+    virtual bool flush(uint32_t timeoutMs) = 0;
+    virtual bool subscribe(const char* filter, uint8_t qos) = 0;  // Renewed on every reconnect
+    virtual void service() = 0;  // Drives a client without a task of its own
+    virtual const char* errorReason() = 0;
+};
+
+// Raw erase-before-write flash region (the data partition on the ESP32).
+// Offsets are relative to the start of the region.
+class FlashBackend {
+public:
+    virtual ~FlashBackend() {}
+    virtual bool begin() = 0;
+    virtual uint32_t sectorSize() = 0;
+    virtual uint32_t sectorCount() = 0;
+    virtual bool read(uint32_t offset, void* data, size_t len) = 0;
+    virtual bool write(uint32_t offset, const void* data, size_t len) = 0;
+    virtual bool eraseSector(uint32_t sector) = 0;
+};
+
+// Small named blobs in the ESP32's NVS partition, which wear-levels across
+// its pages on its own. A write is a full replacement of the key's value.
+class NvsBackend {
+public:
+    virtual ~NvsBackend() {}
+    virtual bool begin() = 0;
+    virtual size_t read(const char* key, void* data, size_t len) = 0;  // Bytes read, 0 if absent
+    virtual bool write(const char* key, const void* data, size_t len) = 0;
+};
+
+// Radio and CPU power saving. Light sleep is the automatic kind: the CPU
+// sleeps whenever every task is blocked, so it only pays off when the tasks
+// block for longer than a tick, which idle() lets the loop task do.
+class PowerBackend {
+public:
+    virtual ~PowerBackend() {}
+    virtual bool setModemSleep(bool enabled) = 0;  // Radio off between DTIM beacons, link kept
+    virtual bool setLightSleep(bool enabled) = 0;  // False if the build has no power management
+    virtual void idle(uint32_t ms) = 0;            // Block the calling task
+};
+
+class Hal {
+public:
+    static MeterBackend& meter() { return *meterBackend; }
+    static AdcBackend& adc() { return *adcBackend; }
+    static CloudBackend& cloud() { return *cloudBackend; }
+    static FlashBackend& flash() { return *flashBackend; }
+    static NvsBackend& nvs() { return *nvsBackend; }
+    static PowerBackend& power() { return *powerBackend; }
+    static MqttBackend& mqtt() { return *mqttBackend; }
+
+    // Swap a backend at runtime (benchmarks, bench rigs). Must be called before setup().
+    static void setMeter(MeterBackend* backend) { meterBackend = backend; }
+    static void setAdc(AdcBackend* backend) { adcBackend = backend; }
+    static void setCloud(CloudBackend* backend) { cloudBackend = backend; }
+    static void setFlash(FlashBackend* backend) { flashBackend = backend; }
+    static void setNvs(NvsBackend* backend) { nvsBackend = backend; }
+    static void setPower(PowerBackend* backend) { powerBackend = backend; }
+    static void setMqtt(MqttBackend* backend) { mqttBackend = backend; }
+
+private:
+    // Defined by the platform translation unit (hal_esp32.cpp or native/fake_backends.cpp)
+    static MeterBackend* meterBackend;
+    static AdcBackend* adcBackend;
+    static CloudBackend* cloudBackend;
+    static FlashBackend* flashBackend;
+    static NvsBackend* nvsBackend;
+    static PowerBackend* powerBackend;
+    static MqttBackend* mqttBackend;
+};
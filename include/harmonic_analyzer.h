@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fixed_fft.h"
+
+// Harmonic content of one captured block of mains voltage and current.
+// Harmonics are RMS as a percentage of the fundamental of the same signal.
+struct HarmonicSpectrum {
+    static const uint8_t FIRST_ORDER = 3;
+    static const uint8_t LAST_ORDER = 15;
+    static const uint8_t ORDERS = LAST_ORDER - FIRST_ORDER + 1;
+
+    float fundamentalHz = 0;
+    float thdVoltage = 0;  // %, orders 2..MAX_THD_ORDER below Nyquist
+    float thdCurrent = 0;
+    float voltage[ORDERS] = {};  // % of fundamental, 3rd .. 15th
+    float current[ORDERS] = {};
+    bool currentValid = false;   // Enough load on the CT for the ratios to mean anything
+    uint32_t capturedAt = 0;     // millis() when the block was complete
+    uint32_t block = 0;          // Sequence number of the analysed block
+};
+
+// FFT of one block of BLOCK_SAMPLES raw ADC samples per signal. The two
+// signals share one complex transform; each gets its mean removed and a Hann
+// window. The fundamental is the voltage peak between 40 and 70 Hz,
+// interpolated between bins; each harmonic's power is the sum over the Hann
+// main lobe (+-2 bins) around h x f0, so the result does not depend on the
+// block holding a whole number of cycles.
+class HarmonicAnalyzer {
+public:
+    static const size_t BLOCK_SAMPLES = 1024;
+    static const uint8_t MAX_THD_ORDER = 40;
+    static const uint16_t MIN_FUNDAMENTAL_COUNTS = 8;  // Peak amplitude below which a signal is "absent"
+
+    // False if no fundamental was found in the voltage; spectrum untouched then
+    static bool analyze(const uint16_t* voltage, const uint16_t* current, uint32_t sampleRateHz,
+                        HarmonicSpectrum& spectrum);
+
+private:
+    typedef FixedFft<BLOCK_SAMPLES> Fft;
+    static const uint8_t LOBE_BINS = 2;
+
+    static void prepare(const uint16_t* voltage, const uint16_t* current);
+    static float binPower(size_t k, bool ofCurrent);
+    static float lobePower(float center, bool ofCurrent);
+
+    static const Fft fft;
+    static int16_t window[BLOCK_SAMPLES / 2 + 1];  // Q15 Hann, symmetric half
+    static Fft::Complex work[BLOCK_SAMPLES];
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "offline_log.h"
+
+// Columnar block format for offline-log history, one channel per block:
+//
+//   byte 0    version (1)
+//   byte 1    channel
+//   byte 2-3  record count, little endian
+//   then a bit stream, MSB first, one column after the other:
+//     timestamps   first value in 32 bits, then Gorilla delta-of-delta codes
+//                  '0' | '10'+7 | '110'+9 | '1110'+12 | '1111'+32 bits
+//     flags        low nibble: first in 4 bits, then '0' = unchanged | '1'+4 bits
+//     voltage, current, power, energy, frequency, powerFactor
+//                  first value's IEEE-754 bits, then XOR with the previous:
+//                  '0' = identical | '10' + bits inside the previous
+//                  leading/trailing-zero window | '11' + 5-bit leading zeros
+//                  + 5-bit (length - 1) + the meaningful bits
+//   padded with zero bits to a whole byte.
+//
+// Lossless: decoded floats are bit-identical. tools/decode_history.py is the
+// reference decoder off the device.
+class HistoryCodec {
+public:
+    static const uint8_t VERSION = 1;
+    static const size_t HEADER_BYTES = 4;
+
+    // Worst case for count records (every value needing a full-width code)
+    static const size_t WORST_BITS_PER_RECORD = 36 + 5 + 6 * 44;
+    static constexpr size_t maxEncodedSize(size_t count) {
+        return HEADER_BYTES + (count * WORST_BITS_PER_RECORD + 7) / 8;
+    }
+
+    // Encodes the records belonging to channel, in order. Bytes written, 0 if
+    // there are none or out is too small.
+    static size_t encode(const LogRecord* records, size_t count, uint8_t channel,
+                         uint8_t* out, size_t capacity);
+
+    // Records decoded, 0 on a malformed block or too small an array
+    static size_t decode(const uint8_t* data, size_t length, LogRecord* records, size_t maxRecords);
+};
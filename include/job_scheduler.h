@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Cooperative scheduler for the periodic work in loop(): each job has its own
+// period and runs to completion when service() finds it due. Jobs sit on a
+// hashed timer wheel of TICK_MS slots keyed by due time, so a service() call
+// only looks at the slots that passed since the last one (plus the current
+// one, for jobs due later in the same tick) instead of every job.
+//
+// Runs are fixed-rate: the next due time is the previous one plus the period,
+// so lateness doesn't accumulate. A run that starts more than its deadline
+// after it was due counts as missed; whole periods that passed without a run
+// are skipped (not run back to back) and counted; a run that takes longer
+// than its period counts as an overrun. All times come from millis(), so the
+// native build drives it with the virtual clock.
+class JobScheduler {
+public:
+    typedef void (*Job)();
+
+    static const uint8_t MAX_JOBS = 12;
+    static const uint8_t NO_JOB = 0xFF;
+    // Powers of two, so the slot sequence carries on across the millis() wrap
+    static const uint32_t TICK_MS = 8;
+    static const uint16_t WHEEL_SLOTS = 256;  // 2.05 s per revolution
+
+    struct JobStats {
+        const char* name = nullptr;
+        uint32_t periodMs = 0;
+        uint32_t deadlineMs = 0;
+        uint32_t runs = 0;
+        uint32_t missed = 0;      // Started later than the deadline
+        uint32_t skipped = 0;     // Periods dropped after falling a whole period behind
+        uint32_t overruns = 0;    // Took longer than the period
+        uint32_t maxLateMs = 0;   // Start behind the due time
+        uint32_t totalLateMs = 0;
+        uint32_t maxRunMs = 0;
+    };
+
+    // Forgets every job and starts the wheel at the current time
+    static void begin();
+
+    // First run delayMs from now; a deadline of 0 means one period
+    static uint8_t add(const char* name, Job job, uint32_t periodMs, uint32_t delayMs = 0,
+                       uint32_t deadlineMs = 0);
+    static void setPeriod(uint8_t id, uint32_t periodMs);  // Next run one new period from now
+    static void trigger(uint8_t id);                       // Due now, off the fixed rate
+
+    static void service();                 // Runs every job that is due, earliest first
+    static uint32_t msUntilNext();         // 0 if something is due already
+    static uint32_t lateness() { return runningLateMs; }  // Of the job being run, 0 if triggered
+
+    static uint8_t jobCount() { return count; }
+    static const JobStats& stats(uint8_t id) { return jobs[id].stats; }
+    static int format(char* buffer, size_t size);  // JSON object for deviceStatus/jobs
+
+private:
+    struct Entry {
+        Job job = nullptr;
+        unsigned long dueAt = 0;
+        bool triggered = false;
+        bool linked = false;    // On the wheel; not while it is being run
+        uint8_t next = NO_JOB;  // Next in the same wheel slot
+        JobStats stats;
+    };
+
+    static uint16_t slotOf(unsigned long at) { return (at / TICK_MS) % WHEEL_SLOTS; }
+    static void insert(uint8_t id);
+    static void unlink(uint8_t id);
+    static void collect(uint16_t slot, unsigned long now, uint8_t* due, uint8_t& dueCount);
+    static void run(uint8_t id);
+
+    static Entry jobs[MAX_JOBS];
+    static uint8_t wheel[WHEEL_SLOTS];
+    static uint8_t count;
+    static unsigned long lastTickAt;
+    static uint32_t runningLateMs;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+// Deferred-format logging. A call site stores a 32-bit hash of its format
+// literal plus the raw argument values in a fixed-size slot of a lock-free
+// ring and returns; nothing is formatted or written on the caller's thread.
+// A low-priority drain task empties the ring to Serial as compact binary
+// frames (tools/decode_log.py turns a capture back into text), or as text
+// when LOG_OUTPUT_TEXT is defined / setTextOutput(true) is called. When the
+// ring is full the record is dropped and counted; logging never blocks.
+//
+// Levels above LOG_LEVEL compile away entirely, arguments included:
+//   -DLOG_LEVEL=LOG_LEVEL_INFO
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_AT(level, format, ...)                                                   \
+    do {                                                                             \
+        if ((level) <= LOG_LEVEL) {                                                  \
+            Logger::write((level), std::integral_constant<uint32_t,                  \
+                                       Logger::formatId(format)>::value,             \
+                          format, ##__VA_ARGS__);                                    \
+        }                                                                            \
+    } while (0)
+
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+
+class Logger {
+public:
+    // Argument tags in the record; the decoder relies on these values
+    enum Tag : uint8_t {
+        TAG_I32 = 'i',
+        TAG_U32 = 'u',
+        TAG_I64 = 'I',
+        TAG_U64 = 'U',
+        TAG_FLOAT = 'f',
+        TAG_STRING = 's',  // Length byte + bytes, cut to fit the slot
+        TAG_TRUNCATED = '~'  // Remaining arguments didn't fit
+    };
+
+    static const uint8_t FRAME_SYNC = 0xA5;
+    static const size_t ARG_CAPACITY = 44;
+    static const size_t RING_CAPACITY = 128;  // Power of two
+
+    struct Entry {
+        uint32_t formatId;
+        uint32_t timeMs;
+        const char* format;  // Only used for text output on the device
+        uint8_t level;
+        uint8_t argBytes;
+        uint8_t args[ARG_CAPACITY];
+    };
+
+    struct Stats {
+        uint32_t records;
+        uint32_t dropped;
+        uint32_t bytesOut;
+        uint32_t maxDepth;
+    };
+
+    // FNV-1a, evaluated at compile time at every call site
+    static constexpr uint32_t formatId(const char* s, uint32_t hash = 2166136261u) {
+        return *s ? formatId(s + 1, (hash ^ (uint8_t)*s) * 16777619u) : hash;
+    }
+
+    static void begin();
+    static void service();  // Drains the ring when there is no RTOS (native build)
+    static void flush();    // Drains on the caller's thread, e.g. before a restart
+    static void setTextOutput(bool enabled) { textOutput = enabled; }
+
+    static Stats stats();
+
+    // Renders one record with the subset of printf the firmware uses
+    static size_t format(const Entry& entry, char* out, size_t size);
+
+    template <typename... Args>
+    static void write(uint8_t level, uint32_t id, const char* fmt, Args... args) {
+        uint32_t pos;
+        Slot* slot = reserve(pos);
+        if (!slot) return;
+        Entry& entry = slot->entry;
+        entry.formatId = id;
+        entry.timeMs = millis();
+        entry.format = fmt;
+        entry.level = level;
+        ArgWriter writer{entry.args, 0};
+        int expand[] = {0, (writer.put(args), 0)...};
+        (void)expand;
+        entry.argBytes = writer.used;
+        commit(slot, pos);
+    }
+
+private:
+    static const uint8_t DRAIN_CORE = 0;
+    static const uint8_t DRAIN_PRIORITY = 1;  // Below the sampler; soaks up idle time
+    static const uint32_t DRAIN_STACK = 3072;
+    static const unsigned long DRAIN_IDLE_MS = 10;
+
+    // Bounded MPMC queue after Vyukov, used with a single consumer. The
+    // sequence is stored relative to the slot index so the zero-initialised
+    // array is already valid before any constructor has run.
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        Entry entry;
+    };
+
+    struct ArgWriter {
+        uint8_t* data;
+        uint8_t used;
+
+        bool room(size_t bytes) {
+            if (used && data[used - 1] == TAG_TRUNCATED) return false;
+            if (used + 1 + bytes <= ARG_CAPACITY) return true;
+            if (used < ARG_CAPACITY) data[used++] = TAG_TRUNCATED;
+            return false;
+        }
+
+        void raw(uint8_t tag, const void* value, size_t bytes) {
+            if (!room(bytes)) return;
+            data[used++] = tag;
+            memcpy(data + used, value, bytes);
+            used += bytes;
+        }
+
+        template <typename T>
+        void integer(T value) {
+            if (sizeof(T) > 4) {
+                if (std::is_signed<T>::value) {
+                    int64_t v = (int64_t)value;
+                    raw(TAG_I64, &v, sizeof(v));
+                } else {
+                    uint64_t v = (uint64_t)value;
+                    raw(TAG_U64, &v, sizeof(v));
+                }
+            } else if (std::is_signed<T>::value) {
+                int32_t v = (int32_t)value;
+                raw(TAG_I32, &v, sizeof(v));
+            } else {
+                uint32_t v = (uint32_t)value;
+                raw(TAG_U32, &v, sizeof(v));
+            }
+        }
+
+        // Narrower types, bool and plain enums promote to int
+        void put(int v) { integer(v); }
+        void put(unsigned v) { integer(v); }
+        void put(long v) { integer(v); }
+        void put(unsigned long v) { integer(v); }
+        void put(long long v) { integer(v); }
+        void put(unsigned long long v) { integer(v); }
+        void put(double v) {
+            float f = (float)v;
+            raw(TAG_FLOAT, &f, sizeof(f));
+        }
+        void put(const char* s) {
+            if (!s) s = "(null)";
+            size_t len = strlen(s);
+            if (!room(1)) return;
+            size_t fit = ARG_CAPACITY - used - 2;
+            if (len > fit) len = fit;
+            if (len > 255) len = 255;
+            data[used++] = TAG_STRING;
+            data[used++] = (uint8_t)len;
+            memcpy(data + used, s, len);
+            used += len;
+        }
+        void put(char* s) { put((const char*)s); }
+    };
+
+    static Slot* reserve(uint32_t& pos);
+    static void commit(Slot* slot, uint32_t pos);
+    static bool pop(Entry& entry);
+    static void emit(const Entry& entry);
+#ifndef NATIVE_BUILD
+    static void taskLoop(void* arg);
+#endif
+
+    static Slot slots[RING_CAPACITY];
+    static std::atomic<uint32_t> enqueuePos;
+    static std::atomic<uint32_t> dequeuePos;
+    static std::atomic<uint32_t> records;
+    static std::atomic<uint32_t> dropped;
+    static std::atomic<uint32_t> maxDepth;
+    static uint32_t bytesOut;
+    static bool textOutput;
+};
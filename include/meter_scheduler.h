@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "hal.h"
+#include "power_readings.h"
+
+// Round-robin polling of every PZEM on the shared RS-485 bus. Transactions are
+// issued back to back, so the bus is only idle for the inter-frame gap; a
+// meter that stops answering is left alone for exponentially longer, in units
+// of what its failed read cost (or of the round gap, if longer), so its
+// timeouts don't eat into the other channels' sample rate. A round gap (power
+// saving) spaces the rounds out instead: the bus sits idle from the end of
+// one round until the gap after its start.
+class MeterScheduler {
+public:
+    struct ChannelStats {
+        uint32_t reads = 0;
+        uint32_t failures = 0;
+        uint32_t energyResets = 0;
+        uint8_t failStreak = 0;
+        unsigned long retryAt = 0;  // Skipped until then while failStreak is set
+    };
+
+    static void begin(const uint8_t* addresses, uint8_t count);
+    static void service();  // One non-blocking step; call every millisecond or so
+    static void setRoundGap(uint32_t ms) { roundGapMs.store(ms, std::memory_order_relaxed); }  // 0 = back to back
+    static uint32_t msUntilNextRound();  // 0 while a round is under way
+
+    // Sends the meter's reset-energy command ahead of its next read
+    static void requestEnergyReset(uint8_t channel) { pendingResets |= 1UL << channel; }
+
+    static uint8_t channelCount() { return count; }
+    static uint8_t address(uint8_t channel) { return addresses[channel]; }
+    static const PowerReadings& latest(uint8_t channel) { return latestReadings[channel]; }
+    static const ChannelStats& channelStats(uint8_t channel) { return stats[channel]; }
+
+    // Aggregate since begin()
+    static uint32_t samplesCompleted() { return completed; }
+    static float samplesPerSecond();
+    static float busUtilization();  // Fraction of time a transaction was in flight
+
+private:
+    static const uint8_t MAX_BACKOFF_SHIFT = 5;  // Back off at most 31 units
+
+    static void startNext();
+
+    static uint8_t addresses[PowerReadings::MAX_CHANNELS];
+    static uint8_t count;
+    static uint8_t current;
+    static bool inFlight;
+    static bool discardInFlight;
+    static bool resetInFlight;
+    static uint32_t pendingResets;
+    static unsigned long startedAt;
+    static unsigned long roundStartedAt;
+    static std::atomic<uint32_t> roundGapMs;
+    static unsigned long begunAt;
+    static unsigned long busyMs;
+    static uint32_t completed;
+    static PowerReadings latestReadings[PowerReadings::MAX_CHANNELS];
+    static ChannelStats stats[PowerReadings::MAX_CHANNELS];
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+
+// Event-driven Modbus-RTU master. A transaction is started with one of the
+// request calls and advanced by poll(), which only moves bytes that are
+// already in the UART buffers and never waits. Timeouts and CRC errors are
+// retried up to MAX_RETRIES times before the transaction fails.
+class ModbusRtuMaster {
+public:
+    enum class Status : uint8_t { Idle, Busy, Done, Failed };
+
+    typedef LinkStats Stats;
+
+    static const uint16_t MAX_REGISTERS = 16;
+    // Answered by a single slave whatever its own address, and from that one
+    static const uint8_t GENERAL_ADDRESS = 0xF8;
+
+    explicit ModbusRtuMaster(SerialPort& port) : port(port) {}
+
+    void begin(uint32_t baud);
+    bool readInputRegisters(uint8_t slave, uint16_t start, uint16_t count);
+    bool sendCommand(uint8_t slave, uint8_t function);  // Bare function code, echoed on success
+    Status poll();
+
+    const uint16_t* registers() const { return regs; }
+    uint16_t registerCount() const { return regCount; }
+    bool busy() const { return state != State::Idle; }
+    const Stats& getStats() const { return stats; }
+
+    void setResponseTimeout(unsigned long ms) { responseTimeout = ms; }
+
+private:
+    enum class State : uint8_t { Idle, WaitGap, Receiving };
+
+    static const int MAX_RETRIES = 2;
+    static const size_t MAX_FRAME = 5 + 2 * MAX_REGISTERS;
+
+    bool start(size_t requestLength, size_t expectedLength);
+    void transmit();
+    Status finish(bool success);
+    Status retryOrFail();
+    bool decode();
+
+    SerialPort& port;
+    State state = State::Idle;
+    uint32_t baudRate = 9600;
+    unsigned long frameGapMs = 4;         // 3.5 character times, rounded up
+    unsigned long responseTimeout = 100;  // After the request has left the UART
+    unsigned long lastActivity = 0;
+    unsigned long deadline = 0;
+    int attempt = 0;
+
+    uint8_t request[8];
+    size_t requestLen = 0;
+    uint8_t response[MAX_FRAME];
+    size_t responseLen = 0;
+    size_t expectedLen = 0;
+
+    uint16_t regs[MAX_REGISTERS];
+    uint16_t regCount = 0;
+    Stats stats;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "uplink.h"
+#include "firebase_manager.h"
+#include "history_codec.h"
+#include "readings_schema.h"
+
+// MQTT over one persistent broker session (Hal::mqtt()), every message QoS 1.
+// Topics mirror the database paths: devices/<id>/<path>, fleet/<id>/...
+//   readings:  [channels/<n>/]readings, ReadingsSchema binary deltas, not retained
+//   history:   [channels/<n>/]history, raw HistoryCodec blocks
+//   events:    events/<day>/<time>_<n>, JSON
+//   status:    everything else, JSON, retained so a new subscriber gets the latest
+//   commands:  commands/<name>, subscribed; the app sets them retained, the
+//              device acknowledges a reset by retaining false over it
+// A cycle's publishes are pipelined and commitCycle() waits for the broker's
+// acknowledgements. The broker keeps no state to read back, so the energy
+// total is only ever restored from the local checkpoint.
+class MqttUplink : public Uplink {
+public:
+    static const uint32_t FLUSH_TIMEOUT_MS = 5000;
+
+    const char* name() override { return "mqtt"; }
+    void begin() override;
+    bool authenticated() override;
+    bool ready() override;
+    void service() override;
+
+    void beginCycle(bool fleet) override;
+    bool publishReadings(const PowerReadings& readings) override;
+    bool publishStatus(const char* path, const char* json, bool deviceScoped = true) override;
+    bool commitCycle() override;
+    Reach lastReach() override { return reach; }
+
+    bool publish(const char* path, const char* json) override;
+    bool publishHistory(const LogRecord* records, size_t count) override;
+    bool readFloat(const char*, float*) override { return false; }
+
+    bool subscribeCommands(const char* path, CommandCallback callback) override;
+    bool commandsConnected() override;
+    const char* errorReason() override;
+    const Stats& stats() override { return cycleStats; }
+
+private:
+    bool send(const char* path, bool deviceScoped, const uint8_t* payload, size_t length, bool retain);
+    static void onMessage(const char* topic, const uint8_t* payload, size_t length);
+
+    static CommandCallback commandCallback;
+    static char commandsTopic[64];  // "devices/<id>/commands"
+
+    bool fleetCycle = false;
+    bool failed = false;  // A publish of this cycle could not be queued
+    bool everConnected = false;
+    bool subscribed = false;
+    int cycleMessages = 0;
+    Reach reach = Reach::NothingSent;
+    Stats cycleStats;
+    char topic[96];
+    uint8_t readingsPayload[ReadingsSchema::maxBinaryLength()];
+    uint8_t historyBlock[HistoryCodec::maxEncodedSize(FirebaseManager::HISTORY_BATCH)];
+};
+
+extern MqttUplink mqttUplink;
@@ -0,0 +1,77 @@
+#pragma once
+
+// Minimal Arduino core stand-in for the native (host) environment.
+// Only what the firmware sources actually touch is provided. Time is virtual:
+// millis() only moves when delay() is called or the host advances it.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+// RTC slow memory survives resets on the ESP32; on the host it is plain RAM
+#define RTC_NOINIT_ATTR
+
+enum adc_attenuation_t { ADC_0db, ADC_2_5db, ADC_6db, ADC_11db };
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation);
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server);
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+// Host control over the virtual clock
+namespace NativeClock {
+    void advance(unsigned long ms);
+    void set(unsigned long ms);
+    const time_t EPOCH_AT_BOOT = 1700000000;  // Wall time at millis() == 0, once synced
+    extern unsigned long ntpDelayMs;          // SNTP answer after the link comes up
+}
+
+class HardwareSerial {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    size_t print(const char* s) { return write(s, strlen(s)); }
+    size_t print(const std::string& s) { return write(s.c_str(), s.size()); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(double v) { return printf("%.2f", v); }
+    template <typename T> size_t println(const T& v) { return print(v) + print("\r\n"); }
+    size_t println() { return print("\r\n"); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t write(const char* data, size_t len);
+
+    // Bytes that would have gone out of the UART since the last reset
+    unsigned long bytesWritten() const { return written; }
+    void resetCounters() { written = 0; }
+    void setEcho(bool enabled) { echo = enabled; }
+    void setCapture(FILE* file) { capture = file; }  // Raw copy of the UART stream
+
+private:
+    unsigned long written = 0;
+    bool echo = false;
+    FILE* capture = nullptr;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+    void restart();
+    uint32_t getFreeHeap() { return 0; }
+    uint32_t getMinFreeHeap() { return 0; }
+};
+
+extern EspClass ESP;
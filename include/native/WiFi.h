@@ -0,0 +1,102 @@
+#pragma once
+
+// WiFi stand-in for the native environment. The host registers the access
+// points in range and can take the link away; timings follow what an ESP32
+// station spends on each step, so fast-connect savings show up in virtual time.
+
+#include "Arduino.h"
+#include <vector>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+class IPAddress {
+public:
+    IPAddress(uint32_t address = 0) : value(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : value(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+    operator uint32_t() const { return value; }
+    std::string toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", value & 0xFF, (value >> 8) & 0xFF,
+                 (value >> 16) & 0xFF, value >> 24);
+        return text;
+    }
+
+private:
+    uint32_t value;
+};
+
+class WiFiClass {
+public:
+    struct AccessPoint {
+        std::string ssid;
+        uint8_t bssid[6];
+        int32_t channel;
+        int8_t rssi;
+    };
+
+    bool mode(wifi_mode_t m) { (void)m; return true; }
+    void persistent(bool enabled) { (void)enabled; }
+    bool setAutoReconnect(bool enabled) { (void)enabled; return true; }
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress());
+    wl_status_t begin(const char* ssid, const char* password, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true);
+    bool disconnect(bool wifiOff = false);
+    wl_status_t status();
+
+    int16_t scanNetworks(bool async = false);
+    int16_t scanComplete();
+    void scanDelete() { scanStartedAt = 0; }
+    std::string SSID(uint8_t i) const { return accessPoints[i].ssid; }
+    int32_t RSSI(uint8_t i) const { return accessPoints[i].rssi; }
+    const uint8_t* BSSID(uint8_t i) const { return accessPoints[i].bssid; }
+    int32_t channel(uint8_t i) const { return accessPoints[i].channel; }
+
+    // Current association
+    int8_t RSSI();
+    const uint8_t* BSSID();
+    int32_t channel();
+    IPAddress localIP() { return status() == WL_CONNECTED ? (staticIp ? staticAddress : dhcpAddress) : IPAddress(); }
+    IPAddress gatewayIP() { return status() == WL_CONNECTED ? IPAddress(192, 168, 4, 1) : IPAddress(); }
+    IPAddress subnetMask() { return status() == WL_CONNECTED ? IPAddress(255, 255, 255, 0) : IPAddress(); }
+    IPAddress dnsIP() { return gatewayIP(); }
+    uint8_t* macAddress(uint8_t* mac) { memcpy(mac, stationMac, sizeof(stationMac)); return mac; }
+
+    // Host control: access points in range, and whether they are reachable at all
+    void addAccessPoint(const char* ssid, uint8_t bssidTail, int32_t channel, int8_t rssi);
+    void setLinkAvailable(bool available);
+    bool linkAvailable() const { return available; }
+    // Whether the station's address is the one DHCP hands out; with a stale
+    // static lease the link is up but nothing is routed
+    bool addressValid() { return status() == WL_CONNECTED && (uint32_t)localIP() == (uint32_t)dhcpAddress; }
+    IPAddress dhcpAddress = IPAddress(192, 168, 4, 2);
+    unsigned long scanMs = 2100;      // Active scan across all channels
+    unsigned long associateMs = 300;  // Auth, association and 4-way handshake
+    unsigned long dhcpMs = 1200;      // Skipped with a static configuration
+    unsigned long beginCalls = 0;
+    unsigned long scans = 0;
+    uint8_t stationMac[6] = {0x24, 0x0A, 0xC4, 0x5E, 0x1F, 0x30};
+
+private:
+    std::vector<AccessPoint> accessPoints;
+    bool available = true;
+    bool staticIp = false;
+    IPAddress staticAddress;
+    int target = -1;                // Access point being joined, -1 = none
+    unsigned long connectAt = 0;
+    unsigned long failAt = 0;       // Attempt reported as failed from then on
+    unsigned long scanStartedAt = 0;
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,261 @@
+#pragma once
+
+// Host implementations of the HAL interfaces used by the native environment.
+
+#include <Arduino.h>
+#include "hal.h"
+#include "pzem_meter.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// PZEM-004T on the other end of a simulated 9600 baud UART. Requests are
+// parsed and answered with bytes that become readable at wire speed on the
+// virtual clock. The load is a slowly drifting resistive/inductive mix and
+// the energy register integrates it like the real meter. Several meters can
+// share the bus at addresses 1..N, each with its own load phase and energy
+// register; the general address 0xF8 only works with a single meter, as on
+// real hardware.
+class SimulatedPzem : public SerialPort {
+public:
+    void begin(uint32_t baud) override { this->baud = baud; }
+    int available() override;
+    int read() override;
+    size_t write(const uint8_t* data, size_t len) override;
+
+    void setDropoutEvery(unsigned n) { dropoutEvery = n; }  // 0 = always answers
+    void setCorruptEvery(unsigned n) { corruptEvery = n; }  // 0 = never flips a bit
+    void setMeterCount(uint8_t n) { meters.resize(n); }
+    // An extra load on the first meter, off for the first half of every period, on for the second
+    void setAppliance(float amps, unsigned long periodMs) { applianceAmps = amps; appliancePeriodMs = periodMs; }
+    bool applianceOn() const { return appliancePeriodMs && millis() % appliancePeriodMs >= appliancePeriodMs / 2; }
+
+    float loadVoltage(uint8_t meter) const;
+    float loadCurrent(uint8_t meter) const;
+    float loadPower(uint8_t meter) const;
+    double energyWh(uint8_t meter) const { return meters[meter].energyWh; }  // Register truth
+
+private:
+    struct Meter {
+        double energyWh = 0;
+        unsigned long lastIntegration = 0;
+    };
+
+    void respond(const uint8_t* frame, size_t len);
+    void integrateEnergy(uint8_t meter);
+
+    uint32_t baud = 9600;
+    unsigned requests = 0;
+    unsigned dropoutEvery = 0;
+    unsigned corruptEvery = 0;
+    float applianceAmps = 0;
+    unsigned long appliancePeriodMs = 0;
+    std::vector<Meter> meters = std::vector<Meter>(1);
+    std::vector<uint8_t> rx;
+    std::vector<unsigned long> rxReadyAt;  // Virtual micros at which each byte arrives
+    size_t rxPos = 0;
+};
+
+// Battery divider around 3.9 V, charge-detect pin low, and mains voltage and
+// CT waveforms around mid-rail with a drive-like harmonic profile. Each pin is
+// a source with Gaussian noise and occasional rail-to-rail spikes; in
+// continuous mode conversions are produced at the configured rate on the
+// virtual clock, each at its own instant of the waveform.
+class FakeAdc : public AdcBackend {
+public:
+    static const uint8_t MAX_ORDER = 15;
+
+    struct Source {
+        float raw = 0;        // True level in counts (the offset, for a waveform)
+        float noise = 0;      // Standard deviation in counts
+        float spikeRate = 0;  // Fraction of conversions that read 0 or 4095
+        float hz = 0;                          // Fundamental of a waveform source
+        float amplitude[MAX_ORDER + 1] = {};   // Peak counts per harmonic order, [1] = fundamental
+        float phase[MAX_ORDER + 1] = {};       // Radians
+    };
+
+    void begin() override {}
+    uint16_t readRaw(uint8_t pin) override { return convert(source(pin), micros() / 1e6); }
+    uint32_t rawToMilliVolts(uint32_t raw) override { return raw * 3300UL / 4095UL; }
+    bool startContinuous(const uint8_t* pins, uint8_t count, uint32_t sampleRateHz) override;
+    size_t readContinuous(AdcSample* out, size_t max) override;
+    void stopContinuous() override { pinCount = 0; }
+
+    Source& source(uint8_t pin);
+    Source battery{1550, 0, 0};
+    Source charging{2000, 0, 0};  // Charger powered: the unit is on external power
+    Source mainsVoltage;  // GPIO39
+    Source mainsCurrent;  // GPIO36
+    FakeAdc();
+    bool continuousSupported = true;
+    unsigned long conversions = 0;
+    unsigned long overruns = 0;  // Conversions lost because nobody read them in time
+
+private:
+    static const size_t DMA_SAMPLES = 1024;
+
+    uint16_t convert(const Source& source, double seconds);
+
+    uint8_t pins[4] = {};
+    uint8_t pinCount = 0;
+    uint8_t nextPin = 0;
+    uint32_t rateHz = 0;
+    unsigned long readAtMicros = 0;
+    double owed = 0;
+    double streamSeconds = 0;  // Instant of the next conversion
+    uint32_t rng = 12345;
+};
+
+// In-memory database. Counts requests and payload bytes per path.
+class FakeCloud : public CloudBackend {
+public:
+    void begin() override { authAt = millis() + authDelayMs; }
+    bool authenticated() override { return authAt != 0 && millis() >= authAt; }
+    bool ready() override { return authenticated(); }  // Holds a token; offline shows in the requests
+    bool setJSON(const char* path, const char* json) override;
+    bool updateJSON(const char* path, const char* json) override;
+    bool setInt(const char* path, int value) override;
+    bool setBool(const char* path, bool value) override;
+    bool getBool(const char* path, bool* value) override;
+    bool getFloat(const char* path, float* value) override;
+    bool beginStream(const char* path, StreamCallback callback) override;
+    bool streamConnected() override { return streamOpen && online; }
+    const char* errorReason() override { return !online ? "offline" : rejecting ? "HTTP 401" : ""; }
+    bool answered() override { return online; }
+
+    // Host side of the stream: deliver an event as if the app wrote it
+    void pushStreamEvent(const char* path, const char* data);
+    // Host side read of a scalar, also from inside an object written in one piece
+    bool lookup(const char* path, std::string& value) const;
+
+    bool online = true;
+    bool rejecting = false;            // Every write answered with an error, as an expired token would be
+    unsigned long authDelayMs = 1200;  // Token exchange after begin()
+    unsigned long rttMs = 0;           // Virtual time each blocking request takes
+    unsigned long requests = 0;
+    unsigned long bytesSent = 0;
+    std::map<std::string, std::string> nodes;
+
+    // Every write as sent, while set: location, body, and whether it was an update
+    struct Request {
+        std::string path, body;
+        bool update;
+    };
+    std::vector<Request>* journal = nullptr;
+
+private:
+    unsigned long authAt = 0;
+    std::string streamPath;
+    StreamCallback streamCallback = nullptr;
+    bool streamOpen = false;
+    bool write(const char* path, const std::string& value);
+    void store(const std::string& path, const std::string& value);
+    static std::string normalize(const char* path);
+};
+
+// A broker and the persistent session to it. Publishes are delivered to the
+// session's own subscriptions and retained ones kept, as a broker would;
+// flush() takes one round trip for the whole pipeline of acknowledgements.
+class FakeMqtt : public MqttBackend {
+public:
+    void begin(const char* clientId, MessageCallback callback) override;
+    bool connected() override { return online && connectAt != 0 && millis() >= connectAt; }
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) override;
+    bool flush(uint32_t timeoutMs) override;
+    bool subscribe(const char* filter, uint8_t qos) override;
+    void service() override {}
+    const char* errorReason() override { return online ? "" : "offline"; }
+
+    // Host side: a message from another client, such as the app
+    void pushMessage(const char* topic, const char* payload, bool retain);
+    static bool matches(const std::string& filter, const std::string& topic);
+    // PUBLISH with QoS 1 on the wire: fixed header, topic, packet id, payload
+    static size_t packetBytes(size_t topicLength, size_t payloadLength);
+
+    bool online = true;
+    unsigned long connectDelayMs = 300;  // TCP, TLS and CONNACK after begin()
+    unsigned long rttMs = 0;             // Virtual time a flush with messages in flight takes
+    unsigned long packets = 0;
+    unsigned long flushes = 0;
+    unsigned long bytesSent = 0;
+    unsigned long bytesReceived = 0;
+    std::map<std::string, std::vector<uint8_t>> retained;
+
+    struct Message {
+        std::string topic;
+        std::vector<uint8_t> payload;
+        bool retain;
+    };
+    std::vector<Message>* journal = nullptr;  // Every publish from the device, while set
+
+private:
+    void deliver(const std::string& topic, const uint8_t* payload, size_t length);
+
+    unsigned long connectAt = 0;
+    MessageCallback callback = nullptr;
+    std::vector<std::string> filters;
+    unsigned inFlight = 0;
+};
+
+// NOR flash model: erase sets bytes to 0xFF, writes can only clear bits.
+class FakeFlash : public FlashBackend {
+public:
+    explicit FakeFlash(uint32_t sectors = 352) : sectors(sectors) {}
+    bool begin() override;
+    uint32_t sectorSize() override { return 4096; }
+    uint32_t sectorCount() override { return sectors; }
+    bool read(uint32_t offset, void* data, size_t len) override;
+    bool write(uint32_t offset, const void* data, size_t len) override;
+    bool eraseSector(uint32_t sector) override;
+
+    unsigned long bytesWritten = 0;
+    std::vector<uint32_t> eraseCounts;
+
+private:
+    uint32_t sectors;
+    std::vector<uint8_t> memory;
+};
+
+// NVS as a key -> blob map. tearNextWrite models power failing mid-write:
+// only the first half of the next blob lands.
+class FakeNvs : public NvsBackend {
+public:
+    bool begin() override { return true; }
+    size_t read(const char* key, void* data, size_t len) override;
+    bool write(const char* key, const void* data, size_t len) override;
+
+    bool tearNextWrite = false;
+    unsigned long writes = 0;
+    unsigned long bytesWritten = 0;
+
+private:
+    std::map<std::string, std::vector<uint8_t>> blobs;
+};
+
+// Records what the firmware asked for. idle() does not move the virtual
+// clock: the harness steps it and calls loop() again.
+class FakePower : public PowerBackend {
+public:
+    bool setModemSleep(bool enabled) override { modemSleep = enabled; return true; }
+    bool setLightSleep(bool enabled) override { lightSleep = enabled && lightSleepSupported; return lightSleepSupported; }
+    void idle(uint32_t ms) override { idleMs += ms; idleCalls++; }
+
+    bool lightSleepSupported = true;
+    bool modemSleep = false;
+    bool lightSleep = false;
+    unsigned long idleMs = 0;
+    unsigned long idleCalls = 0;
+};
+
+// Every configured network in range, later entries stronger; what the
+// harness and the tests boot the firmware with
+void addConfiguredNetworks();
+
+extern SimulatedPzem simulatedPzem;
+extern PzemMeter nativeMeter;
+extern FakeAdc fakeAdc;
+extern FakeCloud fakeCloud;
+extern FakeMqtt fakeMqtt;
+extern FakeFlash fakeFlash;
+extern FakeNvs fakeNvs;
+extern FakePower fakePower;
@@ -0,0 +1,10 @@
+#pragma once
+
+// Heap allocations on the host while armed. On glibc malloc, calloc and
+// realloc are interposed, so printf's internal buffers count as well;
+// elsewhere only operator new is seen.
+
+namespace HeapAudit {
+    void start();          // Counts from zero
+    unsigned long stop();  // Allocations since start()
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// In-process MQTT broker on 127.0.0.1 and a free port, for the uplink bench
+// and the MQTT tests when no real broker is given. Speaks enough MQTT 3.1.1
+// for SocketMqtt: QoS 0 and 1, retained messages, persistent sessions that
+// queue QoS 1 messages while the client is away, + and # filters. Does not
+// retransmit to subscribers. Runs on its own thread from start() to stop().
+
+#include <atomic>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LoopbackBroker {
+public:
+    ~LoopbackBroker() { stop(); }
+
+    bool start();
+    void stop();
+    uint16_t port() const { return boundPort; }
+
+private:
+    struct Connection {
+        int fd;
+        std::vector<uint8_t> rx;
+        std::string clientId;
+        bool closed;
+    };
+    struct Session {
+        std::vector<std::pair<std::string, uint8_t>> filters;
+        std::vector<std::vector<uint8_t>> queued;  // QoS 1 while the client is away
+        int fd = -1;
+        uint16_t nextId = 1;
+    };
+
+    void run();
+    void receive(Connection& c);
+    void send(int fd, const std::vector<uint8_t>& bytes);
+    void handle(Connection& c, uint8_t header, const std::vector<uint8_t>& body);
+    void deliver(Session& session, const std::string& topic, const uint8_t* payload, size_t length, uint8_t qos,
+                 bool retain);
+
+    int listener = -1;
+    uint16_t boundPort = 0;
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::vector<Connection> connections;
+    std::map<std::string, Session> sessions;
+    std::map<std::string, std::vector<uint8_t>> retained;
+    std::vector<std::vector<uint8_t>> held;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+// MQTT 3.1.1 over a plain TCP socket, for the host: the MqttBackend the
+// uplink bench runs against a real broker. QoS 0 and 1 only. The session is
+// persistent (clean session off): unacknowledged publishes are kept and
+// resent with DUP set after a reconnect, and subscriptions are renewed when
+// the broker did not keep the session. Single-threaded; flush(), subscribe()
+// and service() read the socket and run the message callback.
+
+#include "hal.h"
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace MqttWire {
+    enum Type : uint8_t {
+        Connect = 1, Connack = 2, Publish = 3, Puback = 4,
+        Subscribe = 8, Suback = 9, Pingreq = 12, Pingresp = 13, Disconnect = 14
+    };
+
+    void putLength(std::vector<uint8_t>& out, size_t length);  // Remaining length, 7 bits a byte
+    void putUint16(std::vector<uint8_t>& out, uint16_t value);
+    void putString(std::vector<uint8_t>& out, const std::string& text);
+    std::vector<uint8_t> packet(uint8_t header, const std::vector<uint8_t>& body);
+    std::vector<uint8_t> publish(const std::string& topic, const uint8_t* payload, size_t length,
+                                 uint8_t qos, bool retain, uint16_t id);
+    std::vector<uint8_t> ack(Type type, uint16_t id);  // PUBACK
+
+    // Takes one complete packet off the front of a stream buffer
+    bool take(std::vector<uint8_t>& buffer, uint8_t& header, std::vector<uint8_t>& body);
+    // A PUBLISH body: topic, packet id (0 at QoS 0), where the payload starts
+    bool parsePublish(uint8_t header, const std::vector<uint8_t>& body, std::string& topic, uint16_t& id,
+                      size_t& payloadAt);
+}
+
+class SocketMqtt : public MqttBackend {
+public:
+    static const size_t MAX_IN_FLIGHT = 1024;
+
+    SocketMqtt(const std::string& host, uint16_t port) : host(host), port(port) {}
+    ~SocketMqtt() { close(); }
+
+    void begin(const char* clientId, MessageCallback callback) override;
+    bool connected() override { return fd >= 0; }
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) override;
+    bool flush(uint32_t timeoutMs) override;
+    bool subscribe(const char* filter, uint8_t qos) override;
+    void service() override;
+    const char* errorReason() override { return error.c_str(); }
+
+    void drop();        // Closes the connection as a network failure would; the session survives
+    void disconnect();  // DISCONNECT and close, the broker keeps the session
+
+    uint16_t keepAliveS = 60;
+    unsigned long packetsSent = 0;
+    unsigned long bytesSent = 0;
+    unsigned long bytesReceived = 0;
+    unsigned long reconnects = 0;
+    unsigned long resent = 0;  // Publishes sent again with DUP after a reconnect
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    bool open();
+    void close();
+    bool send(const std::vector<uint8_t>& bytes);
+    bool receive(int timeoutMs);  // Handles whatever arrives; false once the connection is gone
+    void handle(uint8_t header, const std::vector<uint8_t>& body);
+
+    std::string host;
+    uint16_t port;
+    std::string clientId;
+    MessageCallback callback = nullptr;
+    std::string error;
+    int fd = -1;
+    bool connackReceived = false;
+    bool sessionPresent = false;
+    unsigned long subacks = 0;
+    uint16_t nextId = 1;
+    std::vector<uint8_t> rx;
+    std::map<uint16_t, std::vector<uint8_t>> inFlight;  // QoS 1 publishes until their PUBACK
+    std::vector<std::pair<std::string, uint8_t>> filters;
+    Clock::time_point lastSend;
+    Clock::time_point retryAt;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+#include "power_readings.h"
+
+// Fixed-size flash image of one sample. state is outside the CRC so a record
+// can be marked sent in place (flash writes can clear bits without an erase).
+struct __attribute__((packed)) LogRecord {
+    uint32_t timestamp;
+    float voltage;
+    float current;
+    float power;
+    float energy;
+    float frequency;
+    float powerFactor;
+    uint8_t flags;   // FLAG_VALID | FLAG_CHARGING, channel in the upper nibble
+    uint8_t state;   // STATE_PENDING until uploaded
+    uint16_t crc;    // CRC-16 over timestamp..flags
+
+    static const uint8_t FLAG_VALID = 0x01;
+    static const uint8_t FLAG_CHARGING = 0x02;
+    static const uint8_t CHANNEL_SHIFT = 4;
+    static const uint8_t STATE_PENDING = 0xFF;
+    static const uint8_t STATE_SENT = 0x00;
+
+    static LogRecord fromReadings(const PowerReadings& readings);
+    PowerReadings toReadings() const;
+    uint8_t channel() const { return flags >> CHANNEL_SHIFT; }
+};
+
+static_assert(sizeof(LogRecord) == 32, "LogRecord must stay 32 bytes");
+
+// Append-only store-and-forward log for readings taken while the cloud is
+// unreachable. Sectors are used round-robin, so erases spread evenly over the
+// region; when it is full the oldest sector is erased and its records dropped.
+// Each sector starts with a header slot carrying a sequence number (to find
+// head and tail after a reboot) and its own erase count. Readings taken before
+// NTP answered carry uptime seconds and are placed on the wall clock at peek().
+class OfflineLog {
+public:
+    static bool begin(uint32_t maxSectors);
+    static bool append(const PowerReadings& readings);
+
+    // Reads up to maxRecords pending records, oldest first, without consuming them
+    static size_t peek(LogRecord* records, size_t maxRecords);
+    static void markSent(size_t count);  // Consumes what the last peek() returned
+
+    static uint32_t pendingCount() { return pending; }
+    static uint32_t capacity() { return sectorCount * RECORDS_PER_SECTOR; }
+
+    struct Stats {
+        uint32_t appended = 0;
+        uint32_t sent = 0;
+        uint32_t evicted = 0;       // Pending records lost to oldest-first eviction
+        uint32_t corrupt = 0;       // Records skipped on CRC mismatch
+        uint32_t unresolved = 0;    // Uptime-stamped records from an earlier boot, dropped
+        uint32_t erases = 0;
+        uint32_t maxSectorErases = 0;
+    };
+    static const Stats& getStats() { return stats; }
+
+private:
+    struct __attribute__((packed)) SectorHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t eraseCount;
+        uint8_t reserved[20];
+    };
+    static_assert(sizeof(SectorHeader) == sizeof(LogRecord), "Header occupies one slot");
+
+    static const uint32_t MAGIC = 0x474F4C45;  // "ELOG"
+    static const uint32_t SECTOR_SIZE = 4096;
+    static const uint32_t RECORDS_PER_SECTOR = SECTOR_SIZE / sizeof(LogRecord) - 1;
+
+    static uint32_t slotOffset(uint32_t sector, uint32_t slot);
+    static bool readHeader(uint32_t sector, SectorHeader& header);
+    static bool openSector(uint32_t sector);
+    static bool isErased(const LogRecord& record);
+    static uint32_t unsentInSector(uint32_t sector, uint32_t fromSlot);
+
+    static uint32_t sectorCount;
+    static uint32_t headSector, headSlot;   // Next free slot
+    static uint32_t tailSector;             // Oldest live sector
+    static uint32_t readSector, readSlot;   // Oldest pending record
+    static uint32_t nextSequence;
+    static uint32_t pending;
+    static uint32_t previousBootPending;    // The oldest pending records predate this boot
+    static uint32_t peekedSector, peekedSlot;
+    static size_t peekedCount;
+    static bool ready;
+    static Stats stats;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+
+// Streaming quantile estimate in constant time and memory: the P-square
+// algorithm (Jain & Chlamtac, 1985). Five markers track the minimum, the
+// target quantile, the points halfway to it on either side and the maximum;
+// each observation moves the markers' positions and adjusts their heights by
+// a piecewise-parabolic fit. The observation count is kept by the caller and
+// passed in, so several estimators over one window share it, and restarting
+// a window is just starting the count from zero again.
+class P2Quantile {
+public:
+    explicit P2Quantile(float p = 0.5f) : p(p) {}
+
+    // count = observations before this one
+    void add(float x, uint32_t count) {
+        if (count < 5) {
+            // Keep the first five sorted; they become the initial markers
+            int i = count;
+            while (i > 0 && height[i - 1] > x) {
+                height[i] = height[i - 1];
+                i--;
+            }
+            height[i] = x;
+            position[count] = count;
+            return;
+        }
+
+        int k;
+        if (x < height[0]) {
+            height[0] = x;
+            k = 0;
+        } else if (x >= height[4]) {
+            height[4] = x;
+            k = 3;
+        } else {
+            k = 0;
+            while (k < 3 && x >= height[k + 1]) k++;
+        }
+        for (int i = k + 1; i < 5; i++) position[i]++;
+
+        // Desired marker positions follow from the count alone
+        float last = (float)count;  // Index of the newest observation
+        const float desired[5] = { 0, last * p / 2, last * p, last * (1 + p) / 2, last };
+        for (int i = 1; i <= 3; i++) {
+            float d = desired[i] - position[i];
+            int32_t gapUp = position[i + 1] - position[i];
+            int32_t gapDown = position[i - 1] - position[i];
+            if ((d >= 1 && gapUp > 1) || (d <= -1 && gapDown < -1)) {
+                int step = d >= 0 ? 1 : -1;
+                float h = parabolic(i, step);
+                if (height[i - 1] < h && h < height[i + 1]) height[i] = h;
+                else height[i] += step * (height[i + step] - height[i]) / (position[i + step] - position[i]);
+                position[i] += step;
+            }
+        }
+    }
+
+    // count = observations so far
+    float estimate(uint32_t count) const {
+        if (count == 0) return 0;
+        if (count < 5) return height[(uint32_t)(p * (count - 1) + 0.5f)];
+        return height[2];
+    }
+
+private:
+    float parabolic(int i, int step) const {
+        float n0 = position[i - 1], n1 = position[i], n2 = position[i + 1];
+        return height[i] + step / (n2 - n0) *
+               ((n1 - n0 + step) * (height[i + 1] - height[i]) / (n2 - n1) +
+                (n2 - n1 - step) * (height[i] - height[i - 1]) / (n1 - n0));
+    }
+
+    float p;
+    float height[5] = {};
+    int32_t position[5] = {};
+};
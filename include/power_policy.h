@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Battery-aware operating mode. On external power (charging, or a full cell
+// the charger has stopped topping up) everything runs at full rate; on the
+// battery the upload and snapshot intervals stretch and the meter rounds
+// space out as the charge drops, the radio goes to modem sleep, and from Low
+// down the CPU light-sleeps between jobs. Dropping a mode takes the charge
+// to fall under the threshold, climbing back takes HYSTERESIS_PERCENT more,
+// so a sagging cell under load doesn't flap between the two.
+//
+// The runtime estimate is a current budget per mode (ESP32 datasheet
+// figures for the radio and CPU states, a fixed cost per upload and per
+// meter transaction), with the charge left spent band by band in the modes
+// the policy will step down through, next to the same charge at full rate;
+// the difference is the runtime the policy buys.
+class PowerPolicy {
+public:
+    enum Mode : uint8_t { External, Saver, Low, Critical, MODE_COUNT };
+
+    struct Settings {
+        uint32_t uploadMs;    // Upload cycle, at least
+        uint32_t snapshotMs;  // Sampler hand-over cadence
+        uint32_t roundGapMs;  // Meter rounds at most this often, 0 = back to back
+        bool modemSleep;
+        bool lightSleep;
+    };
+
+    struct Estimate {
+        float averageMa;
+        float runtimeHours;    // In this mode from the charge left
+        float fullRateHours;   // If everything still ran as on external power
+        float gainedHours;
+    };
+
+    static const uint8_t FULL_PERCENT = 97;       // Not charging above this, coming from External: charger done
+    static const uint8_t LOW_PERCENT = 40;
+    static const uint8_t CRITICAL_PERCENT = 15;
+    static const uint8_t HYSTERESIS_PERCENT = 5;
+    static const uint32_t MAX_IDLE_MS = 1000;     // Longest the loop task blocks in one go
+
+    // Pure decision, for the host bench as much as the firmware
+    static Mode decide(Mode current, bool charging, uint8_t percent);
+    static const Settings& settings(Mode mode) { return SETTINGS[mode]; }
+    static float averageMilliAmps(Mode mode, uint8_t channels, bool lightSleepAvailable);
+    // Runtime from this charge if unplugged now, going down through the modes
+    static Estimate estimate(uint8_t percent, uint8_t channels, bool lightSleepAvailable);
+    static const char* name(Mode mode) { return MODE_NAMES[mode]; }
+
+    // Firmware side: update() returns true when the mode changed and has to be applied
+    static void begin();  // External power until the first update
+    static bool update(bool charging, uint8_t percent);
+    static Mode mode() { return active; }
+    static uint8_t lastPercent() { return chargePercent; }
+    static bool lastCharging() { return onCharger; }
+    static int format(char* buffer, size_t size, uint8_t channels, bool lightSleepAvailable);  // deviceStatus/power
+
+private:
+    // Current budget, mA
+    static const float BASE_MA;          // Regulator, divider, charge detect, RS-485 transceiver
+    static const float RADIO_ON_MA;      // CPU at 240 MHz, radio listening all the time
+    static const float MODEM_SLEEP_MA;   // CPU at 240 MHz, radio between beacons
+    static const float LIGHT_SLEEP_MA;   // Sleeping, waking for beacons and background tasks
+    static const float UPLOAD_MA;        // TLS request on top of the idle state
+    static const float UPLOAD_MS;
+    static const float TRANSACTION_MA;   // CPU awake for a meter transaction
+    static const float TRANSACTION_MS;
+
+    static Mode byCharge(uint8_t percent, uint8_t margin);
+
+    static const Settings SETTINGS[MODE_COUNT];
+    static const char* const MODE_NAMES[MODE_COUNT];
+
+    static Mode active;
+    static uint8_t chargePercent;
+    static bool onCharger;
+};
@@ -2,6 +2,10 @@
 #include <Arduino.h>
 
 struct PowerReadings {
+    static const uint8_t MAX_CHANNELS = 16;  // PZEM meters on one RS-485 bus
+
+    uint32_t timestamp = 0;  // Unix time the sample was taken (uptime seconds before NTP)
+    uint8_t channel = 0;     // Index into the configured meter addresses
     float voltage = 0;
     float current = 0;
     float power = 0;
@@ -17,11 +21,6 @@ struct PowerReadings {
     bool isValid = false;
     bool isCharging = false;  // Add this line for charging status
     
-    static float accumulatedEnergy;  // Static member to keep track of total energy
-    static unsigned long lastMeasurementTime;  // To track time between measurements
-    
-    static void resetEnergy() {
-        accumulatedEnergy = 0;
-        lastMeasurementTime = millis();
-    }
+    // Zeroes the channel's total and clears the meter's own counter with it
+    static void resetEnergy(uint8_t channel);
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+// Per-stage timing hooks for the loop() benchmark in the native environment.
+// On the ESP32 build PROFILE_STAGE() compiles to nothing.
+
+enum class LoopStage : unsigned char {
+    Sample,
+    Battery,
+    Readings,
+    Commit,
+    Backlog,
+    Count
+};
+
+#ifdef NATIVE_BUILD
+
+class StageProfiler {
+public:
+    static void record(LoopStage stage, unsigned long nanos);
+    static unsigned long now();
+};
+
+class StageScope {
+public:
+    explicit StageScope(LoopStage stage) : stage(stage), start(StageProfiler::now()) {}
+    ~StageScope() { StageProfiler::record(stage, StageProfiler::now() - start); }
+
+private:
+    LoopStage stage;
+    unsigned long start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_STAGE(stage) StageScope PROFILE_CONCAT(stageScope_, __LINE__)(stage)
+
+#else
+
+#define PROFILE_STAGE(stage)
+
+#endif
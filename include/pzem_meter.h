@@ -0,0 +1,29 @@
+#pragma once
+
+#include "hal.h"
+#include "modbus_rtu.h"
+
+// PZEM-004T v3 over Modbus-RTU: the ten input registers (voltage through
+// alarm) are fetched in a single 0x04 transaction and decoded in one go.
+// Meters are addressed per call so one driver serves the whole bus; 0xF8 is
+// answered by any single meter regardless of its configured address.
+class PzemMeter : public MeterBackend {
+public:
+    static const uint8_t GENERAL_ADDRESS = ModbusRtuMaster::GENERAL_ADDRESS;
+
+    explicit PzemMeter(SerialPort& port) : modbus(port) {}
+
+    void begin() override;
+    bool request(uint8_t address) override;
+    Status poll(MeterSample& sample) override;
+    bool resetEnergy(uint8_t address) override;
+    const LinkStats& linkStats() override { return modbus.getStats(); }
+
+private:
+    static const uint16_t REGISTER_COUNT = 10;
+    static const uint8_t FN_RESET_ENERGY = 0x42;
+    static void decode(const uint16_t* regs, MeterSample& sample);
+
+    ModbusRtuMaster modbus;
+    bool resetting = false;  // The transaction in flight is a 0x42, not a read
+};
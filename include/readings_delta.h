@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+#include "power_readings.h"
+#include "readings_schema.h"
+
+// Which fields of a channel's readings are worth sending this cycle. The
+// reference is what the database holds: the values of the last committed
+// upload, not the last sample, so a slow drift still goes out once it has
+// added up to the deadband. A field that moved less than its deadband (see
+// READINGS_SCHEMA) is held back, but never for longer than MAX_STALE_MS, and
+// a changed bool always goes. The timestamp goes with every delta, so it
+// says when the values in the database were last brought up to date.
+//
+// select() only stages a snapshot; commitCycle() confirms it when the batch
+// lands, or discards it so the next cycle compares against the database
+// again. Until a channel has been confirmed once, every field goes.
+class ReadingsDelta {
+public:
+    static const uint32_t MAX_STALE_MS = 60000;
+    static const uint32_t ALL_FIELDS = (1UL << READINGS_FIELD_COUNT) - 1;
+    static_assert(READINGS_FIELD_COUNT < 32, "field mask is 32 bits");
+
+    // Bit i set: READINGS_SCHEMA[i] should be sent. 0 if nothing should.
+    static uint32_t select(const PowerReadings& readings, unsigned long now);
+    // What will actually be sent, at least the selected fields
+    static void stage(const PowerReadings& readings, uint32_t fields, unsigned long now);
+
+    static void confirm();  // The staged fields are in the database
+    static void discard();
+    static void reset();    // Forget what the database holds: everything goes next time
+
+private:
+    static bool moved(const ReadingsField& field, const PowerReadings& now, const PowerReadings& last);
+
+    static PowerReadings sent[PowerReadings::MAX_CHANNELS];
+    static unsigned long sentAt[PowerReadings::MAX_CHANNELS][READINGS_FIELD_COUNT];
+    static bool known[PowerReadings::MAX_CHANNELS];
+    static PowerReadings staged[PowerReadings::MAX_CHANNELS];
+    static uint32_t stagedFields[PowerReadings::MAX_CHANNELS];
+    static unsigned long stagedAt;
+};
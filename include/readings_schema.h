@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include "power_readings.h"
+
+// The published fields of PowerReadings, in upload order. Serialisation,
+// NaN validation, the debug dump and delta reporting all walk this table, so
+// a field added here is sent, checked, logged and deadbanded without touching
+// any of them. Output goes into caller-owned buffers with a hand-rolled
+// number formatter: nothing on this path allocates (newlib's printf does
+// for %f).
+struct ReadingsField {
+    enum Kind : uint8_t { Uint32, Bool, Float };
+
+    const char* name;   // JSON key
+    const char* unit;   // Debug dump only
+    Kind kind;
+    uint16_t offset;
+    uint8_t decimals;   // Float: digits after the point on the wire
+    bool validated;     // Float: a NaN rejects the whole snapshot
+    float deadband;     // Float: resent once it moves more than this from the value last sent,
+    float relative;     // or this fraction of it, whichever is larger
+};
+
+#define READINGS_FIELD(member, kind, unit, decimals, validated, deadband, relative) \
+    { #member, unit, ReadingsField::kind, (uint16_t)offsetof(PowerReadings, member), decimals, validated, \
+      deadband, relative }
+
+// Deadbands are a couple of meter counts at least, so a reading flickering
+// by one count isn't resent
+constexpr ReadingsField READINGS_SCHEMA[] = {
+    READINGS_FIELD(timestamp, Uint32, "s", 0, false, 0, 0),  // Goes with every delta
+    READINGS_FIELD(isCharging, Bool, "", 0, false, 0, 0),
+    READINGS_FIELD(voltage, Float, "V", 3, true, 0.5f, 0),
+    READINGS_FIELD(current, Float, "A", 3, true, 0.02f, 0.02f),
+    READINGS_FIELD(power, Float, "W", 3, true, 2.0f, 0.02f),
+    READINGS_FIELD(energy, Float, "Wh", 3, false, 5.0f, 0),
+    READINGS_FIELD(frequency, Float, "Hz", 3, true, 0.15f, 0),
+    READINGS_FIELD(powerFactor, Float, "", 3, true, 0.02f, 0),
+    READINGS_FIELD(apparentPower, Float, "VA", 3, false, 2.0f, 0.02f),
+    READINGS_FIELD(reactivePower, Float, "VAR", 3, false, 2.0f, 0.02f),
+    READINGS_FIELD(loadImpedance, Float, "ohm", 3, false, 0.5f, 0.02f),
+    READINGS_FIELD(distortionPower, Float, "VA", 3, false, 2.0f, 0.02f),
+    READINGS_FIELD(thd, Float, "%", 3, true, 0.5f, 0.02f),
+    READINGS_FIELD(powerQuality, Float, "", 3, true, 0.02f, 0),
+};
+
+#undef READINGS_FIELD
+
+constexpr size_t READINGS_FIELD_COUNT = sizeof(READINGS_SCHEMA) / sizeof(READINGS_SCHEMA[0]);
+
+class ReadingsSchema {
+public:
+    // Longest possible JSON object: every key, 10-digit integers, floats
+    // up to the formatter's limit, separators
+    static constexpr size_t maxJsonLength(size_t i = 0) {
+        return i == READINGS_FIELD_COUNT ? 2
+               : 4 + length(READINGS_SCHEMA[i].name) + MAX_NUMBER_LENGTH + maxJsonLength(i + 1);
+    }
+
+    // Returns the length written, or -1 if the buffer is too small
+    static int toJson(const PowerReadings& readings, char* buffer, size_t size);
+    // One field's value as it goes on the wire; out needs MAX_NUMBER_LENGTH
+    static size_t formatField(const PowerReadings& readings, const ReadingsField& field, char* out);
+    static bool hasNaN(const PowerReadings& readings);
+    static void dump(const PowerReadings& readings);
+
+    // Fixed-point rendering; values beyond +/-1e12 are clamped
+    static size_t formatFloat(char* out, float value, uint8_t decimals);
+    static size_t formatUint(char* out, uint32_t value);
+
+    static const size_t MAX_NUMBER_LENGTH = 20;  // "-999999999999.999999"
+
+    static float floatAt(const PowerReadings& readings, const ReadingsField& field);
+
+    // Binary form for transports that carry bytes: version, channel, the
+    // field mask (bit i: READINGS_SCHEMA[i]) and the selected fields in table
+    // order, little-endian, floats as IEEE 754 singles, bools as one byte
+    static const uint8_t BINARY_VERSION = 1;
+    static const size_t BINARY_HEADER = 6;
+    static constexpr size_t maxBinaryLength(size_t i = 0) {
+        return i == READINGS_FIELD_COUNT ? BINARY_HEADER
+               : (READINGS_SCHEMA[i].kind == ReadingsField::Bool ? 1 : 4) + maxBinaryLength(i + 1);
+    }
+    // Returns the length written, or -1 if the buffer is too small
+    static int toBinary(const PowerReadings& readings, uint32_t fields, uint8_t* buffer, size_t size);
+    // Overwrites the fields present; false on a malformed or foreign payload
+    static bool fromBinary(const uint8_t* data, size_t length, PowerReadings& readings, uint32_t* fields);
+
+private:
+    static constexpr size_t length(const char* s) { return *s ? 1 + length(s + 1) : 0; }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "power_readings.h"
+#include "spsc_ring.h"
+
+// Meter sampling pinned to its own FreeRTOS task on core 0, away from the
+// WiFi/Firebase work in loop() on core 1. The task drives the bus scheduler
+// every tick and, once per interval, hands a snapshot of each channel to the
+// uploader through a lock-free ring so slow HTTPS calls never delay a sample.
+// While the bus scheduler spaces its rounds out, the task sleeps through the
+// gaps instead of waking every tick.
+class SamplingTask {
+public:
+    static void start(unsigned long intervalMs);
+    static void setInterval(unsigned long intervalMs) { interval.store(intervalMs, std::memory_order_relaxed); }
+    static void service();  // Cooperative sampling when there is no RTOS (native build)
+    static bool pop(PowerReadings& readings);
+
+    static const size_t RING_CAPACITY = 64;  // Four snapshots of a full 16-meter bus
+
+    // The snapshot interval to run at so one upload interval's snapshots of
+    // every channel fill at most half the ring: wanted, or longer when the
+    // uploads are too far apart for it
+    static unsigned long intervalFor(unsigned long wantedMs, unsigned long uploadMs, uint8_t channels);
+
+    // Energy is integrated on the sampling side, so resets are handed over too
+    static void requestEnergyReset();
+    // Cloud totals arrive once we're online, after sampling has started; added on the sampler side
+    static void seedEnergy(uint8_t channel, float wh);
+
+    static uint32_t queueDepth();
+    static uint32_t maxQueueDepth();
+    static uint32_t overflowCount();
+    static uint32_t samplesTaken();
+    static unsigned long maxLatenessMs();  // Worst slip behind the sampling cadence
+
+private:
+    static const uint8_t SAMPLER_CORE = 0;
+    static const uint8_t SAMPLER_PRIORITY = 3;
+    static const uint32_t SAMPLER_STACK = 6144;
+    static const unsigned long FIRST_SAMPLE_DELAY = 250;
+
+    static void tick(unsigned long now);
+    static unsigned long idleMs(unsigned long now);
+    static void sampleOnce(unsigned long scheduledAt);
+#ifndef NATIVE_BUILD
+    static void taskLoop(void* arg);
+#endif
+
+    static SpscRing<PowerReadings, RING_CAPACITY> ring;
+    static std::atomic<unsigned long> interval;
+    static unsigned long nextSampleAt;
+#ifdef NATIVE_BUILD
+    static unsigned long steppedTo;
+#endif
+    static std::atomic<bool> resetPending;
+    static float seeds[PowerReadings::MAX_CHANNELS];
+    static std::atomic<uint32_t> seedsPending;
+    static std::atomic<uint32_t> samples;
+    static std::atomic<unsigned long> worstLateness;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Bounded single-producer/single-consumer ring. push() is only ever called from
+// one task and pop() from one other task; no locks, no allocation. When the
+// ring is full the newest item is dropped and counted, so the producer never
+// waits on the consumer.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    bool push(const T& item) {
+        uint32_t head = headIndex.load(std::memory_order_relaxed);
+        uint32_t tail = tailIndex.load(std::memory_order_acquire);
+        if (head - tail >= N) {
+            overflowCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[head & (N - 1)] = item;
+        headIndex.store(head + 1, std::memory_order_release);
+
+        uint32_t depth = head + 1 - tail;
+        if (depth > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool pop(T& item) {
+        uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+        uint32_t head = headIndex.load(std::memory_order_acquire);
+        if (head == tail) return false;
+        item = slots[tail & (N - 1)];
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t depth() const {
+        return headIndex.load(std::memory_order_acquire) - tailIndex.load(std::memory_order_acquire);
+    }
+    uint32_t overflows() const { return overflowCount.load(std::memory_order_relaxed); }
+    uint32_t maxDepth() const { return highWater.load(std::memory_order_relaxed); }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T slots[N];
+    std::atomic<uint32_t> headIndex{0};  // Written by the producer only
+    std::atomic<uint32_t> tailIndex{0};  // Written by the consumer only
+    std::atomic<uint32_t> overflowCount{0};
+    std::atomic<uint32_t> highWater{0};
+};
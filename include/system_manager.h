@@ -3,19 +3,16 @@
 #include <Arduino.h>
 #include "WiFi.h"
 #include "power_readings.h"
-#include "PZEM004Tv30.h"
+#include "hal.h"
 
 class SystemManager {
 private:
     // Pin definitions
     static const int WIFI_LED_PIN = 2;
     static const int CHARGING_PIN = 35;  
-    static const int RX_PIN = 16;
-    static const int TX_PIN = 17;
+    static const uint8_t CHARGING_SMOOTHING = 1;  // EMA over ~2 ADC blocks (12.8 ms with 4 pins), about 25 ms
     
     // Non-const static members
-    static HardwareSerial pzemSerial;
-    static PZEM004Tv30 pzem;
     static bool lastChargingState;
 
     // NTP related constants (removed constexpr)
@@ -24,16 +21,21 @@ private:
     static const int DAYLIGHT_OFFSET_SEC;
 
 public:
+    static const uint32_t MIN_VALID_EPOCH = 1600000000;  // Anything earlier is uptime
+
     static void setupPZEM();
-    static bool setupWiFi();
     static bool isWiFiConnected();
-    static bool reconnectWiFi();
-    static bool syncTime();
+    static void startTimeSync();
+    static bool timeValid();
+    static uint32_t timestampNow();
+    static uint32_t resolveTimestamp(uint32_t timestamp);  // Uptime stamp -> wall time, once known
+    static uint32_t bootEpoch();
     static void setupIndicators();
     static void updateWiFiLED(bool connected);
     static void updateChargingLED(bool charging);
-    static PowerReadings getPowerReadings();
+    static PowerReadings processSample(uint8_t channel, const MeterSample* sample, unsigned long now);
+    static PowerReadings getPowerReadings(uint8_t channel);
     static void checkAndUpdateChargingStatus();
     static bool isCharging();
-    static PZEM004Tv30& getPZEM();
+    static MeterBackend& getMeter();
 };
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// Fixed-bucket histogram for millisecond latencies. Bucket b holds values of
+// bit length b (0, 1, 2-3, 4-7, ... ms) and the last one everything from
+// 16.4 s up, so recording is a count-leading-zeros and a handful of relaxed
+// stores. One writer per histogram; any task may read.
+class Histogram {
+public:
+    static const uint8_t BUCKETS = 16;
+
+    void record(uint32_t value) {
+        uint8_t b = value ? 32 - __builtin_clz(value) : 0;
+        if (b >= BUCKETS) b = BUCKETS - 1;
+        bump(counts[b], 1);
+        bump(total, 1);
+        bump(sum, value);
+        if (value > peak.load(std::memory_order_relaxed)) peak.store(value, std::memory_order_relaxed);
+    }
+
+    uint32_t count() const { return total.load(std::memory_order_relaxed); }
+    uint32_t max() const { return peak.load(std::memory_order_relaxed); }
+    uint32_t mean() const;
+    uint32_t bucket(uint8_t b) const { return counts[b].load(std::memory_order_relaxed); }
+    uint32_t percentile(float q) const;  // Upper edge of the bucket holding q, capped at max()
+    static uint32_t upperBound(uint8_t b) { return b ? (1UL << b) - 1 : 0; }
+
+private:
+    static void bump(std::atomic<uint32_t>& value, uint32_t by) {
+        value.store(value.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> counts[BUCKETS] = {};
+    std::atomic<uint32_t> total{0};
+    std::atomic<uint32_t> sum{0};
+    std::atomic<uint32_t> peak{0};
+};
+
+// Hot-path timings and failure counters, cumulative since boot. Published
+// under deviceStatus/telemetry with the heartbeat and dumped to the serial
+// log, tagged with FIRMWARE_BUILD so builds can be compared across units.
+class Telemetry {
+public:
+    enum Metric : uint8_t {
+        PzemRead,       // Request to answer on the RS-485 bus
+        CloudRtt,       // Each blocking Firebase call from loop()
+        WifiReconnect,  // Link loss to associated with an address
+        LoopJitter,     // Upload cycle start behind its interval
+        EventPush,      // Appliance step to its event written to the cloud
+        METRIC_COUNT
+    };
+
+    enum Counter : uint8_t {
+        ReadingsRejected,  // NaN in a snapshot, never sent
+        UploadFailures,    // Readings writes/commits the cloud refused
+        HistoryFailures,   // Backlog batches left in flash for another try
+        COUNTER_COUNT
+    };
+
+    static const char* const BUILD;
+
+    static void record(Metric metric, uint32_t ms) { histograms[metric].record(ms); }
+    static void count(Counter counter) { counters[counter].fetch_add(1, std::memory_order_relaxed); }
+
+    static const Histogram& histogram(Metric metric) { return histograms[metric]; }
+    static uint32_t counter(Counter counter) { return counters[counter].load(std::memory_order_relaxed); }
+    static uint32_t freeHeap();
+    static uint32_t minFreeHeap();  // Low-water mark since boot
+
+    static int format(char* buffer, size_t size);  // JSON object for deviceStatus/telemetry
+    static void dump();                            // One log line per histogram
+
+private:
+    static const char* const METRIC_NAMES[METRIC_COUNT];
+    static const char* const COUNTER_NAMES[COUNTER_COUNT];
+
+    static Histogram histograms[METRIC_COUNT];
+    static std::atomic<uint32_t> counters[COUNTER_COUNT];
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+#include "power_readings.h"
+#include "offline_log.h"
+
+// The transport between the device and the backend the app reads. What goes
+// out, and the JSON of the status entries, is FirebaseManager's business; an
+// uplink carries it. Paths are relative to devices/<id> unless deviceScoped
+// is false, which only a fleet cycle allows (the fleet index).
+class Uplink {
+public:
+    // A command from the app: path relative to the commands node ("/" with
+    // the whole node as a JSON object), data as JSON text
+    typedef void (*CommandCallback)(const char* path, const char* data);
+
+    // How far the last commitCycle() got, which is what it says about the link
+    enum class Reach : uint8_t {
+        NothingSent,  // Empty, or refused before it went out
+        Answered,     // Delivered, or turned away by the server
+        Unreachable,  // No connection, socket error, no acknowledgement
+    };
+
+    struct Stats {
+        uint32_t commits = 0;
+        uint32_t failedCommits = 0;
+        uint32_t requestsSaved = 0;  // Writes that rode along in another request
+        uint32_t bytesSaved = 0;     // Estimated, against a request per write
+    };
+
+    virtual ~Uplink() {}
+    virtual const char* name() = 0;
+    virtual void begin() = 0;          // Starts connecting and returns at once
+    virtual bool authenticated() = 0;  // Has been connected at least once
+    virtual bool ready() = 0;
+    virtual void service() {}  // Drives a connection that has no task of its own
+
+    // One upload cycle, delivered as a unit by commitCycle()
+    virtual void beginCycle(bool fleet) = 0;
+    virtual bool publishReadings(const PowerReadings& readings) = 0;  // The fields ReadingsDelta selects
+    virtual bool publishStatus(const char* path, const char* json, bool deviceScoped = true) = 0;
+    virtual bool commitCycle() = 0;
+    virtual Reach lastReach() = 0;
+
+    // Written at once, outside the cycle
+    virtual bool publish(const char* path, const char* json) = 0;
+    virtual bool publishHistory(const LogRecord* records, size_t count) = 0;
+    virtual bool readFloat(const char* path, float* value) = 0;  // False where the backend can't be read
+
+    virtual bool subscribeCommands(const char* path, CommandCallback callback) = 0;
+    virtual bool commandsConnected() = 0;
+    virtual const char* errorReason() = 0;
+    virtual const Stats& stats() = 0;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "hal.h"
+#include "harmonic_analyzer.h"
+
+// Mains waveform acquisition for harmonic analysis. The CT burden and the
+// voltage-sense divider are tapped into the ADC sampler's DMA scan; the tap
+// fills one block of HarmonicAnalyzer::BLOCK_SAMPLES per signal while the
+// previous one is being analysed (double buffer, handed over with an atomic
+// index). A block that completes while the other is still waiting is
+// discarded and counted, never queued.
+//
+// A low-priority task runs the FFT on each finished block and publishes the
+// spectrum through a sequence lock, so readers on other cores copy a
+// consistent snapshot without waiting.
+class WaveformCapture {
+public:
+    static const uint8_t CURRENT_PIN = 36;  // GPIO36 (ADC1_0, VP): CT burden, biased to mid-rail
+    static const uint8_t VOLTAGE_PIN = 39;  // GPIO39 (ADC1_3, VN): isolated voltage sense, mid-rail
+    static const unsigned long MAX_AGE_MS = 5000;  // Older spectra don't replace the readings' THD
+
+    struct Stats {
+        uint32_t blocks = 0;      // Analysed
+        uint32_t discarded = 0;   // Completed while the analyser was busy
+        uint32_t noSignal = 0;    // No fundamental in the voltage
+        uint32_t lastMicros = 0;  // Analysis time of the latest block
+    };
+
+    static bool begin();     // Before AdcSampler::start()
+    static void service();   // Analyses a finished block when there is no RTOS (native build)
+
+    static bool latest(HarmonicSpectrum& out);  // False if nothing has been analysed yet
+    static bool fresh(HarmonicSpectrum& out);   // Same, and no older than MAX_AGE_MS
+    static Stats stats();
+
+private:
+    static const size_t N = HarmonicAnalyzer::BLOCK_SAMPLES;
+    static const uint8_t NO_BLOCK = 0xFF;
+    static const uint8_t TASK_CORE = 0;
+    static const uint8_t TASK_PRIORITY = 1;  // Below the ADC drain, which feeds it
+    static const uint32_t TASK_STACK = 3072;
+    static const unsigned long POLL_MS = 20;
+
+    struct Block {
+        uint16_t voltage[N];
+        uint16_t current[N];
+        uint32_t completedAt;
+    };
+
+    static void onSamples(const AdcSample* samples, size_t count);
+    static void analyzeReady();
+#ifndef NATIVE_BUILD
+    static void taskLoop(void* arg);
+#endif
+
+    // Tap side (ADC task)
+    static Block blocks[2];
+    static uint8_t filling;
+    static size_t voltageCount;
+    static size_t currentCount;
+    static std::atomic<uint8_t> readyBlock;
+
+    // Published spectrum
+    static HarmonicSpectrum spectrum;
+    static std::atomic<uint32_t> sequence;  // Odd while being written
+
+    static std::atomic<uint32_t> analysed;
+    static std::atomic<uint32_t> discarded;
+    static std::atomic<uint32_t> noSignal;
+    static std::atomic<uint32_t> lastMicros;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "WiFi.h"
+
+// Station link management, run off the loop thread. The first connect scans
+// once and tries the configured networks strongest first, joining by BSSID
+// and channel so the driver doesn't scan again. The AP and the DHCP lease
+// that worked are cached in RTC memory (kept across resets) and NVS (kept
+// across power cycles); after that a dropped link is rejoined directly with a
+// static IP, no scan and no DHCP, and only falls back to scanning when the
+// cached AP stays away. A cached lease the cloud can't be reached through is
+// dropped and the AP rejoined through DHCP; a link that got its lease from
+// DHCP keeps the cache in step with renewals.
+class WifiLink {
+public:
+    struct Stats {
+        uint32_t attempts = 0;       // WiFi.begin() calls
+        uint32_t scans = 0;
+        uint32_t fastConnects = 0;   // Joins from the cache
+        uint32_t scanConnects = 0;   // Joins after a scan
+        uint32_t reconnects = 0;     // Link recovered after having been up
+        uint32_t staleLeases = 0;    // Cached leases dropped because nothing got through
+        unsigned long lastConnectMs = 0;  // Link down (or boot) to link up
+        unsigned long maxReconnectMs = 0;
+    };
+
+    static void start();    // Spawns the link task on the ESP32
+    static void service();  // Cooperative stepping when there is no RTOS (native build)
+
+    static bool connected() { return state == State::Connected; }
+    static const Stats& getStats() { return stats; }
+    static void forgetCache();  // Next join scans and uses DHCP
+    // From the loop task: whether the cloud answered over the current link
+    static void reportCloud(bool reached);
+
+private:
+    enum class State : uint8_t { Idle, FastConnect, Scanning, Connecting, Connected };
+
+    struct __attribute__((packed)) Cache {
+        uint32_t magic;
+        char ssid[33];
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint32_t ip, gateway, subnet, dns;
+        uint16_t crc;
+    };
+
+    struct Candidate {
+        uint8_t network;    // Index into WIFI_NETWORKS
+        uint8_t bssid[6];
+        int32_t channel;    // 0 = unknown, let the driver scan
+        int32_t rssi;
+    };
+
+    static const uint32_t CACHE_MAGIC = 0x4B4E4957;  // "WINK"
+    static const size_t CACHE_CRC_SPAN;
+    static const uint8_t MAX_CANDIDATES = 8;
+    static const unsigned long FAST_RETRY_MS = 250;      // Between direct rejoin attempts
+    static const unsigned long FAST_WINDOW_MS = 3000;    // Then give up on the cached AP and scan
+    static const unsigned long CONNECT_TIMEOUT_MS = 10000;
+    static const unsigned long SCAN_TIMEOUT_MS = 8000;
+    static const uint8_t STALE_LEASE_FAILURES = 3;      // Cloud failures in a row on a cached lease
+    static const unsigned long LEASE_CHECK_MS = 60000;  // DHCP renewals are looked for this often
+    static const unsigned long TASK_PERIOD_MS = 20;
+    static const uint8_t TASK_CORE = 1;
+    static const uint8_t TASK_PRIORITY = 2;
+    static const uint32_t TASK_STACK = 4096;
+
+    static void step(unsigned long now);
+    static void startFast(unsigned long now);
+    static void joinCached(unsigned long now);
+    static void startScan(unsigned long now);
+    static void rankScan(int16_t found);
+    static void connectCandidate(unsigned long now);
+    static void onConnected(unsigned long now);
+    static void checkLease(unsigned long now);
+    static void rejoinWithDhcp(unsigned long now);
+    static bool cacheValid(const Cache& candidate);
+    static const char* passwordFor(const char* ssid);
+    static void saveCache(const char* ssid);
+#ifndef NATIVE_BUILD
+    static void taskLoop(void* arg);
+#endif
+
+    static State state;
+    static Cache cache;  // In RTC memory on the ESP32
+    static Candidate candidates[MAX_CANDIDATES];
+    static uint8_t candidateCount, nextCandidate;
+    static unsigned long downSince, attemptAt, fastUntil, scanStartedAt, leaseCheckedAt;
+    static bool everConnected;
+    static bool leaseFromCache;  // Current link runs on the cached static lease
+    static std::atomic<uint8_t> cloudFailures;
+    static Stats stats;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include "p2_quantile.h"
+#include "power_readings.h"
+#include "spsc_ring.h"
+
+// Summary of one finished window for one channel: per metric the minimum,
+// maximum, mean, standard deviation and p50/p95, plus the energy counted over
+// the window. This is what goes to the cloud instead of
+// every raw sample.
+struct WindowSummary {
+    enum Metric : uint8_t { Voltage, Current, Power, Frequency, PowerFactor, METRIC_COUNT };
+
+    struct Stats {
+        float min, max, mean, stddev, p50, p95;
+    };
+
+    uint32_t start;      // Window start, aligned to its length (wall-clock seconds)
+    uint8_t window;      // WindowAggregator::Window
+    uint8_t channel;
+    uint16_t count;      // Valid samples in the window
+    float energyWh;
+    Stats metrics[METRIC_COUNT];
+};
+
+// Rolling 1-minute, 15-minute and 1-hour windows over every channel's
+// readings. Each sample updates min/max, a Welford mean/variance and two
+// P-square quantile markers per metric in constant time; memory is fixed
+// (about 2.2 KB per channel). Windows are aligned to multiples of their
+// length, and a sample past the end of a window closes it into a summary.
+// Readings still stamped with uptime (taken before NTP answered) are skipped.
+//
+// min/max/mean/stddev are exact (to float rounding). A minute holds 30
+// samples at the 2 s cycle, too few for P-square to settle, so its samples
+// are kept (up to MINUTE_SAMPLES) and p50/p95 are exact, nearest rank. The
+// 15m and 1h quantiles are P-square estimates: on shuffled data within 0.01
+// in rank after a few hundred samples, but a load that switches in long runs
+// (a compressor cycling every 20 min) drags the markers, and `program
+// --bench aggregate` measures them up to 0.42 off in rank and ~30% off the
+// true value. Peaks are carried by max, which is exact.
+class WindowAggregator {
+public:
+    enum Window : uint8_t { Minute, Quarter, Hour, WINDOW_COUNT };
+    static const uint32_t WINDOW_SECONDS[WINDOW_COUNT];
+    static const char* const WINDOW_NAMES[WINDOW_COUNT];
+
+    static void add(const PowerReadings& readings);
+    static bool pop(WindowSummary& summary);  // Finished windows, oldest first
+
+    static uint32_t pendingCount() { return finished.depth(); }
+    static uint32_t droppedCount() { return finished.overflows(); }
+    static size_t stateBytesPerChannel() { return sizeof(windows[0]) + sizeof(minuteSamples[0]); }
+
+    static const uint16_t MINUTE_SAMPLES = 32;  // Past this a minute falls back to P-square
+
+private:
+    static const size_t QUEUE_CAPACITY = 64;  // An hour boundary on a full bus closes 48
+
+    struct MetricState {
+        float min, max, mean, m2;
+        P2Quantile p50{0.50f};
+        P2Quantile p95{0.95f};
+    };
+
+    struct WindowState {
+        uint32_t start = 0;
+        uint16_t count = 0;
+        bool open = false;
+        bool seenEnergy = false;
+        float firstEnergy = 0, lastEnergy = 0;
+        MetricState metrics[WindowSummary::METRIC_COUNT];
+    };
+
+    static void close(uint8_t channel, uint8_t window);
+    static void accumulate(MetricState& state, float x, uint16_t count);
+    static void exactQuantiles(const float* samples, uint16_t count, float& p50, float& p95);
+
+    static WindowState windows[PowerReadings::MAX_CHANNELS][WINDOW_COUNT];
+    static float minuteSamples[PowerReadings::MAX_CHANNELS][WindowSummary::METRIC_COUNT][MINUTE_SAMPLES];
+    static SpscRing<WindowSummary, QUEUE_CAPACITY> finished;
+};
@@ -0,0 +1,218 @@
+#include "adc_sampler.h"
+#include "hal.h"
+#include "debug_utils.h"
+
+AdcSampler::Channel AdcSampler::channels[MAX_PINS];
+uint8_t AdcSampler::channelCount = 0;
+uint8_t AdcSampler::tappedPins[MAX_PINS];
+uint8_t AdcSampler::tappedCount = 0;
+AdcSampler::Tap AdcSampler::tapSink = nullptr;
+bool AdcSampler::continuous = false;
+std::atomic<bool> AdcSampler::lowPowerRequested{false};
+bool AdcSampler::lowPowerActive = false;
+std::atomic<uint32_t> AdcSampler::conversions{0};
+std::atomic<uint32_t> AdcSampler::blocks{0};
+#ifdef NATIVE_BUILD
+unsigned long AdcSampler::steppedTo = 0;
+#endif
+
+bool AdcSampler::watch(uint8_t pin, uint8_t smoothingShift) {
+    if (find(pin)) return true;
+    if (channelCount + tappedCount >= MAX_PINS) return false;
+    Channel& channel = channels[channelCount++];
+    channel.pin = pin;
+    channel.shift = smoothingShift;
+    channel.sum = 0;
+    channel.n = 0;
+    channel.filled = 0;
+    channel.head = 0;
+    channel.primed.store(false);
+    return true;
+}
+
+bool AdcSampler::tap(uint8_t pin, Tap sink) {
+    if (tapSink && tapSink != sink) return false;
+    tapSink = sink;
+    for (uint8_t i = 0; i < tappedCount; i++) {
+        if (tappedPins[i] == pin) return true;
+    }
+    if (find(pin) || channelCount + tappedCount >= MAX_PINS) return false;
+    tappedPins[tappedCount++] = pin;
+    return true;
+}
+
+void AdcSampler::start() {
+    lowPowerRequested.store(false);
+    lowPowerActive = false;
+    uint8_t pins[MAX_PINS];
+    for (uint8_t i = 0; i < channelCount; i++) pins[i] = channels[i].pin;
+    for (uint8_t i = 0; i < tappedCount; i++) pins[channelCount + i] = tappedPins[i];
+    continuous = Hal::adc().startContinuous(pins, channelCount + tappedCount, SAMPLE_RATE_HZ);
+    DEBUG_PRINTF("ADC sampler: %u filtered + %u tapped pin(s), %s\n", channelCount, tappedCount,
+                 continuous ? "continuous DMA" : "one-shot fallback");
+#ifdef NATIVE_BUILD
+    steppedTo = millis();
+#else
+    xTaskCreatePinnedToCore(taskLoop, "adc", TASK_STACK, nullptr, TASK_PRIORITY, nullptr, TASK_CORE);
+#endif
+}
+
+#ifndef NATIVE_BUILD
+void AdcSampler::taskLoop(void* arg) {
+    (void)arg;
+    for (;;) {
+        applyMode();
+        drain();
+        vTaskDelay(pdMS_TO_TICKS(wakePeriod()));
+    }
+}
+#endif
+
+void AdcSampler::service() {
+#ifdef NATIVE_BUILD
+    // Replay the task's wake-ups since the last call
+    unsigned long now = millis();
+    for (unsigned long t = steppedTo + wakePeriod(); (long)(now - t) >= 0; t = steppedTo + wakePeriod()) {
+        NativeClock::set(t);
+        applyMode();
+        drain();
+        steppedTo = t;
+    }
+    NativeClock::set(now);
+#endif
+}
+
+void AdcSampler::setLowPower(bool enabled) {
+    lowPowerRequested.store(enabled, std::memory_order_relaxed);
+}
+
+// Runs in the task, so the stream is never stopped under a drain
+void AdcSampler::applyMode() {
+    bool wanted = lowPowerRequested.load(std::memory_order_relaxed);
+    if (wanted == lowPowerActive) return;
+    lowPowerActive = wanted;
+    if (wanted) {
+        if (continuous) Hal::adc().stopContinuous();
+        for (uint8_t i = 0; i < channelCount; i++) {
+            channels[i].sum = 0;  // A part block from the stream would mix in
+            channels[i].n = 0;
+        }
+    } else if (continuous) {
+        uint8_t pins[MAX_PINS];
+        for (uint8_t i = 0; i < channelCount; i++) pins[i] = channels[i].pin;
+        for (uint8_t i = 0; i < tappedCount; i++) pins[channelCount + i] = tappedPins[i];
+        if (!Hal::adc().startContinuous(pins, channelCount + tappedCount, SAMPLE_RATE_HZ)) {
+            LOG_WARN("ADC sampler: continuous scan did not restart, one-shot from here on\n");
+            continuous = false;
+        }
+    }
+    DEBUG_PRINTF("ADC sampler: %s\n", wanted ? "low power, one block per second" : "back to full rate");
+}
+
+unsigned long AdcSampler::wakePeriod() {
+    if (lowPowerActive) return LOW_POWER_PERIOD_MS;
+    return continuous ? DRAIN_PERIOD_MS : 1;
+}
+
+void AdcSampler::drain() {
+    if (lowPowerActive) {
+        for (uint8_t i = 0; i < channelCount; i++) {
+            for (uint8_t n = 0; n < OVERSAMPLE; n++) add(channels[i], Hal::adc().readRaw(channels[i].pin));
+        }
+        conversions.fetch_add(channelCount * OVERSAMPLE, std::memory_order_relaxed);
+        return;
+    }
+    if (!continuous) {
+        for (uint8_t i = 0; i < channelCount; i++) add(channels[i], Hal::adc().readRaw(channels[i].pin));
+        conversions.fetch_add(channelCount, std::memory_order_relaxed);
+        return;
+    }
+    AdcSample batch[256];
+    size_t count;
+    while ((count = Hal::adc().readContinuous(batch, sizeof(batch) / sizeof(batch[0]))) > 0) {
+        if (tapSink) tapSink(batch, count);
+        for (size_t i = 0; i < count; i++) {
+            Channel* channel = find(batch[i].pin);
+            if (channel) add(*channel, batch[i].raw);
+        }
+        conversions.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+void AdcSampler::add(Channel& channel, uint16_t raw) {
+    if (channel.n == 0 || raw < channel.low) channel.low = raw;
+    if (channel.n == 0 || raw > channel.high) channel.high = raw;
+    channel.sum += raw;
+    if (++channel.n == OVERSAMPLE) finishBlock(channel);
+}
+
+void AdcSampler::finishBlock(Channel& channel) {
+    // Trimmed mean in 1/16 counts, into the median window
+    uint32_t trimmed = channel.sum - channel.low - channel.high;
+    channel.window[channel.head] = (uint16_t)((trimmed * 16 + (OVERSAMPLE - 2) / 2) / (OVERSAMPLE - 2));
+    channel.head = (channel.head + 1) % MEDIAN_WINDOW;
+    if (channel.filled < MEDIAN_WINDOW) channel.filled++;
+    channel.sum = 0;
+    channel.n = 0;
+
+    uint16_t sorted[MEDIAN_WINDOW];
+    for (uint8_t i = 0; i < channel.filled; i++) {
+        uint16_t v = channel.window[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    int32_t median = (int32_t)sorted[channel.filled / 2] << (FRACTION_BITS - 4);
+
+    if (!channel.primed.load(std::memory_order_relaxed)) {
+        channel.ema = median;  // Valid from the first block instead of ramping up from zero
+    } else {
+        channel.ema += (median - channel.ema) >> channel.shift;
+    }
+    channel.published.store((uint32_t)channel.ema, std::memory_order_relaxed);
+    channel.primed.store(true, std::memory_order_release);
+    blocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+AdcSampler::Channel* AdcSampler::find(uint8_t pin) {
+    for (uint8_t i = 0; i < channelCount; i++) {
+        if (channels[i].pin == pin) return &channels[i];
+    }
+    return nullptr;
+}
+
+bool AdcSampler::ready(uint8_t pin) {
+    Channel* channel = find(pin);
+    return channel && channel->primed.load(std::memory_order_acquire);
+}
+
+float AdcSampler::rawValue(uint8_t pin) {
+    Channel* channel = find(pin);
+    if (!channel) return 0;
+    return channel->published.load(std::memory_order_relaxed) / (float)(1 << FRACTION_BITS);
+}
+
+float AdcSampler::milliVolts(uint8_t pin) {
+    Channel* channel = find(pin);
+    if (!channel) return 0;
+    uint32_t q = channel->published.load(std::memory_order_relaxed);
+    uint32_t raw = q >> FRACTION_BITS;
+    float fraction = (q & ((1 << FRACTION_BITS) - 1)) / (float)(1 << FRACTION_BITS);
+    float low = Hal::adc().rawToMilliVolts(raw);
+    if (raw >= 4095) return low;
+    float high = Hal::adc().rawToMilliVolts(raw + 1);
+    return low + (high - low) * fraction;
+}
+
+AdcSampler::Stats AdcSampler::stats() {
+    Stats s;
+    s.conversions = conversions.load(std::memory_order_relaxed);
+    s.blocks = blocks.load(std::memory_order_relaxed);
+    s.continuous = continuous;
+    return s;
+}
+
+uint32_t AdcSampler::pinRateHz() {
+    uint8_t pins = channelCount + tappedCount;
+    return pins ? SAMPLE_RATE_HZ / pins : 0;
+}
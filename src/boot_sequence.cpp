@@ -0,0 +1,102 @@
+#include "boot_sequence.h"
+#include "system_manager.h"
+#include "firebase_manager.h"
+#include "debug_utils.h"
+#include "hal.h"
+#include "wifi_link.h"
+
+BootSequence::State BootSequence::current = BootSequence::State::WifiConnecting;
+unsigned long BootSequence::timeRequestedAt = 0;
+unsigned long BootSequence::waitingSince = 0;
+bool BootSequence::cloudStarted = false;
+bool BootSequence::onlineEdge = false;
+BootSequence::Metrics BootSequence::bootMetrics;
+
+void BootSequence::begin() {
+    DEBUG_PRINTLN("\n=== Connectivity (background) ===");
+    // SNTP retries on its own, so it is configured before there is a link
+    SystemManager::startTimeSync();
+    timeRequestedAt = millis();
+    WifiLink::start();
+    enter(State::WifiConnecting);
+}
+
+void BootSequence::enter(State next) {
+    current = next;
+    waitingSince = millis();
+    SystemManager::updateWiFiLED(next != State::WifiConnecting);
+}
+
+void BootSequence::service() {
+    WifiLink::service();  // No-op on the ESP32, the link runs as its own task
+    unsigned long now = millis();
+    bool linkUp = WifiLink::connected();
+
+    if (!bootMetrics.timeMs) {
+        if (SystemManager::timeValid()) {
+            bootMetrics.timeMs = now;
+            DEBUG_PRINTLN("Time synchronized successfully");
+        } else if (linkUp && now - timeRequestedAt >= TIME_RESYNC_INTERVAL) {
+            SystemManager::startTimeSync();
+            timeRequestedAt = now;
+        }
+    }
+
+    switch (current) {
+        case State::WifiConnecting:
+            if (linkUp) {
+                if (!bootMetrics.wifiMs) {
+                    bootMetrics.wifiMs = now;
+                    bootMetrics.wifiAttempts = WifiLink::getStats().attempts;
+                }
+                enter(State::Connecting);
+            }
+            break;
+
+        case State::Connecting:
+            if (!linkUp) {
+                LOG_WARN("WiFi lost while connecting");
+                enter(State::WifiConnecting);
+                break;
+            }
+            if (!cloudStarted) {
+                FirebaseManager::begin();
+                cloudStarted = true;
+            }
+            if (!bootMetrics.cloudMs && FirebaseManager::authenticated()) {
+                bootMetrics.cloudMs = now;
+                DEBUG_PRINTLN("Firebase authenticated successfully!");
+            }
+            if (bootMetrics.timeMs && bootMetrics.cloudMs) {
+                if (!bootMetrics.onlineMs) bootMetrics.onlineMs = now;
+                onlineEdge = true;
+                enter(State::Online);
+            } else if (now - waitingSince >= CLOUD_WAIT_MS) {
+                // Neither NTP nor sign-in got through; may be a stale cached lease
+                WifiLink::reportCloud(false);
+                waitingSince = now;
+            }
+            break;
+
+        case State::Online:
+            if (!linkUp) {
+                LOG_WARN("WiFi lost, reconnecting in the background");
+                enter(State::WifiConnecting);
+            }
+            break;
+    }
+}
+
+bool BootSequence::takeOnlineEdge() {
+    bool edge = onlineEdge;
+    onlineEdge = false;
+    return edge;
+}
+
+void BootSequence::markFirstSample() {
+    if (!bootMetrics.firstSampleMs) bootMetrics.firstSampleMs = millis();
+}
+
+void BootSequence::markFirstUpload() {
+    if (!bootMetrics.firstUploadMs) bootMetrics.firstUploadMs = millis();
+}
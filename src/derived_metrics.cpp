@@ -0,0 +1,55 @@
+#include "derived_metrics.h"
+#include <math.h>
+
+const uint32_t DerivedMetrics::REACTIVE_FACTOR_Q16[101] = {
+    65536, 65533, 65523, 65507, 65484, 65454, 65418, 65375,
+    65326, 65270, 65207, 65138, 65062, 64980, 64891, 64795,
+    64692, 64582, 64466, 64342, 64212, 64075, 63930, 63779,
+    63621, 63455, 63282, 63102, 62915, 62720, 62517, 62307,
+    62090, 61865, 61632, 61391, 61142, 60885, 60620, 60347,
+    60065, 59774, 59475, 59168, 58851, 58526, 58191, 57846,
+    57493, 57129, 56756, 56372, 55979, 55574, 55159, 54733,
+    54296, 53847, 53387, 52914, 52429, 51931, 51420, 50895,
+    50356, 49803, 49235, 48651, 48052, 47436, 46802, 46151,
+    45480, 44790, 44080, 43348, 42593, 41815, 41011, 40181,
+    39322, 38432, 37510, 36554, 35559, 34523, 33443, 32313,
+    31128, 29882, 28566, 27172, 25685, 24088, 22359, 20464,
+    18350, 15932, 13041, 9245, 0,
+};
+
+void DerivedMetrics::compute(const MeterSample& sample, PowerReadings& readings) {
+    readings.voltage = sample.voltage * 0.1f;
+    readings.current = sample.current * 0.001f;
+    readings.power = sample.power * 0.1f;
+    readings.frequency = sample.frequency * 0.1f;
+    readings.powerFactor = sample.pf * 0.01f;
+
+    // Apparent and active power on a common 1e-4 VA/W scale, exact in 64 bits
+    int64_t apparent = (int64_t)sample.voltage * sample.current;
+    int64_t active = (int64_t)sample.power * 1000;
+    readings.apparentPower = apparent * 1e-4f;
+
+    readings.reactivePower = sample.pf <= 100
+        ? readings.apparentPower * (REACTIVE_FACTOR_Q16[sample.pf] * (1.0f / 65536))
+        : 0;
+
+    readings.loadImpedance = sample.current > 0 ? (sample.voltage * 100.0f) / sample.current : 0;
+
+    // S^2 - P^2 as (S - P)(S + P): the difference is exact, so a power factor
+    // close to 1 does not lose the distortion term to cancellation
+    if (apparent >= active && active > 0) {
+        float distortion = sqrtf((float)(apparent - active) * (float)(apparent + active));
+        readings.distortionPower = distortion * 1e-4f;
+        setThd(readings, distortion * 100.0f / active);
+    } else {
+        readings.distortionPower = 0;
+        setThd(readings, 0);
+    }
+}
+
+void DerivedMetrics::setThd(PowerReadings& readings, float thd) {
+    readings.thd = thd;
+    readings.powerQuality = thd <= 100
+        ? readings.powerFactor * (1 - thd / 100)
+        : readings.powerFactor;
+}
@@ -0,0 +1,90 @@
+#include "device_commands.h"
+#include "system_manager.h"
+#include "debug_utils.h"
+#include "firebase_manager.h"
+
+const char* DeviceCommands::COMMANDS_PATH = "commands";  // Under the device's node
+
+SpscRing<DeviceCommand, 8> DeviceCommands::queue;
+unsigned long DeviceCommands::lastAttempt = 0;
+uint32_t DeviceCommands::reconnects = 0;
+
+void DeviceCommands::maintain() {
+    Uplink& uplink = FirebaseManager::uplink();
+    if (uplink.commandsConnected()) return;
+    if (!SystemManager::isWiFiConnected() || !uplink.ready()) return;
+
+    unsigned long now = millis();
+    if (lastAttempt != 0 && now - lastAttempt < RETRY_INTERVAL) return;
+    lastAttempt = now;
+
+    DEBUG_PRINTLN("Opening command stream...");
+    if (uplink.subscribeCommands(COMMANDS_PATH, handleEvent)) {
+        reconnects++;
+        DEBUG_PRINTLN("Command stream connected");
+    } else {
+        LOG_WARN("Failed to open command stream: %s\n", uplink.errorReason());
+    }
+}
+
+bool DeviceCommands::poll(DeviceCommand& command) {
+    return queue.pop(command);
+}
+
+bool DeviceCommands::isConnected() {
+    return FirebaseManager::uplink().commandsConnected();
+}
+
+uint32_t DeviceCommands::reconnectCount() {
+    return reconnects;
+}
+
+// The first event after (re)connecting carries the whole node at path "/",
+// later events carry a single child such as "/reset".
+void DeviceCommands::handleEvent(const char* path, const char* data) {
+    if (path[0] == '/' && path[1] == '\0') {
+        char value[16];
+        if (findMember(data, "reset", value, sizeof(value))) handleField("reset", value);
+        if (findMember(data, "updateInterval", value, sizeof(value))) handleField("updateInterval", value);
+        return;
+    }
+    handleField(path[0] == '/' ? path + 1 : path, data);
+}
+
+void DeviceCommands::handleField(const char* key, const char* value) {
+    DeviceCommand command;
+    if (strcmp(key, "reset") == 0) {
+        if (strcmp(value, "true") != 0) return;  // Our own clear echoes back as false
+        command.type = DeviceCommand::ResetEnergy;
+        command.value = 0;
+    } else if (strcmp(key, "updateInterval") == 0) {
+        uint32_t interval = strtoul(value, nullptr, 10);
+        if (interval < MIN_UPDATE_INTERVAL || interval > MAX_UPDATE_INTERVAL) return;
+        command.type = DeviceCommand::SetUpdateInterval;
+        command.value = interval;
+    } else {
+        return;
+    }
+
+    if (!queue.push(command)) {
+        LOG_WARN("Command queue full, dropping command");
+    }
+}
+
+// Looks up a scalar member of a flat JSON object
+bool DeviceCommands::findMember(const char* json, const char* key, char* value, size_t size) {
+    char quoted[24];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    const char* p = strstr(json, quoted);
+    if (!p) return false;
+    p = strchr(p + strlen(quoted), ':');
+    if (!p) return false;
+    p++;
+    while (*p == ' ') p++;
+
+    size_t len = 0;
+    while (p[len] && p[len] != ',' && p[len] != '}' && len < size - 1) len++;
+    memcpy(value, p, len);
+    value[len] = '\0';
+    return len > 0;
+}
@@ -0,0 +1,45 @@
+#include "device_identity.h"
+#include "WiFi.h"
+#include "debug_utils.h"
+#include <time.h>
+
+const char* const DeviceIdentity::DEVICES_PATH = "devices";
+const char* const DeviceIdentity::FLEET_PATH = "fleet";
+
+char DeviceIdentity::deviceId[ID_LENGTH + 1];
+char DeviceIdentity::rootPath[32];
+char DeviceIdentity::fleetPath[32];
+
+// The station MAC is burnt into eFuse, so the id survives reflashing and NVS erases
+void DeviceIdentity::begin() {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(deviceId, sizeof(deviceId), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4],
+             mac[5]);
+    snprintf(rootPath, sizeof(rootPath), "%s/%s", DEVICES_PATH, deviceId);
+    snprintf(fleetPath, sizeof(fleetPath), "%s/%s", FLEET_PATH, deviceId);
+    DEBUG_PRINTF("Device id %s\n", deviceId);
+}
+
+bool DeviceIdentity::path(char* buffer, size_t size, const char* leaf) {
+    int written = snprintf(buffer, size, "%s/%s", rootPath, leaf);
+    return written > 0 && (size_t)written < size;
+}
+
+void DeviceIdentity::channelPath(char* buffer, size_t size, uint8_t channel, const char* leaf) {
+    if (channel == 0) {
+        snprintf(buffer, size, "%s", leaf);
+    } else {
+        snprintf(buffer, size, "channels/%u/%s", channel, leaf);
+    }
+}
+
+// History, events and aggregates are filed by UTC day, so no node grows without
+// bound and a day can be fetched on its own
+void DeviceIdentity::dayBucket(char* buffer, size_t size, uint32_t timestamp) {
+    time_t seconds = timestamp;
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+    snprintf(buffer, size, "%04u%02u%02u", (unsigned)(utc.tm_year + 1900) % 10000, (unsigned)(utc.tm_mon + 1) % 100,
+             (unsigned)utc.tm_mday % 100);
+}
@@ -0,0 +1,107 @@
+#include "energy_account.h"
+#include "debug_utils.h"
+
+EnergyAccount::Channel EnergyAccount::channels[PowerReadings::MAX_CHANNELS];
+EnergyAccount::Stats EnergyAccount::stats[PowerReadings::MAX_CHANNELS];
+
+void EnergyAccount::update(uint8_t channel, const MeterSample& sample, unsigned long now) {
+    Channel& ch = channels[channel];
+    Stats& st = stats[channel];
+
+    unsigned long elapsed = 0;
+    if (!ch.haveCounter) {
+        // First sample, or first after a reset/restore: only take the baseline
+        ch.lastCounterWh = sample.energy;
+        ch.haveCounter = true;
+    } else {
+        elapsed = now - ch.lastSampleMs;
+        // 0.1 W x 1 ms = 1/36 uWh
+        ch.residualMicroWh += (uint64_t)sample.power * elapsed / 36;
+
+        uint32_t delta = counterDelta(ch, st, sample.energy, elapsed);
+        if (delta > 0) {
+            uint64_t stepped = (uint64_t)delta * MICRO_WH_PER_WH;
+            int64_t drift = (int64_t)ch.residualMicroWh - (int64_t)stepped;
+            st.lastDriftMicroWh = drift;
+            if (llabs(drift) > st.maxDriftMicroWh) st.maxDriftMicroWh = llabs(drift);
+            st.counterSteps++;
+
+            ch.counterMicroWh += stepped;
+            ch.residualMicroWh = drift > 0 ? drift : 0;
+        }
+    }
+    // The counter has not ticked, so less than a whole Wh can have passed
+    if (ch.residualMicroWh >= MICRO_WH_PER_WH) ch.residualMicroWh = MICRO_WH_PER_WH - 1;
+    ch.lastSampleMs = now;
+}
+
+// Whole Wh the meter counted since the previous sample, accounting for the
+// counter wrapping or being reset behind our back
+uint32_t EnergyAccount::counterDelta(Channel& ch, Stats& st, uint32_t counterWh, unsigned long elapsedMs) {
+    uint32_t last = ch.lastCounterWh;
+    ch.lastCounterWh = counterWh;
+
+    uint32_t delta;
+    if (counterWh >= last) {
+        delta = counterWh - last;
+    } else if (last >= COUNTER_ROLLOVER_WH - COUNTER_ROLLOVER_WH / 100) {
+        delta = COUNTER_ROLLOVER_WH - last + counterWh;
+        st.rollovers++;
+        DEBUG_PRINTLN("Energy counter rolled over");
+    } else {
+        delta = counterWh;  // Counted up from zero since the reset
+        st.counterResets++;
+        DEBUG_PRINTF("Energy counter reset on the meter (%lu -> %lu Wh)\n",
+                     (unsigned long)last, (unsigned long)counterWh);
+    }
+
+    // Downtime is unknown after a reboot; the counter is trusted across it
+    if (ch.resumed) {
+        if (delta > 0) ch.resumed = false;
+        return delta;
+    }
+
+    // More than full scale for the whole interval (+1 Wh of counter phase) is a glitch
+    uint64_t limitWh = (uint64_t)MAX_POWER_DECIWATTS * elapsedMs / 36000000ULL + 1;
+    if (delta > limitWh) {
+        st.rejected++;
+        DEBUG_PRINTF("Rejected energy counter jump of %lu Wh\n", (unsigned long)delta);
+        return 0;
+    }
+    return delta;
+}
+
+uint64_t EnergyAccount::totalMicroWh(uint8_t channel) {
+    return channels[channel].counterMicroWh + channels[channel].residualMicroWh;
+}
+
+void EnergyAccount::restore(uint8_t channel, double wh) {
+    Channel& ch = channels[channel];
+    ch.counterMicroWh = wh > 0 ? (uint64_t)(wh * MICRO_WH_PER_WH) : 0;
+    ch.residualMicroWh = 0;
+    ch.haveCounter = false;
+    ch.resumed = false;
+}
+
+void EnergyAccount::addOffset(uint8_t channel, double wh) {
+    if (wh > 0) channels[channel].counterMicroWh += (uint64_t)(wh * MICRO_WH_PER_WH);
+}
+
+void EnergyAccount::reset(uint8_t channel) {
+    restore(channel, 0);
+}
+
+EnergyAccount::Snapshot EnergyAccount::snapshot(uint8_t channel) {
+    const Channel& ch = channels[channel];
+    return { ch.counterMicroWh, ch.lastCounterWh, ch.haveCounter };
+}
+
+void EnergyAccount::resume(uint8_t channel, const Snapshot& saved) {
+    Channel& ch = channels[channel];
+    ch.counterMicroWh = saved.baseMicroWh;
+    ch.residualMicroWh = 0;
+    ch.lastCounterWh = saved.counterWh;
+    ch.haveCounter = saved.haveCounter;
+    ch.resumed = saved.haveCounter;
+    ch.lastSampleMs = millis();
+}
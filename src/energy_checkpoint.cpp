@@ -0,0 +1,107 @@
+#include "energy_checkpoint.h"
+#include "crc16.h"
+#include "debug_utils.h"
+
+const char* const EnergyCheckpoint::SLOT_KEYS[2] = { "energy0", "energy1" };
+uint8_t EnergyCheckpoint::channels = 0;
+uint32_t EnergyCheckpoint::sequence = 0;
+unsigned long EnergyCheckpoint::lastSaveMs = 0;
+uint64_t EnergyCheckpoint::savedSum = 0;
+bool EnergyCheckpoint::restoredFromNvs = false;
+EnergyCheckpoint::Stats EnergyCheckpoint::stats;
+
+bool EnergyCheckpoint::readSlot(uint8_t slot, Record& record) {
+    if (Hal::nvs().read(SLOT_KEYS[slot], &record, sizeof(record)) != sizeof(record)) return false;
+    if (record.magic != MAGIC || record.version != VERSION ||
+        crc16(&record, offsetof(Record, crc)) != record.crc) {
+        stats.corruptSlots++;
+        return false;
+    }
+    return true;
+}
+
+bool EnergyCheckpoint::begin(uint8_t channelCount) {
+    unsigned long start = micros();
+    channels = channelCount;
+    restoredFromNvs = false;
+    if (!Hal::nvs().begin()) {
+        DEBUG_PRINTLN("NVS unavailable, energy checkpoints disabled");
+        return false;
+    }
+
+    Record slots[2];
+    bool valid[2] = { readSlot(0, slots[0]), readSlot(1, slots[1]) };
+    int newest = -1;
+    for (int i = 0; i < 2; i++) {
+        if (valid[i] && (newest < 0 || (int32_t)(slots[i].sequence - slots[newest].sequence) > 0)) newest = i;
+    }
+
+    if (newest >= 0) {
+        const Record& record = slots[newest];
+        uint8_t restoredChannels = record.channelCount < channels ? record.channelCount : channels;
+        for (uint8_t ch = 0; ch < restoredChannels; ch++) {
+            EnergyAccount::Snapshot saved = { record.channels[ch].baseMicroWh,
+                                              record.channels[ch].counterWh,
+                                              record.channels[ch].haveCounter != 0 };
+            EnergyAccount::resume(ch, saved);
+        }
+        sequence = record.sequence;
+        restoredFromNvs = true;
+    }
+    savedSum = totalsSum();
+    lastSaveMs = millis();
+    stats.sequence = sequence;
+    stats.restoreMicros = micros() - start;
+    DEBUG_PRINTF("Energy checkpoint: %s (seq %lu, %lu us)\n",
+                 restoredFromNvs ? "restored" : "none found",
+                 (unsigned long)sequence, stats.restoreMicros);
+    return restoredFromNvs;
+}
+
+uint64_t EnergyCheckpoint::totalsSum() {
+    uint64_t sum = 0;
+    for (uint8_t ch = 0; ch < channels; ch++) sum += EnergyAccount::totalMicroWh(ch);
+    return sum;
+}
+
+void EnergyCheckpoint::service(unsigned long now) {
+    if (channels == 0) return;
+    uint64_t sum = totalsSum();
+    if (sum < savedSum) {
+        // A reset must not come back after a reboot; retry at most once a second
+        if (now - lastSaveMs >= 1000) save();
+        return;
+    }
+    if (now - lastSaveMs >= SAVE_INTERVAL_MS && sum - savedSum >= MIN_CHANGE_MICRO_WH) {
+        save();
+    }
+}
+
+bool EnergyCheckpoint::save() {
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.magic = MAGIC;
+    record.sequence = sequence + 1;
+    record.version = VERSION;
+    record.channelCount = channels;
+    for (uint8_t ch = 0; ch < channels; ch++) {
+        EnergyAccount::Snapshot snap = EnergyAccount::snapshot(ch);
+        record.channels[ch].baseMicroWh = snap.baseMicroWh;
+        record.channels[ch].counterWh = snap.counterWh;
+        record.channels[ch].haveCounter = snap.haveCounter;
+    }
+    record.crc = crc16(&record, offsetof(Record, crc));
+
+    lastSaveMs = millis();
+    // Overwrite the older slot; the newest valid copy stays intact meanwhile
+    if (!Hal::nvs().write(SLOT_KEYS[record.sequence % 2], &record, sizeof(record))) {
+        stats.failedSaves++;
+        LOG_WARN("Energy checkpoint write failed");
+        return false;
+    }
+    sequence = record.sequence;
+    savedSum = totalsSum();
+    stats.saves++;
+    stats.sequence = sequence;
+    return true;
+}
@@ -0,0 +1,166 @@
+#include "event_detector.h"
+#include <math.h>
+#include "debug_utils.h"
+
+const float EventDetector::DRIFT_SIGMAS = 1.5f;
+const float EventDetector::THRESHOLD_SIGMAS = 6.0f;
+const float EventDetector::STEP_SIGMAS = 3.0f;
+const float EventDetector::MIN_STEP_W = 15.0f;
+const float EventDetector::MIN_SIGMA_W = 0.5f;          // Quantisation of the 0.1 W register
+const float EventDetector::MIN_SIGMA_FRACTION = 0.002f;  // And of the load itself
+
+EventDetector::ChannelState EventDetector::channels[PowerReadings::MAX_CHANNELS];
+SpscRing<ApplianceEvent, EventDetector::QUEUE_CAPACITY> EventDetector::events;
+uint32_t EventDetector::sequence = 0;
+uint32_t EventDetector::samples = 0;
+uint32_t EventDetector::emitted = 0;
+uint32_t EventDetector::rejected = 0;
+
+// Baseline smoothing: level, trend (Holt) and noise scale
+static const float LEVEL_GAIN = 1.0f / 8;
+static const float TREND_GAIN = 1.0f / 64;
+static const float NOISE_GAIN = 1.0f / 32;
+static const float SIGNATURE_GAIN = 1.0f / 8;
+static const float NOISE_CLAMP_SIGMAS = 4.0f;  // A step nudges sigma, it doesn't blow it up
+static const float STABLE_FRACTION = 0.01f;    // Settling run tolerance, relative to its mean
+
+float EventDetector::noise(const ChannelState& state) {
+    float floor = fmaxf(MIN_SIGMA_W, MIN_SIGMA_FRACTION * fabsf(state.level));
+    return fmaxf(state.sigma, floor);
+}
+
+void EventDetector::add(uint8_t channel, const PowerReadings& readings, unsigned long now) {
+    if (!readings.isValid || channel >= PowerReadings::MAX_CHANNELS) return;
+    samples++;
+    ChannelState& state = channels[channel];
+    float x = readings.power;
+
+    switch (state.phase) {
+        case Warmup:
+            // Plain running means until the EWMAs have something to start from
+            state.count++;
+            state.level += (x - state.level) / state.count;
+            state.current += (readings.current - state.current) / state.count;
+            state.powerFactor += (readings.powerFactor - state.powerFactor) / state.count;
+            if (state.count > 1) state.sigma += (1.25f * fabsf(x - state.level) - state.sigma) / (state.count - 1);
+            if (state.count >= WARMUP_SAMPLES) {
+                state.phase = Watching;
+                state.trend = 0;
+                state.high = state.low = 0;
+            }
+            break;
+
+        case Watching:
+            watch(state, channel, readings, now);
+            break;
+
+        case Settling:
+            settle(state, readings);
+            break;
+    }
+}
+
+void EventDetector::watch(ChannelState& state, uint8_t channel, const PowerReadings& readings, unsigned long now) {
+    float x = readings.power;
+    float predicted = state.level + state.trend;
+    float e = x - predicted;
+    float sigma = noise(state);
+
+    float clamped = fminf(fabsf(e), NOISE_CLAMP_SIGMAS * sigma);
+    state.sigma += (1.25f * clamped - state.sigma) * NOISE_GAIN;
+
+    if (state.high == 0) state.highStartAt = now;
+    if (state.low == 0) state.lowStartAt = now;
+    float drift = DRIFT_SIGMAS * sigma;
+    state.high = fmaxf(0, state.high + e - drift);
+    state.low = fmaxf(0, state.low - e - drift);
+
+    float threshold = fmaxf(THRESHOLD_SIGMAS * sigma, MIN_STEP_W);
+    if (state.high > threshold || state.low > threshold) {
+        ApplianceEvent& event = state.pending;
+        event.channel = channel;
+        event.atMs = state.high > threshold ? state.highStartAt : state.lowStartAt;
+        event.before.power = predicted;
+        event.before.current = state.current;
+        event.before.powerFactor = state.powerFactor;
+        state.level = predicted;
+        state.phase = Settling;
+        state.count = 0;
+        state.waited = 0;
+        return;
+    }
+
+    if (state.high == 0 && state.low == 0) {
+        state.level = predicted + LEVEL_GAIN * e;
+        state.trend += TREND_GAIN * e;
+        state.current += (readings.current - state.current) * SIGNATURE_GAIN;
+        state.powerFactor += (readings.powerFactor - state.powerFactor) * SIGNATURE_GAIN;
+    } else {
+        state.level = predicted;  // Coast until the sums clear or alarm
+    }
+}
+
+void EventDetector::settle(ChannelState& state, const PowerReadings& readings) {
+    float x = readings.power;
+    state.level += state.trend;
+    state.waited++;
+    if (state.count > 0) {
+        float mean = state.sumPower / state.count;
+        float tolerance = fmaxf(fmaxf(MIN_STEP_W, 4 * noise(state)), STABLE_FRACTION * fabsf(mean));
+        if (fabsf(x - mean) > tolerance) state.count = 0;  // Still moving: start the run again
+    }
+    if (state.count == 0) state.sumPower = state.sumBaseline = state.sumCurrent = state.sumPowerFactor = 0;
+    state.sumPower += x;
+    state.sumBaseline += state.level;
+    state.sumCurrent += readings.current;
+    state.sumPowerFactor += readings.powerFactor;
+    state.count++;
+    if (state.count >= SETTLE_SAMPLES || state.waited >= MAX_SETTLE_SAMPLES) finish(state);
+}
+
+void EventDetector::finish(ChannelState& state) {
+    ApplianceEvent& event = state.pending;
+    event.after.power = state.sumPower / state.count;
+    event.after.current = state.sumCurrent / state.count;
+    event.after.powerFactor = state.sumPowerFactor / state.count;
+    event.deltaPower = (state.sumPower - state.sumBaseline) / state.count;
+
+    float sigma = noise(state);
+    if (fabsf(event.deltaPower) >= fmaxf(MIN_STEP_W, STEP_SIGMAS * sigma)) {
+        event.kind = event.deltaPower > 0 ? ApplianceEvent::On : ApplianceEvent::Off;
+        event.sequence = ++sequence;
+        emitted++;
+        if (!events.push(event)) {
+            LOG_WARN("Event queue full, dropping event %u", (unsigned)event.sequence);
+        }
+    } else {
+        rejected++;
+    }
+
+    // Restart from the new level
+    state.level = event.after.power;
+    state.trend = 0;
+    state.current = event.after.current;
+    state.powerFactor = event.after.powerFactor;
+    state.high = state.low = 0;
+    state.phase = Watching;
+}
+
+bool EventDetector::pop(ApplianceEvent& event) {
+    return events.pop(event);
+}
+
+EventDetector::Stats EventDetector::stats() {
+    Stats s;
+    s.samples = samples;
+    s.events = emitted;
+    s.rejected = rejected;
+    s.dropped = events.overflows();
+    return s;
+}
+
+void EventDetector::reset() {
+    for (ChannelState& state : channels) state = ChannelState();
+    ApplianceEvent event;
+    while (events.pop(event)) {}
+}
@@ -1,221 +1,271 @@
 #include "firebase_manager.h"
 #include "credentials.h"
 #include "debug_utils.h"
+#include "profiling.h"
+#include "energy_account.h"
+#include "sampling_task.h"
+#include "telemetry.h"
+#include "readings_schema.h"
+#include "power_policy.h"
+#include "meter_scheduler.h"
+#include "firebase_uplink.h"
+#include "mqtt_uplink.h"
+#include <time.h>
 
-FirebaseData FirebaseManager::fbdo;
-FirebaseAuth FirebaseManager::auth;
-FirebaseConfig FirebaseManager::config;
-
-const char* FirebaseManager::DEVICE_STATUS_PATH = "/deviceStatus";
-
-bool FirebaseManager::setup() {
-    DEBUG_PRINTLN("Initializing Firebase...");
-    DEBUG_PRINTLN("Initializing Firebase connection...");
-    config.api_key = FIREBASE_API_KEY;
-    config.database_url = FIREBASE_DATABASE_URL;
-    auth.user.email = FIREBASE_USER_EMAIL;
-    auth.user.password = FIREBASE_USER_PASSWORD;
-    
-    Firebase.reconnectWiFi(true);
-    config.token_status_callback = tokenStatusCallback;
-    Firebase.begin(&config, &auth);
-    
-    DEBUG_PRINT("Waiting for Firebase authentication");
-    unsigned long timeout = millis();
-    while (auth.token.uid.empty() && millis() - timeout < 10000) {
-        DEBUG_PRINT(".");
-        delay(1000);
-    }
-    
-    if (!auth.token.uid.empty()) {
-        DEBUG_PRINTLN("\nFirebase authenticated successfully!");
-        syncTime();  // Sync time after successful Firebase connection
-        setupHeartbeat();  // Add this line
-        DEBUG_PRINTLN("Firebase setup complete");
-        return true;
-    }
-    DEBUG_PRINTLN("\nFirebase authentication failed!");
-    return false;
-}
-
-void FirebaseManager::tokenStatusCallback(TokenInfo info) {
-    // Print token status without accessing undefined members
-    DEBUG_PRINT("Token Status: ");
-    switch (info.status) {
-        case token_status_ready:
-            DEBUG_PRINTLN("Token is ready");
-            break;
-        case token_status_error:
-            DEBUG_PRINTLN("Token error");
-            break;
-        case token_status_uninitialized:
-            DEBUG_PRINTLN("Token is not initialized");
-            break;
-        default:
-            DEBUG_PRINTLN("Unknown token status");
-            break;
-    }
+#ifdef MQTT_BROKER_URI
+Uplink* FirebaseManager::active = &mqttUplink;
+#else
+Uplink* FirebaseManager::active = &firebaseUplink;
+#endif
+char FirebaseManager::jsonBuffer[512];
+
+void FirebaseManager::setUplink(Uplink* uplink) {
+    active = uplink;
+}
+
+// Sign-in or the broker connection completes in the background; BootSequence watches for it
+void FirebaseManager::begin() {
+    DEBUG_PRINTF("Initializing %s uplink...\n", active->name());
+    active->begin();
+}
+
+bool FirebaseManager::authenticated() {
+    return active->authenticated();
 }
 
-void FirebaseManager::syncTime() {
-    DEBUG_PRINT("Synchronizing time with NTP...");
-    
-    // Set the correct timezone for India (IST, UTC+5:30)
-    setenv("TZ", "IST-5:30", 1);  
-    tzset();
+void FirebaseManager::onAuthenticated() {
+    registerDevice();
+    DEBUG_PRINTF("%s setup complete\n", active->name());
+}
 
-    // Sync time from NTP server
-    configTime(0, 0, "pool.ntp.org");
+bool FirebaseManager::ready() {
+    return active->ready();
+}
 
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-        DEBUG_PRINTF("\nTime synchronized: %02d:%02d:%02d\n",
-                      timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+void FirebaseManager::service() {
+    active->service();
+}
+
+// The unit's entry in the fleet index, field by field so those the app adds
+// (a label, say) stay
+void FirebaseManager::registerDevice() {
+    DEBUG_PRINTLN("Registering in the fleet index...");
+    char path[48];
+    char value[32];
+    active->beginCycle(true);
+    snprintf(path, sizeof(path), "%s/build", DeviceIdentity::fleet());
+    snprintf(value, sizeof(value), "\"%s %s\"", __DATE__, __TIME__);
+    active->publishStatus(path, value, false);
+    snprintf(path, sizeof(path), "%s/channels", DeviceIdentity::fleet());
+    snprintf(value, sizeof(value), "%u", (unsigned)MeterScheduler::channelCount());
+    active->publishStatus(path, value, false);
+    queueHeartbeat();
+    if (active->commitCycle()) {
+        DEBUG_PRINTF("Registered as %s\n", DeviceIdentity::id());
     } else {
-        DEBUG_PRINTLN("\nFailed to sync time!");
+        LOG_WARN("Failed to register in the fleet index: %s\n", active->errorReason());
     }
 }
 
-bool FirebaseManager::updateReadings(const PowerReadings& readings) {
-    DEBUG_PRINTLN("Updating Firebase readings...");
-    // Remove the isValid check to allow zero values
-    // if (!readings.isValid) return false;
-    
-    // Only validate for NaN, not zero values
-    if (isnan(readings.voltage) || isnan(readings.current) || 
-        isnan(readings.power) || isnan(readings.frequency) ||
-        isnan(readings.powerFactor) || isnan(readings.thd) ||
-        isnan(readings.powerQuality)) {
-        DEBUG_PRINTLN("Error: Invalid readings detected (NaN values)");
-        return false;
+// The local checkpoint is authoritative; the cloud copy only seeds a device
+// that has none (first boot, erased NVS) and is otherwise just compared
+bool FirebaseManager::reconcileSavedEnergy(uint8_t channelCount, bool restoredLocally) {
+    DEBUG_PRINTLN("Reconciling energy with Firebase...");
+    bool seeded = false;
+    for (uint8_t channel = 0; channel < channelCount; channel++) {
+        float cloudEnergy = 0;
+        char leaf[40];
+        DeviceIdentity::channelPath(leaf, sizeof(leaf), channel, "readings/energy");
+        if (!active->readFloat(leaf, &cloudEnergy) || cloudEnergy < 0) continue;
+
+        if (restoredLocally) {
+            DEBUG_PRINTF("Channel %u: local %.2f Wh, cloud %.2f Wh\n",
+                         channel, EnergyAccount::totalWh(channel), cloudEnergy);
+        } else {
+            SamplingTask::seedEnergy(channel, cloudEnergy);
+            DEBUG_PRINTF("Seeded channel %u from cloud: %.2f Wh\n", channel, cloudEnergy);
+            seeded = true;
+        }
     }
+    DEBUG_PRINTLN("Firebase energy reconciliation complete");
+    return seeded;
+}
 
-    DEBUG_PRINTLN("\n=== Updating Readings ===");
-    DEBUG_PRINTF("Voltage: %.2fV\n", readings.voltage);
-    DEBUG_PRINTF("Current: %.2fA\n", readings.current);
-    DEBUG_PRINTF("Power: %.2fW\n", readings.power);
-    DEBUG_PRINTF("Energy: %.2fWh\n", readings.energy);
-    DEBUG_PRINTF("Frequency: %.2fHz\n", readings.frequency);
-    DEBUG_PRINTF("Power Factor: %.2f\n", readings.powerFactor);
-    DEBUG_PRINTF("Apparent Power: %.2fVA\n", readings.apparentPower);
-    DEBUG_PRINTF("Reactive Power: %.2fVAR\n", readings.reactivePower);
-    DEBUG_PRINTF("THD: %.2f%%\n", readings.thd);
-    DEBUG_PRINTF("Power Quality: %.2f\n", readings.powerQuality);
-
-    FirebaseJson jsonData;
-    
-    // Get current time
-    time_t now;
-    time(&now);
-    jsonData.set("timestamp", (int)now);  // Unix timestamp in seconds
-
-    // Add isCharging status along with other readings
-    jsonData.set("isCharging", readings.isCharging);
-
-    // Always send values, even if they're zero
-    jsonData.set("voltage", readings.voltage);
-    jsonData.set("current", readings.current);
-    jsonData.set("power", readings.power);
-    jsonData.set("energy", PowerReadings::accumulatedEnergy);  // Use the static member
-    jsonData.set("frequency", readings.frequency);
-    jsonData.set("powerFactor", readings.powerFactor);
-    jsonData.set("apparentPower", readings.apparentPower);
-    jsonData.set("reactivePower", readings.reactivePower);
-    jsonData.set("loadImpedance", readings.loadImpedance);
-    jsonData.set("distortionPower", readings.distortionPower);
-    jsonData.set("thd", readings.thd);
-    jsonData.set("powerQuality", readings.powerQuality);
-    
-    bool success = Firebase.RTDB.setJSON(&fbdo, "/readings", &jsonData);
-    if (success) {
-        DEBUG_PRINTLN("Readings updated successfully");
-    } else {
-        DEBUG_PRINTF("Failed to update readings: %s\n", fbdo.errorReason().c_str());
+void FirebaseManager::beginCycle(bool fleet) {
+    active->beginCycle(fleet);
+}
+
+bool FirebaseManager::queueReadings(const PowerReadings& readings) {
+    PROFILE_STAGE(LoopStage::Readings);
+    if (ReadingsSchema::hasNaN(readings)) {
+        LOG_WARN("Error: Invalid readings detected (NaN values)");
+        Telemetry::count(Telemetry::ReadingsRejected);
+        return false;
     }
-    DEBUG_PRINTLN("Firebase update complete");
-    return success;
+    return active->publishReadings(readings);
 }
 
-bool FirebaseManager::updateBattery(uint8_t level) {
-    DEBUG_PRINTLN("Updating Firebase battery level...");
-    DEBUG_PRINTF("Updating battery level: %d%%\n", level);
-    bool success = Firebase.RTDB.setInt(&fbdo, "battery", level);
-    if (!success) {
-        DEBUG_PRINTF("Failed to update battery: %s\n", fbdo.errorReason().c_str());
+// Compact form: per metric [min, max, mean, stddev, p50, p95]
+bool FirebaseManager::queueSummary(const WindowSummary& summary) {
+    static const char* const KEYS[WindowSummary::METRIC_COUNT] = { "v", "i", "p", "f", "pf" };
+    static const uint8_t DECIMALS[WindowSummary::METRIC_COUNT] = { 1, 3, 1, 2, 3 };
+    char day[16];
+    DeviceIdentity::dayBucket(day, sizeof(day), summary.start);
+    char leaf[48];
+    snprintf(leaf, sizeof(leaf), "aggregates/%s/%s/%lu", WindowAggregator::WINDOW_NAMES[summary.window], day,
+             (unsigned long)summary.start);
+    char path[64];
+    DeviceIdentity::channelPath(path, sizeof(path), summary.channel, leaf);
+
+    // Numbers go through the schema's formatter: printf's %f allocates on newlib
+    size_t length = snprintf(jsonBuffer, sizeof(jsonBuffer), "{\"n\":%u,\"e\":", (unsigned)summary.count);
+    length += ReadingsSchema::formatFloat(jsonBuffer + length, summary.energyWh, 3);
+    for (uint8_t m = 0; m < WindowSummary::METRIC_COUNT; m++) {
+        const WindowSummary::Stats& s = summary.metrics[m];
+        const float values[] = { s.min, s.max, s.mean, s.stddev, s.p50, s.p95 };
+        if (length + 8 > sizeof(jsonBuffer)) return false;
+        length += snprintf(jsonBuffer + length, sizeof(jsonBuffer) - length, ",\"%s\":[", KEYS[m]);
+        for (size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+            if (length + ReadingsSchema::MAX_NUMBER_LENGTH + 4 > sizeof(jsonBuffer)) return false;
+            if (v) jsonBuffer[length++] = ',';
+            length += ReadingsSchema::formatFloat(jsonBuffer + length, values[v], DECIMALS[m]);
+        }
+        jsonBuffer[length++] = ']';
     }
-    DEBUG_PRINTLN("Firebase battery update complete");
-    return success;
+    jsonBuffer[length++] = '}';
+    jsonBuffer[length] = '\0';
+    return active->publishStatus(path, jsonBuffer);
 }
 
-bool FirebaseManager::checkResetFlag() {
-    DEBUG_PRINTLN("Checking Firebase reset flag...");
-    bool resetEnergy = false;
-    if (Firebase.RTDB.getBool(&fbdo, "reset", &resetEnergy)) {
-        if (resetEnergy) {
-            DEBUG_PRINTLN("Reset flag detected!");
-            // Return true so main loop can reset PZEM first
-            DEBUG_PRINTLN("Firebase reset flag detected");
-            return true;
-            // Don't set reset flag to false here - it will be done after PZEM reset
+// {"f":Hz,"thdV":%,"thdI":%,"v":[3rd..15th],"i":[3rd..15th]}, % of fundamental
+bool FirebaseManager::queueHarmonics(const HarmonicSpectrum& spectrum) {
+    size_t length = snprintf(jsonBuffer, sizeof(jsonBuffer), "{\"block\":%lu,\"f\":", (unsigned long)spectrum.block);
+    length += ReadingsSchema::formatFloat(jsonBuffer + length, spectrum.fundamentalHz, 2);
+    length += snprintf(jsonBuffer + length, sizeof(jsonBuffer) - length, ",\"thdV\":");
+    length += ReadingsSchema::formatFloat(jsonBuffer + length, spectrum.thdVoltage, 2);
+    length += snprintf(jsonBuffer + length, sizeof(jsonBuffer) - length, ",\"thdI\":");
+    length += ReadingsSchema::formatFloat(jsonBuffer + length, spectrum.thdCurrent, 2);
+    const char* const KEYS[] = { "v", "i" };
+    const float* const ORDERS[] = { spectrum.voltage, spectrum.current };
+    for (uint8_t s = 0; s < 2; s++) {
+        length += snprintf(jsonBuffer + length, sizeof(jsonBuffer) - length, ",\"%s\":[", KEYS[s]);
+        for (uint8_t h = 0; h < HarmonicSpectrum::ORDERS; h++) {
+            if (length + ReadingsSchema::MAX_NUMBER_LENGTH + 4 > sizeof(jsonBuffer)) return false;
+            if (h) jsonBuffer[length++] = ',';
+            length += ReadingsSchema::formatFloat(jsonBuffer + length, ORDERS[s][h], 2);
         }
-    } else {
-        DEBUG_PRINTF("Failed to check reset flag: %s\n", fbdo.errorReason().c_str());
+        jsonBuffer[length++] = ']';
     }
-    DEBUG_PRINTLN("Firebase reset flag check complete");
-    return false;
+    jsonBuffer[length++] = '}';
+    jsonBuffer[length] = '\0';
+    return active->publishStatus("harmonics", jsonBuffer);
 }
 
-// Add new method to clear reset flag
-bool FirebaseManager::clearResetFlag() {
-    DEBUG_PRINTLN("Clearing Firebase reset flag...");
-    DEBUG_PRINTLN("Clearing reset flag...");
-    bool success = Firebase.RTDB.setBool(&fbdo, "reset", false);
-    if (success) {
-        DEBUG_PRINTLN("Reset flag cleared successfully");
-    } else {
-        DEBUG_PRINTF("Failed to clear reset flag: %s\n", fbdo.errorReason().c_str());
+bool FirebaseManager::pushEvent(const ApplianceEvent& event, uint32_t timestamp) {
+    char day[16];
+    DeviceIdentity::dayBucket(day, sizeof(day), timestamp);
+    char path[48];
+    snprintf(path, sizeof(path), "events/%s/%lu_%lu", day, (unsigned long)timestamp, (unsigned long)event.sequence);
+    size_t length = snprintf(jsonBuffer, sizeof(jsonBuffer), "{\"t\":%lu,\"ch\":%u,\"kind\":\"%s\",\"dP\":",
+                             (unsigned long)timestamp, (unsigned)event.channel,
+                             event.kind == ApplianceEvent::On ? "on" : "off");
+    length += ReadingsSchema::formatFloat(jsonBuffer + length, event.deltaPower, 1);
+    const char* const KEYS[] = { "before", "after" };
+    const ApplianceEvent::Signature* const SIGNATURES[] = { &event.before, &event.after };
+    for (uint8_t s = 0; s < 2; s++) {
+        length += snprintf(jsonBuffer + length, sizeof(jsonBuffer) - length, ",\"%s\":{\"p\":", KEYS[s]);
+        length += ReadingsSchema::formatFloat(jsonBuffer + length, SIGNATURES[s]->power, 1);
+        length += snprintf(jsonBuffer + length, sizeof(jsonBuffer) - length, ",\"i\":");
+        length += ReadingsSchema::formatFloat(jsonBuffer + length, SIGNATURES[s]->current, 3);
+        length += snprintf(jsonBuffer + length, sizeof(jsonBuffer) - length, ",\"pf\":");
+        length += ReadingsSchema::formatFloat(jsonBuffer + length, SIGNATURES[s]->powerFactor, 2);
+        jsonBuffer[length++] = '}';
     }
-    DEBUG_PRINTLN("Firebase reset flag clear complete");
+    jsonBuffer[length++] = '}';
+    jsonBuffer[length] = '\0';
+
+    bool success = active->publish(path, jsonBuffer);
+    if (!success) LOG_WARN("Failed to push event %u: %s\n", (unsigned)event.sequence, active->errorReason());
     return success;
 }
 
-void FirebaseManager::setupHeartbeat() {
-    DEBUG_PRINTLN("Setting up Firebase heartbeat...");
-    // Only set initial lastSeen timestamp
-    FirebaseJson statusData;
-    statusData.set("lastSeen", (int)time(nullptr));
-    
-    // Set initial timestamp
-    if (Firebase.RTDB.setJSON(&fbdo, DEVICE_STATUS_PATH, &statusData)) {
-        DEBUG_PRINTLN("Initial heartbeat timestamp set successfully");
+bool FirebaseManager::queueBattery(uint8_t level) {
+    char value[8];
+    snprintf(value, sizeof(value), "%u", level);
+    return active->publishStatus("battery", value);
+}
+
+// Acknowledges a reset pushed over the command stream
+bool FirebaseManager::queueResetClear() {
+    return active->publishStatus("commands/reset", "false");
+}
+
+bool FirebaseManager::queueBootMetrics(const BootSequence::Metrics& metrics) {
+    char value[192];
+    snprintf(value, sizeof(value),
+             "{\"firstSampleMs\":%lu,\"wifiMs\":%lu,\"timeMs\":%lu,\"cloudMs\":%lu,"
+             "\"onlineMs\":%lu,\"firstUploadMs\":%lu,\"wifiAttempts\":%u}",
+             metrics.firstSampleMs, metrics.wifiMs, metrics.timeMs, metrics.cloudMs,
+             metrics.onlineMs, metrics.firstUploadMs, (unsigned)metrics.wifiAttempts);
+    return active->publishStatus("deviceStatus/boot", value);
+}
+
+bool FirebaseManager::queueWifiStats(const WifiLink::Stats& stats) {
+    char value[208];
+    snprintf(value, sizeof(value),
+             "{\"rssi\":%d,\"reconnects\":%u,\"lastConnectMs\":%lu,\"maxReconnectMs\":%lu,"
+             "\"fastConnects\":%u,\"scans\":%u,\"staleLeases\":%u}",
+             (int)WiFi.RSSI(), (unsigned)stats.reconnects, stats.lastConnectMs, stats.maxReconnectMs,
+             (unsigned)stats.fastConnects, (unsigned)stats.scans, (unsigned)stats.staleLeases);
+    return active->publishStatus("deviceStatus/wifi", value);
+}
+
+bool FirebaseManager::queueTelemetry() {
+    static char value[TELEMETRY_BYTES];
+    if (Telemetry::format(value, sizeof(value)) < 0) return false;
+    return active->publishStatus("deviceStatus/telemetry", value);
+}
+
+bool FirebaseManager::queueJobStats() {
+    static char value[JOB_STATS_BYTES];
+    if (JobScheduler::format(value, sizeof(value)) < 0) return false;
+    return active->publishStatus("deviceStatus/jobs", value);
+}
+
+bool FirebaseManager::queuePower(uint8_t channels, bool lightSleepAvailable) {
+    char value[192];
+    if (PowerPolicy::format(value, sizeof(value), channels, lightSleepAvailable) < 0) return false;
+    return active->publishStatus("deviceStatus/power", value);
+}
+
+bool FirebaseManager::queueHeartbeat() {
+    char value[16];
+    char path[48];
+    snprintf(value, sizeof(value), "%d", (int)time(nullptr));
+    snprintf(path, sizeof(path), "%s/lastSeen", DeviceIdentity::fleet());
+    return active->publishStatus(path, value, false);
+}
+
+bool FirebaseManager::commitCycle() {
+    PROFILE_STAGE(LoopStage::Commit);
+    bool success = active->commitCycle();
+    if (!success) Telemetry::count(Telemetry::UploadFailures);
+    return success;
+}
+
+const FirebaseManager::BatchStats& FirebaseManager::getBatchStats() {
+    return active->stats();
+}
+
+bool FirebaseManager::uploadHistory(const LogRecord* records, size_t count) {
+    if (count == 0) return true;
+    PROFILE_STAGE(LoopStage::Backlog);
+    bool success = active->publishHistory(records, count);
+    if (success) {
+        DEBUG_PRINTF("Uploaded %u backlog records\n", (unsigned)count);
     } else {
-        DEBUG_PRINTF("Failed to set initial heartbeat: %s\n", fbdo.errorReason().c_str());
+        LOG_WARN("Failed to upload backlog: %s\n", active->errorReason());
+        Telemetry::count(Telemetry::HistoryFailures);
     }
-    
-    // No need for onDisconnect handler since we're using timestamp-based status
-    DEBUG_PRINTLN("Firebase heartbeat setup complete");
-}
-
-void FirebaseManager::updateHeartbeat() {
-    DEBUG_PRINTLN("Updating Firebase heartbeat...");
-    FirebaseJson statusData;
-    statusData.set("lastSeen", (int)time(nullptr));
-    Firebase.RTDB.setJSON(&fbdo, "deviceStatus", &statusData);
-    DEBUG_PRINTLN("Firebase heartbeat update complete");
-}
-
-bool FirebaseManager::loadSavedEnergy() {
-    DEBUG_PRINTLN("Loading saved energy from Firebase...");
-    if (Firebase.RTDB.getFloat(&fbdo, "readings/energy")) {
-        float savedEnergy = fbdo.floatData();
-        if (savedEnergy >= 0) {
-            PowerReadings::accumulatedEnergy = savedEnergy;
-            DEBUG_PRINTF("Loaded saved energy: %.2f Wh\n", savedEnergy);
-            DEBUG_PRINTLN("Firebase saved energy load complete");
-            return true;
-        }
-    }
-    DEBUG_PRINTLN("No saved energy found, starting from 0");
-    DEBUG_PRINTLN("Firebase saved energy load complete");
-    return false;
+    return success;
 }
@@ -0,0 +1,188 @@
+#include "firebase_uplink.h"
+#include "debug_utils.h"
+#include "hal.h"
+#include "profiling.h"
+#include "telemetry.h"
+#include "readings_schema.h"
+#include "readings_delta.h"
+
+FirebaseUplink firebaseUplink;
+
+// Sign-in completes in the background; BootSequence watches for it
+void FirebaseUplink::begin() {
+    Hal::cloud().begin();
+}
+
+bool FirebaseUplink::authenticated() {
+    return Hal::cloud().authenticated();
+}
+
+bool FirebaseUplink::ready() {
+    return Hal::cloud().ready();
+}
+
+// ---------------------------------------------------------------------------
+// Batched cycle: every write of one update cycle goes out as a single
+// multi-location update, which RTDB applies atomically.
+// ---------------------------------------------------------------------------
+
+void FirebaseUplink::beginCycle(bool fleet) {
+    fleetCycle = fleet;
+    batchLength = snprintf(batchBuffer, sizeof(batchBuffer), "{");
+    batchEntries = 0;
+    batchUnbatchedBytes = 0;
+}
+
+bool FirebaseUplink::publishStatus(const char* path, const char* json, bool deviceScoped) {
+    if (!deviceScoped && !fleetCycle) return false;  // Outside the node the batch is committed at
+    int written = snprintf(batchBuffer + batchLength, sizeof(batchBuffer) - batchLength,
+                           "%s\"%s%s%s\":%s", batchEntries ? "," : "", fleetCycle && deviceScoped ? DeviceIdentity::root() : "",
+                           fleetCycle && deviceScoped ? "/" : "", path, json);
+    if (written < 0 || batchLength + written >= (int)sizeof(batchBuffer) - 1) {
+        batchBuffer[batchLength] = '\0';  // Drop the partial entry, keep the rest valid
+        LOG_WARN("Batch full, dropping %s\n", path);
+        return false;
+    }
+    batchLength += written;
+    batchEntries++;
+    // What the same write would have cost as its own request
+    batchUnbatchedBytes += REQUEST_OVERHEAD_BYTES + strlen(path) + strlen(json);
+    return true;
+}
+
+bool FirebaseUplink::publishReadings(const PowerReadings& readings) {
+    uint32_t fields = ReadingsDelta::select(readings, millis());
+    if (fields == 0) return true;  // Nothing moved past its deadband
+
+    static_assert(ReadingsSchema::maxJsonLength() < sizeof(readingsJson), "readings no longer fit the buffer");
+    char path[48];
+    DeviceIdentity::channelPath(path, sizeof(path), readings.channel, "readings");
+    size_t pathLength = strlen(path);
+    size_t prefixLength = fleetCycle ? KEY_PREFIX_BYTES : 0;
+    int fullLength = ReadingsSchema::toJson(readings, readingsJson, sizeof(readingsJson));
+
+    // Field by field as "readings/<name>" keys, unless the whole object is no longer
+    char value[ReadingsSchema::MAX_NUMBER_LENGTH + 1];
+    size_t deltaLength = 0;
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        if (!(fields & (1UL << i))) continue;
+        deltaLength += prefixLength + pathLength + strlen(READINGS_SCHEMA[i].name) + 5 +
+                       ReadingsSchema::formatField(readings, READINGS_SCHEMA[i], value);
+    }
+    if (fields == ReadingsDelta::ALL_FIELDS || deltaLength >= prefixLength + pathLength + fullLength + 3) {
+        if (!publishStatus(path, readingsJson)) return false;
+        ReadingsDelta::stage(readings, ReadingsDelta::ALL_FIELDS, millis());
+        return true;
+    }
+    path[pathLength++] = '/';
+    uint32_t queued = 0;
+    for (size_t i = 0; i < READINGS_FIELD_COUNT && queued != fields; i++) {
+        if (!(fields & (1UL << i))) continue;
+        snprintf(path + pathLength, sizeof(path) - pathLength, "%s", READINGS_SCHEMA[i].name);
+        value[ReadingsSchema::formatField(readings, READINGS_SCHEMA[i], value)] = '\0';
+        if (!publishStatus(path, value)) break;
+        queued |= 1UL << i;
+    }
+    ReadingsDelta::stage(readings, queued, millis());  // Only what is in the batch counts as sent
+    return queued == fields;
+}
+
+bool FirebaseUplink::commitCycle() {
+    reach = Reach::NothingSent;
+    if (batchEntries == 0) return true;
+
+    snprintf(batchBuffer + batchLength, sizeof(batchBuffer) - batchLength, "}");
+    unsigned long started = millis();
+    bool success = Hal::cloud().updateJSON(fleetCycle ? "/" : DeviceIdentity::root(), batchBuffer);
+    Telemetry::record(Telemetry::CloudRtt, millis() - started);
+    reach = success || Hal::cloud().answered() ? Reach::Answered : Reach::Unreachable;
+    if (success) {
+        ReadingsDelta::confirm();
+        uint32_t batchedBytes = REQUEST_OVERHEAD_BYTES + batchLength + 1;
+        batchStats.requestsSaved += batchEntries - 1;
+        if (batchUnbatchedBytes > batchedBytes) {
+            batchStats.bytesSaved += batchUnbatchedBytes - batchedBytes;
+        }
+        batchStats.commits++;
+        DEBUG_PRINTF("Batched %d writes into one update (%d bytes)\n", batchEntries, batchLength + 1);
+    } else {
+        ReadingsDelta::discard();
+        batchStats.failedCommits++;
+        LOG_WARN("Failed to commit batch: %s\n", Hal::cloud().errorReason());
+    }
+    batchEntries = 0;
+    return success;
+}
+
+bool FirebaseUplink::publish(const char* path, const char* json) {
+    char fullPath[96];
+    if (!DeviceIdentity::path(fullPath, sizeof(fullPath), path)) return false;
+    unsigned long started = millis();
+    bool success = Hal::cloud().setJSON(fullPath, json);
+    Telemetry::record(Telemetry::CloudRtt, millis() - started);
+    return success;
+}
+
+// One multi-location update per batch of backlog records: a columnar block
+// per channel, base64, under [channels/<n>/]historyBlocks/<day>/<first timestamp>
+bool FirebaseUplink::publishHistory(const LogRecord* records, size_t count) {
+    uint32_t channels = 0;
+    for (size_t i = 0; i < count; i++) channels |= 1UL << records[i].channel();
+
+    int length = snprintf(historyBuffer, sizeof(historyBuffer), "{");
+    for (uint8_t channel = 0; channel < PowerReadings::MAX_CHANNELS; channel++) {
+        if (!(channels & (1UL << channel))) continue;
+        size_t first = 0;
+        while (records[first].channel() != channel) first++;
+        size_t blockBytes = HistoryCodec::encode(records, count, channel, historyBlock, sizeof(historyBlock));
+
+        char day[16];
+        char key[48];
+        char path[64];
+        DeviceIdentity::dayBucket(day, sizeof(day), records[first].timestamp);
+        snprintf(key, sizeof(key), "historyBlocks/%s/%lu", day, (unsigned long)records[first].timestamp);
+        DeviceIdentity::channelPath(path, sizeof(path), channel, key);
+        int written = snprintf(historyBuffer + length, sizeof(historyBuffer) - length,
+                               "%s\"%s\":\"", length > 1 ? "," : "", path);
+        size_t encoded = 0;
+        if (written > 0 && length + written < (int)sizeof(historyBuffer)) {
+            length += written;
+            encoded = base64Encode(historyBlock, blockBytes, historyBuffer + length,
+                                   sizeof(historyBuffer) - length);
+        }
+        if (blockBytes == 0 || encoded == 0 || length + encoded + 2 >= sizeof(historyBuffer)) {
+            DEBUG_PRINTLN("History batch does not fit the buffer");
+            return false;
+        }
+        length += encoded;
+        historyBuffer[length++] = '"';
+        historyBuffer[length] = '\0';
+    }
+    snprintf(historyBuffer + length, sizeof(historyBuffer) - length, "}");
+
+    unsigned long started = millis();
+    bool success = Hal::cloud().updateJSON(DeviceIdentity::root(), historyBuffer);
+    Telemetry::record(Telemetry::CloudRtt, millis() - started);
+    return success;
+}
+
+bool FirebaseUplink::readFloat(const char* path, float* value) {
+    char fullPath[96];
+    if (!DeviceIdentity::path(fullPath, sizeof(fullPath), path)) return false;
+    return Hal::cloud().getFloat(fullPath, value);
+}
+
+// A persistent RTDB stream on the commands node; the library reconnects it
+bool FirebaseUplink::subscribeCommands(const char* path, CommandCallback callback) {
+    char fullPath[64];
+    if (!DeviceIdentity::path(fullPath, sizeof(fullPath), path)) return false;
+    return Hal::cloud().beginStream(fullPath, callback);
+}
+
+bool FirebaseUplink::commandsConnected() {
+    return Hal::cloud().streamConnected();
+}
+
+const char* FirebaseUplink::errorReason() {
+    return Hal::cloud().errorReason();
+}
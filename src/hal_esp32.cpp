@@ -0,0 +1,628 @@
+#include "hal.h"
+#include "credentials.h"
+#include "debug_utils.h"
+#include <Firebase_ESP_Client.h>
+#include "pzem_meter.h"
+#include <esp_adc_cal.h>
+#include <driver/adc.h>
+#include <esp_partition.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <esp_pm.h>
+#ifdef MQTT_BROKER_URI
+#include <mqtt_client.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// UART1 towards the PZEM-004T
+// ---------------------------------------------------------------------------
+class Esp32UartPort : public SerialPort {
+public:
+    explicit Esp32UartPort(int uart) : serial(uart) {}
+
+    void begin(uint32_t baud) override {
+        serial.begin(baud, SERIAL_8N1, RX_PIN, TX_PIN);
+    }
+    int available() override { return serial.available(); }
+    int read() override { return serial.read(); }
+    size_t write(const uint8_t* data, size_t len) override {
+        return serial.write(data, len);  // Queued in the TX ring, returns immediately
+    }
+
+private:
+    HardwareSerial serial;
+};
+
+// ---------------------------------------------------------------------------
+// ESP32 ADC1 with eFuse calibration
+// ---------------------------------------------------------------------------
+class Esp32AdcBackend : public AdcBackend {
+public:
+    void begin() override {
+        analogReadResolution(12);         // Set ADC resolution to 12 bits (0-4095)
+        analogSetAttenuation(ADC_11db);     // Use 11dB attenuation for full range (0-3.3V)
+
+        // ESP32 ADC Calibration
+        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_12, ADC_WIDTH_BIT_12, 1100, &adcChars);
+    }
+    uint16_t readRaw(uint8_t pin) override { return analogRead(pin); }
+    uint32_t rawToMilliVolts(uint32_t raw) override {
+        return esp_adc_cal_raw_to_voltage(raw, &adcChars);
+    }
+
+    // ADC1 digital controller: conversions land in the driver's DMA ring
+    // (via I2S0 on the ESP32) and are fetched in frames without waiting
+    bool startContinuous(const uint8_t* pins, uint8_t count, uint32_t sampleRateHz) override {
+        if (count == 0 || count > MAX_CONTINUOUS_PINS) return false;
+        adc_digi_pattern_config_t patterns[MAX_CONTINUOUS_PINS];
+        uint16_t mask = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            int8_t channel = digitalPinToAnalogChannel(pins[i]);
+            if (channel < 0 || channel > 7) return false;  // ADC1 only; ADC2 belongs to WiFi
+            channelPins[channel] = pins[i];
+            mask |= 1 << channel;
+            patterns[i].atten = ADC_ATTEN_DB_12;
+            patterns[i].channel = channel;
+            patterns[i].unit = 0;
+            patterns[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        }
+
+        adc_digi_init_config_t init = {};
+        init.max_store_buf_size = DMA_BUFFER_BYTES;
+        init.conv_num_each_intr = FRAME_BYTES;
+        init.adc1_chan_mask = mask;
+        init.adc2_chan_mask = 0;
+        if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+        adc_digi_configuration_t config = {};
+        config.conv_limit_en = true;
+        config.conv_limit_num = 250;
+        config.pattern_num = count;
+        config.adc_pattern = patterns;
+        config.sample_freq_hz = sampleRateHz;
+        config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+        config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+        if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+            adc_digi_deinitialize();
+            return false;
+        }
+        return true;
+    }
+
+    void stopContinuous() override {
+        adc_digi_stop();
+        adc_digi_deinitialize();
+    }
+
+    size_t readContinuous(AdcSample* out, size_t max) override {
+        size_t produced = 0;
+        while (produced + FRAME_BYTES / SOC_ADC_DIGI_RESULT_BYTES <= max) {
+            uint32_t length = 0;
+            if (adc_digi_read_bytes(frame, FRAME_BYTES, &length, 0) != ESP_OK) break;
+            for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+                const adc_digi_output_data_t* result = reinterpret_cast<const adc_digi_output_data_t*>(frame + i);
+                if (result->type1.channel > 7) continue;
+                out[produced].pin = channelPins[result->type1.channel];
+                out[produced].raw = result->type1.data;
+                produced++;
+            }
+        }
+        return produced;
+    }
+
+private:
+    static const uint8_t MAX_CONTINUOUS_PINS = 4;
+    static const uint32_t FRAME_BYTES = 256;
+    static const uint32_t DMA_BUFFER_BYTES = 4 * FRAME_BYTES;
+
+    esp_adc_cal_characteristics_t adcChars;
+    uint8_t channelPins[8] = {};
+    uint8_t frame[FRAME_BYTES];
+};
+
+// ---------------------------------------------------------------------------
+// Firebase Realtime Database via the Firebase ESP Client library
+// ---------------------------------------------------------------------------
+class FirebaseCloudBackend : public CloudBackend {
+public:
+    void begin() override {
+        instance = this;
+        // "https://<name>.firebaseio.com/" -> "<name>.firebaseio.com"
+        const char* url = FIREBASE_DATABASE_URL;
+        const char* scheme = strstr(url, "://");
+        snprintf(host, sizeof(host), "%s", scheme ? scheme + 3 : url);
+        char* slash = strchr(host, '/');
+        if (slash) *slash = '\0';
+        tls.setInsecure();  // As the library connects when no certificate is configured
+
+        config.api_key = FIREBASE_API_KEY;
+        config.database_url = FIREBASE_DATABASE_URL;
+        auth.user.email = FIREBASE_USER_EMAIL;
+        auth.user.password = FIREBASE_USER_PASSWORD;
+
+        Firebase.reconnectWiFi(true);
+        config.token_status_callback = tokenStatusCallback;
+        Firebase.begin(&config, &auth);
+    }
+
+    // The library generates the token from inside ready()
+    bool authenticated() override {
+        Firebase.ready();
+        return !auth.token.uid.empty();
+    }
+
+    bool ready() override { return Firebase.ready(); }
+
+    // The JSON writes every cycle makes skip the library: it only takes a
+    // FirebaseJson, which parses the text into heap nodes on every call.
+    // The body goes out from the caller's buffer over one kept-alive TLS
+    // connection, authenticated with the library's ID token.
+    bool setJSON(const char* path, const char* json) override { return write("PUT", path, json); }
+    bool updateJSON(const char* path, const char* json) override { return write("PATCH", path, json); }
+    bool setInt(const char* path, int value) override {
+        viaLibrary = true;
+        return Firebase.RTDB.setInt(&fbdo, path, value);
+    }
+    bool setBool(const char* path, bool value) override {
+        viaLibrary = true;
+        return Firebase.RTDB.setBool(&fbdo, path, value);
+    }
+    bool getBool(const char* path, bool* value) override {
+        viaLibrary = true;
+        return Firebase.RTDB.getBool(&fbdo, path, value);
+    }
+    bool getFloat(const char* path, float* value) override {
+        viaLibrary = true;
+        if (!Firebase.RTDB.getFloat(&fbdo, path)) return false;
+        *value = fbdo.floatData();
+        return true;
+    }
+    // The library services the stream from its own task and reconnects it
+    // after WiFi drops; streamUp only tracks whether HTTP is currently open.
+    bool beginStream(const char* path, StreamCallback callback) override {
+        streamCallback = callback;
+        if (!Firebase.RTDB.beginStream(&stream, path)) {
+            LOG_WARN("Stream begin error: %s\n", stream.errorReason().c_str());
+            return false;
+        }
+        Firebase.RTDB.setStreamCallback(&stream, onStreamData, onStreamTimeout);
+        streamUp = true;
+        return true;
+    }
+    bool streamConnected() override { return streamUp && stream.httpConnected(); }
+    const char* errorReason() override {
+        if (!viaLibrary && writeError) return writeError;
+        lastError = fbdo.errorReason();
+        return lastError.c_str();
+    }
+    // The library reports connection and socket errors as negative codes
+    bool answered() override { return viaLibrary ? fbdo.httpCode() > 0 : writeAnswered; }
+
+private:
+    static const uint32_t RESPONSE_TIMEOUT_MS = 5000;
+
+    // One request, print=silent so a success is a bodiless 204
+    bool write(const char* method, const char* path, const char* json) {
+        viaLibrary = false;
+        writeError = nullptr;
+        writeAnswered = false;
+        if (!idToken[0]) return fail("no ID token yet");
+        if (!tls.connected()) {
+            tls.stop();
+            if (!tls.connect(host, 443)) return fail("TLS connect failed");
+        }
+        size_t length = strlen(json);
+        int header = snprintf(request, sizeof(request),
+                              "%s /%s.json?auth=%s&print=silent HTTP/1.1\r\nHost: %s\r\n"
+                              "Content-Type: application/json\r\nContent-Length: %u\r\n\r\n",
+                              method, path[0] == '/' ? path + 1 : path, idToken, host, (unsigned)length);
+        if (header <= 0 || (size_t)header >= sizeof(request)) return fail("request header too long");
+        if (tls.write((const uint8_t*)request, header) != (size_t)header ||
+            tls.write((const uint8_t*)json, length) != length) {
+            tls.stop();
+            return fail("send failed");
+        }
+        return readResponse();
+    }
+
+    // Status line and headers, then whatever body there is, so the
+    // connection is ready for the next request
+    bool readResponse() {
+        unsigned long started = millis();
+        int status = 0;
+        long bodyBytes = 0;
+        bool closing = false;
+        char line[128];
+        for (;;) {
+            if (!readLine(line, sizeof(line), started)) {
+                tls.stop();
+                return fail("no response");
+            }
+            if (!line[0]) break;
+            if (!status) {
+                status = strncmp(line, "HTTP/1.", 7) == 0 ? atoi(line + 9) : -1;
+            } else if (!strncasecmp(line, "Content-Length:", 15)) {
+                bodyBytes = atol(line + 15);
+            } else if (!strncasecmp(line, "Connection: close", 17)) {
+                closing = true;
+            }
+        }
+        while (bodyBytes > 0 && millis() - started < RESPONSE_TIMEOUT_MS) {
+            size_t chunk = bodyBytes < (long)sizeof(line) ? (size_t)bodyBytes : sizeof(line);
+            int n = tls.read((uint8_t*)line, chunk);
+            if (n > 0) bodyBytes -= n;
+            else if (!tls.connected()) break;
+            else delay(1);
+        }
+        if (closing || bodyBytes > 0) tls.stop();
+        writeAnswered = status > 0;
+        if (status >= 200 && status < 300) return true;
+        snprintf(statusError, sizeof(statusError), "HTTP %d", status);
+        return fail(statusError);
+    }
+
+    // One line without its CRLF; longer lines are cut to the buffer
+    bool readLine(char* out, size_t size, unsigned long started) {
+        size_t length = 0;
+        while (millis() - started < RESPONSE_TIMEOUT_MS) {
+            int c = tls.read();
+            if (c < 0) {
+                if (!tls.connected()) return false;
+                delay(1);
+                continue;
+            }
+            if (c == '\n') {
+                if (length && out[length - 1] == '\r') length--;
+                out[length] = '\0';
+                return true;
+            }
+            if (length + 1 < size) out[length++] = (char)c;
+        }
+        return false;
+    }
+
+    bool fail(const char* reason) {
+        writeError = reason;
+        LOG_WARN("Firebase write failed: %s\n", reason);
+        return false;
+    }
+
+    static void onStreamData(FirebaseStream data) {
+        String value = data.dataTypeEnum() == fb_esp_rtdb_data_type_json
+                           ? data.jsonString() : data.stringData();
+        if (instance && instance->streamCallback) {
+            instance->streamCallback(data.dataPath().c_str(), value.c_str());
+        }
+    }
+
+    static void onStreamTimeout(bool timeout) {
+        if (timeout) {
+            DEBUG_PRINTLN("Command stream timed out, resuming...");
+        }
+        if (instance && !instance->stream.httpConnected()) {
+            LOG_WARN("Command stream error %d: %s\n", instance->stream.httpCode(),
+                      instance->stream.errorReason().c_str());
+            instance->streamUp = false;
+        }
+    }
+
+    static void tokenStatusCallback(TokenInfo info) {
+        switch (info.status) {
+            case token_status_ready:
+                LOG_INFO("Token status: ready\n");
+                // Copied once per refresh (hourly) for the writes that skip the library
+                if (instance) {
+                    snprintf(instance->idToken, sizeof(instance->idToken), "%s", Firebase.getToken().c_str());
+                }
+                break;
+            case token_status_error:
+                LOG_WARN("Token status: error\n");
+                break;
+            case token_status_uninitialized:
+                LOG_DEBUG("Token status: not initialized\n");
+                break;
+            default:
+                LOG_DEBUG("Token status: %d\n", (int)info.status);
+                break;
+        }
+    }
+
+    static FirebaseCloudBackend* instance;
+    FirebaseData fbdo;
+    FirebaseData stream;  // Separate connection, the stream keeps it busy
+    FirebaseAuth auth;
+    FirebaseConfig config;
+    WiFiClientSecure tls;  // JSON writes, loop task only
+    char host[96] = "";
+    char idToken[1400] = "";
+    char request[1700];
+    char statusError[16];
+    const char* writeError = nullptr;
+    bool writeAnswered = false;
+    bool viaLibrary = false;  // Which of the two the last request went through
+    String lastError;
+    StreamCallback streamCallback = nullptr;
+    volatile bool streamUp = false;
+};
+
+FirebaseCloudBackend* FirebaseCloudBackend::instance = nullptr;
+
+#ifdef MQTT_BROKER_URI
+// ---------------------------------------------------------------------------
+// MQTT through ESP-IDF's esp-mqtt client, which runs its own task and
+// reconnects on its own. The session is persistent (clean session off), so
+// QoS 1 messages still in the outbox are resent after a reconnect.
+// ---------------------------------------------------------------------------
+class Esp32MqttBackend : public MqttBackend {
+public:
+    static const int MAX_FILTERS = 4;
+    static const int MAX_PENDING = 64;  // QoS 1 messages of one cycle
+
+    void begin(const char* clientId, MessageCallback callback) override {
+        this->callback = callback;
+        esp_mqtt_client_config_t config = {};
+        config.uri = MQTT_BROKER_URI;
+        config.client_id = clientId;
+#ifdef MQTT_USERNAME
+        config.username = MQTT_USERNAME;
+        config.password = MQTT_PASSWORD;
+#endif
+        config.disable_clean_session = true;
+        config.keepalive = 60;
+        client = esp_mqtt_client_init(&config);
+        esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, onEvent, this);
+        esp_mqtt_client_start(client);
+    }
+
+    bool connected() override { return up; }
+
+    // Into the client's outbox; its task sends it. The msg_id of a QoS 1
+    // message is held until its PUBACK (or its expiry from the outbox)
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) override {
+        if (!client) return false;
+        if (qos > 0 && pendingCount() >= MAX_PENDING) {
+            lastError = "too many unacknowledged";
+            return false;
+        }
+        int msgId = esp_mqtt_client_enqueue(client, topic, (const char*)payload, length, qos, retain, true);
+        if (msgId < 0) {
+            lastError = "outbox full";
+            return false;
+        }
+        if (qos > 0) {
+            // The esp-mqtt task may have sent it and had the PUBACK already
+            portENTER_CRITICAL(&pendingLock);
+            int i = 0;
+            while (i < earlyTotal && early[i].msgId != msgId) i++;
+            if (i < earlyTotal) {
+                if (!early[i].delivered) pendingLost = true;
+                early[i] = early[--earlyTotal];
+            } else {
+                pending[pendingTotal++] = msgId;
+            }
+            portEXIT_CRITICAL(&pendingLock);
+        }
+        return true;
+    }
+
+    // Waits for this cycle's messages only: whatever happens, the next cycle
+    // starts from an empty set, so one lost PUBACK cannot fail every later flush
+    bool flush(uint32_t timeoutMs) override {
+        unsigned long started = millis();
+        bool success = true;
+        while (pendingCount() > 0) {
+            if (millis() - started >= timeoutMs) {
+                lastError = up ? "acknowledgement timeout" : "disconnected";
+                success = false;
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        portENTER_CRITICAL(&pendingLock);
+        if (pendingLost) success = false;  // Dropped with a new session or expired: not delivered
+        pendingTotal = 0;
+        pendingLost = false;
+        earlyTotal = 0;  // Every publish of the cycle has been recorded by now
+        portEXIT_CRITICAL(&pendingLock);
+        return success;
+    }
+
+    bool subscribe(const char* filter, uint8_t qos) override {
+        int i = 0;
+        while (i < filterCount && filters[i] != filter) i++;
+        if (i == filterCount && filterCount < MAX_FILTERS) filters[filterCount++] = filter;
+        subscribeQos = qos;
+        return up && esp_mqtt_client_subscribe(client, filter, qos) >= 0;
+    }
+
+    void service() override {}
+    const char* errorReason() override { return lastError; }
+
+private:
+    int pendingCount() {
+        portENTER_CRITICAL(&pendingLock);
+        int count = pendingTotal;
+        portEXIT_CRITICAL(&pendingLock);
+        return count;
+    }
+
+    // On the esp-mqtt task. It sends from the outbox on its own and runs at a
+    // higher priority, so an acknowledgement can arrive before publish() has
+    // recorded the msg_id; it is kept for publish() to find. A lock held
+    // across the enqueue instead would deadlock: events are dispatched under
+    // the client's own lock, which the enqueue also takes.
+    void settle(int msgId, bool delivered) {
+        portENTER_CRITICAL(&pendingLock);
+        int i = 0;
+        while (i < pendingTotal && pending[i] != msgId) i++;
+        if (i < pendingTotal) {
+            pending[i] = pending[--pendingTotal];
+            if (!delivered) pendingLost = true;
+        } else if (earlyTotal < MAX_PENDING) {
+            early[earlyTotal++] = {msgId, delivered};
+        }
+        portEXIT_CRITICAL(&pendingLock);
+    }
+
+    static void onEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+        Esp32MqttBackend* self = static_cast<Esp32MqttBackend*>(arg);
+        esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(data);
+        switch ((esp_mqtt_event_id_t)id) {
+            case MQTT_EVENT_CONNECTED:
+                self->up = true;
+                // The broker kept the subscriptions and in-flight messages if it kept the session
+                if (!event->session_present) {
+                    portENTER_CRITICAL(&self->pendingLock);
+                    if (self->pendingTotal > 0) self->pendingLost = true;
+                    self->pendingTotal = 0;
+                    portEXIT_CRITICAL(&self->pendingLock);
+                    for (int i = 0; i < self->filterCount; i++) {
+                        esp_mqtt_client_subscribe(self->client, self->filters[i].c_str(), self->subscribeQos);
+                    }
+                }
+                break;
+            case MQTT_EVENT_DISCONNECTED:
+                self->up = false;
+                self->lastError = "disconnected";
+                break;
+            case MQTT_EVENT_PUBLISHED:
+                self->settle(event->msg_id, true);
+                break;
+            case MQTT_EVENT_DELETED:  // Expired from the outbox unacknowledged
+                self->settle(event->msg_id, false);
+                break;
+            case MQTT_EVENT_DATA: {
+                if (event->data_len != event->total_data_len) break;  // Commands are never fragmented
+                char topic[96];
+                if (event->topic_len >= (int)sizeof(topic)) break;
+                memcpy(topic, event->topic, event->topic_len);
+                topic[event->topic_len] = '\0';
+                if (self->callback) self->callback(topic, (const uint8_t*)event->data, event->data_len);
+                break;
+            }
+            case MQTT_EVENT_ERROR:
+                self->lastError = event->error_handle->error_type == MQTT_ERROR_TYPE_CONNECTION_REFUSED
+                                      ? "connection refused" : "transport error";
+                break;
+            default:
+                break;
+        }
+    }
+
+    esp_mqtt_client_handle_t client = nullptr;
+    MessageCallback callback = nullptr;
+    String filters[MAX_FILTERS];
+    int filterCount = 0;
+    uint8_t subscribeQos = 1;
+    volatile bool up = false;
+    portMUX_TYPE pendingLock = portMUX_INITIALIZER_UNLOCKED;  // Loop task and esp-mqtt task
+    int pending[MAX_PENDING];  // msg_ids of this cycle not yet acknowledged
+    int pendingTotal = 0;
+    struct Settled {
+        int msgId;
+        bool delivered;
+    };
+    Settled early[MAX_PENDING];  // Acknowledged before publish() recorded them
+    int earlyTotal = 0;
+    bool pendingLost = false;
+    const char* lastError = "";
+};
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Raw access to the default table's "spiffs" data partition, which this
+// firmware does not mount as a filesystem
+// ---------------------------------------------------------------------------
+class PartitionFlashBackend : public FlashBackend {
+public:
+    bool begin() override {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                             ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "spiffs");
+        if (!partition) {
+            DEBUG_PRINTLN("Data partition not found!");
+            return false;
+        }
+        return true;
+    }
+    uint32_t sectorSize() override { return SPI_FLASH_SEC_SIZE; }
+    uint32_t sectorCount() override { return partition ? partition->size / SPI_FLASH_SEC_SIZE : 0; }
+    bool read(uint32_t offset, void* data, size_t len) override {
+        return esp_partition_read(partition, offset, data, len) == ESP_OK;
+    }
+    bool write(uint32_t offset, const void* data, size_t len) override {
+        return esp_partition_write(partition, offset, data, len) == ESP_OK;
+    }
+    bool eraseSector(uint32_t sector) override {
+        return esp_partition_erase_range(partition, sector * SPI_FLASH_SEC_SIZE,
+                                         SPI_FLASH_SEC_SIZE) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* partition = nullptr;
+};
+
+// ---------------------------------------------------------------------------
+// NVS through the core's Preferences wrapper, one namespace for the firmware
+// ---------------------------------------------------------------------------
+class PreferencesNvsBackend : public NvsBackend {
+public:
+    bool begin() override {
+        return prefs.begin("energymon", false);
+    }
+    size_t read(const char* key, void* data, size_t len) override {
+        if (!prefs.isKey(key)) return 0;
+        return prefs.getBytes(key, data, len);
+    }
+    bool write(const char* key, const void* data, size_t len) override {
+        return prefs.putBytes(key, data, len) == len;
+    }
+
+private:
+    Preferences prefs;
+};
+
+// ---------------------------------------------------------------------------
+// WiFi power save and automatic light sleep (needs CONFIG_PM_ENABLE and
+// tickless idle in the SDK build; without them esp_pm_configure() refuses)
+// ---------------------------------------------------------------------------
+class Esp32PowerBackend : public PowerBackend {
+public:
+    bool setModemSleep(bool enabled) override {
+        return WiFi.setSleep(enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+    }
+    bool setLightSleep(bool enabled) override {
+        esp_pm_config_esp32_t config = {};
+        config.max_freq_mhz = 240;
+        config.min_freq_mhz = enabled ? 80 : 240;
+        config.light_sleep_enable = enabled;
+        return esp_pm_configure(&config) == ESP_OK;
+    }
+    void idle(uint32_t ms) override {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+    }
+};
+
+static Esp32UartPort pzemPort(1);  // Serial1
+static PzemMeter pzemMeter(pzemPort);
+static Esp32AdcBackend esp32Adc;
+static FirebaseCloudBackend firebaseCloud;
+#ifdef MQTT_BROKER_URI
+static Esp32MqttBackend esp32Mqtt;
+#endif
+static PartitionFlashBackend partitionFlash;
+static PreferencesNvsBackend preferencesNvs;
+static Esp32PowerBackend esp32Power;
+
+MeterBackend* Hal::meterBackend = &pzemMeter;
+AdcBackend* Hal::adcBackend = &esp32Adc;
+CloudBackend* Hal::cloudBackend = &firebaseCloud;
+#ifdef MQTT_BROKER_URI
+MqttBackend* Hal::mqttBackend = &esp32Mqtt;
+#else
+MqttBackend* Hal::mqttBackend = nullptr;  // Only the MQTT uplink uses it
+#endif
+FlashBackend* Hal::flashBackend = &partitionFlash;
+NvsBackend* Hal::nvsBackend = &preferencesNvs;
+PowerBackend* Hal::powerBackend = &esp32Power;
@@ -0,0 +1,113 @@
+#include "harmonic_analyzer.h"
+#include <math.h>
+
+const HarmonicAnalyzer::Fft HarmonicAnalyzer::fft;
+int16_t HarmonicAnalyzer::window[BLOCK_SAMPLES / 2 + 1];
+HarmonicAnalyzer::Fft::Complex HarmonicAnalyzer::work[BLOCK_SAMPLES];
+
+static const float MIN_FUNDAMENTAL_HZ = 40;
+static const float MAX_FUNDAMENTAL_HZ = 70;
+
+// Mean removed, 12-bit counts scaled by 16 and Hann-windowed: |value| < 2^16
+void HarmonicAnalyzer::prepare(const uint16_t* voltage, const uint16_t* current) {
+    static bool windowReady = false;
+    if (!windowReady) {
+        for (size_t n = 0; n <= BLOCK_SAMPLES / 2; n++) {
+            window[n] = (int16_t)lround((0.5 - 0.5 * cos(2.0 * M_PI * n / BLOCK_SAMPLES)) * 32767.0);
+        }
+        windowReady = true;
+    }
+
+    uint32_t sumV = 0, sumI = 0;
+    for (size_t n = 0; n < BLOCK_SAMPLES; n++) {
+        sumV += voltage[n];
+        sumI += current[n];
+    }
+    int32_t meanV = (int32_t)((sumV + BLOCK_SAMPLES / 2) / BLOCK_SAMPLES);
+    int32_t meanI = (int32_t)((sumI + BLOCK_SAMPLES / 2) / BLOCK_SAMPLES);
+    for (size_t n = 0; n < BLOCK_SAMPLES; n++) {
+        int32_t w = window[n <= BLOCK_SAMPLES / 2 ? n : BLOCK_SAMPLES - n];
+        work[n].re = ((int32_t)voltage[n] - meanV) * w >> 11;
+        work[n].im = ((int32_t)current[n] - meanI) * w >> 11;
+    }
+}
+
+// |2X[k]|^2 of one signal
+float HarmonicAnalyzer::binPower(size_t k, bool ofCurrent) {
+    Fft::Complex v, i;
+    Fft::split(work, k, v, i);
+    const Fft::Complex& x = ofCurrent ? i : v;
+    return (float)x.re * (float)x.re + (float)x.im * (float)x.im;
+}
+
+float HarmonicAnalyzer::lobePower(float center, bool ofCurrent) {
+    long nearest = lroundf(center);
+    long first = nearest - LOBE_BINS;
+    long last = nearest + LOBE_BINS;
+    if (first < 1) first = 1;
+    if (last > (long)BLOCK_SAMPLES / 2 - 1) last = BLOCK_SAMPLES / 2 - 1;
+    float power = 0;
+    for (long k = first; k <= last; k++) power += binPower((size_t)k, ofCurrent);
+    return power;
+}
+
+bool HarmonicAnalyzer::analyze(const uint16_t* voltage, const uint16_t* current, uint32_t sampleRateHz,
+                               HarmonicSpectrum& spectrum) {
+    prepare(voltage, current);
+    fft.transform(work);
+
+    // Lobe power of a tone with peak amplitude A counts: 96 x N^2 x A^2 (the
+    // x16 input scale, the Hann window's sum of squares 3N/8, and split()'s x2)
+    const float powerPerCount2 = 96.0f * BLOCK_SAMPLES * BLOCK_SAMPLES;
+    const float minPower = powerPerCount2 * MIN_FUNDAMENTAL_COUNTS * MIN_FUNDAMENTAL_COUNTS;
+
+    float binHz = (float)sampleRateHz / BLOCK_SAMPLES;
+    size_t lowBin = (size_t)(MIN_FUNDAMENTAL_HZ / binHz);
+    size_t highBin = (size_t)(MAX_FUNDAMENTAL_HZ / binHz) + 1;
+    if (lowBin < 2) lowBin = 2;
+    size_t peak = 0;
+    float peakPower = 0;
+    for (size_t k = lowBin; k <= highBin && k < BLOCK_SAMPLES / 2 - 1; k++) {
+        float p = binPower(k, false);
+        if (p > peakPower) {
+            peakPower = p;
+            peak = k;
+        }
+    }
+    if (!peak) return false;
+
+    // Hann-window interpolation between bins, exact for a single tone
+    float below = sqrtf(binPower(peak - 1, false));
+    float at = sqrtf(peakPower);
+    float above = sqrtf(binPower(peak + 1, false));
+    float fundamentalBin = peak + 2.0f * (above - below) / (below + 2.0f * at + above);
+
+    float fundamentalV = lobePower(fundamentalBin, false);
+    if (fundamentalV < minPower) return false;
+    float fundamentalI = lobePower(fundamentalBin, true);
+    bool currentValid = fundamentalI >= minPower;
+
+    for (uint8_t n = 0; n < HarmonicSpectrum::ORDERS; n++) {
+        spectrum.voltage[n] = 0;  // Orders above Nyquist stay zero
+        spectrum.current[n] = 0;
+    }
+    float distortionV = 0, distortionI = 0;
+    float lastCenter = BLOCK_SAMPLES / 2 - 1 - LOBE_BINS;
+    for (uint8_t h = 2; h <= MAX_THD_ORDER && h * fundamentalBin <= lastCenter; h++) {
+        float pv = lobePower(h * fundamentalBin, false);
+        float pi = lobePower(h * fundamentalBin, true);
+        distortionV += pv;
+        distortionI += pi;
+        if (h >= HarmonicSpectrum::FIRST_ORDER && h <= HarmonicSpectrum::LAST_ORDER) {
+            spectrum.voltage[h - HarmonicSpectrum::FIRST_ORDER] = 100.0f * sqrtf(pv / fundamentalV);
+            spectrum.current[h - HarmonicSpectrum::FIRST_ORDER] =
+                currentValid ? 100.0f * sqrtf(pi / fundamentalI) : 0;
+        }
+    }
+
+    spectrum.fundamentalHz = fundamentalBin * binHz;
+    spectrum.thdVoltage = 100.0f * sqrtf(distortionV / fundamentalV);
+    spectrum.thdCurrent = currentValid ? 100.0f * sqrtf(distortionI / fundamentalI) : 0;
+    spectrum.currentValid = currentValid;
+    return true;
+}
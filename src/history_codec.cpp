@@ -0,0 +1,289 @@
+#include "history_codec.h"
+#include <string.h>
+
+namespace {
+
+const int FLOAT_COLUMNS = 6;
+
+class BitWriter {
+public:
+    BitWriter(uint8_t* out, size_t capacity) : out(out), capacity(capacity) {}
+
+    void write(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            if (used == capacity) {
+                overflow = true;
+                return;
+            }
+            if (value & (1UL << i)) out[used] |= 0x80 >> bit;
+            if (++bit == 8) {
+                bit = 0;
+                used++;
+                if (used < capacity) out[used] = 0;
+            }
+        }
+    }
+
+    // Bytes in use including a partial last byte; 0 after an overflow
+    size_t finish() const { return overflow ? 0 : used + (bit ? 1 : 0); }
+
+private:
+    uint8_t* out;
+    size_t capacity;
+    size_t used = 0;
+    int bit = 0;
+    bool overflow = false;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t length) : data(data), length(length) {}
+
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; i++) {
+            if (pos >= length * 8) {
+                overrun = true;
+                return 0;
+            }
+            value = (value << 1) | ((data[pos / 8] >> (7 - pos % 8)) & 1);
+            pos++;
+        }
+        return value;
+    }
+
+    bool overrun = false;
+
+private:
+    const uint8_t* data;
+    size_t length;
+    size_t pos = 0;
+};
+
+uint32_t floatBits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+float bitsFloat(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Column order on the wire. Fields are copied by value: LogRecord is packed.
+float columnValue(const LogRecord& r, int column) {
+    switch (column) {
+        case 0: return r.voltage;
+        case 1: return r.current;
+        case 2: return r.power;
+        case 3: return r.energy;
+        case 4: return r.frequency;
+        default: return r.powerFactor;
+    }
+}
+
+void setColumn(LogRecord& r, int column, float value) {
+    switch (column) {
+        case 0: r.voltage = value; break;
+        case 1: r.current = value; break;
+        case 2: r.power = value; break;
+        case 3: r.energy = value; break;
+        case 4: r.frequency = value; break;
+        default: r.powerFactor = value; break;
+    }
+}
+
+// Delta-of-delta buckets: prefix, prefix length, value bits
+struct DodBucket {
+    uint32_t prefix;
+    int prefixBits;
+    int valueBits;
+};
+const DodBucket DOD_BUCKETS[] = { { 0x2, 2, 7 }, { 0x6, 3, 9 }, { 0xE, 4, 12 } };
+
+void writeDod(BitWriter& w, int32_t dod) {
+    if (dod == 0) {
+        w.write(0, 1);
+        return;
+    }
+    for (const DodBucket& b : DOD_BUCKETS) {
+        int32_t half = 1 << (b.valueBits - 1);
+        if (dod >= -half + 1 && dod <= half) {
+            w.write(b.prefix, b.prefixBits);
+            w.write((uint32_t)(dod + half - 1), b.valueBits);
+            return;
+        }
+    }
+    w.write(0xF, 4);
+    w.write((uint32_t)dod, 32);
+}
+
+int32_t readDod(BitReader& r) {
+    if (!r.read(1)) return 0;
+    for (int i = 1; i < 4; i++) {
+        if (!r.read(1)) {
+            const DodBucket& b = DOD_BUCKETS[i - 1];
+            int32_t half = 1 << (b.valueBits - 1);
+            return (int32_t)r.read(b.valueBits) - half + 1;
+        }
+    }
+    return (int32_t)r.read(32);
+}
+
+// Gorilla XOR coding of one float column
+class XorEncoder {
+public:
+    void write(BitWriter& w, uint32_t value, bool first) {
+        if (first) {
+            w.write(value, 32);
+        } else {
+            uint32_t x = value ^ previous;
+            if (x == 0) {
+                w.write(0, 1);
+            } else {
+                int lead = __builtin_clz(x);
+                int trail = __builtin_ctz(x);
+                if (haveWindow && lead >= leading && trail >= trailing) {
+                    w.write(0x2, 2);
+                    w.write(x >> trailing, 32 - leading - trailing);
+                } else {
+                    int meaningful = 32 - lead - trail;
+                    w.write(0x3, 2);
+                    w.write(lead, 5);
+                    w.write(meaningful - 1, 5);
+                    w.write(x >> trail, meaningful);
+                    leading = lead;
+                    trailing = trail;
+                    haveWindow = true;
+                }
+            }
+        }
+        previous = value;
+    }
+
+    bool read(BitReader& r, uint32_t& value, bool first) {
+        if (first) {
+            previous = r.read(32);
+        } else if (r.read(1)) {
+            if (r.read(1)) {
+                leading = r.read(5);
+                int meaningful = r.read(5) + 1;
+                trailing = 32 - leading - meaningful;
+                if (trailing < 0) return false;
+                haveWindow = true;
+            } else if (!haveWindow) {
+                return false;
+            }
+            int meaningful = 32 - leading - trailing;
+            previous ^= r.read(meaningful) << trailing;
+        }
+        value = previous;
+        return !r.overrun;
+    }
+
+private:
+    uint32_t previous = 0;
+    int leading = 0, trailing = 0;
+    bool haveWindow = false;
+};
+
+}  // namespace
+
+size_t HistoryCodec::encode(const LogRecord* records, size_t count, uint8_t channel,
+                            uint8_t* out, size_t capacity) {
+    size_t matching = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].channel() == channel) matching++;
+    }
+    if (matching == 0 || matching > UINT16_MAX || capacity <= HEADER_BYTES) return 0;
+
+    out[0] = VERSION;
+    out[1] = channel;
+    out[2] = matching & 0xFF;
+    out[3] = matching >> 8;
+    out[HEADER_BYTES] = 0;
+    BitWriter w(out + HEADER_BYTES, capacity - HEADER_BYTES);
+
+    bool first = true;
+    uint32_t lastTimestamp = 0;
+    int32_t lastDelta = 0;
+    for (size_t i = 0; i < count; i++) {
+        const LogRecord& r = records[i];
+        if (r.channel() != channel) continue;
+        if (first) {
+            w.write(r.timestamp, 32);
+        } else {
+            int32_t delta = (int32_t)(r.timestamp - lastTimestamp);
+            writeDod(w, delta - lastDelta);
+            lastDelta = delta;
+        }
+        lastTimestamp = r.timestamp;
+        first = false;
+    }
+
+    first = true;
+    uint8_t lastFlags = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].channel() != channel) continue;
+        uint8_t flags = records[i].flags & 0x0F;
+        if (first) {
+            w.write(flags, 4);
+        } else if (flags == lastFlags) {
+            w.write(0, 1);
+        } else {
+            w.write(1, 1);
+            w.write(flags, 4);
+        }
+        lastFlags = flags;
+        first = false;
+    }
+
+    for (int column = 0; column < FLOAT_COLUMNS; column++) {
+        XorEncoder encoder;
+        first = true;
+        for (size_t i = 0; i < count; i++) {
+            if (records[i].channel() != channel) continue;
+            encoder.write(w, floatBits(columnValue(records[i], column)), first);
+            first = false;
+        }
+    }
+
+    size_t bytes = w.finish();
+    return bytes ? HEADER_BYTES + bytes : 0;
+}
+
+size_t HistoryCodec::decode(const uint8_t* data, size_t length, LogRecord* records, size_t maxRecords) {
+    if (length < HEADER_BYTES || data[0] != VERSION || data[1] >= PowerReadings::MAX_CHANNELS) return 0;
+    uint8_t channel = data[1];
+    size_t count = data[2] | (data[3] << 8);
+    if (count == 0 || count > maxRecords) return 0;
+    BitReader r(data + HEADER_BYTES, length - HEADER_BYTES);
+
+    int32_t delta = 0;
+    for (size_t i = 0; i < count; i++) {
+        memset(&records[i], 0, sizeof(LogRecord));
+        if (i == 0) {
+            records[i].timestamp = r.read(32);
+        } else {
+            delta += readDod(r);
+            records[i].timestamp = records[i - 1].timestamp + delta;
+        }
+    }
+    uint8_t flags = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || r.read(1)) flags = r.read(4);
+        records[i].flags = flags | (channel << LogRecord::CHANNEL_SHIFT);
+        records[i].state = LogRecord::STATE_SENT;
+    }
+    for (int column = 0; column < FLOAT_COLUMNS; column++) {
+        XorEncoder decoder;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bits;
+            if (!decoder.read(r, bits, i == 0)) return 0;
+            setColumn(records[i], column, bitsFloat(bits));
+        }
+    }
+    return r.overrun ? 0 : count;
+}
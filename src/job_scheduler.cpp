@@ -0,0 +1,186 @@
+#include "job_scheduler.h"
+#include "debug_utils.h"
+
+JobScheduler::Entry JobScheduler::jobs[MAX_JOBS];
+uint8_t JobScheduler::wheel[WHEEL_SLOTS];
+uint8_t JobScheduler::count = 0;
+unsigned long JobScheduler::lastTickAt = 0;
+uint32_t JobScheduler::runningLateMs = 0;
+
+void JobScheduler::begin() {
+    for (Entry& entry : jobs) entry = Entry();
+    for (uint8_t& head : wheel) head = NO_JOB;
+    count = 0;
+    lastTickAt = millis();
+    runningLateMs = 0;
+}
+
+uint8_t JobScheduler::add(const char* name, Job job, uint32_t periodMs, uint32_t delayMs, uint32_t deadlineMs) {
+    if (count >= MAX_JOBS || !job || periodMs == 0) {
+        LOG_WARN("Scheduler: cannot add job %s\n", name);
+        return NO_JOB;
+    }
+    uint8_t id = count++;
+    Entry& entry = jobs[id];
+    entry.job = job;
+    entry.dueAt = millis() + delayMs;
+    entry.stats.name = name;
+    entry.stats.periodMs = periodMs;
+    entry.stats.deadlineMs = deadlineMs ? deadlineMs : periodMs;
+    insert(id);
+    return id;
+}
+
+void JobScheduler::setPeriod(uint8_t id, uint32_t periodMs) {
+    if (id >= count || periodMs == 0) return;
+    Entry& entry = jobs[id];
+    if (entry.stats.deadlineMs == entry.stats.periodMs) entry.stats.deadlineMs = periodMs;
+    entry.stats.periodMs = periodMs;
+    unlink(id);
+    entry.dueAt = millis() + periodMs;
+    entry.triggered = false;
+    insert(id);
+}
+
+void JobScheduler::trigger(uint8_t id) {
+    if (id >= count) return;
+    unlink(id);
+    jobs[id].dueAt = millis();
+    jobs[id].triggered = true;
+    insert(id);
+}
+
+// A due time the wheel has already passed goes in the slot it looks at next
+void JobScheduler::insert(uint8_t id) {
+    Entry& entry = jobs[id];
+    if (entry.linked) return;
+    uint16_t slot = (long)(entry.dueAt - lastTickAt) < 0 ? slotOf(lastTickAt) : slotOf(entry.dueAt);
+    entry.next = wheel[slot];
+    wheel[slot] = id;
+    entry.linked = true;
+}
+
+void JobScheduler::unlink(uint8_t id) {
+    Entry& entry = jobs[id];
+    if (!entry.linked) return;
+    for (uint8_t* link = &wheel[slotOf(entry.dueAt)]; *link != NO_JOB; link = &jobs[*link].next) {
+        if (*link == id) {
+            *link = entry.next;
+            entry.linked = false;
+            return;
+        }
+    }
+    // Placed in the catch-up slot rather than its own: look everywhere
+    for (uint8_t& head : wheel) {
+        for (uint8_t* link = &head; *link != NO_JOB; link = &jobs[*link].next) {
+            if (*link == id) {
+                *link = entry.next;
+                entry.linked = false;
+                return;
+            }
+        }
+    }
+}
+
+// Takes the jobs of one slot that are due by now off the wheel
+void JobScheduler::collect(uint16_t slot, unsigned long now, uint8_t* due, uint8_t& dueCount) {
+    uint8_t* link = &wheel[slot];
+    while (*link != NO_JOB) {
+        uint8_t id = *link;
+        Entry& entry = jobs[id];
+        if ((long)(now - entry.dueAt) < 0) {
+            link = &entry.next;  // Later in this tick, or a later revolution
+            continue;
+        }
+        *link = entry.next;
+        entry.linked = false;
+        due[dueCount++] = id;
+    }
+}
+
+void JobScheduler::service() {
+    unsigned long now = millis();
+    uint8_t due[MAX_JOBS];
+    uint8_t dueCount = 0;
+
+    // The slots passed since the last call, the current one included again
+    uint32_t ticks = now / TICK_MS - lastTickAt / TICK_MS;
+    if (ticks >= WHEEL_SLOTS) {
+        for (uint16_t slot = 0; slot < WHEEL_SLOTS; slot++) collect(slot, now, due, dueCount);
+    } else {
+        for (uint32_t t = 0; t <= ticks; t++) collect(slotOf(lastTickAt + t * TICK_MS), now, due, dueCount);
+    }
+    lastTickAt = now;
+    if (dueCount == 0) return;
+
+    // Earliest due first, then in the order the jobs were added
+    for (uint8_t i = 1; i < dueCount; i++) {
+        uint8_t id = due[i];
+        uint8_t j = i;
+        while (j > 0 && ((long)(jobs[due[j - 1]].dueAt - jobs[id].dueAt) > 0 ||
+                         (jobs[due[j - 1]].dueAt == jobs[id].dueAt && due[j - 1] > id))) {
+            due[j] = due[j - 1];
+            j--;
+        }
+        due[j] = id;
+    }
+    for (uint8_t i = 0; i < dueCount; i++) run(due[i]);
+}
+
+void JobScheduler::run(uint8_t id) {
+    Entry& entry = jobs[id];
+    JobStats& stats = entry.stats;
+    unsigned long started = millis();
+    bool triggered = entry.triggered;
+    runningLateMs = triggered ? 0 : started - entry.dueAt;
+    if (runningLateMs > stats.deadlineMs) stats.missed++;
+    if (runningLateMs > stats.maxLateMs) stats.maxLateMs = runningLateMs;
+    stats.totalLateMs += runningLateMs;
+
+    entry.job();
+
+    unsigned long finished = millis();
+    uint32_t ranMs = finished - started;
+    stats.runs++;
+    if (ranMs > stats.maxRunMs) stats.maxRunMs = ranMs;
+    if (ranMs > stats.periodMs) stats.overruns++;
+    runningLateMs = 0;
+    if (entry.linked) return;  // The job rescheduled itself
+
+    // Fixed rate from the due time; periods that have gone by entirely are dropped
+    entry.triggered = false;
+    entry.dueAt = triggered ? started + stats.periodMs : entry.dueAt + stats.periodMs;
+    if ((long)(finished - entry.dueAt) >= 0) {
+        uint32_t behind = (finished - entry.dueAt) / stats.periodMs + 1;
+        stats.skipped += behind;
+        entry.dueAt += behind * stats.periodMs;
+    }
+    insert(id);
+}
+
+uint32_t JobScheduler::msUntilNext() {
+    unsigned long now = millis();
+    uint32_t soonest = UINT32_MAX;
+    for (uint8_t id = 0; id < count; id++) {
+        long wait = (long)(jobs[id].dueAt - now);
+        if (wait <= 0) return 0;
+        if ((uint32_t)wait < soonest) soonest = wait;
+    }
+    return soonest;
+}
+
+int JobScheduler::format(char* buffer, size_t size) {
+    int length = snprintf(buffer, size, "{");
+    for (uint8_t id = 0; id < count && length < (int)size; id++) {
+        const JobStats& s = jobs[id].stats;
+        length += snprintf(buffer + length, size - length,
+                           "%s\"%s\":{\"periodMs\":%u,\"runs\":%u,\"missed\":%u,\"skipped\":%u,\"overruns\":%u,"
+                           "\"lateMeanMs\":%u,\"lateMaxMs\":%u,\"runMaxMs\":%u}",
+                           id ? "," : "", s.name, (unsigned)s.periodMs, (unsigned)s.runs, (unsigned)s.missed,
+                           (unsigned)s.skipped, (unsigned)s.overruns,
+                           (unsigned)(s.runs ? s.totalLateMs / s.runs : 0), (unsigned)s.maxLateMs,
+                           (unsigned)s.maxRunMs);
+    }
+    if (length < (int)size) length += snprintf(buffer + length, size - length, "}");
+    return length < (int)size ? length : -1;
+}
@@ -0,0 +1,217 @@
+#include "logger.h"
+#include "crc16.h"
+
+Logger::Slot Logger::slots[RING_CAPACITY];
+std::atomic<uint32_t> Logger::enqueuePos{0};
+std::atomic<uint32_t> Logger::dequeuePos{0};
+std::atomic<uint32_t> Logger::records{0};
+std::atomic<uint32_t> Logger::dropped{0};
+std::atomic<uint32_t> Logger::maxDepth{0};
+uint32_t Logger::bytesOut = 0;
+#ifdef LOG_OUTPUT_TEXT
+bool Logger::textOutput = true;
+#else
+bool Logger::textOutput = false;
+#endif
+
+static_assert((Logger::RING_CAPACITY & (Logger::RING_CAPACITY - 1)) == 0,
+              "log ring capacity must be a power of two");
+
+void Logger::begin() {
+#ifndef NATIVE_BUILD
+    xTaskCreatePinnedToCore(taskLoop, "logdrain", DRAIN_STACK, nullptr,
+                            DRAIN_PRIORITY, nullptr, DRAIN_CORE);
+#endif
+}
+
+#ifndef NATIVE_BUILD
+void Logger::taskLoop(void* arg) {
+    (void)arg;
+    for (;;) {
+        flush();
+        vTaskDelay(pdMS_TO_TICKS(DRAIN_IDLE_MS));
+    }
+}
+#endif
+
+void Logger::service() {
+#ifdef NATIVE_BUILD
+    flush();
+#endif
+}
+
+void Logger::flush() {
+    Entry entry;
+    while (pop(entry)) emit(entry);
+}
+
+Logger::Slot* Logger::reserve(uint32_t& pos) {
+    pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t index = pos & (RING_CAPACITY - 1);
+        Slot* slot = &slots[index];
+        uint32_t seq = slot->sequence.load(std::memory_order_acquire) + index;
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                uint32_t depth = pos + 1 - dequeuePos.load(std::memory_order_relaxed);
+                if (depth > maxDepth.load(std::memory_order_relaxed)) {
+                    maxDepth.store(depth, std::memory_order_relaxed);
+                }
+                return slot;
+            }
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);  // Full
+            return nullptr;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::commit(Slot* slot, uint32_t pos) {
+    uint32_t index = pos & (RING_CAPACITY - 1);
+    records.fetch_add(1, std::memory_order_relaxed);
+    slot->sequence.store(pos + 1 - index, std::memory_order_release);
+}
+
+bool Logger::pop(Entry& entry) {
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+    uint32_t index = pos & (RING_CAPACITY - 1);
+    Slot* slot = &slots[index];
+    uint32_t seq = slot->sequence.load(std::memory_order_acquire) + index;
+    if (seq != pos + 1) return false;  // Empty, or the writer hasn't committed yet
+    entry = slot->entry;
+    slot->sequence.store(pos + RING_CAPACITY - index, std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+// Frame: sync, length, format id, time, level, args, CRC-16 over length..args
+void Logger::emit(const Entry& entry) {
+    uint8_t frame[4 + 9 + ARG_CAPACITY];
+    size_t len;
+    if (textOutput) {
+        static const char LEVELS[] = "-EWID";
+        int head = snprintf((char*)frame, sizeof(frame), "[%lu] %c ",
+                            (unsigned long)entry.timeMs, LEVELS[entry.level <= 4 ? entry.level : 0]);
+        char text[160];
+        size_t body = format(entry, text, sizeof(text));
+        Serial.write((const char*)frame, head);
+        Serial.write(text, body);
+        len = head + body;
+        if (!body || text[body - 1] != '\n') {
+            Serial.write("\n", 1);
+            len++;
+        }
+    } else {
+        len = 0;
+        frame[len++] = FRAME_SYNC;
+        frame[len++] = (uint8_t)(9 + entry.argBytes);
+        memcpy(frame + len, &entry.formatId, 4);
+        memcpy(frame + len + 4, &entry.timeMs, 4);
+        frame[len + 8] = entry.level;
+        memcpy(frame + len + 9, entry.args, entry.argBytes);
+        len += 9 + entry.argBytes;
+        uint16_t crc = crc16(frame + 1, len - 1);
+        frame[len++] = crc & 0xFF;
+        frame[len++] = crc >> 8;
+        Serial.write((const char*)frame, len);
+    }
+    bytesOut += len;
+}
+
+Logger::Stats Logger::stats() {
+    Stats s;
+    s.records = records.load(std::memory_order_relaxed);
+    s.dropped = dropped.load(std::memory_order_relaxed);
+    s.bytesOut = bytesOut;
+    s.maxDepth = maxDepth.load(std::memory_order_relaxed);
+    return s;
+}
+
+// Walks the format, handing each conversion with its own argument to
+// snprintf after swapping the length modifier for the stored width.
+size_t Logger::format(const Entry& entry, char* out, size_t size) {
+    if (!size) return 0;
+    size_t n = 0;
+    size_t arg = 0;
+    const char* p = entry.format;
+    auto append = [&](int written) {
+        if (written > 0) n += (size_t)written < size - n ? (size_t)written : size - n - 1;
+    };
+
+    while (*p && n + 1 < size) {
+        if (*p != '%') {
+            out[n++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[n++] = '%';
+            p += 2;
+            continue;
+        }
+
+        char spec[16];
+        size_t s = 0;
+        spec[s++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && s < sizeof(spec) - 4) spec[s++] = *p++;
+        while (*p && strchr("hlLzjt", *p)) p++;
+        char conversion = *p ? *p++ : 's';
+
+        if (arg >= entry.argBytes || entry.args[arg] == TAG_TRUNCATED) {
+            append(snprintf(out + n, size - n, "<?>"));
+            continue;
+        }
+        uint8_t tag = entry.args[arg++];
+        const uint8_t* value = entry.args + arg;
+        switch (tag) {
+            case TAG_STRING: {
+                uint8_t len = value[0];
+                char text[ARG_CAPACITY];
+                memcpy(text, value + 1, len);
+                text[len] = '\0';
+                arg += 1 + len;
+                spec[s++] = 's';
+                spec[s] = '\0';
+                append(snprintf(out + n, size - n, spec, text));
+                break;
+            }
+            case TAG_FLOAT: {
+                float f;
+                memcpy(&f, value, 4);
+                arg += 4;
+                spec[s++] = strchr("eEfgG", conversion) ? conversion : 'f';
+                spec[s] = '\0';
+                append(snprintf(out + n, size - n, spec, (double)f));
+                break;
+            }
+            default: {
+                long long v;
+                if (tag == TAG_I32) {
+                    int32_t i;
+                    memcpy(&i, value, 4);
+                    v = i;
+                    arg += 4;
+                } else if (tag == TAG_U32) {
+                    uint32_t u;
+                    memcpy(&u, value, 4);
+                    v = u;
+                    arg += 4;
+                } else {
+                    memcpy(&v, value, 8);
+                    arg += 8;
+                }
+                spec[s++] = 'l';
+                spec[s++] = 'l';
+                spec[s++] = strchr("diouxXc", conversion) ? conversion : 'd';
+                spec[s] = '\0';
+                if (conversion == 'c') append(snprintf(out + n, size - n, "%c", (char)v));
+                else append(snprintf(out + n, size - n, spec, v));
+                break;
+            }
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
@@ -3,86 +3,357 @@
 #include "battery_monitor.h"
 #include "firebase_manager.h"
 #include "power_readings.h"
+#include "sampling_task.h"
+#include "meter_scheduler.h"
+#include "energy_checkpoint.h"
+#include "pzem_meter.h"
+#include "device_commands.h"
+#include "offline_log.h"
+#include "boot_sequence.h"
+#include "wifi_link.h"
+#include "window_aggregator.h"
+#include "telemetry.h"
+#include "adc_sampler.h"
+#include "waveform_capture.h"
+#include "event_detector.h"
+#include "job_scheduler.h"
+#include "power_policy.h"
+#include "device_identity.h"
 #include "debug_utils.h"
 
 unsigned long sendDataPrevMillis = 0;
 bool signupOK = false;
-FirebaseData fbdo;
 
 const unsigned long UPDATE_INTERVAL = 2000;  // 2 seconds in milliseconds
+unsigned long requestedInterval = UPDATE_INTERVAL;  // Can be changed over the command stream
+bool resetClearPending = false;
+
+// Job periods. Battery, heartbeat and telemetry only mark their part due, and
+// it goes out with the next upload cycle
+const unsigned long COMMAND_INTERVAL = 100;
+const unsigned long EVENT_INTERVAL = 100;
+const unsigned long POWER_INTERVAL = 10000;  // Battery level and charger, and the power mode from them
+const unsigned long BATTERY_INTERVAL = 30000;
+const unsigned long HEARTBEAT_INTERVAL = 60000;  // The app counts two missed as offline
+const unsigned long TELEMETRY_INTERVAL = 60000;
+const unsigned long STATUS_INTERVAL = 5000;  // Debug output
+uint8_t uploadJob = JobScheduler::NO_JOB;
+bool flushPending = false;
+bool wifiStatsDue = false;
+bool batteryDue = false;
+bool heartbeatDue = false;
+bool telemetryDue = false;
+bool powerDue = false;
+bool lightSleepAvailable = false;
+uint8_t batteryLevel = 0;
+
+// Store-and-forward capacity: 256 sectors x 127 records, about 18 h at 2 s
+const uint32_t OFFLINE_LOG_SECTORS = 256;
+const int BACKLOG_BATCHES_PER_CYCLE = 4;
+const unsigned long EVENT_RETRY_MS = 1000;
+
+// Modbus addresses of the meters on the RS-485 bus, one channel each. A single
+// meter can be reached on the general address; for several, give each its own
+// address (1..247) first and list them here.
+const uint8_t METER_ADDRESSES[] = { PzemMeter::GENERAL_ADDRESS };
+const uint8_t METER_COUNT = sizeof(METER_ADDRESSES) / sizeof(METER_ADDRESSES[0]);
+
+void scheduleJobs();
 
 void setup() {
     Serial.begin(9600);
+    Logger::begin();  // Everything below is formatted and written off the caller's thread
     DEBUG_PRINTLN("\n=== ESP32 Energy Monitor Starting (Debug Mode) ===\n");
     
     SystemManager::setupPZEM();
+    MeterScheduler::begin(METER_ADDRESSES, METER_COUNT);
+    EnergyCheckpoint::begin(METER_COUNT);  // Totals are known from here on, no network needed
     SystemManager::setupIndicators();
-    
-    // Wait indefinitely for WiFi connection
-    while (!SystemManager::setupWiFi()) {
-        DEBUG_PRINTLN("WiFi setup failed! Retrying...");
-        delay(1000);
-        ESP.restart();
+    BatteryMonitor::setup();
+    WaveformCapture::begin();  // Mains voltage and CT into the same ADC scan
+    AdcSampler::start();  // Battery and charge-detect pins, filtered in the background
+    OfflineLog::begin(OFFLINE_LOG_SECTORS);
+    DeviceIdentity::begin();  // Every database path is under devices/<id>
+
+    // Sample on core 0 from here on; loop() brings the network up and uploads
+    SamplingTask::start(UPDATE_INTERVAL);
+    BootSequence::begin();
+    PowerPolicy::begin();
+    scheduleJobs();
+    DEBUG_PRINTLN("=== PZEM-004T v3 Monitor Ready, connecting in the background ===\n");
+}
+
+// First time online: finish the cloud side of the setup
+void onFirstOnline() {
+    FirebaseManager::onAuthenticated();
+    // The cloud total only seeds channels without a local checkpoint
+    FirebaseManager::reconcileSavedEnergy(METER_COUNT, EnergyCheckpoint::restored());
+    signupOK = true;
+}
+
+// The app's interval on external power; on the battery the mode's, if longer
+unsigned long uploadInterval() {
+    if (PowerPolicy::mode() == PowerPolicy::External) return requestedInterval;
+    unsigned long floor = PowerPolicy::settings(PowerPolicy::mode()).uploadMs;
+    return requestedInterval > floor ? requestedInterval : floor;
+}
+
+// The mode's snapshot cadence, slowed when uploads are so far apart that the
+// ring would overflow between them
+void applyIntervals() {
+    unsigned long upload = uploadInterval();
+    JobScheduler::setPeriod(uploadJob, upload);
+    SamplingTask::setInterval(SamplingTask::intervalFor(PowerPolicy::settings(PowerPolicy::mode()).snapshotMs,
+                                                        upload, MeterScheduler::channelCount()));
+}
+
+void applyPowerMode() {
+    const PowerPolicy::Settings& mode = PowerPolicy::settings(PowerPolicy::mode());
+    applyIntervals();
+    MeterScheduler::setRoundGap(mode.roundGapMs);
+    AdcSampler::setLowPower(mode.lightSleep);  // The DMA scan would keep the CPU awake
+    Hal::power().setModemSleep(mode.modemSleep);
+    lightSleepAvailable = Hal::power().setLightSleep(mode.lightSleep) && mode.lightSleep;
+    PowerPolicy::Estimate estimate =
+        PowerPolicy::estimate(PowerPolicy::lastPercent(), MeterScheduler::channelCount(), lightSleepAvailable);
+    LOG_INFO("Power mode %s at %u%%: upload every %lu ms, ~%.0f h on the battery (%.0f h more than at full rate)\n",
+             PowerPolicy::name(PowerPolicy::mode()), (unsigned)PowerPolicy::lastPercent(), uploadInterval(),
+             estimate.runtimeHours, estimate.gainedHours);
+    powerDue = true;
+}
+
+void handleCommands() {
+    if (!signupOK) return;
+    DeviceCommands::maintain();
+
+    DeviceCommand command;
+    while (DeviceCommands::poll(command)) {
+        switch (command.type) {
+            case DeviceCommand::ResetEnergy:
+                DEBUG_PRINTLN("Reset command received");
+                SamplingTask::requestEnergyReset();
+                resetClearPending = true;  // Acknowledged with the next upload
+                break;
+            case DeviceCommand::SetUpdateInterval:
+                DEBUG_PRINTF("Upload interval set to %u ms\n", (unsigned)command.value);
+                requestedInterval = command.value;
+                applyIntervals();
+                break;
+        }
     }
-    
-    if (!SystemManager::syncTime()) {
-        DEBUG_PRINTLN("Time sync failed! System halted.");
-        ESP.restart();
-        return;
+}
+
+// Sends a few batches of the offline backlog per cycle, oldest first
+void drainBacklog() {
+    static LogRecord records[FirebaseManager::HISTORY_BATCH];
+    for (int batch = 0; batch < BACKLOG_BATCHES_PER_CYCLE && OfflineLog::pendingCount() > 0; batch++) {
+        size_t count = OfflineLog::peek(records, FirebaseManager::HISTORY_BATCH);
+        if (count > 0 && !FirebaseManager::uploadHistory(records, count)) return;
+        OfflineLog::markSent(count);
     }
-    
-    if (!FirebaseManager::setup()) {
-        DEBUG_PRINTLN("Firebase setup failed! System halted.");
-        ESP.restart();
-        return;
+}
+
+// Appliance events go out as soon as the detector emits them, between upload
+// cycles; a failed push is retried before anything newer
+void pushEvents() {
+    static ApplianceEvent pending;
+    static uint32_t pendingTimestamp = 0;
+    static bool havePending = false;
+    static unsigned long retryAt = 0;
+    if (!BootSequence::online() || !signupOK || !FirebaseManager::ready()) return;
+    if (havePending && (long)(millis() - retryAt) < 0) return;
+
+    while (havePending || EventDetector::pop(pending)) {
+        if (!havePending) {
+            // Stamped once, so a retry writes the same key
+            uint32_t ageS = (millis() - pending.atMs + 500) / 1000;
+            pendingTimestamp = SystemManager::resolveTimestamp(SystemManager::timestampNow() - ageS);
+            havePending = true;
+        }
+        if (!FirebaseManager::pushEvent(pending, pendingTimestamp)) {
+            retryAt = millis() + EVENT_RETRY_MS;
+            return;
+        }
+        Telemetry::record(Telemetry::EventPush, millis() - pending.atMs);
+        havePending = false;
     }
-    
-    // Load saved energy after Firebase setup
-    FirebaseManager::loadSavedEnergy();
-    
-    BatteryMonitor::setup();
-    DEBUG_PRINTLN("\nSystem initialization complete!");
-    DEBUG_PRINTLN("=== PZEM-004T v3 Monitor Ready ===\n");
-    signupOK = true;
-    DEBUG_PRINTLN("Setup complete!");
 }
 
-void loop() {
-    static unsigned long lastUpdateTime = 0;
-    static unsigned long lastDebugTime = 0;
-    unsigned long currentTime = millis();
-
-    // Always get readings regardless of WiFi status
-    if (currentTime - lastUpdateTime >= UPDATE_INTERVAL) {
-        PowerReadings readings = SystemManager::getPowerReadings();
-        lastUpdateTime = currentTime;
-
-        // Check WiFi status
-        if (!SystemManager::isWiFiConnected()) {
-            SystemManager::updateWiFiLED(false);
-            SystemManager::reconnectWiFi(); // Non-blocking now
-        } else {
-            SystemManager::updateWiFiLED(true);
-            
-            if (Firebase.ready() && signupOK) {
-                uint8_t batteryLevel = BatteryMonitor::getBatteryPercentage();
-                FirebaseManager::updateBattery(batteryLevel);
-                
-                if (FirebaseManager::checkResetFlag()) {
-                    PowerReadings::resetEnergy();
-                    FirebaseManager::clearResetFlag();
-                }
-                
-                FirebaseManager::updateReadings(readings);
-                FirebaseManager::updateHeartbeat();
-            }
+// Upload cycle: everything the sampler produced since the last one goes out in
+// one batched write, or to the offline log when that isn't possible
+void uploadCycle() {
+    if (flushPending) flushPending = false;  // Early, not late
+    else Telemetry::record(Telemetry::LoopJitter, JobScheduler::lateness());
+
+    // Drain everything the sampler produced; the newest snapshot of each channel is uploaded
+    static PowerReadings drained[SamplingTask::RING_CAPACITY];
+    static PowerReadings latest[PowerReadings::MAX_CHANNELS];
+    uint32_t channelsSeen = 0;
+    size_t drainedCount = 0;
+    while (drainedCount < SamplingTask::RING_CAPACITY && SamplingTask::pop(drained[drainedCount])) {
+        PowerReadings& r = drained[drainedCount];
+        // Taken before NTP answered: move from uptime to wall-clock seconds
+        r.timestamp = SystemManager::resolveTimestamp(r.timestamp);
+        WindowAggregator::add(r);
+        latest[r.channel] = r;
+        channelsSeen |= 1UL << r.channel;
+        drainedCount++;
+    }
+    bool uploaded = false;
+    bool attempted = false;
+
+    // WiFi, time and sign-in are handled by BootSequence; until then everything is logged
+    if (BootSequence::online() && signupOK && FirebaseManager::ready()) {
+        // Readings (incl. charging state) plus whatever the slower jobs have made due, in one
+        // request; with the heartbeat it also touches the fleet index, at the root
+        bool sendingHeartbeat = heartbeatDue;
+        FirebaseManager::beginCycle(sendingHeartbeat);
+        if (resetClearPending) {
+            FirebaseManager::queueResetClear();
+        }
+        bool sendingBattery = batteryDue;
+        if (sendingBattery) FirebaseManager::queueBattery(batteryLevel);
+        for (uint8_t ch = 0; ch < PowerReadings::MAX_CHANNELS; ch++) {
+            if (channelsSeen & (1UL << ch)) FirebaseManager::queueReadings(latest[ch]);
+        }
+        if (sendingHeartbeat) FirebaseManager::queueHeartbeat();
+        // Boot milestones go out with the cycle after the first upload
+        static bool bootMetricsSent = false;
+        bool sendingBootMetrics = !bootMetricsSent && BootSequence::metrics().firstUploadMs;
+        if (sendingBootMetrics) FirebaseManager::queueBootMetrics(BootSequence::metrics());
+        if (wifiStatsDue) FirebaseManager::queueWifiStats(WifiLink::getStats());
+        // Each analysed spectrum goes out once, with the next cycle after it
+        static uint32_t harmonicsSent = 0;
+        HarmonicSpectrum spectrum;
+        bool sendingHarmonics = WaveformCapture::fresh(spectrum) && spectrum.block != harmonicsSent;
+        if (sendingHarmonics) FirebaseManager::queueHarmonics(spectrum);
+        bool sendingTelemetry = telemetryDue;
+        if (sendingTelemetry) {
+            FirebaseManager::queueTelemetry();
+            FirebaseManager::queueJobStats();
+            Telemetry::dump();
+        }
+        bool sendingPower = powerDue || sendingTelemetry;  // On every mode change too
+        if (sendingPower) FirebaseManager::queuePower(MeterScheduler::channelCount(), lightSleepAvailable);
+        // Finished windows wait here until a commit carrying them succeeds
+        static WindowSummary summaries[FirebaseManager::SUMMARIES_PER_CYCLE];
+        static size_t summaryCount = 0;
+        while (summaryCount < FirebaseManager::SUMMARIES_PER_CYCLE &&
+               WindowAggregator::pop(summaries[summaryCount])) {
+            summaryCount++;
+        }
+        for (size_t i = 0; i < summaryCount; i++) FirebaseManager::queueSummary(summaries[i]);
+        uploaded = FirebaseManager::commitCycle();
+        attempted = true;
+        if (uploaded) {
+            summaryCount = 0;
+            wifiStatsDue = false;
+            if (sendingBattery) batteryDue = false;
+            if (sendingHeartbeat) heartbeatDue = false;
+            if (sendingTelemetry) telemetryDue = false;
+            if (sendingPower) powerDue = false;
+            BootSequence::markFirstUpload();
+            if (sendingBootMetrics) bootMetricsSent = true;
+            if (sendingHarmonics) harmonicsSent = spectrum.block;
+            resetClearPending = false;
+            drainBacklog();
+        }
+    }
+
+    // Not getting through while online may mean a stale cached lease; WifiLink
+    // decides. A cycle that sent nothing, or that the server turned away, says
+    // nothing against the link.
+    if (attempted && BootSequence::online() && signupOK) {
+        Uplink::Reach reach = FirebaseManager::uplink().lastReach();
+        if (reach != Uplink::Reach::NothingSent) WifiLink::reportCloud(reach == Uplink::Reach::Answered);
+    }
+
+    // Keep what could not be sent so the cloud history has no holes
+    if (!uploaded) {
+        for (size_t i = 0; i < drainedCount; i++) {
+            OfflineLog::append(drained[i]);
         }
     }
+}
+
+// Battery and charger state drive the power mode
+void checkPower() {
+    batteryLevel = BatteryMonitor::getBatteryPercentage();
+    if (PowerPolicy::update(SystemManager::isCharging(), batteryLevel)) applyPowerMode();
+}
+
+// The slow jobs only mark their part due; it rides along with the next upload
+void markBatteryDue() { batteryDue = true; }
+void markHeartbeatDue() { heartbeatDue = true; }
+void markTelemetryDue() { telemetryDue = true; }
 
-    if (currentTime - lastDebugTime >= 5000) {  // Debug output every 5 seconds
-        DEBUG_PRINTF("System uptime: %lu ms\n", currentTime);
-        DEBUG_PRINTF("WiFi Status: %s\n", SystemManager::isWiFiConnected() ? "Connected" : "Disconnected");
-        lastDebugTime = currentTime;
+void printStatus() {
+    DEBUG_PRINTF("System uptime: %lu ms\n", millis());
+    DEBUG_PRINTF("WiFi Status: %s, %s\n", SystemManager::isWiFiConnected() ? "Connected" : "Disconnected",
+                 BootSequence::online() ? "online" : "connecting");
+    DEBUG_PRINTF("WiFi link: %u reconnects, last %lu ms, worst %lu ms\n",
+                 (unsigned)WifiLink::getStats().reconnects, WifiLink::getStats().lastConnectMs,
+                 WifiLink::getStats().maxReconnectMs);
+    DEBUG_PRINTF("Sampler: %u samples, queue %u (max %u), %u dropped, max lateness %lu ms\n",
+                 (unsigned)SamplingTask::samplesTaken(), (unsigned)SamplingTask::queueDepth(),
+                 (unsigned)SamplingTask::maxQueueDepth(), (unsigned)SamplingTask::overflowCount(),
+                 SamplingTask::maxLatenessMs());
+    DEBUG_PRINTF("Meter bus: %.1f samples/s, %.0f%% busy\n",
+                 MeterScheduler::samplesPerSecond(), MeterScheduler::busUtilization() * 100);
+    DEBUG_PRINTF("Offline backlog: %lu records\n", (unsigned long)OfflineLog::pendingCount());
+    EventDetector::Stats events = EventDetector::stats();
+    DEBUG_PRINTF("Events: %u detected, %u rejected steps, %u dropped, %u waiting\n", (unsigned)events.events,
+                 (unsigned)events.rejected, (unsigned)events.dropped, (unsigned)EventDetector::pendingCount());
+    WaveformCapture::Stats wave = WaveformCapture::stats();
+    DEBUG_PRINTF("Waveform: %u blocks analysed (%u us last), %u discarded, %u without mains\n",
+                 (unsigned)wave.blocks, (unsigned)wave.lastMicros, (unsigned)wave.discarded,
+                 (unsigned)wave.noSignal);
+    Logger::Stats log = Logger::stats();
+    DEBUG_PRINTF("Log: %u records, %u dropped, ring max %u, %u bytes out\n", (unsigned)log.records,
+                 (unsigned)log.dropped, (unsigned)log.maxDepth, (unsigned)log.bytesOut);
+    uint32_t missed = 0, overruns = 0;
+    uint8_t latest = 0;  // The job that has started furthest behind its due time
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) {
+        const JobScheduler::JobStats& job = JobScheduler::stats(id);
+        missed += job.missed;
+        overruns += job.overruns;
+        if (job.maxLateMs > JobScheduler::stats(latest).maxLateMs) latest = id;
     }
+    DEBUG_PRINTF("Jobs: %u missed deadlines, %u overruns, latest %s by %u ms\n", (unsigned)missed,
+                 (unsigned)overruns, JobScheduler::stats(latest).name, (unsigned)JobScheduler::stats(latest).maxLateMs);
 }
 
+void scheduleJobs() {
+    JobScheduler::begin();
+    JobScheduler::add("commands", handleCommands, COMMAND_INTERVAL);
+    JobScheduler::add("events", pushEvents, EVENT_INTERVAL);
+    uploadJob = JobScheduler::add("upload", uploadCycle, UPDATE_INTERVAL, UPDATE_INTERVAL);
+    JobScheduler::add("power", checkPower, POWER_INTERVAL);
+    JobScheduler::add("battery", markBatteryDue, BATTERY_INTERVAL);
+    JobScheduler::add("heartbeat", markHeartbeatDue, HEARTBEAT_INTERVAL);
+    JobScheduler::add("telemetry", markTelemetryDue, TELEMETRY_INTERVAL, TELEMETRY_INTERVAL);
+    JobScheduler::add("status", printStatus, STATUS_INTERVAL, STATUS_INTERVAL);
+}
+
+void loop() {
+    SamplingTask::service();  // No-op on the ESP32, the sampler runs as its own task
+    Logger::service();        // Likewise for the log drain
+    AdcSampler::service();    // And the ADC filter task
+    WaveformCapture::service();  // And the harmonic analysis
+    FirebaseManager::service();  // And the MQTT client, on the host
+    BootSequence::service();
+    bool cameOnline = BootSequence::takeOnlineEdge();
+    if (cameOnline && !signupOK) onFirstOnline();
+    if (cameOnline) {
+        wifiStatsDue = true;  // Reconnect timings go out after every (re)connect
+        flushPending = true;  // Flush as soon as we're up
+        JobScheduler::trigger(uploadJob);
+    }
+    JobScheduler::service();
+
+    // Off external power, block until the next job so the CPU can sleep
+    if (PowerPolicy::mode() != PowerPolicy::External) {
+        uint32_t idle = JobScheduler::msUntilNext();
+        if (idle > 0) Hal::power().idle(idle < PowerPolicy::MAX_IDLE_MS ? idle : PowerPolicy::MAX_IDLE_MS);
+    }
+}
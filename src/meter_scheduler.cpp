@@ -0,0 +1,135 @@
+#include "meter_scheduler.h"
+#include "system_manager.h"
+#include "telemetry.h"
+#include "debug_utils.h"
+
+uint8_t MeterScheduler::addresses[PowerReadings::MAX_CHANNELS];
+uint8_t MeterScheduler::count = 0;
+uint8_t MeterScheduler::current = 0;
+bool MeterScheduler::inFlight = false;
+bool MeterScheduler::discardInFlight = false;
+bool MeterScheduler::resetInFlight = false;
+uint32_t MeterScheduler::pendingResets = 0;
+unsigned long MeterScheduler::startedAt = 0;
+unsigned long MeterScheduler::roundStartedAt = 0;
+std::atomic<uint32_t> MeterScheduler::roundGapMs{0};
+unsigned long MeterScheduler::begunAt = 0;
+unsigned long MeterScheduler::busyMs = 0;
+uint32_t MeterScheduler::completed = 0;
+PowerReadings MeterScheduler::latestReadings[PowerReadings::MAX_CHANNELS];
+MeterScheduler::ChannelStats MeterScheduler::stats[PowerReadings::MAX_CHANNELS];
+
+void MeterScheduler::begin(const uint8_t* meterAddresses, uint8_t meterCount) {
+    count = meterCount < PowerReadings::MAX_CHANNELS ? meterCount : PowerReadings::MAX_CHANNELS;
+    for (uint8_t ch = 0; ch < count; ch++) {
+        addresses[ch] = meterAddresses[ch];
+        latestReadings[ch] = PowerReadings();
+        latestReadings[ch].channel = ch;
+        stats[ch] = ChannelStats();
+    }
+    current = 0;
+    pendingResets = 0;
+    discardInFlight = inFlight;  // Let a transaction from the old layout run out
+    begunAt = millis();
+    busyMs = 0;
+    completed = 0;
+    DEBUG_PRINTF("Meter scheduler: %d channel(s)\n", count);
+}
+
+void MeterScheduler::service() {
+    if (count == 0) return;
+
+    if (inFlight) {
+        MeterSample sample;
+        MeterBackend::Status status = Hal::meter().poll(sample);
+        if (status == MeterBackend::Status::Busy) return;
+
+        unsigned long now = millis();
+        busyMs += now - startedAt;
+        inFlight = false;
+        if (discardInFlight) {
+            discardInFlight = false;
+            resetInFlight = false;
+            startNext();
+            return;
+        }
+
+        bool ok = status == MeterBackend::Status::Ready;
+        if (resetInFlight) {
+            // Not retried: the account was zeroed already and rebaselines on the next read
+            resetInFlight = false;
+            if (ok) stats[current].energyResets++;
+            else LOG_WARN("Energy reset failed on meter 0x%02X\n", addresses[current]);
+            startNext();
+            return;
+        }
+
+        Telemetry::record(Telemetry::PzemRead, now - startedAt);
+        ChannelStats& channel = stats[current];
+        channel.reads++;
+        if (ok) {
+            completed++;
+            channel.failStreak = 0;
+        } else {
+            channel.failures++;
+            if (channel.failStreak < MAX_BACKOFF_SHIFT) channel.failStreak++;
+            // By the clock, not per pass: with every channel backing off the passes are empty
+            unsigned long unit = now - startedAt;
+            uint32_t gap = roundGapMs.load(std::memory_order_relaxed);
+            if (gap > unit) unit = gap;
+            channel.retryAt = now + ((1UL << channel.failStreak) - 1) * unit;
+        }
+        latestReadings[current] = SystemManager::processSample(current, ok ? &sample : nullptr, now);
+        current = (current + 1) % count;
+    }
+
+    startNext();
+}
+
+void MeterScheduler::startNext() {
+    if (msUntilNextRound() > 0) return;
+
+    // A pending reset goes first so the meter's counter clears close to the account
+    for (uint8_t ch = 0; ch < count; ch++) {
+        if (!(pendingResets & (1UL << ch))) continue;
+        if (Hal::meter().resetEnergy(addresses[ch])) {
+            pendingResets &= ~(1UL << ch);
+            current = ch;
+            inFlight = true;
+            resetInFlight = true;
+            startedAt = millis();
+        }
+        return;
+    }
+
+    unsigned long now = millis();
+    if (current == 0) roundStartedAt = now;
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t ch = (current + i) % count;
+        if (stats[ch].failStreak && (long)(now - stats[ch].retryAt) < 0) continue;
+        if (Hal::meter().request(addresses[ch])) {
+            current = ch;
+            inFlight = true;
+            startedAt = now;
+        }
+        return;
+    }
+}
+
+// A round is over once the channel index has wrapped back to the start
+uint32_t MeterScheduler::msUntilNextRound() {
+    uint32_t gap = roundGapMs.load(std::memory_order_relaxed);
+    if (gap == 0 || inFlight || current != 0) return 0;
+    long wait = (long)(roundStartedAt + gap - millis());
+    return wait > 0 ? wait : 0;
+}
+
+float MeterScheduler::samplesPerSecond() {
+    unsigned long elapsed = millis() - begunAt;
+    return elapsed ? completed * 1000.0f / elapsed : 0;
+}
+
+float MeterScheduler::busUtilization() {
+    unsigned long elapsed = millis() - begunAt;
+    return elapsed ? (float)busyMs / elapsed : 0;
+}
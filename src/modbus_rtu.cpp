@@ -0,0 +1,133 @@
+#include "modbus_rtu.h"
+#include "crc16.h"
+#include <Arduino.h>
+
+static const uint8_t FN_READ_INPUT_REGISTERS = 0x04;
+static const uint8_t EXCEPTION_FLAG = 0x80;
+
+void ModbusRtuMaster::begin(uint32_t baud) {
+    baudRate = baud;
+    frameGapMs = (35000UL + baud - 1) / baud;  // 3.5 characters of 10 bits
+    port.begin(baud);
+}
+
+bool ModbusRtuMaster::readInputRegisters(uint8_t slave, uint16_t start, uint16_t count) {
+    if (busy() || count == 0 || count > MAX_REGISTERS) return false;
+    request[0] = slave;
+    request[1] = FN_READ_INPUT_REGISTERS;
+    request[2] = start >> 8;
+    request[3] = start & 0xFF;
+    request[4] = count >> 8;
+    request[5] = count & 0xFF;
+    uint16_t crc = crc16(request, 6);
+    request[6] = crc & 0xFF;
+    request[7] = crc >> 8;
+    return this->start(8, 5 + 2 * count);
+}
+
+bool ModbusRtuMaster::sendCommand(uint8_t slave, uint8_t function) {
+    if (busy()) return false;
+    request[0] = slave;
+    request[1] = function;
+    uint16_t crc = crc16(request, 2);
+    request[2] = crc & 0xFF;
+    request[3] = crc >> 8;
+    return start(4, 4);
+}
+
+bool ModbusRtuMaster::start(size_t requestLength, size_t expectedLength) {
+    requestLen = requestLength;
+    expectedLen = expectedLength;
+    regCount = 0;
+    attempt = 0;
+    stats.transactions++;
+    state = State::WaitGap;
+    return true;
+}
+
+void ModbusRtuMaster::transmit() {
+    while (port.available() > 0) port.read();  // Drop late bytes from an earlier frame
+    port.write(request, requestLen);
+    responseLen = 0;
+    unsigned long now = millis();
+    unsigned long txTime = (requestLen * 10000UL) / baudRate + 1;
+    deadline = now + txTime + responseTimeout;
+    lastActivity = now;
+    state = State::Receiving;
+}
+
+ModbusRtuMaster::Status ModbusRtuMaster::finish(bool success) {
+    state = State::Idle;
+    if (success) {
+        stats.completed++;
+        return Status::Done;
+    }
+    stats.failed++;
+    return Status::Failed;
+}
+
+ModbusRtuMaster::Status ModbusRtuMaster::retryOrFail() {
+    if (attempt >= MAX_RETRIES) return finish(false);
+    attempt++;
+    stats.retries++;
+    lastActivity = millis();
+    state = State::WaitGap;
+    return Status::Busy;
+}
+
+bool ModbusRtuMaster::decode() {
+    if (request[1] != FN_READ_INPUT_REGISTERS) return true;  // Echoed command, nothing to decode
+    uint8_t byteCount = response[2];
+    if (byteCount != expectedLen - 5) return false;
+    regCount = byteCount / 2;
+    for (uint16_t i = 0; i < regCount; i++) {
+        regs[i] = (uint16_t)(response[3 + 2 * i] << 8) | response[4 + 2 * i];
+    }
+    return true;
+}
+
+ModbusRtuMaster::Status ModbusRtuMaster::poll() {
+    switch (state) {
+        case State::Idle:
+            return Status::Idle;
+
+        case State::WaitGap:
+            if (millis() - lastActivity >= frameGapMs) transmit();
+            return Status::Busy;
+
+        case State::Receiving:
+            break;
+    }
+
+    unsigned long now = millis();
+    while (port.available() > 0 && responseLen < MAX_FRAME) {
+        response[responseLen++] = (uint8_t)port.read();
+        lastActivity = now;
+    }
+
+    bool exception = responseLen >= 2 && (response[1] & EXCEPTION_FLAG);
+    size_t needed = exception ? 5 : expectedLen;
+    if (responseLen < needed) {
+        if ((long)(now - deadline) >= 0) {
+            stats.timeouts++;
+            return retryOrFail();
+        }
+        return Status::Busy;
+    }
+
+    uint16_t crc = crc16(response, needed - 2);
+    if (response[needed - 2] != (crc & 0xFF) || response[needed - 1] != (crc >> 8)) {
+        stats.crcErrors++;
+        return retryOrFail();
+    }
+    if ((response[1] & ~EXCEPTION_FLAG) != request[1] ||
+        (request[0] != GENERAL_ADDRESS && response[0] != request[0])) {
+        stats.mismatched++;  // Valid frame, but not the answer to our request
+        return retryOrFail();
+    }
+    if (exception) {
+        stats.exceptions++;
+        return finish(false);
+    }
+    return finish(decode());
+}
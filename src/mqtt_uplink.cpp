@@ -0,0 +1,144 @@
+#include "mqtt_uplink.h"
+#include "debug_utils.h"
+#include "hal.h"
+#include "telemetry.h"
+#include "readings_delta.h"
+
+MqttUplink mqttUplink;
+
+Uplink::CommandCallback MqttUplink::commandCallback = nullptr;
+char MqttUplink::commandsTopic[64];
+
+void MqttUplink::begin() {
+    Hal::mqtt().begin(DeviceIdentity::id(), onMessage);
+}
+
+bool MqttUplink::authenticated() {
+    if (Hal::mqtt().connected()) everConnected = true;
+    return everConnected;
+}
+
+bool MqttUplink::ready() {
+    return Hal::mqtt().connected();
+}
+
+void MqttUplink::service() {
+    Hal::mqtt().service();
+}
+
+bool MqttUplink::send(const char* path, bool deviceScoped, const uint8_t* payload, size_t length, bool retain) {
+    int written = deviceScoped ? snprintf(topic, sizeof(topic), "%s/%s", DeviceIdentity::root(), path)
+                               : snprintf(topic, sizeof(topic), "%s", path);
+    if (written < 0 || (size_t)written >= sizeof(topic)) return false;
+    return Hal::mqtt().publish(topic, payload, length, 1, retain);
+}
+
+void MqttUplink::beginCycle(bool fleet) {
+    fleetCycle = fleet;
+    failed = false;
+    cycleMessages = 0;
+}
+
+bool MqttUplink::publishStatus(const char* path, const char* json, bool deviceScoped) {
+    if (!deviceScoped && !fleetCycle) return false;
+    cycleMessages++;
+    if (!send(path, deviceScoped, reinterpret_cast<const uint8_t*>(json), strlen(json), true)) {
+        LOG_WARN("MQTT publish failed, dropping %s\n", path);
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool MqttUplink::publishReadings(const PowerReadings& readings) {
+    uint32_t fields = ReadingsDelta::select(readings, millis());
+    if (fields == 0) return true;  // Nothing moved past its deadband
+
+    char path[48];
+    DeviceIdentity::channelPath(path, sizeof(path), readings.channel, "readings");
+    int length = ReadingsSchema::toBinary(readings, fields, readingsPayload, sizeof(readingsPayload));
+    cycleMessages++;
+    if (length < 0 || !send(path, true, readingsPayload, length, false)) {
+        failed = true;
+        return false;
+    }
+    ReadingsDelta::stage(readings, fields, millis());
+    return true;
+}
+
+// Everything was queued as it came; delivered once the broker has acknowledged it all
+bool MqttUplink::commitCycle() {
+    reach = Reach::NothingSent;
+    if (cycleMessages == 0) return true;
+    unsigned long started = millis();
+    bool success = !failed && Hal::mqtt().flush(FLUSH_TIMEOUT_MS);
+    Telemetry::record(Telemetry::CloudRtt, millis() - started);
+    // A publish the client couldn't queue while connected never left the device
+    if (success) reach = Reach::Answered;
+    else if (!failed || !Hal::mqtt().connected()) reach = Reach::Unreachable;
+    if (success) {
+        ReadingsDelta::confirm();
+        cycleStats.requestsSaved += cycleMessages - 1;  // Pipelined behind one round trip
+        cycleStats.commits++;
+        DEBUG_PRINTF("Published %d messages in one round trip\n", cycleMessages);
+    } else {
+        ReadingsDelta::discard();
+        cycleStats.failedCommits++;
+        LOG_WARN("Failed to deliver cycle: %s\n", Hal::mqtt().errorReason());
+    }
+    cycleMessages = 0;
+    return success;
+}
+
+bool MqttUplink::publish(const char* path, const char* json) {
+    unsigned long started = millis();
+    bool success = send(path, true, reinterpret_cast<const uint8_t*>(json), strlen(json), false) &&
+                   Hal::mqtt().flush(FLUSH_TIMEOUT_MS);
+    Telemetry::record(Telemetry::CloudRtt, millis() - started);
+    return success;
+}
+
+// The codec's blocks as they are, no base64; the block carries its channel and timestamps
+bool MqttUplink::publishHistory(const LogRecord* records, size_t count) {
+    uint32_t channels = 0;
+    for (size_t i = 0; i < count; i++) channels |= 1UL << records[i].channel();
+    unsigned long started = millis();
+    for (uint8_t channel = 0; channel < PowerReadings::MAX_CHANNELS; channel++) {
+        if (!(channels & (1UL << channel))) continue;
+        size_t blockBytes = HistoryCodec::encode(records, count, channel, historyBlock, sizeof(historyBlock));
+        char path[48];
+        DeviceIdentity::channelPath(path, sizeof(path), channel, "history");
+        if (blockBytes == 0 || !send(path, true, historyBlock, blockBytes, false)) return false;
+    }
+    bool success = Hal::mqtt().flush(FLUSH_TIMEOUT_MS);
+    Telemetry::record(Telemetry::CloudRtt, millis() - started);
+    return success;
+}
+
+bool MqttUplink::subscribeCommands(const char* path, CommandCallback callback) {
+    snprintf(commandsTopic, sizeof(commandsTopic), "%s/%s", DeviceIdentity::root(), path);
+    commandCallback = callback;
+    char filter[72];
+    snprintf(filter, sizeof(filter), "%s/#", commandsTopic);
+    subscribed = Hal::mqtt().subscribe(filter, 1);
+    return subscribed;
+}
+
+bool MqttUplink::commandsConnected() {
+    return subscribed && Hal::mqtt().connected();
+}
+
+const char* MqttUplink::errorReason() {
+    return Hal::mqtt().errorReason();
+}
+
+// devices/<id>/commands/reset "true" arrives as ("/reset", "true"), the way the RTDB stream has it
+void MqttUplink::onMessage(const char* topic, const uint8_t* payload, size_t length) {
+    size_t prefix = strlen(commandsTopic);
+    if (!commandCallback || strncmp(topic, commandsTopic, prefix) != 0 || topic[prefix] != '/') return;
+    char data[32];
+    if (length >= sizeof(data)) return;
+    memcpy(data, payload, length);
+    data[length] = '\0';
+    commandCallback(topic + prefix, data);
+}
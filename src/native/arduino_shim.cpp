@@ -0,0 +1,152 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <stdarg.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+static unsigned long virtualMillis = 0;
+
+unsigned long millis() { return virtualMillis; }
+unsigned long micros() { return virtualMillis * 1000UL; }
+void delay(unsigned long ms) { virtualMillis += ms; }
+
+void NativeClock::advance(unsigned long ms) { virtualMillis += ms; }
+void NativeClock::set(unsigned long ms) { virtualMillis = ms; }
+unsigned long NativeClock::ntpDelayMs = 150;
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void digitalWrite(uint8_t pin, uint8_t value) { (void)pin; (void)value; }
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation) { (void)pin; (void)attenuation; }
+
+// Wall clock on the virtual timeline. Like the ESP32 it counts from zero at
+// boot until SNTP has been configured and the link has been up for a moment,
+// then jumps to NativeClock::EPOCH_AT_BOOT plus uptime. Defining time() here
+// takes precedence over the C library's for the whole program.
+static bool sntpConfigured = false;
+static bool sntpSynced = false;
+static unsigned long linkUpSince = 0;
+
+extern "C" time_t time(time_t* out) {
+    if (sntpConfigured && !sntpSynced) {
+        if (WiFi.status() != WL_CONNECTED) linkUpSince = 0;
+        else if (!linkUpSince) linkUpSince = virtualMillis ? virtualMillis : 1;
+        else if (virtualMillis - linkUpSince >= NativeClock::ntpDelayMs) sntpSynced = true;
+    }
+    time_t now = (sntpSynced ? NativeClock::EPOCH_AT_BOOT : 0) + virtualMillis / 1000;
+    if (out) *out = now;
+    return now;
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server) {
+    (void)gmtOffsetSec; (void)daylightOffsetSec; (void)server;
+    sntpConfigured = true;
+}
+
+bool getLocalTime(struct tm* info, uint32_t ms) {
+    (void)ms;
+    time_t now = time(nullptr);
+    return localtime_r(&now, info) != nullptr;
+}
+
+size_t HardwareSerial::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write(buffer, (size_t)len < sizeof(buffer) ? (size_t)len : sizeof(buffer) - 1);
+}
+
+size_t HardwareSerial::write(const char* data, size_t len) {
+    written += len;
+    if (echo) fwrite(data, 1, len, stdout);
+    if (capture) fwrite(data, 1, len, capture);
+    return len;
+}
+
+void EspClass::restart() {
+    fprintf(stderr, "ESP.restart() called on host, exiting\n");
+    exit(1);
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+    (void)gateway; (void)subnet; (void)dns;
+    staticIp = (uint32_t)local != 0;
+    staticAddress = local;
+    return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+    (void)password; (void)connect;
+    beginCalls++;
+    target = -1;
+    failAt = 0;
+    for (size_t i = 0; i < accessPoints.size() && available; i++) {
+        const AccessPoint& ap = accessPoints[i];
+        if (ap.ssid != ssid) continue;
+        if (bssid && memcmp(bssid, ap.bssid, 6) != 0) continue;
+        if (channel && channel != ap.channel) continue;
+        target = (int)i;
+        break;
+    }
+    // Without a channel the driver scans first; without a static IP it waits for DHCP
+    unsigned long scan = channel ? 0 : scanMs;
+    if (target < 0) {
+        failAt = millis() + scan + associateMs;
+    } else {
+        connectAt = millis() + scan + associateMs + (staticIp ? 0 : dhcpMs);
+    }
+    return status();
+}
+
+wl_status_t WiFiClass::status() {
+    if (target >= 0) return millis() >= connectAt ? WL_CONNECTED : WL_DISCONNECTED;
+    if (failAt && millis() >= failAt) return WL_NO_SSID_AVAIL;
+    return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+    (void)wifiOff;
+    target = -1;
+    failAt = 0;
+    return true;
+}
+
+int16_t WiFiClass::scanNetworks(bool async) {
+    scans++;
+    scanStartedAt = millis();
+    if (!async) delay(scanMs);
+    return async ? WIFI_SCAN_RUNNING : scanComplete();
+}
+
+int16_t WiFiClass::scanComplete() {
+    if (!scanStartedAt) return WIFI_SCAN_FAILED;
+    if (millis() - scanStartedAt < scanMs) return WIFI_SCAN_RUNNING;
+    return available ? (int16_t)accessPoints.size() : 0;
+}
+
+int8_t WiFiClass::RSSI() {
+    return status() == WL_CONNECTED ? accessPoints[target].rssi : 0;
+}
+
+const uint8_t* WiFiClass::BSSID() {
+    return status() == WL_CONNECTED ? accessPoints[target].bssid : nullptr;
+}
+
+int32_t WiFiClass::channel() {
+    return status() == WL_CONNECTED ? accessPoints[target].channel : 0;
+}
+
+void WiFiClass::addAccessPoint(const char* ssid, uint8_t bssidTail, int32_t channel, int8_t rssi) {
+    AccessPoint ap = { ssid, { 0x24, 0x0A, 0xC4, 0x00, 0x00, bssidTail }, channel, rssi };
+    accessPoints.push_back(ap);
+}
+
+void WiFiClass::setLinkAvailable(bool linkUp) {
+    available = linkUp;
+    if (!linkUp) target = -1;  // Beacon loss; the station notices at once
+}
@@ -0,0 +1,117 @@
+// ADC filter chain against synthetic noisy inputs: the battery divider with
+// Gaussian noise and rail spikes, and the charge-detect pin stepping from
+// idle to charging half-way through. Compares the filtered values with the
+// true levels, and with what the old one-read-per-cycle code reported.
+// Measurement only; the behaviour is asserted by test/test_adc_sampler.
+//
+//   .pio/build/native/program --bench adc
+
+#include <Arduino.h>
+#include <chrono>
+#include <math.h>
+#include "native/fake_backends.h"
+#include "adc_sampler.h"
+
+namespace {
+
+const uint8_t BATTERY_PIN = 34;
+const uint8_t CHARGING_PIN = 35;
+const float CHARGING_THRESHOLD_V = 1.3f;
+
+struct ErrorStats {
+    double sumSq = 0;
+    double worst = 0;
+    unsigned long n = 0;
+
+    void add(double error) {
+        sumSq += error * error;
+        if (fabs(error) > worst) worst = fabs(error);
+        n++;
+    }
+    double rms() const { return n ? sqrt(sumSq / n) : 0; }
+};
+
+// The code this replaced: one raw read per call, averaged over 20 calls,
+// returning the running partial average in between
+struct LegacyBattery {
+    uint32_t sum = 0;
+    uint32_t count = 0;
+
+    float read() {
+        sum += fakeAdc.readRaw(BATTERY_PIN);
+        count++;
+        if (count >= 20) {
+            float mv = fakeAdc.rawToMilliVolts(sum / 20);
+            sum = 0;
+            count = 0;
+            return mv;
+        }
+        return fakeAdc.rawToMilliVolts(sum / count);
+    }
+};
+
+}  // namespace
+
+int runAdcBench() {
+    const unsigned long RUN_MS = 120000;
+    const unsigned long STEP_AT_MS = 60000;
+    const unsigned long CYCLE_MS = 2000;  // How often loop() reads the battery
+    const unsigned long POLL_MS = 10;     // How often the charge state is checked here
+
+    fakeAdc.battery = {1550, 25, 0.005f};
+    fakeAdc.charging = {40, 30, 0.005f};
+    const float chargingRaw = 2000;
+
+    AdcSampler::watch(BATTERY_PIN, 6);
+    AdcSampler::watch(CHARGING_PIN, 2);
+    AdcSampler::start();
+
+    ErrorStats filtered, legacy;
+    LegacyBattery legacyBattery;
+    unsigned long firstReadyMs = 0;
+    unsigned long detectMs = 0;
+    unsigned long filteredFalse = 0, legacyFalse = 0, polls = 0;
+    double hostSeconds = 0;
+    unsigned long start = millis();
+
+    for (unsigned long t = POLL_MS; t <= RUN_MS; t += POLL_MS) {
+        NativeClock::set(start + t);
+        if (t == STEP_AT_MS) fakeAdc.charging.raw = chargingRaw;
+
+        auto before = std::chrono::steady_clock::now();
+        AdcSampler::service();
+        hostSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+
+        if (!firstReadyMs && AdcSampler::ready(BATTERY_PIN)) firstReadyMs = t;
+
+        // Charge detect: filtered value vs a single raw read, as the old code did
+        bool charging = t >= STEP_AT_MS;
+        bool filteredSays = AdcSampler::milliVolts(CHARGING_PIN) / 1000.0f > CHARGING_THRESHOLD_V;
+        bool legacySays = fakeAdc.readRaw(CHARGING_PIN) / 1000.0f > CHARGING_THRESHOLD_V;
+        if (charging && filteredSays && !detectMs) detectMs = t - STEP_AT_MS;
+        bool settled = !charging || t - STEP_AT_MS > 200;
+        if (settled) {
+            polls++;
+            if (filteredSays != charging) filteredFalse++;
+            if (legacySays != charging) legacyFalse++;
+        }
+
+        if (t % CYCLE_MS == 0) {
+            float truth = fakeAdc.battery.raw * 3300.0f / 4095.0f;
+            filtered.add(AdcSampler::milliVolts(BATTERY_PIN) - truth);
+            legacy.add(legacyBattery.read() - truth);
+        }
+    }
+
+    AdcSampler::Stats st = AdcSampler::stats();
+    printf("\n=== ADC sampling: %lu s, %u Hz shared by 2 pins ===\n", RUN_MS / 1000, (unsigned)AdcSampler::SAMPLE_RATE_HZ);
+    printf("conversions:        %u (%u blocks, %lu lost to DMA overrun), %s\n", (unsigned)st.conversions,
+           (unsigned)st.blocks, fakeAdc.overruns, st.continuous ? "continuous" : "one-shot fallback");
+    printf("filter cost:        %.1f ns per conversion (host)\n", hostSeconds * 1e9 / (st.conversions ? st.conversions : 1));
+    printf("first value after:  %lu ms\n", firstReadyMs);
+    printf("battery pin error:  filtered rms %.2f mV, worst %.2f mV | old per-cycle average rms %.2f mV, worst %.2f mV\n",
+           filtered.rms(), filtered.worst, legacy.rms(), legacy.worst);
+    printf("charge detect:      step seen after %lu ms; wrong state in %lu of %lu polls filtered, %lu single-read\n",
+           detectMs, filteredFalse, polls, legacyFalse);
+    return 0;
+}
@@ -0,0 +1,147 @@
+// Rolling-window aggregation: feeds six hours of synthetic household load at
+// the 2 s sampling cadence through WindowAggregator and checks every finished
+// window against exact statistics over the same samples. Quantile accuracy is
+// reported as rank error: where the estimate actually falls in the window's
+// sorted samples, against where p50/p95 should be.
+//
+//   .pio/build/native/program --bench aggregate
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include "native/fake_backends.h"
+#include "firebase_manager.h"
+#include "window_aggregator.h"
+
+static const uint32_t START_EPOCH = 1700000000;  // Hour-aligned
+static const uint32_t RUN_SECONDS = 6 * 3600;
+static const uint32_t SAMPLE_SECONDS = 2;
+
+// Base load, a compressor cycling every 20 min and occasional kettle peaks
+static PowerReadings syntheticReading(uint32_t t, std::mt19937& rng, float& energy) {
+    std::normal_distribution<float> noise(0, 1);
+    PowerReadings r;
+    r.timestamp = START_EPOCH + t;
+    r.isValid = true;
+    r.voltage = 230 + 2.5f * noise(rng);
+    float power = 180 + 15 * noise(rng);
+    if ((t / 60) % 20 < 7) power += 120;
+    if (rng() % 1000 < 4) power += 2000;
+    r.power = power;
+    r.powerFactor = std::min(1.0f, 0.92f + 0.02f * noise(rng));
+    r.current = power / (r.voltage * r.powerFactor);
+    r.frequency = 50 + 0.02f * noise(rng);
+    energy += power * SAMPLE_SECONDS / 3600.0f;
+    r.energy = energy;
+    return r;
+}
+
+static double rankOf(std::vector<float>& sorted, float estimate) {
+    return (double)(std::lower_bound(sorted.begin(), sorted.end(), estimate) - sorted.begin()) /
+           (sorted.size() - 1);
+}
+
+int runAggregateBench() {
+    std::mt19937 rng(7);
+    float energy = 0;
+    std::vector<PowerReadings> raw;
+    double addNanos = 0;
+    std::vector<WindowSummary> summaries;
+
+    for (uint32_t t = 0; t <= RUN_SECONDS; t += SAMPLE_SECONDS) {
+        PowerReadings r = syntheticReading(t, rng, energy);
+        raw.push_back(r);
+        auto start = std::chrono::steady_clock::now();
+        WindowAggregator::add(r);
+        addNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        WindowSummary s;
+        while (WindowAggregator::pop(s)) summaries.push_back(s);
+    }
+
+    // Exact statistics of power per finished window
+    double worstMean = 0, worstStd = 0, worstEnergy = 0;
+    // Rank error per window length: P-square needs a few hundred samples to settle
+    double worstRank[WindowAggregator::WINDOW_COUNT][2] = {}, sumRank[WindowAggregator::WINDOW_COUNT][2] = {};
+    double worstValue[WindowAggregator::WINDOW_COUNT][2] = {};
+    int counted[WindowAggregator::WINDOW_COUNT] = {};
+    bool peaksKept = true;
+    for (const WindowSummary& s : summaries) {
+        counted[s.window]++;
+        uint32_t len = WindowAggregator::WINDOW_SECONDS[s.window];
+        std::vector<float> values;
+        double sum = 0, firstEnergy = 0, lastEnergy = 0;
+        for (size_t i = 0; i < raw.size(); i++) {
+            if (raw[i].timestamp < s.start || raw[i].timestamp >= s.start + len) continue;
+            if (values.empty()) firstEnergy = i ? raw[i - 1].energy : raw[i].energy;
+            values.push_back(raw[i].power);
+            sum += raw[i].power;
+            lastEnergy = raw[i].energy;
+        }
+        double mean = sum / values.size(), m2 = 0;
+        for (float v : values) m2 += (v - mean) * (v - mean);
+        double stddev = sqrt(m2 / (values.size() - 1));
+        std::sort(values.begin(), values.end());
+
+        const WindowSummary::Stats& p = s.metrics[WindowSummary::Power];
+        worstMean = std::max(worstMean, fabs(p.mean - mean) / mean);
+        worstStd = std::max(worstStd, fabs(p.stddev - stddev) / stddev);
+        worstEnergy = std::max(worstEnergy, fabs(s.energyWh - (lastEnergy - firstEnergy)));
+        if (p.max != values.back()) peaksKept = false;
+        const double targets[2] = { 0.50, 0.95 };
+        const float estimates[2] = { p.p50, p.p95 };
+        for (int q = 0; q < 2; q++) {
+            double err = fabs(rankOf(values, estimates[q]) - targets[q]);
+            worstRank[s.window][q] = std::max(worstRank[s.window][q], err);
+            float exact = values[(size_t)(targets[q] * (values.size() - 1) + 0.5)];
+            worstValue[s.window][q] = std::max(worstValue[s.window][q], (double)fabs(estimates[q] - exact) / exact);
+            sumRank[s.window][q] += err;
+        }
+    }
+
+    // Uplink: every raw sample as its own history entry, against the summaries
+    fakeCloud.online = true;
+    unsigned long before = fakeCloud.bytesSent;
+    for (const PowerReadings& r : raw) {
+        FirebaseManager::beginCycle();
+        FirebaseManager::queueReadings(r);
+        FirebaseManager::commitCycle();
+    }
+    unsigned long rawBytes = fakeCloud.bytesSent - before;
+    unsigned long windowBytes[WindowAggregator::WINDOW_COUNT] = {};
+    for (const WindowSummary& s : summaries) {
+        before = fakeCloud.bytesSent;
+        FirebaseManager::beginCycle();
+        FirebaseManager::queueSummary(s);
+        FirebaseManager::commitCycle();
+        windowBytes[s.window] += fakeCloud.bytesSent - before;
+    }
+
+    printf("\n=== rolling windows: %u h at %u s, %zu samples ===\n",
+           (unsigned)(RUN_SECONDS / 3600), (unsigned)SAMPLE_SECONDS, raw.size());
+    printf("update cost:        %.0f ns/sample (host), %zu bytes of state per channel\n",
+           addNanos / raw.size(), WindowAggregator::stateBytesPerChannel());
+    printf("windows closed:     %d x 1m, %d x 15m, %d x 1h, %u dropped\n",
+           counted[0], counted[1], counted[2], (unsigned)WindowAggregator::droppedCount());
+    printf("power mean:         worst relative error %.2e\n", worstMean);
+    printf("power stddev:       worst relative error %.2e\n", worstStd);
+    printf("power max:          %s\n", peaksKept ? "exact in every window" : "MISMATCH");
+    for (uint8_t w = 0; w < WindowAggregator::WINDOW_COUNT; w++) {
+        printf("%-3s rank error:     p50 mean %.3f worst %.3f, p95 mean %.3f worst %.3f (%u samples)\n",
+               WindowAggregator::WINDOW_NAMES[w], sumRank[w][0] / counted[w], worstRank[w][0],
+               sumRank[w][1] / counted[w], worstRank[w][1],
+               (unsigned)(WindowAggregator::WINDOW_SECONDS[w] / SAMPLE_SECONDS));
+        printf("    value error:     p50 worst %.1f%%, p95 worst %.1f%%\n", worstValue[w][0] * 100, worstValue[w][1] * 100);
+    }
+    printf("window energy:      worst error %.4f Wh\n", worstEnergy);
+    printf("\n%-22s %12s %10s\n", "uplink", "bytes", "vs raw");
+    printf("%-22s %12lu %10s\n", "raw samples", rawBytes, "1x");
+    for (uint8_t w = 0; w < WindowAggregator::WINDOW_COUNT; w++) {
+        char label[24];
+        snprintf(label, sizeof(label), "%s summaries", WindowAggregator::WINDOW_NAMES[w]);
+        printf("%-22s %12lu %9.0fx\n", label, windowBytes[w], (double)rawBytes / windowBytes[w]);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Heap audit of the steady-state loop: boots the firmware, lets every
+// periodic job (telemetry, window summaries, debug block) run once, then
+// counts heap allocations over an hour of upload cycles. The zero-allocation
+// requirement itself is asserted by test/test_loop_allocations.
+//
+//   .pio/build/native/program --bench alloc
+//
+// Cloud writes go to a sink that keeps nothing, so the fake's own std::map
+// doesn't show up; what the Firebase library does internally is out of view.
+
+#include <Arduino.h>
+#include "native/fake_backends.h"
+#include "native/heap_audit.h"
+#include "boot_sequence.h"
+#include "readings_schema.h"
+
+void setup();
+void loop();
+
+namespace {
+
+class SinkCloud : public CloudBackend {
+public:
+    void begin() override {}
+    bool authenticated() override { return true; }
+    bool ready() override { return true; }
+    bool setJSON(const char*, const char* json) override { return count(json); }
+    bool updateJSON(const char*, const char* json) override { return count(json); }
+    bool setInt(const char*, int) override { return count(""); }
+    bool setBool(const char*, bool) override { return count(""); }
+    bool getBool(const char*, bool*) override { return false; }
+    bool getFloat(const char*, float*) override { return false; }
+    bool beginStream(const char*, StreamCallback) override { return true; }
+    bool streamConnected() override { return true; }
+    const char* errorReason() override { return ""; }
+    bool answered() override { return true; }
+
+    unsigned long requests = 0;
+    unsigned long bytes = 0;
+
+private:
+    bool count(const char* json) {
+        requests++;
+        bytes += strlen(json);
+        return true;
+    }
+};
+
+SinkCloud sinkCloud;
+
+}  // namespace
+
+int runAllocBench() {
+    const unsigned long CYCLE_MS = 2000;
+    const unsigned long WARMUP_CYCLES = 1900;  // Past the first 1 h window and a telemetry push
+    const unsigned long CYCLES = 1800;
+
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(10);
+        loop();
+    }
+    Hal::setCloud(&sinkCloud);
+    for (unsigned long i = 0; i < WARMUP_CYCLES; i++) {
+        NativeClock::advance(CYCLE_MS);
+        loop();
+    }
+
+    sinkCloud.requests = 0;
+    HeapAudit::start();
+    for (unsigned long i = 0; i < CYCLES; i++) {
+        NativeClock::advance(CYCLE_MS);
+        loop();
+    }
+    unsigned long total = HeapAudit::stop();
+
+    char json[ReadingsSchema::maxJsonLength() + 1];
+    PowerReadings sample;
+    HeapAudit::start();
+    int length = ReadingsSchema::toJson(sample, json, sizeof(json));
+    bool nan = ReadingsSchema::hasNaN(sample);
+    unsigned long schemaAllocations = HeapAudit::stop();
+
+    printf("\n=== heap allocations in the steady-state loop ===\n");
+    printf("cycles:            %lu (%lu cloud requests, %lu bytes)\n", CYCLES, sinkCloud.requests, sinkCloud.bytes);
+    printf("allocations:       %lu (%.3f per cycle)\n", total, (double)total / CYCLES);
+    printf("readings JSON:     %d of %u bytes max, NaN check %s, %lu allocations\n", length,
+           (unsigned)ReadingsSchema::maxJsonLength(), nan ? "failed" : "ok", schemaAllocations);
+    return 0;
+}
@@ -0,0 +1,49 @@
+// Multi-meter bus throughput: drives MeterScheduler alone on the virtual
+// clock, one step per millisecond like the sampling task, and reports how the
+// aggregate sample rate and per-channel update rate scale with meter count.
+//
+//   .pio/build/native/program --bench bus [--dead]
+//
+// --dead adds one configured address that never answers, to show what its
+// timeouts cost the live channels with back-off in place.
+
+#include <Arduino.h>
+#include "native/fake_backends.h"
+#include "meter_scheduler.h"
+
+static const unsigned long RUN_MS = 60000;
+
+int runBusBench(bool withDeadMeter) {
+    static const uint8_t COUNTS[] = { 1, 2, 4, 8, 12, 16 };
+
+    nativeMeter.begin();
+    printf("\n=== RS-485 bus benchmark: %lu s virtual time per run%s ===\n",
+           RUN_MS / 1000, withDeadMeter ? ", one dead address" : "");
+    printf("%8s %12s %14s %14s %8s %9s\n",
+           "meters", "samples/s", "per-ch Hz", "per-ch ms", "busy %", "timeouts");
+
+    for (uint8_t live : COUNTS) {
+        uint8_t channels = withDeadMeter ? live + 1 : live;
+        if (channels > PowerReadings::MAX_CHANNELS) break;
+
+        uint8_t addresses[PowerReadings::MAX_CHANNELS];
+        for (uint8_t ch = 0; ch < channels; ch++) addresses[ch] = ch + 1;  // Last one is dead with --dead
+        simulatedPzem.setMeterCount(live);
+        uint32_t timeoutsBefore = nativeMeter.linkStats().timeouts;
+        MeterScheduler::begin(addresses, channels);
+
+        unsigned long end = millis() + RUN_MS;
+        while ((long)(millis() - end) < 0) {
+            NativeClock::advance(1);
+            MeterScheduler::service();
+        }
+
+        float rate = MeterScheduler::samplesPerSecond();
+        float perChannel = rate / live;
+        printf("%8u %12.1f %14.2f %14.0f %8.1f %9u\n",
+               (unsigned)live, rate, perChannel, perChannel > 0 ? 1000.0f / perChannel : 0,
+               MeterScheduler::busUtilization() * 100,
+               (unsigned)(nativeMeter.linkStats().timeouts - timeoutsBefore));
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+// History codec: encodes a trace in blocks of the upload batch size and
+// others, checks the round trip is bit-exact and compares the bytes with the
+// JSON object per record that uploadHistory() used to send.
+//
+//   .pio/build/native/program --bench codec [trace.csv] [--export blocks.json]
+//
+// Without a CSV the trace is recorded from the simulated meter through the
+// offline log, i.e. exactly the records a device would replay. CSV columns:
+// timestamp,voltage,current,power,energy,frequency,powerFactor[,channel]
+// (a header line is skipped). --export writes the blocks in the database
+// layout for tools/decode_history.py.
+
+#include <Arduino.h>
+#include <chrono>
+#include <time.h>
+#include <vector>
+#include "native/fake_backends.h"
+#include "base64.h"
+#include "history_codec.h"
+#include "offline_log.h"
+#include "firebase_manager.h"
+#include <stddef.h>
+#include <algorithm>
+
+void setup();
+void loop();
+
+static const unsigned long RECORD_CYCLES = 3000;
+
+static std::vector<LogRecord> recordSimulatedTrace() {
+    setup();
+    fakeCloud.online = false;  // Everything sampled lands in the offline log
+    for (unsigned long i = 0; i < RECORD_CYCLES; i++) {
+        NativeClock::advance(2000);
+        loop();
+    }
+    std::vector<LogRecord> trace;
+    LogRecord batch[64];
+    size_t n;
+    while ((n = OfflineLog::peek(batch, 64)) > 0) {
+        trace.insert(trace.end(), batch, batch + n);
+        OfflineLog::markSent(n);
+    }
+    return trace;
+}
+
+static std::vector<LogRecord> loadTrace(const char* path) {
+    std::vector<LogRecord> trace;
+    FILE* f = fopen(path, "r");
+    if (!f) return trace;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long ts;
+        PowerReadings r;
+        unsigned channel = 0;
+        int fields = sscanf(line, "%lu,%f,%f,%f,%f,%f,%f,%u", &ts, &r.voltage, &r.current, &r.power,
+                            &r.energy, &r.frequency, &r.powerFactor, &channel);
+        if (fields < 7) continue;
+        r.timestamp = ts;
+        r.channel = channel;
+        r.isValid = true;
+        trace.push_back(LogRecord::fromReadings(r));
+    }
+    fclose(f);
+    return trace;
+}
+
+// The per-record JSON uploadHistory() sent before the codec
+static size_t jsonBytes(const LogRecord& r) {
+    char buffer[256];
+    return snprintf(buffer, sizeof(buffer),
+                    ",\"history/%lu\":{\"isCharging\":%s,\"voltage\":%.3f,\"current\":%.3f,"
+                    "\"power\":%.3f,\"energy\":%.3f,\"frequency\":%.3f,\"powerFactor\":%.3f}",
+                    (unsigned long)r.timestamp, (r.flags & LogRecord::FLAG_CHARGING) ? "true" : "false",
+                    r.voltage, r.current, r.power, r.energy, r.frequency, r.powerFactor);
+}
+
+int runCodecBench(const char* tracePath, const char* exportPath) {
+    std::vector<LogRecord> trace = tracePath ? loadTrace(tracePath) : recordSimulatedTrace();
+    if (trace.empty()) {
+        fprintf(stderr, "no records in trace\n");
+        return 1;
+    }
+    size_t json = 0;
+    for (const LogRecord& r : trace) json += jsonBytes(r);
+
+    printf("\n=== history codec: %zu records from %s ===\n", trace.size(), tracePath ? tracePath : "simulator");
+    printf("%8s %10s %10s %8s %9s %11s %11s\n",
+           "block", "binary B", "base64 B", "B/rec", "vs JSON", "enc us/rec", "dec us/rec");
+    static const size_t BLOCKS[] = { 24, FirebaseManager::HISTORY_BATCH, 360, 1800 };
+    std::vector<uint8_t> block(HistoryCodec::maxEncodedSize(1800));
+    std::vector<char> text(base64Length(block.size()) + 1);
+    std::vector<LogRecord> decoded(1800);
+    FILE* exported = exportPath ? fopen(exportPath, "w") : nullptr;
+    if (exported) fprintf(exported, "{");
+    bool exact = true;
+
+    for (size_t blockSize : BLOCKS) {
+        size_t binary = 0, base64 = 0;
+        double encodeNanos = 0, decodeNanos = 0;
+        for (size_t start = 0; start < trace.size(); start += blockSize) {
+            size_t count = std::min(blockSize, trace.size() - start);
+            const LogRecord* records = &trace[start];
+            uint32_t channels = 0;
+            for (size_t i = 0; i < count; i++) channels |= 1UL << records[i].channel();
+            for (uint8_t ch = 0; ch < PowerReadings::MAX_CHANNELS; ch++) {
+                if (!(channels & (1UL << ch))) continue;
+                auto t0 = std::chrono::steady_clock::now();
+                size_t bytes = HistoryCodec::encode(records, count, ch, block.data(), block.size());
+                auto t1 = std::chrono::steady_clock::now();
+                size_t n = HistoryCodec::decode(block.data(), bytes, decoded.data(), decoded.size());
+                auto t2 = std::chrono::steady_clock::now();
+                encodeNanos += std::chrono::duration<double, std::nano>(t1 - t0).count();
+                decodeNanos += std::chrono::duration<double, std::nano>(t2 - t1).count();
+                binary += bytes;
+                base64 += base64Encode(block.data(), bytes, text.data(), text.size());
+
+                size_t k = 0;
+                for (size_t i = 0; i < count; i++) {
+                    if (records[i].channel() != ch) continue;
+                    if (k >= n || memcmp(&decoded[k], &records[i], offsetof(LogRecord, state)) != 0) exact = false;
+                    k++;
+                }
+                if (k != n) exact = false;
+                if (exported && blockSize == FirebaseManager::HISTORY_BATCH) {
+                    char prefix[20] = "";
+                    if (ch) snprintf(prefix, sizeof(prefix), "channels/%u/", ch);
+                    time_t ts = decoded[0].timestamp;
+                    struct tm utc;
+                    char day[16];
+                    gmtime_r(&ts, &utc);
+                    strftime(day, sizeof(day), "%Y%m%d", &utc);
+                    fprintf(exported, "%s\"%shistoryBlocks/%s/%lu\":\"%s\"", ftell(exported) > 1 ? "," : "",
+                            prefix, day, (unsigned long)decoded[0].timestamp, text.data());
+                }
+            }
+        }
+        printf("%8zu %10zu %10zu %8.2f %8.1fx %11.3f %11.3f\n", blockSize, binary, base64,
+               (double)binary / trace.size(), (double)json / base64,
+               encodeNanos / 1000 / trace.size(), decodeNanos / 1000 / trace.size());
+    }
+    if (exported) {
+        fprintf(exported, "}\n");
+        fclose(exported);
+    }
+    printf("JSON per record: %zu bytes total, %.1f B/rec\n", json, (double)json / trace.size());
+    printf("round trip: %s\n", exact ? "bit-exact" : "MISMATCH");
+    return exact ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+// Delta reporting of /readings: a trace is uploaded once with every field
+// every cycle, as before, and once through the deadbands, with the database
+// read back after every cycle. Reports the bytes and writes saved and, per
+// field, the worst gap between the database and the true value against its
+// deadband, and how stale the database got. Measurement only; the bounds are
+// asserted by test/test_readings_delta.
+//
+//   .pio/build/native/program --bench delta [trace.csv]
+//
+// Without a CSV: six hours of a household load at the 2 s upload cycle
+// (base load, fridge, TV, kettle, an hour of heater, mains voltage and
+// frequency wander, meter noise), with the link down for five minutes in
+// the middle. CSV columns as for the codec bench: timestamp,voltage,current,
+// power,energy,frequency,powerFactor[,channel], timestamp in seconds.
+
+#include <Arduino.h>
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "native/fake_backends.h"
+#include "derived_metrics.h"
+#include "device_identity.h"
+#include "firebase_manager.h"
+#include "readings_delta.h"
+#include "readings_schema.h"
+
+namespace {
+
+const unsigned long CYCLE_MS = 2000;
+
+struct Snapshot {
+    unsigned long ms;
+    bool online;
+    PowerReadings readings;
+};
+
+MeterSample quantize(float volts, float amps, float watts, float wh, float hz, float pf) {
+    MeterSample s = {};
+    s.voltage = (uint16_t)lroundf(volts * 10);
+    s.current = (uint32_t)lroundf(amps * 1000);
+    s.power = (uint32_t)lroundf(watts * 10);
+    s.energy = (uint32_t)wh;
+    s.frequency = (uint16_t)lroundf(hz * 10);
+    s.pf = (uint16_t)lroundf(pf * 100);
+    return s;
+}
+
+Snapshot snapshot(unsigned long ms, const MeterSample& sample, float wh, uint8_t channel, bool charging) {
+    Snapshot snap = {ms, true, PowerReadings()};
+    DerivedMetrics::compute(sample, snap.readings);
+    snap.readings.energy = wh;
+    snap.readings.timestamp = 1700000000UL + ms / 1000;
+    snap.readings.channel = channel;
+    snap.readings.isValid = true;
+    snap.readings.isCharging = charging;
+    return snap;
+}
+
+std::vector<Snapshot> synthesize() {
+    const double HOURS = 6;
+    std::mt19937 rng(23);
+    std::normal_distribution<double> gauss(0, 1);
+    std::vector<Snapshot> trace;
+    double wh = 12000;
+    for (unsigned long ms = 0; ms < HOURS * 3600000; ms += CYCLE_MS) {
+        double t = ms / 1000.0;
+        // Active power and power factor of what is on
+        double watts = 60 + 10 * sin(t / 1800), va = watts / 0.6;
+        if (fmod(t, 1800) < 600) watts += 120, va += 150;            // Fridge: 10 min of every 30
+        if (t > 3600 && t < 3 * 3600) watts += 90, va += 100;       // TV
+        if (fmod(t + 900, 7200) < 180) watts += 2000, va += 2000;   // Kettle
+        if (t > 4 * 3600 && t < 5 * 3600) watts += 1500, va += 1500;  // Heater
+        watts *= 1 + 0.003 * gauss(rng);
+        double volts = 230 + 2 * sin(t / 5400) - watts / 1000 * 0.5 + 0.15 * gauss(rng);
+        double hz = 50 + 0.03 * sin(t / 900) + 0.02 * gauss(rng);
+        double pf = watts / va;
+        wh += watts * CYCLE_MS / 3600000.0;
+        MeterSample s = quantize(volts, va / volts, watts, wh, hz, pf);
+        Snapshot snap = snapshot(ms, s, (float)wh, 0, ms < HOURS * 3600000 * 0.8);  // Unplugged near the end
+        snap.online = !(t > 3 * 3600 && t < 3 * 3600 + 300);
+        trace.push_back(snap);
+    }
+    return trace;
+}
+
+std::vector<Snapshot> loadTrace(const char* path) {
+    std::vector<Snapshot> trace;
+    FILE* f = fopen(path, "r");
+    if (!f) return trace;
+    char line[256];
+    double first = -1;
+    while (fgets(line, sizeof(line), f)) {
+        double ts;
+        float v, i, p, e, hz, pf;
+        unsigned channel = 0;
+        if (sscanf(line, "%lf,%f,%f,%f,%f,%f,%f,%u", &ts, &v, &i, &p, &e, &hz, &pf, &channel) < 7) continue;
+        if (first < 0) first = ts;
+        MeterSample s = quantize(v, i, p, e, hz, pf);
+        trace.push_back(snapshot((unsigned long)((ts - first) * 1000), s, e,
+                                 (uint8_t)std::min(channel, (unsigned)PowerReadings::MAX_CHANNELS - 1), true));
+    }
+    fclose(f);
+    return trace;
+}
+
+struct FieldError {
+    double worst = 0;       // Database against the true value
+    double worstBand = 0;   // The same, in deadbands
+    unsigned long over = 0; // Beyond the deadband and the rounding to the decimals sent
+    unsigned long writes = 0;
+};
+
+struct Run {
+    unsigned long bytes = 0;
+    unsigned long writes = 0;       // Cycles that changed /readings (an onValue in the app)
+    unsigned long fieldWrites = 0;
+    unsigned long cycles = 0;
+    FieldError errors[READINGS_FIELD_COUNT];
+    unsigned long stalest = 0;      // Seconds the database timestamp lagged
+    unsigned long mismatched = 0;   // Bools or timestamps the database got wrong
+};
+
+std::string leafPath(uint8_t channel, const char* field) {
+    std::string path = channel ? "channels/" + std::to_string(channel) + "/readings/" : "readings/";
+    return std::string(DeviceIdentity::root()) + "/" + path + field;
+}
+
+Run upload(const std::vector<Snapshot>& trace, bool delta) {
+    Run run;
+    fakeCloud.nodes.clear();
+    fakeCloud.online = true;
+    ReadingsDelta::reset();
+    unsigned long start = millis();
+    unsigned long bytes = fakeCloud.bytesSent;
+    for (const Snapshot& snap : trace) {
+        NativeClock::set(start + snap.ms);
+        if (!delta) ReadingsDelta::reset();
+        fakeCloud.online = snap.online;
+        uint32_t fields = ReadingsDelta::select(snap.readings, millis());
+        FirebaseManager::beginCycle();
+        FirebaseManager::queueReadings(snap.readings);
+        bool committed = FirebaseManager::commitCycle();
+        run.cycles++;
+        if (!snap.online) continue;
+        if (committed && fields) {
+            run.writes++;
+            for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+                if (fields & (1UL << i)) run.fieldWrites++, run.errors[i].writes++;
+            }
+        }
+
+        // What the app would see now
+        const PowerReadings& truth = snap.readings;
+        for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+            const ReadingsField& field = READINGS_SCHEMA[i];
+            std::string value;
+            if (!fakeCloud.lookup(leafPath(truth.channel, field.name).c_str(), value)) {
+                run.mismatched++;
+                continue;
+            }
+            if (field.kind == ReadingsField::Bool) {
+                if ((value == "true") != truth.isCharging) run.mismatched++;
+            } else if (field.kind == ReadingsField::Uint32) {
+                unsigned long stored = strtoul(value.c_str(), nullptr, 10);
+                if (stored > truth.timestamp) run.mismatched++;
+                else run.stalest = std::max(run.stalest, (unsigned long)(truth.timestamp - stored));
+            } else {
+                double stored = strtod(value.c_str(), nullptr);
+                double error = fabs(stored - ReadingsSchema::floatAt(truth, field));
+                double band = std::max((double)field.deadband, fabs(stored) * field.relative);
+                FieldError& e = run.errors[i];
+                e.worst = std::max(e.worst, error);
+                if (band > 0) e.worstBand = std::max(e.worstBand, error / band);
+                if (error > band + 0.5 * pow(10, -field.decimals) + 1e-6) e.over++;
+            }
+        }
+    }
+    run.bytes = fakeCloud.bytesSent - bytes;
+    fakeCloud.online = true;
+    return run;
+}
+
+}  // namespace
+
+int runDeltaBench(const char* tracePath) {
+    std::vector<Snapshot> trace = tracePath ? loadTrace(tracePath) : synthesize();
+    if (trace.empty()) {
+        fprintf(stderr, "no records in trace\n");
+        return 1;
+    }
+    DeviceIdentity::begin();
+    printf("\n=== delta reporting: %zu cycles from %s, stale after %u s ===\n", trace.size(),
+           tracePath ? tracePath : "synthetic household", (unsigned)(ReadingsDelta::MAX_STALE_MS / 1000));
+    Run full = upload(trace, false);
+    Run delta = upload(trace, true);
+
+    printf("%-22s %12s %12s %8s\n", "", "every field", "deltas", "saved");
+    printf("%-22s %12lu %12lu %7.1f%%\n", "bytes", full.bytes, delta.bytes,
+           100.0 * (1 - (double)delta.bytes / full.bytes));
+    printf("%-22s %12lu %12lu %7.1f%%\n", "readings writes", full.writes, delta.writes,
+           100.0 * (1 - (double)delta.writes / full.writes));
+    printf("%-22s %12lu %12lu %7.1f%%\n", "field writes", full.fieldWrites, delta.fieldWrites,
+           100.0 * (1 - (double)delta.fieldWrites / full.fieldWrites));
+
+    printf("worst database error against the true value, and writes per field:\n");
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        const ReadingsField& field = READINGS_SCHEMA[i];
+        if (field.kind != ReadingsField::Float) continue;
+        const FieldError& e = delta.errors[i];
+        printf("  %-16s %10.3f %-4s (%.2f deadbands, %lu cycles over) %6lu writes\n", field.name, e.worst,
+               field.unit, e.worstBand, e.over, e.writes);
+    }
+    printf("stalest timestamp: %lu s, charging/timestamp mismatches: %lu\n", delta.stalest, delta.mismatched);
+    return 0;
+}
@@ -0,0 +1,311 @@
+// Appliance on/off detection. Without arguments: an hour of synthetic meter
+// samples at the bus rate (drifting base load, fridge and pump with inrush,
+// heater, kettle, TV, a 25 W lamp) is replayed through EventDetector and the
+// events scored against the true switchings; then the full firmware runs
+// with an appliance toggling on the simulated meter and the time from each
+// step to its event landing in the database is measured. Measurement only;
+// the detection rate and latency are asserted by test/test_event_detector.
+//
+//   .pio/build/native/program --bench events
+//   .pio/build/native/program --bench events --export synthetic.csv
+//   .pio/build/native/program --bench events trace.csv
+//
+// A trace is replayed sample by sample and its events listed. CSV columns as
+// for the codec bench: timestamp,voltage,current,power,energy,frequency,
+// powerFactor[,channel], with the timestamp in (fractional) seconds.
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "native/fake_backends.h"
+#include "event_detector.h"
+#include "boot_sequence.h"
+#include "device_identity.h"
+#include "telemetry.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const double SAMPLE_HZ = 24.4;  // One meter on the bus
+const unsigned long MATCH_MS = 250;
+
+struct Sample {
+    unsigned long ms;
+    uint8_t channel;
+    PowerReadings readings;
+};
+
+struct Switching {
+    unsigned long ms;
+    ApplianceEvent::Kind kind;
+    float watts;
+    const char* name;
+    bool matched;
+};
+
+struct Appliance {
+    const char* name;
+    float watts;
+    float powerFactor;
+    float inrush;          // Multiple of the running power in the first samples
+    uint8_t inrushSamples;
+    double minOnS, maxOnS, minOffS, maxOffS;
+};
+
+std::vector<Sample> synthesize(std::vector<Switching>& truth) {
+    const double HOURS = 1;
+    const Appliance APPLIANCES[] = {
+        {"fridge", 120, 0.80f, 5.0f, 4, 400, 700, 600, 1100},
+        {"heater", 2000, 1.00f, 1.0f, 0, 300, 900, 600, 1500},
+        {"kettle", 1800, 1.00f, 1.0f, 0, 120, 200, 900, 1800},
+        {"pump", 750, 0.75f, 4.0f, 5, 90, 300, 400, 900},
+        {"tv", 90, 0.90f, 1.0f, 0, 900, 1800, 300, 900},
+        {"lamp", 25, 0.95f, 1.0f, 0, 200, 600, 200, 600},
+    };
+    const size_t COUNT = sizeof(APPLIANCES) / sizeof(APPLIANCES[0]);
+    std::mt19937 rng(20201);
+    auto uniform = [&](double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+    std::normal_distribution<double> gauss(0, 1);
+
+    // On/off schedule per appliance
+    std::vector<std::vector<std::pair<unsigned long, unsigned long>>> onPeriods(COUNT);
+    for (size_t a = 0; a < COUNT; a++) {
+        const Appliance& app = APPLIANCES[a];
+        double t = uniform(30, app.maxOffS);
+        while (t < HOURS * 3600) {
+            double on = uniform(app.minOnS, app.maxOnS);
+            unsigned long start = (unsigned long)(t * 1000), end = (unsigned long)((t + on) * 1000);
+            onPeriods[a].push_back({start, end});
+            truth.push_back({start, ApplianceEvent::On, app.watts, app.name, false});
+            if (t + on < HOURS * 3600) truth.push_back({end, ApplianceEvent::Off, app.watts, app.name, false});
+            t += on + uniform(app.minOffS, app.maxOffS);
+        }
+    }
+    std::sort(truth.begin(), truth.end(), [](const Switching& a, const Switching& b) { return a.ms < b.ms; });
+
+    std::vector<Sample> samples;
+    size_t total = (size_t)(HOURS * 3600 * SAMPLE_HZ);
+    samples.reserve(total);
+    for (size_t n = 0; n < total; n++) {
+        unsigned long ms = (unsigned long)(n * 1000 / SAMPLE_HZ);
+        double voltage = 230 + 3 * sin(ms / 700000.0) + 0.2 * gauss(rng);
+        double base = 180 + 60 * sin(2 * M_PI * ms / 1200000.0);  // Slow 20-minute swing
+        double power = base, apparent = base / 0.95;
+        for (size_t a = 0; a < COUNT; a++) {
+            const Appliance& app = APPLIANCES[a];
+            for (const auto& period : onPeriods[a]) {
+                if (ms < period.first || ms >= period.second) continue;
+                double p = app.watts;
+                unsigned long sinceOn = ms - period.first;
+                if (sinceOn < app.inrushSamples * 1000 / SAMPLE_HZ) p *= app.inrush;
+                power += p;
+                apparent += p / app.powerFactor;
+                break;
+            }
+        }
+        power *= 1 + 0.002 * gauss(rng);
+        Sample s;
+        s.ms = ms;
+        s.channel = 0;
+        s.readings.isValid = true;
+        s.readings.voltage = roundf((float)voltage * 10) / 10;
+        s.readings.power = roundf((float)power * 10) / 10;
+        s.readings.current = roundf((float)(apparent / voltage) * 1000) / 1000;
+        s.readings.powerFactor = roundf((float)(power / apparent) * 100) / 100;
+        s.readings.frequency = 50;
+        samples.push_back(s);
+    }
+    return samples;
+}
+
+std::vector<Sample> loadTrace(const char* path) {
+    std::vector<Sample> samples;
+    FILE* f = fopen(path, "r");
+    if (!f) return samples;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        double seconds;
+        Sample s;
+        unsigned channel = 0;
+        PowerReadings& r = s.readings;
+        int fields = sscanf(line, "%lf,%f,%f,%f,%f,%f,%f,%u", &seconds, &r.voltage, &r.current, &r.power,
+                            &r.energy, &r.frequency, &r.powerFactor, &channel);
+        if (fields < 7 || channel >= PowerReadings::MAX_CHANNELS) continue;
+        s.ms = (unsigned long)llround(seconds * 1000);
+        s.channel = (uint8_t)channel;
+        r.channel = (uint8_t)channel;
+        r.isValid = true;
+        samples.push_back(s);
+    }
+    fclose(f);
+    return samples;
+}
+
+bool exportTrace(const char* path, const std::vector<Sample>& samples) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "timestamp,voltage,current,power,energy,frequency,powerFactor,channel\n");
+    for (const Sample& s : samples) {
+        const PowerReadings& r = s.readings;
+        fprintf(f, "%.3f,%.1f,%.3f,%.1f,%.3f,%.1f,%.2f,%u\n", s.ms / 1000.0, r.voltage, r.current, r.power, r.energy,
+                r.frequency, r.powerFactor, (unsigned)s.channel);
+    }
+    fclose(f);
+    return true;
+}
+
+void printEvent(const ApplianceEvent& e) {
+    printf("  %9.3f s  ch%u %-3s %+8.1f W   before %7.1f W %6.3f A pf %.2f   after %7.1f W %6.3f A pf %.2f\n",
+           e.atMs / 1000.0, (unsigned)e.channel, e.kind == ApplianceEvent::On ? "on" : "off", e.deltaPower,
+           e.before.power, e.before.current, e.before.powerFactor, e.after.power, e.after.current,
+           e.after.powerFactor);
+}
+
+// Feeds every sample; returns host nanoseconds per sample
+double replay(const std::vector<Sample>& samples, std::vector<ApplianceEvent>& out) {
+    EventDetector::reset();
+    double seconds = 0;
+    for (const Sample& s : samples) {
+        auto before = std::chrono::steady_clock::now();
+        EventDetector::add(s.channel, s.readings, s.ms);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+        ApplianceEvent e;
+        while (EventDetector::pop(e)) out.push_back(e);
+    }
+    return samples.empty() ? 0 : seconds * 1e9 / samples.size();
+}
+
+// The firmware itself: boot, then a 690 W load toggling every 30 s
+void runLive() {
+    const unsigned long PERIOD_MS = 60000;
+    const unsigned long RUN_MS = 600000;
+    const unsigned long STEP_MS = 10;
+
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    // Run on to a whole period so the first toggle is half a period away (a clock
+    // jump would be a step in the simulated load)
+    while (millis() % PERIOD_MS >= STEP_MS) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    unsigned long start = millis();
+    fakeCloud.nodes.clear();
+    const std::string eventsPrefix = std::string(DeviceIdentity::root()) + "/events/";
+    simulatedPzem.setAppliance(3.0f, PERIOD_MS);
+
+    std::vector<unsigned long> latencies;
+    size_t seen = 0;
+    unsigned long toggles = 0, toggledAt = 0;
+    bool on = false;
+    // loop() sleeps on the same clock, so go by millis() rather than counting steps
+    while (millis() - start <= RUN_MS + PERIOD_MS / 4) {
+        NativeClock::advance(STEP_MS);
+        if (millis() - start <= RUN_MS && simulatedPzem.applianceOn() != on) {
+            on = !on;
+            toggles++;
+            toggledAt = millis();
+        }
+        loop();
+        size_t events = 0;
+        for (const auto& node : fakeCloud.nodes) {
+            if (node.first.compare(0, eventsPrefix.size(), eventsPrefix) == 0) events++;
+        }
+        for (; seen < events; seen++) latencies.push_back(millis() - toggledAt);
+    }
+    simulatedPzem.setAppliance(0, 0);
+
+    std::sort(latencies.begin(), latencies.end());
+    const Histogram& h = Telemetry::histogram(Telemetry::EventPush);
+    printf("\nfirmware, 690 W load toggling every %lu s for %lu s:\n", PERIOD_MS / 2000, RUN_MS / 1000);
+    printf("  toggles %lu, events written %zu; step to database: median %lu ms, max %lu ms "
+           "(upload cycle %d ms); telemetry eventPushMs p50 %u\n",
+           toggles, latencies.size(), latencies.empty() ? 0 : latencies[latencies.size() / 2],
+           latencies.empty() ? 0 : latencies.back(), 2000, (unsigned)h.percentile(0.5f));
+    for (const auto& node : fakeCloud.nodes) {
+        if (node.first.compare(0, eventsPrefix.size(), eventsPrefix) == 0) {
+            printf("  %s = %s\n", node.first.c_str(), node.second.c_str());
+            break;
+        }
+    }
+}
+
+}  // namespace
+
+int runEventsBench(const char* tracePath, const char* exportPath) {
+    if (tracePath) {
+        std::vector<Sample> samples = loadTrace(tracePath);
+        if (samples.empty()) {
+            fprintf(stderr, "no samples in trace\n");
+            return 1;
+        }
+        std::vector<ApplianceEvent> events;
+        double ns = replay(samples, events);
+        printf("\n=== appliance events: %zu samples from %s ===\n", samples.size(), tracePath);
+        for (const ApplianceEvent& e : events) printEvent(e);
+        EventDetector::Stats st = EventDetector::stats();
+        printf("%zu events, %u rejected steps, %.0f ns per sample (host)\n", events.size(), (unsigned)st.rejected, ns);
+        return 0;
+    }
+
+    std::vector<Switching> truth;
+    std::vector<Sample> samples = synthesize(truth);
+    if (exportPath && !exportTrace(exportPath, samples)) {
+        fprintf(stderr, "cannot write %s\n", exportPath);
+        return 1;
+    }
+    std::vector<ApplianceEvent> events;
+    double ns = replay(samples, events);
+
+    // Each event matches the nearest unmatched switching of the same direction
+    unsigned long falsePositives = 0;
+    double timingError = 0, deltaError = 0;
+    unsigned long matched = 0;
+    for (const ApplianceEvent& e : events) {
+        Switching* best = nullptr;
+        for (Switching& s : truth) {
+            if (s.matched || s.kind != e.kind) continue;
+            unsigned long distance = s.ms > e.atMs ? s.ms - e.atMs : e.atMs - s.ms;
+            if (distance <= MATCH_MS && (!best || distance < (best->ms > e.atMs ? best->ms - e.atMs : e.atMs - best->ms))) {
+                best = &s;
+            }
+        }
+        if (!best) {
+            falsePositives++;
+            printf("  unmatched:");
+            printEvent(e);
+            continue;
+        }
+        best->matched = true;
+        matched++;
+        timingError += fabs((double)e.atMs - (double)best->ms);
+        deltaError += fabs(fabs(e.deltaPower) - best->watts) / best->watts;
+    }
+    unsigned long missed = 0;
+    for (const Switching& s : truth) {
+        if (s.matched) continue;
+        missed++;
+        printf("  missed: %9.3f s %-6s %s\n", s.ms / 1000.0, s.name, s.kind == ApplianceEvent::On ? "on" : "off");
+    }
+
+    EventDetector::Stats st = EventDetector::stats();
+    printf("\n=== appliance events: 1 h synthetic trace, %zu samples at %.1f/s ===\n", samples.size(), SAMPLE_HZ);
+    printf("switchings:         %zu true, %lu detected (%lu missed), %lu false\n", truth.size(), matched, missed,
+           falsePositives);
+    printf("change point:       mean error %.0f ms; step size mean error %.1f%%\n",
+           matched ? timingError / matched : 0, matched ? 100 * deltaError / matched : 0);
+    printf("detector:           %.0f ns per sample (host), %u alarms rejected as drift\n", ns, (unsigned)st.rejected);
+
+    EventDetector::reset();
+    runLive();
+    return 0;
+}
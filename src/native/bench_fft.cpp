@@ -0,0 +1,134 @@
+// Harmonic analysis against synthetic mains waveforms with known content:
+// each case is quantised to 12-bit counts with noise, analysed, and the
+// reported THD and 3rd..15th harmonics compared with the true values. Then
+// the default fake waveforms go through the real path (DMA scan -> tap ->
+// double buffer -> FFT), and the FFT cost per block is timed on the host.
+// Measurement only; the tolerances are asserted by test/test_harmonic_analyzer.
+//
+//   .pio/build/native/program --bench fft
+
+#include <Arduino.h>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include "native/fake_backends.h"
+#include "adc_sampler.h"
+#include "waveform_capture.h"
+
+namespace {
+
+const size_t N = HarmonicAnalyzer::BLOCK_SAMPLES;
+const uint32_t RATE_HZ = 5000;  // 20 kHz scan over four pins
+
+struct Case {
+    const char* name;
+    float hz;
+    float amplitude[FakeAdc::MAX_ORDER + 1];  // Peak counts; the current signal
+    bool loaded;  // Enough current for the ratios to be compared
+};
+
+std::mt19937 rng(7);
+
+void synthesize(uint16_t* out, float hz, const float* amplitude, float noise, double startSeconds) {
+    std::normal_distribution<double> gauss(0, noise);
+    for (size_t n = 0; n < N; n++) {
+        double t = startSeconds + (double)n / RATE_HZ;
+        double value = 2048 + gauss(rng);
+        for (uint8_t h = 1; h <= FakeAdc::MAX_ORDER; h++) {
+            value += amplitude[h] * sin(2.0 * M_PI * h * hz * t + 0.4 * h);
+        }
+        out[n] = (uint16_t)lround(value < 0 ? 0 : value > 4095 ? 4095 : value);
+    }
+}
+
+float trueThd(const float* amplitude) {
+    double sum = 0;
+    for (uint8_t h = 2; h <= FakeAdc::MAX_ORDER; h++) sum += amplitude[h] * amplitude[h];
+    return amplitude[1] > 0 ? (float)(100.0 * sqrt(sum) / amplitude[1]) : 0;
+}
+
+// Worst harmonic error in percentage points, THD error into *thdError
+float compare(const float* amplitude, const float* reported, float reportedThd, float* thdError) {
+    float worst = 0;
+    for (uint8_t h = HarmonicSpectrum::FIRST_ORDER; h <= HarmonicSpectrum::LAST_ORDER; h++) {
+        float truth = 100.0f * amplitude[h] / amplitude[1];
+        float error = fabsf(reported[h - HarmonicSpectrum::FIRST_ORDER] - truth);
+        if (error > worst) worst = error;
+    }
+    *thdError = fabsf(reportedThd - trueThd(amplitude));
+    return worst;
+}
+
+}  // namespace
+
+int runFftBench() {
+    const float mainsVoltage[FakeAdc::MAX_ORDER + 1] = {0, 1400, 0, 1400 * 0.012f, 0, 1400 * 0.03f, 0, 1400 * 0.015f};
+    const Case cases[] = {
+        {"pure sine 50 Hz", 50, {0, 1400}, true},
+        {"6-pulse drive 50 Hz", 50, {0, 900, 0, 36, 0, 342, 0, 162, 0, 18, 0, 63, 0, 45, 0, 9}, true},
+        {"6-pulse drive 59.7 Hz", 59.7f, {0, 900, 0, 36, 0, 342, 0, 162, 0, 18, 0, 63, 0, 45, 0, 9}, true},
+        {"square-ish 1/h, 50.3 Hz", 50.3f,
+         {0, 1000, 0, 1000 / 3.0f, 0, 1000 / 5.0f, 0, 1000 / 7.0f, 0, 1000 / 9.0f, 0, 1000 / 11.0f, 0,
+          1000 / 13.0f, 0, 1000 / 15.0f}, true},
+        {"light load, 6 counts", 50, {0, 6, 0, 0, 0, 2}, false},
+    };
+
+    static uint16_t voltage[N], current[N];
+    printf("\n=== harmonic analysis: %u-sample blocks at %u Hz per signal (%.1f ms) ===\n",
+           (unsigned)N, (unsigned)RATE_HZ, N * 1000.0 / RATE_HZ);
+    printf("%-26s %9s %9s %9s %9s %10s\n", "case", "f0 Hz", "THD-I %", "true %", "THD err", "worst h err");
+    for (const Case& c : cases) {
+        synthesize(voltage, c.hz, mainsVoltage, 1.5f, 0.0123);
+        synthesize(current, c.hz, c.amplitude, 1.5f, 0.0123);
+        HarmonicSpectrum spectrum;
+        HarmonicAnalyzer::analyze(voltage, current, RATE_HZ, spectrum);
+        float thdError = 0, worst = 0;
+        if (c.loaded) worst = compare(c.amplitude, spectrum.current, spectrum.thdCurrent, &thdError);
+        printf("%-26s %9.3f %9.2f %9.2f %9.3f %10.3f\n", c.name, spectrum.fundamentalHz, spectrum.thdCurrent,
+               c.loaded ? trueThd(c.amplitude) : 0.0f, thdError, worst);
+    }
+
+    // Cost per block: the transform alone, and the whole analysis
+    const int RUNS = 2000;
+    static FixedFft<N> fft;
+    static FixedFft<N>::Complex data[N];
+    double fftSeconds = 0;
+    for (int r = 0; r < RUNS; r++) {
+        for (size_t n = 0; n < N; n++) data[n] = {((int32_t)voltage[n] - 2048) * 16, ((int32_t)current[n] - 2048) * 16};
+        auto before = std::chrono::steady_clock::now();
+        fft.transform(data);
+        fftSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+    }
+    HarmonicSpectrum spectrum;
+    auto before = std::chrono::steady_clock::now();
+    for (int r = 0; r < RUNS; r++) HarmonicAnalyzer::analyze(voltage, current, RATE_HZ, spectrum);
+    double analyzeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+    printf("fft (%u-point complex, V+jI): %.1f us per block; whole analysis %.1f us per block (host)\n",
+           (unsigned)N, fftSeconds * 1e6 / RUNS, analyzeSeconds * 1e6 / RUNS);
+
+    // The real acquisition path on the default fake waveforms
+    AdcSampler::watch(34, 5);
+    AdcSampler::watch(35, 1);
+    WaveformCapture::begin();
+    AdcSampler::start();
+    unsigned long start = millis();
+    for (unsigned long t = 20; t <= 10000; t += 20) {
+        NativeClock::set(start + t);
+        AdcSampler::service();
+        WaveformCapture::service();
+    }
+    WaveformCapture::Stats st = WaveformCapture::stats();
+    HarmonicSpectrum live;
+    bool haveLive = WaveformCapture::fresh(live);
+    float liveThdError = 0, liveWorst = 0;
+    if (haveLive) liveWorst = compare(fakeAdc.mainsCurrent.amplitude, live.current, live.thdCurrent, &liveThdError);
+    printf("capture path:       %u Hz per pin, %u blocks analysed, %u discarded, %lu DMA overruns\n",
+           (unsigned)AdcSampler::pinRateHz(), (unsigned)st.blocks, (unsigned)st.discarded, fakeAdc.overruns);
+    printf("                    f0 %.3f Hz, THD-I %.2f%% (true %.2f%%, error %.3f), THD-V %.2f%%, worst harmonic error %.3f\n",
+           live.fundamentalHz, live.thdCurrent, trueThd(fakeAdc.mainsCurrent.amplitude), liveThdError, live.thdVoltage,
+           liveWorst);
+    printf("                    I harmonics %%:");
+    for (uint8_t h = 0; h < HarmonicSpectrum::ORDERS; h++) printf(" %.1f", live.current[h]);
+    printf("\n");
+    return 0;
+}
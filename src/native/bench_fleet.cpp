@@ -0,0 +1,301 @@
+// Fan-in of a fleet into one database. First the firmware on the fakes for a
+// few minutes, with the requests recorded. Then N
+// simulated devices replay that recording at full speed from their own
+// threads against a stand-in backend, once with every device on the old
+// global paths and once namespaced, reporting aggregate write throughput,
+// bytes, request latency and how often one device overwrote another's data.
+// Measurement only; test/test_device_identity asserts that the firmware
+// writes nothing outside its own nodes.
+//
+//   .pio/build/native/program --bench fleet [devices]
+//
+// The stand-in is a tree whose top-level subtrees (devices/<id> counting as
+// one) each have their own lock, held while an update is applied; applying
+// takes a fixed cost per request plus a cost per byte. A multi-location update
+// locks every subtree it touches, in order, so it lands atomically.
+
+#include <Arduino.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "native/fake_backends.h"
+#include "boot_sequence.h"
+#include "device_identity.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const unsigned long RECORD_MS = 120000;       // Two heartbeats' worth of the firmware
+const unsigned APPLY_US = 100;                // Per request, under the lock
+const unsigned APPLY_BYTES_PER_US = 100;
+
+struct Write {
+    std::string path, value;
+};
+
+// One request as a device sends it: the locks it needs and the nodes it writes
+struct Request {
+    std::vector<std::string> shards;
+    std::vector<Write> writes;
+    size_t bytes;
+};
+
+std::string shardOf(const std::string& path) {
+    size_t slash = path.find('/');
+    if (path.compare(0, slash, DeviceIdentity::DEVICES_PATH) == 0 && slash != std::string::npos) {
+        slash = path.find('/', slash + 1);
+    }
+    return path.substr(0, slash);
+}
+
+// The members of an update body, as FakeCloud::updateJSON splits them
+std::vector<Write> split(const std::string& base, const FakeCloud::Request& request) {
+    std::string prefix = base.empty() ? "" : base + "/";
+    if (!request.update) return {{base, request.body}};
+    std::vector<Write> writes;
+    const char* p = request.body.c_str() + 1;
+    while (*p && *p != '}') {
+        const char* keyStart = strchr(p, '"') + 1;
+        const char* keyEnd = strchr(keyStart, '"');
+        const char* valueStart = keyEnd + 2;
+        const char* valueEnd = valueStart;
+        int depth = 0;
+        bool inString = false;
+        for (; *valueEnd; valueEnd++) {
+            char c = *valueEnd;
+            if (inString) { if (c == '"' && valueEnd[-1] != '\\') inString = false; continue; }
+            if (c == '"') inString = true;
+            else if (c == '{' || c == '[') depth++;
+            else if (c == '}' || c == ']') { if (depth == 0) break; depth--; }
+            else if (c == ',' && depth == 0) break;
+        }
+        writes.push_back({prefix + std::string(keyStart, keyEnd), std::string(valueStart, valueEnd)});
+        p = *valueEnd == ',' ? valueEnd + 1 : valueEnd;
+    }
+    return writes;
+}
+
+std::string trimmed(const std::string& path) {
+    size_t start = path.find_first_not_of('/');
+    if (start == std::string::npos) return "";
+    size_t end = path.find_last_not_of('/');
+    return path.substr(start, end - start + 1);
+}
+
+void replaceAll(std::string& text, const std::string& from, const std::string& to) {
+    for (size_t at = text.find(from); at != std::string::npos; at = text.find(from, at + to.size())) {
+        text.replace(at, from.size(), to);
+    }
+}
+
+// The recording as device `id` sends it, namespaced or on the old global paths
+std::vector<Request> requestsFor(const std::vector<FakeCloud::Request>& recorded, const std::string& id,
+                                 bool namespaced) {
+    std::string root = std::string(DeviceIdentity::DEVICES_PATH) + "/" + DeviceIdentity::id();
+    std::string fleet = std::string(DeviceIdentity::FLEET_PATH) + "/" + DeviceIdentity::id();
+    std::vector<Request> requests;
+    for (const FakeCloud::Request& r : recorded) {
+        std::string path = r.path;
+        std::string body = r.body;
+        if (namespaced) {
+            replaceAll(path, DeviceIdentity::id(), id);
+            replaceAll(body, DeviceIdentity::id(), id);
+        } else {
+            // Where the same data went before: readings at the root, lastSeen in deviceStatus
+            for (std::string* text : {&path, &body}) {
+                replaceAll(*text, root + "/", "");
+                replaceAll(*text, root, "");
+                replaceAll(*text, fleet + "/lastSeen", "deviceStatus/lastSeen");
+            }
+            if (trimmed(path) == fleet) path = "deviceStatus";
+        }
+        Request request;
+        request.writes = split(trimmed(path), {path, body, r.update});
+        request.bytes = path.size() + body.size();
+        for (const Write& w : request.writes) request.shards.push_back(shardOf(w.path));
+        std::sort(request.shards.begin(), request.shards.end());
+        request.shards.erase(std::unique(request.shards.begin(), request.shards.end()), request.shards.end());
+        requests.push_back(request);
+    }
+    return requests;
+}
+
+class StandInBackend {
+public:
+    explicit StandInBackend(const std::vector<std::vector<Request>>& fleet) {
+        for (const auto& requests : fleet) {
+            for (const Request& r : requests) {
+                for (const std::string& s : r.shards) {
+                    if (!shards.count(s)) shards[s].reset(new Shard());
+                }
+            }
+        }
+    }
+
+    void apply(const Request& request, int device) {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (const std::string& s : request.shards) locks.emplace_back(shards[s]->lock);
+        std::this_thread::sleep_for(std::chrono::microseconds(APPLY_US + request.bytes / APPLY_BYTES_PER_US));
+        for (const Write& w : request.writes) store(*shards[shardOf(w.path)], w, device);
+    }
+
+    unsigned long overwrites() const {
+        unsigned long n = 0;
+        for (const auto& s : shards) n += s.second->overwrites;
+        return n;
+    }
+
+    // The devices whose readings an app opening each one's node would find
+    size_t visible(const std::vector<std::string>& readingsPaths) const {
+        size_t n = 0;
+        for (size_t device = 0; device < readingsPaths.size(); device++) {
+            const Shard& s = *shards.at(shardOf(readingsPaths[device]));
+            auto it = s.nodes.lower_bound(readingsPaths[device]);
+            if (it != s.nodes.end() && it->first.compare(0, readingsPaths[device].size(), readingsPaths[device]) == 0 &&
+                it->second.writer == (int)device) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    size_t children(const std::string& path) const {
+        auto it = shards.find(path);
+        if (it == shards.end()) return 0;
+        size_t n = 0;
+        std::string last;
+        for (const auto& node : it->second->nodes) {
+            std::string child = node.first.substr(0, node.first.find('/', path.size() + 1));
+            if (child != last) n++, last = child;
+        }
+        return n;
+    }
+
+private:
+    struct Node {
+        int writer;
+        std::string value;
+    };
+    struct Shard {
+        std::mutex lock;
+        std::map<std::string, Node> nodes;
+        unsigned long overwrites = 0;  // Nodes last written by another device
+    };
+
+    // Writing a node replaces everything under it, as in the real database
+    static void store(Shard& s, const Write& w, int device) {
+        std::string prefix = w.path + "/";
+        for (auto it = s.nodes.lower_bound(prefix);
+             it != s.nodes.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+            if (it->second.writer != device) s.overwrites++;
+            it = s.nodes.erase(it);
+        }
+        auto it = s.nodes.find(w.path);
+        if (it != s.nodes.end() && it->second.writer != device) s.overwrites++;
+        s.nodes[w.path] = {device, w.value};
+    }
+
+    std::map<std::string, std::unique_ptr<Shard>> shards;
+};
+
+struct Result {
+    unsigned long requests = 0;
+    unsigned long bytes = 0;
+    double seconds = 0;
+    double p99Ms = 0;
+    unsigned long overwrites = 0;
+    size_t visible = 0;
+    size_t indexed = 0;
+};
+
+Result drive(const std::vector<FakeCloud::Request>& recorded, int devices, bool namespaced) {
+    std::vector<std::vector<Request>> fleet;
+    std::vector<std::string> readingsPaths;
+    for (int d = 0; d < devices; d++) {
+        char id[DeviceIdentity::ID_LENGTH + 1];
+        snprintf(id, sizeof(id), "240ac4%06x", (unsigned)d & 0xffffffu);
+        fleet.push_back(requestsFor(recorded, id, namespaced));
+        readingsPaths.push_back(namespaced ? std::string(DeviceIdentity::DEVICES_PATH) + "/" + id + "/readings"
+                                           : "readings");
+    }
+    StandInBackend backend(fleet);
+    std::vector<std::vector<double>> latencies(devices);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int d = 0; d < devices; d++) {
+        threads.emplace_back([&, d] {
+            while (!go) std::this_thread::yield();
+            for (const Request& r : fleet[d]) {
+                auto t0 = std::chrono::steady_clock::now();
+                backend.apply(r, d);
+                latencies[d].push_back(
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (std::thread& t : threads) t.join();
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<double> all;
+    for (int d = 0; d < devices; d++) {
+        all.insert(all.end(), latencies[d].begin(), latencies[d].end());
+        for (const Request& r : fleet[d]) result.bytes += r.bytes;
+    }
+    result.requests = all.size();
+    std::sort(all.begin(), all.end());
+    result.p99Ms = all.empty() ? 0 : all[(size_t)(0.99 * (all.size() - 1))];
+    result.overwrites = backend.overwrites();
+    result.visible = backend.visible(readingsPaths);
+    result.indexed = backend.children(DeviceIdentity::FLEET_PATH);
+    return result;
+}
+
+}  // namespace
+
+int runFleetBench(int devices) {
+    printf("\n=== fleet: the firmware's writes for %lu s ===\n", RECORD_MS / 1000);
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(10);
+        loop();
+    }
+    std::vector<FakeCloud::Request> recorded;
+    fakeCloud.journal = &recorded;
+    for (unsigned long start = millis(); millis() - start < RECORD_MS;) {
+        NativeClock::advance(100);
+        loop();
+    }
+    fakeCloud.journal = nullptr;
+
+    unsigned long bytes = 0;
+    for (const FakeCloud::Request& r : recorded) bytes += r.path.size() + r.body.size();
+    printf("  %zu requests, %lu bytes: %.1f requests/min, %.0f bytes/s per device\n", recorded.size(), bytes,
+           recorded.size() * 60000.0 / RECORD_MS, bytes * 1000.0 / RECORD_MS);
+
+    printf("\n%d devices replaying it at full speed (apply %u us + 1 us per %u bytes under the lock):\n", devices,
+           APPLY_US, APPLY_BYTES_PER_US);
+    printf("%-12s %9s %10s %8s %11s %8s %11s %9s %8s\n", "layout", "requests", "bytes", "wall s", "requests/s",
+           "p99 ms", "overwrites", "visible", "indexed");
+    Result results[2];
+    for (int namespaced = 0; namespaced < 2; namespaced++) {
+        Result& r = results[namespaced] = drive(recorded, devices, namespaced);
+        printf("%-12s %9lu %10lu %8.2f %11.0f %8.2f %11lu %9zu %8zu\n", namespaced ? "devices/<id>" : "global",
+               r.requests, r.bytes, r.seconds, r.requests / r.seconds, r.p99Ms, r.overwrites, r.visible, r.indexed);
+    }
+    const Result& global = results[0];
+    const Result& scoped = results[1];
+    printf("namespaced: %.1fx the throughput, %.1fx lower p99\n",
+           (scoped.requests / scoped.seconds) / (global.requests / global.seconds), global.p99Ms / scoped.p99Ms);
+    return 0;
+}
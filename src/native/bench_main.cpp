@@ -0,0 +1,269 @@
+// Host entry point for the native environment: runs the real setup()/loop()
+// against the fake backends and reports per-stage latency percentiles.
+//
+//   pio run -e native && .pio/build/native/program --cycles 5000
+//   .pio/build/native/program --bench bus     (RS-485 multi-meter throughput)
+//   .pio/build/native/program --bench metrics (derived-metrics kernel)
+//   .pio/build/native/program --bench energy  (energy counter reconciliation)
+//   .pio/build/native/program --bench checkpoint (reboot from NVS checkpoint)
+//   .pio/build/native/program --bench wifi    (reconnect after AP blips)
+//   .pio/build/native/program --bench aggregate (rolling-window statistics)
+//   .pio/build/native/program --bench codec   (history block compression)
+//   .pio/build/native/program --bench alloc   (heap allocations per loop)
+//   .pio/build/native/program --bench adc     (battery/charge-detect filtering on noisy inputs)
+//   .pio/build/native/program --bench fft     (THD and harmonics of synthetic waveforms, FFT time)
+//   .pio/build/native/program --bench events [trace.csv] (appliance on/off detection and push latency)
+//   .pio/build/native/program --bench scheduler (job periods, lateness and overruns on the virtual clock)
+//   .pio/build/native/program --bench power   (battery-aware modes, sleep and runtime estimate)
+//   .pio/build/native/program --bench delta [trace.csv] (readings deadbands: bytes saved, worst error)
+//   .pio/build/native/program --bench fleet [devices] (per-device paths; N devices into one backend)
+//   .pio/build/native/program --bench uplink [--broker host:port] [--rtt ms] (Firebase vs MQTT uplink)
+//   .pio/build/native/program --wifi-delay 8000 (slow association; boot metrics)
+//   .pio/build/native/program --rtt 180    (Firebase round trip; see the telemetry section)
+//   .pio/build/native/program --text-log   (log as text, for the serial bytes comparison)
+//   .pio/build/native/program --log-capture serial.bin (raw UART stream for tools/decode_log.py)
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "native/fake_backends.h"
+#include "profiling.h"
+#include "sampling_task.h"
+#include "firebase_manager.h"
+#include "device_commands.h"
+#include "offline_log.h"
+#include "meter_scheduler.h"
+#include "energy_account.h"
+#include "boot_sequence.h"
+#include "logger.h"
+#include "telemetry.h"
+#include "adc_sampler.h"
+#include "waveform_capture.h"
+
+void setup();
+void loop();
+int runBusBench(bool withDeadMeter);
+int runMetricsBench();
+int runEnergyBench();
+int runCheckpointBench();
+int runWifiBench();
+int runAggregateBench();
+int runCodecBench(const char* tracePath, const char* exportPath);
+int runAllocBench();
+int runAdcBench();
+int runFftBench();
+int runEventsBench(const char* tracePath, const char* exportPath);
+int runSchedulerBench();
+int runPowerBench();
+int runDeltaBench(const char* tracePath);
+int runFleetBench(int devices);
+int runUplinkBench(const char* broker, unsigned long rttMs);
+
+static const unsigned long UPDATE_INTERVAL_MS = 2000;  // Mirrors main.cpp
+
+static const unsigned long BOOT_STEP_MS = 10;
+static const unsigned long BOOT_TIMEOUT_MS = 120000;
+
+unsigned long StageProfiler::now() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef PIO_UNIT_TESTING
+// Each test under test/ brings its own main(); nothing reads the stage timings there
+void StageProfiler::record(LoopStage stage, unsigned long nanos) {
+    (void)stage;
+    (void)nanos;
+}
+#else
+static std::vector<unsigned long> stageSamples[(int)LoopStage::Count];
+
+void StageProfiler::record(LoopStage stage, unsigned long nanos) {
+    stageSamples[(int)stage].push_back(nanos);
+}
+
+static const char* STAGE_NAMES[] = {
+    "sample", "battery", "readings", "commit", "backlog"
+};
+
+static void printPercentiles(const char* name, std::vector<unsigned long>& samples) {
+    if (samples.empty()) {
+        printf("%-12s %8s\n", name, "-");
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](double p) {
+        size_t idx = (size_t)(p * (samples.size() - 1));
+        return samples[idx] / 1000.0;
+    };
+    printf("%-12s %8zu %10.2f %10.2f %10.2f %10.2f\n",
+           name, samples.size(), pct(0.50), pct(0.90), pct(0.99), samples.back() / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    unsigned long cycles = 2000;
+    unsigned long resetEvery = 0;
+    unsigned long outageStart = 0, outageLength = 0;
+    uint8_t channels = 0;
+    for (auto& s : stageSamples) s.reserve(1 << 16);  // Keeps the profiler off the heap while measuring
+    addConfiguredNetworks();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--bench") && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (!strcmp(name, "bus")) return runBusBench(i + 1 < argc && !strcmp(argv[i + 1], "--dead"));
+            if (!strcmp(name, "metrics")) return runMetricsBench();
+            if (!strcmp(name, "energy")) return runEnergyBench();
+            if (!strcmp(name, "checkpoint")) return runCheckpointBench();
+            if (!strcmp(name, "wifi")) return runWifiBench();
+            if (!strcmp(name, "aggregate")) return runAggregateBench();
+            if (!strcmp(name, "alloc")) return runAllocBench();
+            if (!strcmp(name, "adc")) return runAdcBench();
+            if (!strcmp(name, "fft")) return runFftBench();
+            if (!strcmp(name, "scheduler")) return runSchedulerBench();
+            if (!strcmp(name, "power")) return runPowerBench();
+            if (!strcmp(name, "delta")) return runDeltaBench(i + 1 < argc ? argv[i + 1] : nullptr);
+            if (!strcmp(name, "fleet")) return runFleetBench(i + 1 < argc ? std::max(1, atoi(argv[i + 1])) : 200);
+            if (!strcmp(name, "uplink")) {
+                const char* broker = nullptr;
+                unsigned long rttMs = 150;
+                for (int j = i + 1; j + 1 < argc; j++) {
+                    if (!strcmp(argv[j], "--broker")) broker = argv[++j];
+                    else if (!strcmp(argv[j], "--rtt")) rttMs = strtoul(argv[++j], nullptr, 10);
+                }
+                return runUplinkBench(broker, rttMs);
+            }
+            if (!strcmp(name, "codec") || !strcmp(name, "events")) {
+                const char* tracePath = nullptr;
+                const char* exportPath = nullptr;
+                for (int j = i + 1; j < argc; j++) {
+                    if (!strcmp(argv[j], "--export") && j + 1 < argc) exportPath = argv[++j];
+                    else tracePath = argv[j];
+                }
+                return name[0] == 'c' ? runCodecBench(tracePath, exportPath) : runEventsBench(tracePath, exportPath);
+            }
+            fprintf(stderr, "unknown benchmark: %s\n", name);
+            return 1;
+        }
+        else if (!strcmp(argv[i], "--channels") && i + 1 < argc) {
+            channels = (uint8_t)std::min(atoi(argv[++i]), (int)PowerReadings::MAX_CHANNELS);
+        }
+        else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) cycles = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--dropout") && i + 1 < argc) simulatedPzem.setDropoutEvery(atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--corrupt") && i + 1 < argc) simulatedPzem.setCorruptEvery(atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--reset-every") && i + 1 < argc) resetEvery = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--outage") && i + 2 < argc) {
+            outageStart = strtoul(argv[++i], nullptr, 10);
+            outageLength = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "--wifi-delay") && i + 1 < argc) WiFi.associateMs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--rtt") && i + 1 < argc) fakeCloud.rttMs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--verbose")) {
+            Serial.setEcho(true);
+            Logger::setTextOutput(true);
+        }
+        else if (!strcmp(argv[i], "--text-log")) Logger::setTextOutput(true);
+        else if (!strcmp(argv[i], "--log-capture") && i + 1 < argc) {
+            FILE* capture = fopen(argv[++i], "wb");
+            if (!capture) {
+                fprintf(stderr, "cannot open %s\n", argv[i]);
+                return 1;
+            }
+            Serial.setCapture(capture);
+        }
+    }
+
+    // Boot: step loop() at a fine grain until the first upload has gone out
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < BOOT_TIMEOUT_MS) {
+        NativeClock::advance(BOOT_STEP_MS);
+        loop();
+    }
+    const BootSequence::Metrics& boot = BootSequence::metrics();
+    printf("\n=== boot (virtual ms) ===\n");
+    printf("first sample %lu, wifi %lu (%u attempts), time %lu, cloud %lu, online %lu, first upload %lu\n",
+           boot.firstSampleMs, boot.wifiMs, (unsigned)boot.wifiAttempts, boot.timeMs,
+           boot.cloudMs, boot.onlineMs, boot.firstUploadMs);
+    if (channels > 0) {
+        // Meters at 1..N instead of the single meter on the general address
+        uint8_t addresses[PowerReadings::MAX_CHANNELS];
+        for (uint8_t ch = 0; ch < channels; ch++) addresses[ch] = ch + 1;
+        simulatedPzem.setMeterCount(channels);
+        MeterScheduler::begin(addresses, channels);
+    }
+    for (auto& s : stageSamples) s.clear();
+    Serial.resetCounters();
+    fakeCloud.requests = 0;
+    fakeCloud.bytesSent = 0;
+
+    std::vector<unsigned long> loopSamples;
+    loopSamples.reserve(cycles);
+    for (unsigned long i = 0; i < cycles; i++) {
+        NativeClock::advance(UPDATE_INTERVAL_MS);
+        fakeCloud.online = !(i >= outageStart && i < outageStart + outageLength);
+        if (resetEvery && i % resetEvery == resetEvery - 1) {
+            fakeCloud.pushStreamEvent("/reset", "true");
+        }
+        AdcSampler::service();  // Its own task on the device, kept out of the loop() timings
+        WaveformCapture::service();  // Likewise
+        unsigned long start = StageProfiler::now();
+        loop();
+        loopSamples.push_back(StageProfiler::now() - start);
+        Logger::flush();  // The drain task's share, kept out of the loop() timings
+    }
+
+    printf("\n=== loop() benchmark: %lu cycles ===\n", cycles);
+    printf("%-12s %8s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p90 us", "p99 us", "max us");
+    for (int s = 0; s < (int)LoopStage::Count; s++) {
+        printPercentiles(STAGE_NAMES[s], stageSamples[s]);
+    }
+    printPercentiles("loop", loopSamples);
+
+    printf("\nserial bytes/cycle:   %.1f (%.0f ms at 9600 baud)\n",
+           (double)Serial.bytesWritten() / cycles,
+           Serial.bytesWritten() * 10.0 / 9600.0 * 1000.0 / cycles);
+    Logger::Stats logStats = Logger::stats();
+    printf("log records/cycle:    %.1f (%u dropped, ring max %u of %u)\n",
+           (double)logStats.records / cycles, (unsigned)logStats.dropped,
+           (unsigned)logStats.maxDepth, (unsigned)Logger::RING_CAPACITY);
+    printf("cloud requests/cycle: %.2f\n", (double)fakeCloud.requests / cycles);
+    printf("cloud bytes/cycle:    %.1f\n", (double)fakeCloud.bytesSent / cycles);
+    const FirebaseManager::BatchStats& batch = FirebaseManager::getBatchStats();
+    printf("batching: %u commits, %u requests saved, %u bytes saved (est.)\n",
+           (unsigned)batch.commits, (unsigned)batch.requestsSaved, (unsigned)batch.bytesSaved);
+    printf("command stream: %s, %u connects\n",
+           DeviceCommands::isConnected() ? "up" : "down", (unsigned)DeviceCommands::reconnectCount());
+    const OfflineLog::Stats& log = OfflineLog::getStats();
+    unsigned long backlogNanos = 0;
+    for (unsigned long n : stageSamples[(int)LoopStage::Backlog]) backlogNanos += n;
+    printf("offline log: %u appended, %u replayed, %u evicted, %u corrupt, %u pending\n",
+           (unsigned)log.appended, (unsigned)log.sent, (unsigned)log.evicted,
+           (unsigned)log.corrupt, (unsigned)OfflineLog::pendingCount());
+    if (backlogNanos > 0) {
+        printf("replay throughput: %.0f records/s (host CPU time)\n", log.sent / (backlogNanos / 1e9));
+    }
+    printf("flash wear: %u erases, max %u per sector, %lu bytes written\n",
+           (unsigned)log.erases, (unsigned)log.maxSectorErases, fakeFlash.bytesWritten);
+    const LinkStats& link = nativeMeter.linkStats();
+    printf("modbus: %u transactions, %u ok, %u failed, %u timeouts, %u crc errors, %u retries\n",
+           (unsigned)link.transactions, (unsigned)link.completed, (unsigned)link.failed,
+           (unsigned)link.timeouts, (unsigned)link.crcErrors, (unsigned)link.retries);
+    printf("meter bus: %u channel(s), %.1f samples/s, %.0f%% busy\n",
+           (unsigned)MeterScheduler::channelCount(), MeterScheduler::samplesPerSecond(),
+           MeterScheduler::busUtilization() * 100);
+    const EnergyAccount::Stats& energy = EnergyAccount::getStats(0);
+    printf("energy ch0: %.3f Wh (meter %.3f Wh), %u counter steps, max drift %.3f Wh, "
+           "%u meter resets, %u wraps\n",
+           EnergyAccount::totalWh(0), simulatedPzem.energyWh(0), (unsigned)energy.counterSteps,
+           energy.maxDriftMicroWh / 1e6, (unsigned)MeterScheduler::channelStats(0).energyResets,
+           (unsigned)energy.rollovers);
+    printf("sampler: %u samples, max queue %u/%u, %u dropped\n",
+           (unsigned)SamplingTask::samplesTaken(), (unsigned)SamplingTask::maxQueueDepth(),
+           (unsigned)SamplingTask::RING_CAPACITY, (unsigned)SamplingTask::overflowCount());
+    char telemetry[1024];
+    int telemetryBytes = Telemetry::format(telemetry, sizeof(telemetry));
+    printf("telemetry (%d bytes): %s\n", telemetryBytes, telemetryBytes > 0 ? telemetry : "");
+    return 0;
+}
+#endif
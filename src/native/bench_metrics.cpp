@@ -0,0 +1,157 @@
+// Derived-metrics kernel against the original float/pow/sqrt formulas: host
+// cycles per sample for both, and each one's worst error against an exact
+// double-precision evaluation over random register blocks spanning the
+// meter's range.
+//
+//   .pio/build/native/program --bench metrics
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "derived_metrics.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycleCounter() { return __rdtsc(); }
+static const char* CYCLE_UNIT = "TSC cycles";
+#else
+static uint64_t cycleCounter() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+static const char* CYCLE_UNIT = "ns";
+#endif
+
+// The derived-metric block as it was in SystemManager::getPowerReadings
+static void legacyCompute(const MeterSample& sample, PowerReadings& readings) {
+    readings.voltage = sample.voltage / 10.0f;
+    readings.current = sample.current / 1000.0f;
+    readings.power = sample.power / 10.0f;
+    readings.frequency = sample.frequency / 10.0f;
+    readings.powerFactor = sample.pf / 100.0f;
+
+    readings.apparentPower = readings.voltage * readings.current;
+    float powerFactorSquared = readings.powerFactor * readings.powerFactor;
+    if (powerFactorSquared <= 1.0) {
+        readings.reactivePower = readings.apparentPower * sqrt(1 - powerFactorSquared);
+    } else {
+        readings.reactivePower = 0;
+    }
+    readings.loadImpedance = (readings.current > 0) ? readings.voltage / readings.current : 0;
+    if (readings.apparentPower >= readings.power && readings.power > 0) {
+        float distPowerSquared = pow(readings.apparentPower, 2) - pow(readings.power, 2);
+        if (distPowerSquared >= 0) {
+            readings.distortionPower = sqrt(distPowerSquared);
+            readings.thd = (readings.distortionPower / readings.power) * 100;
+        } else {
+            readings.distortionPower = 0;
+            readings.thd = 0;
+        }
+    } else {
+        readings.distortionPower = 0;
+        readings.thd = 0;
+    }
+    if (readings.thd >= 0 && readings.thd <= 100) {
+        readings.powerQuality = readings.powerFactor * (1 - readings.thd/100);
+    } else {
+        readings.powerQuality = readings.powerFactor;
+    }
+    if (isnan(readings.thd)) readings.thd = 0;
+    if (isnan(readings.powerQuality)) readings.powerQuality = 0;
+}
+
+// Exact values in double from the integer registers, as the yardstick
+struct Reference {
+    double apparent, reactive, distortion, thd, quality;
+};
+
+static Reference referenceCompute(const MeterSample& sample) {
+    double v = sample.voltage / 10.0, i = sample.current / 1000.0, p = sample.power / 10.0;
+    double pf = sample.pf / 100.0;
+    Reference r;
+    r.apparent = v * i;
+    r.reactive = pf <= 1 ? r.apparent * ::sqrt(1 - pf * pf) : 0;
+    r.distortion = r.apparent >= p && p > 0 ? ::sqrt(r.apparent * r.apparent - p * p) : 0;
+    r.thd = p > 0 ? r.distortion / p * 100 : 0;
+    r.quality = r.thd <= 100 ? pf * (1 - r.thd / 100) : pf;
+    return r;
+}
+
+// Worst deviation of one implementation from the reference, per field
+struct Deviation {
+    double apparent = 0;    // Relative
+    double reactive = 0;    // Relative to apparent power
+    double distortion = 0;  // Relative to apparent power
+    double thd = 0;         // Relative (THD runs to 1e6 % at tiny active power)
+    double quality = 0;     // Absolute
+
+    void add(const PowerReadings& r, const Reference& ref) {
+        double scale = ref.apparent > 1e-9 ? ref.apparent : 1.0;
+        apparent = std::max(apparent, fabs(r.apparentPower - ref.apparent) / scale);
+        reactive = std::max(reactive, fabs(r.reactivePower - ref.reactive) / scale);
+        distortion = std::max(distortion, fabs(r.distortionPower - ref.distortion) / scale);
+        thd = std::max(thd, fabs(r.thd - ref.thd) / std::max(1.0, ref.thd));
+        quality = std::max(quality, fabs(r.powerQuality - ref.quality));
+    }
+};
+
+static volatile float sink;
+
+template <typename Fn>
+static double cyclesPerSample(Fn compute, const std::vector<MeterSample>& samples, int rounds) {
+    PowerReadings readings;
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = cycleCounter();
+        for (const MeterSample& s : samples) {
+            compute(s, readings);
+            sink = readings.powerQuality;
+        }
+        uint64_t elapsed = cycleCounter() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return (double)best / samples.size();
+}
+
+int runMetricsBench() {
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<uint32_t> volts(1800, 2600), amps(0, 100000), pfs(0, 100), noise(0, 40);
+    std::vector<MeterSample> samples(4096);
+    for (MeterSample& s : samples) {
+        s.voltage = volts(rng);
+        s.current = amps(rng);
+        s.pf = pfs(rng);
+        // Active power consistent with V, I and PF, within the meter's rounding
+        uint64_t p = (uint64_t)s.voltage * s.current * s.pf / 100000;
+        s.power = (uint32_t)(p + noise(rng)) - 20 * (p >= 20);
+        s.energy = 0;
+        s.frequency = 500;
+        s.alarm = 0;
+    }
+
+    double legacy = cyclesPerSample(legacyCompute, samples, 200);
+    double kernel = cyclesPerSample(DerivedMetrics::compute, samples, 200);
+    printf("\n=== derived metrics: %zu samples ===\n", samples.size());
+    printf("legacy float/pow/sqrt: %8.1f %s/sample\n", legacy, CYCLE_UNIT);
+    printf("integer kernel:        %8.1f %s/sample (%.1fx)\n", kernel, CYCLE_UNIT, legacy / kernel);
+
+    // Both against the exact double-precision result for the same registers
+    Deviation legacyDev, kernelDev;
+    for (const MeterSample& s : samples) {
+        PowerReadings a, b;
+        legacyCompute(s, a);
+        DerivedMetrics::compute(s, b);
+        Reference ref = referenceCompute(s);
+        legacyDev.add(a, ref);
+        kernelDev.add(b, ref);
+    }
+    printf("\nworst error vs exact        %12s %12s\n", "legacy", "kernel");
+    printf("  apparent (rel)            %12.2e %12.2e\n", legacyDev.apparent, kernelDev.apparent);
+    printf("  reactive (of apparent)    %12.2e %12.2e\n", legacyDev.reactive, kernelDev.reactive);
+    printf("  distortion (of apparent)  %12.2e %12.2e\n", legacyDev.distortion, kernelDev.distortion);
+    printf("  thd (rel)                 %12.2e %12.2e\n", legacyDev.thd, kernelDev.thd);
+    printf("  power quality (abs)       %12.2e %12.2e\n", legacyDev.quality, kernelDev.quality);
+    return 0;
+}
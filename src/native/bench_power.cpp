@@ -0,0 +1,165 @@
+// Battery-aware power modes: a simulated discharge of the cell (the firmware's voltage table taken as its
+// curve, sagging under each mode's load, plus filtered noise) spending charge at each
+// mode's modelled current, against the same cell at full rate; then the
+// firmware on the fakes, taken off the charger and down through the modes,
+// showing what every mode switches and what it does to the cloud traffic
+// and the meter polling. Measurement only; the decisions and each mode's
+// settings are asserted by test/test_power_policy.
+//
+//   .pio/build/native/program --bench power
+
+#include <Arduino.h>
+#include <random>
+#include "native/fake_backends.h"
+#include "adc_sampler.h"
+#include "battery_monitor.h"
+#include "boot_sequence.h"
+#include "job_scheduler.h"
+#include "meter_scheduler.h"
+#include "power_policy.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const uint8_t CHANNELS = 1;
+
+// The cell as the firmware's voltage table has it: the voltage that reads as this charge
+float cellVolts(float soc) {
+    float low = 2.7f, high = 4.2f;
+    for (int i = 0; i < 24; i++) {
+        float mid = (low + high) / 2;
+        if (BatteryMonitor::percentageFor(mid) < soc) low = mid;
+        else high = mid;
+    }
+    return high;
+}
+
+// Hours from full to empty, checking the mode once a minute like the firmware does every 10 s
+float discharge(bool adaptive, bool lightSleep, unsigned& switches) {
+    const float INTERNAL_OHMS = 0.15f;
+    std::mt19937 rng(22);
+    std::normal_distribution<float> noise(0.0f, 0.003f);  // What is left after the sampler's filter
+    const float STEP_H = 1.0f / 60;
+    float mah = BatteryMonitor::CAPACITY_MAH;
+    float hours = 0;
+    PowerPolicy::Mode mode = PowerPolicy::External;
+    switches = 0;
+    while (mah > 0) {
+        // The lighter the mode, the less the cell sags under it: stepping down reads as more charge
+        float ma = PowerPolicy::averageMilliAmps(mode, CHANNELS, lightSleep);
+        float soc = 100.0f * mah / BatteryMonitor::CAPACITY_MAH;
+        float volts = cellVolts(soc) - ma / 1000.0f * INTERNAL_OHMS + noise(rng);
+        uint8_t percent = BatteryMonitor::percentageFor(volts);
+        PowerPolicy::Mode next = adaptive ? PowerPolicy::decide(mode, false, percent) : PowerPolicy::External;
+        if (next != mode) switches++;
+        mode = next;
+        mah -= PowerPolicy::averageMilliAmps(mode, CHANNELS, lightSleep) * STEP_H;
+        hours += STEP_H;
+    }
+    return hours;
+}
+
+void discharges() {
+    for (bool lightSleep : {true, false}) {
+        printf("discharge from full, %u channel, light sleep %s:\n", (unsigned)CHANNELS,
+               lightSleep ? "available" : "unavailable (no CONFIG_PM_ENABLE)");
+        for (uint8_t m = 0; m < PowerPolicy::MODE_COUNT; m++) {
+            printf("    %-9s %6.1f mA\n", PowerPolicy::name((PowerPolicy::Mode)m),
+                   PowerPolicy::averageMilliAmps((PowerPolicy::Mode)m, CHANNELS, lightSleep));
+        }
+        unsigned switches = 0;
+        unsigned none = 0;
+        float fullRate = discharge(false, lightSleep, none);
+        float adaptive = discharge(true, lightSleep, switches);
+        PowerPolicy::Estimate e = PowerPolicy::estimate(100, CHANNELS, lightSleep);
+        printf("    full rate %.1f h, adaptive %.1f h (x%.1f), %u mode switches; estimate from full: %.1f h vs %.1f h\n",
+               fullRate, adaptive, adaptive / fullRate, switches, e.runtimeHours, e.fullRateHours);
+    }
+}
+
+// Counts of the battery divider for a cell voltage
+float batteryRaw(float volts) {
+    float scaler = (96.5f + 45.5f) / 45.5f;
+    return volts / scaler * 1000.0f * 4095.0f / 3300.0f;
+}
+
+// One loop() per 10 ms, or as long as it asked to block for
+void runFor(unsigned long ms) {
+    unsigned long end = millis() + ms;
+    while ((long)(millis() - end) < 0) {
+        unsigned long idleMs = fakePower.idleMs;
+        loop();
+        unsigned long blocked = fakePower.idleMs - idleMs;
+        NativeClock::advance(blocked ? blocked : 10);
+    }
+}
+
+struct Phase {
+    const char* name;
+    bool charging;
+    float volts;
+};
+
+void firmware() {
+    const Phase PHASES[] = {
+        {"on the charger", true, 4.10f},
+        {"unplugged, 3.85 V", false, 3.85f},
+        {"3.45 V", false, 3.45f},
+        {"3.20 V", false, 3.20f},
+        {"back on the charger", true, 3.60f},
+    };
+    const unsigned long SETTLE_MS = 60000;
+    const unsigned long MEASURE_MS = 480000;
+
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(10);
+        loop();
+    }
+    uint8_t uploadJob = JobScheduler::NO_JOB;
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) {
+        if (!strcmp(JobScheduler::stats(id).name, "upload")) uploadJob = id;
+    }
+    if (uploadJob == JobScheduler::NO_JOB) return;
+
+    printf("firmware through the modes (%lu s each):\n", MEASURE_MS / 1000);
+    printf("  %-20s %-9s %9s %6s %6s %7s %8s %9s %9s\n", "phase", "mode", "upload ms", "modem", "light",
+           "adc", "idle %", "req/min", "reads/s");
+    for (const Phase& phase : PHASES) {
+        fakeAdc.charging.raw = phase.charging ? 2000 : 0;
+        fakeAdc.battery.raw = batteryRaw(phase.volts);
+        runFor(SETTLE_MS);
+
+        unsigned long requests = fakeCloud.requests;
+        unsigned long idleMs = fakePower.idleMs;
+        uint32_t reads = MeterScheduler::samplesCompleted();
+        runFor(MEASURE_MS);
+        float perMinute = (fakeCloud.requests - requests) * 60000.0f / MEASURE_MS;
+        float readsPerSecond = (MeterScheduler::samplesCompleted() - reads) * 1000.0f / MEASURE_MS;
+        float idleShare = 100.0f * (fakePower.idleMs - idleMs) / MEASURE_MS;
+
+        uint32_t uploadMs = JobScheduler::stats(uploadJob).periodMs;
+        printf("  %-20s %-9s %9u %6s %6s %7s %8.0f %9.1f %9.2f\n", phase.name, PowerPolicy::name(PowerPolicy::mode()),
+               (unsigned)uploadMs, fakePower.modemSleep ? "on" : "off", fakePower.lightSleep ? "on" : "off",
+               AdcSampler::lowPower() ? "bursts" : "dma", idleShare, perMinute, readsPerSecond);
+    }
+
+    static char json[192];
+    int length = PowerPolicy::format(json, sizeof(json), MeterScheduler::channelCount(), fakePower.lightSleepSupported);
+    printf("  deviceStatus/power (%d bytes): %s\n", length, json);
+
+    fakeAdc.battery.raw = 1550;
+    fakeAdc.charging.raw = 2000;
+}
+
+}  // namespace
+
+int runPowerBench() {
+    printf("\n=== power modes: %u mAh cell, %u channel ===\n", (unsigned)BatteryMonitor::CAPACITY_MAH,
+           (unsigned)CHANNELS);
+    discharges();
+    firmware();
+    return 0;
+}
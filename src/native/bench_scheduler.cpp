@@ -0,0 +1,128 @@
+// Job scheduler on the virtual clock: run counts and lateness for periods
+// from 10 ms to a minute (longer than a wheel revolution), serviced every
+// millisecond and every 37 ms; a job that stalls the loop, and what that does
+// to the others' deadlines. Then the firmware's own jobs over ten minutes with
+// the cost of a service() call. Measurement only; trigger(), setPeriod() and
+// the expected counts are asserted by test/test_job_scheduler.
+//
+//   .pio/build/native/program --bench scheduler
+
+#include <Arduino.h>
+#include <chrono>
+#include "native/fake_backends.h"
+#include "boot_sequence.h"
+#include "job_scheduler.h"
+
+void setup();
+void loop();
+
+namespace {
+
+unsigned long stallMs = 0;  // How long the next run of the stalling job takes
+
+void idle() {}
+void stall() {
+    NativeClock::advance(stallMs);
+    stallMs = 0;
+}
+
+void runFor(unsigned long ms, unsigned long step) {
+    unsigned long end = millis() + ms;
+    while ((long)(millis() - end) < 0) {
+        NativeClock::advance(step);
+        JobScheduler::service();
+    }
+}
+
+// Every period once per period; service() granularity bounds the lateness
+void periods(unsigned long step) {
+    const uint32_t PERIODS[] = {10, 100, 1000, 2000, 60000};
+    const unsigned long RUN_MS = 600000;
+    JobScheduler::begin();
+    for (uint32_t period : PERIODS) JobScheduler::add("job", idle, period, period);
+    runFor(RUN_MS, step);
+
+    printf("service every %lu ms, %lu s:\n", step, RUN_MS / 1000);
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) {
+        const JobScheduler::JobStats& s = JobScheduler::stats(id);
+        uint32_t expected = RUN_MS / s.periodMs;
+        printf("  %6u ms: %6u runs (%u expected), %5u skipped, %5u missed, late max %u mean %u ms\n",
+               (unsigned)s.periodMs, (unsigned)s.runs, (unsigned)expected, (unsigned)s.skipped,
+               (unsigned)s.missed, (unsigned)s.maxLateMs, (unsigned)(s.runs ? s.totalLateMs / s.runs : 0));
+    }
+}
+
+void printJob(const JobScheduler::JobStats& s) {
+    printf("  %-6s every %4u ms: %3u runs, %u missed, %u skipped, %u overruns, late max %u ms, longest run %u ms\n",
+           s.name, (unsigned)s.periodMs, (unsigned)s.runs, (unsigned)s.missed, (unsigned)s.skipped,
+           (unsigned)s.overruns, (unsigned)s.maxLateMs, (unsigned)s.maxRunMs);
+}
+
+void stalls() {
+    printf("a job stalling the loop for 250 ms once, 10 s:\n");
+    JobScheduler::begin();
+    uint8_t fast = JobScheduler::add("fast", idle, 100, 50);
+    uint8_t slow = JobScheduler::add("slow", idle, 2000, 2000, 500);
+    uint8_t staller = JobScheduler::add("stall", stall, 200, 200);
+    runFor(5000, 1);
+    stallMs = 250;
+    runFor(5000, 1);
+    printJob(JobScheduler::stats(fast));
+    printJob(JobScheduler::stats(slow));
+    printJob(JobScheduler::stats(staller));
+}
+
+// The firmware's jobs over ten minutes, stepping the clock 10 ms per loop()
+void firmware() {
+    const unsigned long RUN_MS = 600000;
+    const unsigned long STEP_MS = 10;
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    unsigned long requests = fakeCloud.requests;
+    unsigned long bytes = fakeCloud.bytesSent;
+    uint32_t runsBefore[JobScheduler::MAX_JOBS];
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) runsBefore[id] = JobScheduler::stats(id).runs;
+
+    double serviceSeconds = 0;
+    unsigned long services = 0;
+    unsigned long end = millis() + RUN_MS;
+    while ((long)(millis() - end) < 0) {
+        NativeClock::advance(STEP_MS);
+        loop();
+        // An idle service() on its own: the wheel walk with nothing due
+        auto before = std::chrono::steady_clock::now();
+        JobScheduler::service();
+        serviceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+        services++;
+    }
+
+    printf("firmware jobs, %lu s at one loop() per %lu ms:\n", RUN_MS / 1000, STEP_MS);
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) {
+        const JobScheduler::JobStats& s = JobScheduler::stats(id);
+        uint32_t runs = s.runs - runsBefore[id];
+        printf("  %-10s every %5u ms: %5u runs, %u missed, %u skipped, %u overruns, late max %u ms\n", s.name,
+               (unsigned)s.periodMs, (unsigned)runs, (unsigned)s.missed, (unsigned)s.skipped,
+               (unsigned)s.overruns, (unsigned)s.maxLateMs);
+    }
+    printf("  cloud: %.2f requests/s, %.0f bytes/s; idle service() %.0f ns (host)\n",
+           (fakeCloud.requests - requests) * 1000.0 / RUN_MS, (fakeCloud.bytesSent - bytes) * 1000.0 / RUN_MS,
+           serviceSeconds * 1e9 / services);
+    static char json[JobScheduler::MAX_JOBS * 160];
+    int length = JobScheduler::format(json, sizeof(json));
+    printf("  deviceStatus/jobs (%d bytes)\n", length);
+}
+
+}  // namespace
+
+int runSchedulerBench() {
+    printf("\n=== job scheduler: %u ms ticks, %u-slot wheel ===\n", (unsigned)JobScheduler::TICK_MS,
+           (unsigned)JobScheduler::WHEEL_SLOTS);
+    periods(1);
+    periods(37);
+    stalls();
+    firmware();
+    return 0;
+}
@@ -0,0 +1,445 @@
+// The two uplinks side by side. First the firmware boots and runs on the MQTT
+// uplink against FakeMqtt for two minutes. Then the same stream of cycles
+// (readings and battery every cycle, heartbeat and telemetry every minute)
+// goes through each uplink into a sink with the same virtual round trip, reporting messages, round trips,
+// bytes on the wire (with the per-request HTTPS overhead for Firebase and a
+// TLS record per packet for MQTT), messages per second of link time and host
+// CPU per message. Last, the MQTT uplink over a real TCP connection to a
+// broker, with an app client subscribed, including a connection dropped
+// mid-cycle. Reports wall-clock messages/s, bytes and CPU per message.
+// Measurement only; test/test_mqtt_uplink asserts the same paths.
+//
+//   .pio/build/native/program --bench uplink [--broker host:port] [--rtt ms]
+//
+// Without --broker the in-process LoopbackBroker is used.
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <vector>
+#include "native/fake_backends.h"
+#include "native/loopback_broker.h"
+#include "native/mqtt_socket.h"
+#include "boot_sequence.h"
+#include "device_identity.h"
+#include "firebase_manager.h"
+#include "firebase_uplink.h"
+#include "mqtt_uplink.h"
+#include "readings_delta.h"
+#include "readings_schema.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const unsigned long CYCLE_MS = 2000;
+const unsigned long MODEL_CYCLES = 1800;     // An hour at the upload interval
+const unsigned long SOCKET_CYCLES = 2000;
+const unsigned TLS_RECORD_BYTES = 29;        // Header, explicit nonce and GCM tag per record
+
+double threadCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double wallSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A household load wandering enough for the deadbands to let most cycles through
+PowerReadings readingsAt(unsigned long cycle) {
+    PowerReadings r;
+    double t = cycle * CYCLE_MS / 1000.0;
+    r.timestamp = 1700000000UL + (uint32_t)t;
+    r.voltage = 230 + 2 * sin(t / 300) + 0.2f * sin(t * 1.7);
+    r.power = 400 + 350 * sin(t / 40) + (fmod(t, 600) < 120 ? 2000 : 0);
+    r.powerFactor = 0.85f + 0.1f * sin(t / 90);
+    r.apparentPower = r.power / r.powerFactor;
+    r.current = r.apparentPower / r.voltage;
+    r.reactivePower = sqrtf(r.apparentPower * r.apparentPower - r.power * r.power);
+    r.energy = 12000 + 400 * t / 3600 + cycle * 0.01f;
+    r.frequency = 50 + 0.03f * sin(t / 70);
+    r.loadImpedance = r.voltage / r.current;
+    r.thd = 3 + sin(t / 200);
+    r.distortionPower = r.apparentPower * 0.02f;
+    r.powerQuality = 0.9f;
+    r.isValid = true;
+    r.isCharging = (cycle / 450) % 2 == 0;
+    return r;
+}
+
+bool sameFields(const PowerReadings& a, const PowerReadings& b, uint32_t fields) {
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        if (!(fields & (1UL << i))) continue;
+        const ReadingsField& field = READINGS_SCHEMA[i];
+        if (field.kind == ReadingsField::Bool) {
+            if (a.isCharging != b.isCharging) return false;
+        } else if (field.kind == ReadingsField::Uint32) {
+            if (a.timestamp != b.timestamp) return false;
+        } else {
+            float x = ReadingsSchema::floatAt(a, field), y = ReadingsSchema::floatAt(b, field);
+            if (memcmp(&x, &y, sizeof(x)) != 0) return false;
+        }
+    }
+    return a.channel == b.channel;
+}
+
+// ---------------------------------------------------------------------------
+// Part 1: the firmware on the MQTT uplink
+// ---------------------------------------------------------------------------
+void runFirmware() {
+    printf("\n=== firmware on the MQTT uplink (FakeMqtt), 120 s ===\n");
+    FirebaseManager::setUplink(&mqttUplink);
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(10);
+        loop();
+    }
+    std::vector<FakeMqtt::Message> journal;
+    fakeMqtt.journal = &journal;
+    for (unsigned long start = millis(); millis() - start < 120000;) {
+        NativeClock::advance(100);
+        loop();
+    }
+
+    std::string root = std::string(DeviceIdentity::root()) + "/";
+    unsigned long readings = 0, decoded = 0, retainedReadings = 0, retainedStatus = 0, status = 0;
+    for (const FakeMqtt::Message& m : journal) {
+        if (m.topic == root + "readings") {
+            readings++;
+            PowerReadings r;
+            uint32_t fields = 0;
+            if (ReadingsSchema::fromBinary(m.payload.data(), m.payload.size(), r, &fields) && fields) {
+                decoded++;
+            }
+            if (m.retain) retainedReadings++;
+        } else {
+            status++;
+            if (m.retain) retainedStatus++;
+        }
+    }
+    fakeMqtt.journal = nullptr;
+    printf("  %lu messages: %lu readings (binary, %lu decode, %lu retained), %lu status (%lu retained)\n",
+           (unsigned long)journal.size(), readings, decoded, retainedReadings, status, retainedStatus);
+    printf("  %lu packets, %lu flushes, %lu bytes\n", fakeMqtt.packets, fakeMqtt.flushes, fakeMqtt.bytesSent);
+}
+
+// ---------------------------------------------------------------------------
+// Part 2: the same cycles through each uplink into a sink
+// ---------------------------------------------------------------------------
+class SinkCloud : public CloudBackend {
+public:
+    void begin() override {}
+    bool authenticated() override { return true; }
+    bool ready() override { return true; }
+    bool setJSON(const char* path, const char* json) override { return request(path, strlen(json)); }
+    bool updateJSON(const char* path, const char* json) override { return request(path, strlen(json)); }
+    bool setInt(const char* path, int) override { return request(path, 8); }
+    bool setBool(const char* path, bool) override { return request(path, 5); }
+    bool getBool(const char*, bool*) override { return false; }
+    bool getFloat(const char*, float*) override { return false; }
+    bool beginStream(const char*, StreamCallback) override { return true; }
+    bool streamConnected() override { return true; }
+    const char* errorReason() override { return ""; }
+    bool answered() override { return true; }
+
+    unsigned long rttMs = 0;
+    unsigned long requests = 0;
+    unsigned long bytes = 0;
+
+private:
+    bool request(const char* path, size_t length) {
+        requests++;
+        bytes += strlen(path) + length;
+        NativeClock::advance(rttMs);
+        return true;
+    }
+};
+
+class SinkMqtt : public MqttBackend {
+public:
+    void begin(const char*, MessageCallback) override {}
+    bool connected() override { return true; }
+    bool publish(const char* topic, const uint8_t*, size_t length, uint8_t qos, bool) override {
+        packets++;
+        bytes += FakeMqtt::packetBytes(strlen(topic), length);
+        if (qos) inFlight++;
+        return true;
+    }
+    bool flush(uint32_t) override {
+        if (inFlight == 0) return true;
+        flushes++;
+        NativeClock::advance(rttMs);
+        inFlight = 0;
+        return true;
+    }
+    bool subscribe(const char*, uint8_t) override { return true; }
+    void service() override {}
+    const char* errorReason() override { return ""; }
+
+    unsigned long rttMs = 0;
+    unsigned long packets = 0;
+    unsigned long flushes = 0;
+    unsigned long bytes = 0;
+
+private:
+    unsigned inFlight = 0;
+};
+
+struct Modelled {
+    unsigned long messages = 0;
+    unsigned long roundTrips = 0;
+    unsigned long wireBytes = 0;
+    double linkSeconds = 0;
+    double cpuSeconds = 0;
+    unsigned long failures = 0;
+};
+
+Modelled model(Uplink& uplink, unsigned long rttMs) {
+    SinkCloud cloud;
+    SinkMqtt mqtt;
+    cloud.rttMs = mqtt.rttMs = rttMs;
+    CloudBackend* savedCloud = &Hal::cloud();
+    MqttBackend* savedMqtt = &Hal::mqtt();
+    Hal::setCloud(&cloud);
+    Hal::setMqtt(&mqtt);
+    FirebaseManager::setUplink(&uplink);
+    uplink.begin();
+    ReadingsDelta::reset();
+
+    Modelled result;
+    for (unsigned long cycle = 0; cycle < MODEL_CYCLES; cycle++) {
+        PowerReadings readings = readingsAt(cycle);
+        bool minute = cycle % 30 == 0;
+        // Readings that clear the deadbands (a few more on MQTT, which never
+        // rebaselines every field at once), battery, heartbeat and telemetry
+        result.messages += (ReadingsDelta::select(readings, millis()) ? 1 : 0) + 1 + (minute ? 2 : 0);
+        double cpu = threadCpuSeconds();
+        FirebaseManager::beginCycle(minute);
+        FirebaseManager::queueReadings(readings);
+        FirebaseManager::queueBattery(80 - cycle / 100);
+        if (minute) {
+            FirebaseManager::queueHeartbeat();
+            FirebaseManager::queueTelemetry();
+        }
+        unsigned long started = millis();
+        // Virtual time only moves inside the sink, so the CPU clock is unaffected
+        if (!FirebaseManager::commitCycle()) result.failures++;
+        result.linkSeconds += (millis() - started) / 1000.0;
+        result.cpuSeconds += threadCpuSeconds() - cpu;
+        NativeClock::advance(CYCLE_MS);
+    }
+    if (&uplink == &mqttUplink) {
+        result.roundTrips = mqtt.flushes;
+        result.wireBytes = mqtt.bytes + mqtt.packets * TLS_RECORD_BYTES;
+    } else {
+        result.roundTrips = cloud.requests;
+        result.wireBytes = cloud.bytes + cloud.requests * FirebaseUplink::REQUEST_OVERHEAD_BYTES;
+    }
+    Hal::setCloud(savedCloud);
+    Hal::setMqtt(savedMqtt);
+    return result;
+}
+
+void printModelled(const char* name, const Modelled& m) {
+    printf("  %-9s %9lu %8lu %11lu %9.1f %10.1f %11.0f %9.2f\n", name, m.messages, m.roundTrips, m.wireBytes,
+           (double)m.wireBytes / m.messages, m.linkSeconds, m.linkSeconds > 0 ? m.messages / m.linkSeconds : 0,
+           m.cpuSeconds * 1e6 / m.messages);
+}
+
+void runModelled(unsigned long rttMs) {
+    printf("\n=== modelled: %lu cycles into sinks, %lu ms round trip for both ===\n", MODEL_CYCLES, rttMs);
+    printf("  %-9s %9s %8s %11s %9s %10s %11s %9s\n", "uplink", "messages", "trips", "wire bytes", "B/msg",
+           "link s", "msgs/link-s", "cpu us/msg");
+    Modelled firebase = model(firebaseUplink, rttMs);
+    Modelled mqtt = model(mqttUplink, rttMs);
+    printModelled("firebase", firebase);
+    printModelled("mqtt", mqtt);
+    printf("  mqtt / firebase: %.2fx bytes, %.2fx link time, %.2fx cpu per message\n",
+           (double)mqtt.wireBytes / firebase.wireBytes, mqtt.linkSeconds / firebase.linkSeconds,
+           (mqtt.cpuSeconds / mqtt.messages) / (firebase.cpuSeconds / firebase.messages));
+    if (firebase.failures || mqtt.failures) {
+        printf("  failed cycles: firebase %lu, mqtt %lu\n", firebase.failures, mqtt.failures);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Part 3: a real connection to a broker
+// ---------------------------------------------------------------------------
+// What the firmware handed the transport, in order, and what the app received
+struct Received {
+    std::string topic;
+    std::vector<uint8_t> payload;
+};
+std::vector<Received> appInbox;
+std::vector<Received> deviceSent;
+
+void onApp(const char* topic, const uint8_t* payload, size_t length) {
+    appInbox.push_back({topic, std::vector<uint8_t>(payload, payload + length)});
+}
+
+class TapMqtt : public MqttBackend {
+public:
+    explicit TapMqtt(MqttBackend& inner) : inner(inner) {}
+    void begin(const char* clientId, MessageCallback callback) override { inner.begin(clientId, callback); }
+    bool connected() override { return inner.connected(); }
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) override {
+        deviceSent.push_back({topic, std::vector<uint8_t>(payload, payload + length)});
+        return inner.publish(topic, payload, length, qos, retain);
+    }
+    bool flush(uint32_t timeoutMs) override { return inner.flush(timeoutMs); }
+    bool subscribe(const char* filter, uint8_t qos) override { return inner.subscribe(filter, qos); }
+    void service() override { inner.service(); }
+    const char* errorReason() override { return inner.errorReason(); }
+
+private:
+    MqttBackend& inner;
+};
+
+void drain(SocketMqtt& client, size_t expected, double seconds) {
+    double until = wallSeconds() + seconds;
+    do {
+        client.service();
+    } while (appInbox.size() < expected && wallSeconds() < until);
+}
+
+void runSocket(const char* broker) {
+    LoopbackBroker loopback;
+    std::string host = "127.0.0.1";
+    uint16_t port = 0;
+    if (broker) {
+        const char* colon = strrchr(broker, ':');
+        host = colon ? std::string(broker, colon) : broker;
+        port = colon ? (uint16_t)atoi(colon + 1) : 1883;
+    } else if (loopback.start()) {
+        port = loopback.port();
+    } else {
+        printf("  cannot start the loopback broker\n");
+        return;
+    }
+    printf("\n=== MQTT over TCP to %s %s:%u, %lu cycles ===\n", broker ? "broker" : "loopback broker", host.c_str(),
+           port, SOCKET_CYCLES);
+
+    std::string root = std::string(DeviceIdentity::root()) + "/";
+    SocketMqtt app(host, port);
+    app.begin("bench-app", onApp);
+    if (!app.connected() || !app.subscribe((root + "#").c_str(), 1)) {
+        printf("  app: %s\n", app.errorReason());
+        return;
+    }
+    // Whatever earlier runs left retained on a real broker
+    drain(app, SIZE_MAX, 0.3);
+    appInbox.clear();
+
+    SocketMqtt socket(host, port);
+    TapMqtt device(socket);
+    Hal::setMqtt(&device);
+    FirebaseManager::setUplink(&mqttUplink);
+    mqttUplink.begin();
+    if (!mqttUplink.ready()) {
+        printf("  device: %s\n", socket.errorReason());
+        Hal::setMqtt(&fakeMqtt);
+        return;
+    }
+
+    // The upload cycles, timed on the device's side only
+    ReadingsDelta::reset();
+    Uplink::Stats before = mqttUplink.stats();
+    unsigned long bytesBefore = socket.bytesSent;
+    unsigned long packetsBefore = socket.packetsSent;
+    std::vector<PowerReadings> truth;
+    double cpu = 0;
+    double wall = 0;
+    unsigned long failures = 0;
+    for (unsigned long cycle = 0; cycle < SOCKET_CYCLES; cycle++) {
+        PowerReadings readings = readingsAt(cycle);
+        double cpuStart = threadCpuSeconds(), wallStart = wallSeconds();
+        size_t sentBefore = deviceSent.size();
+        FirebaseManager::beginCycle();
+        FirebaseManager::queueReadings(readings);
+        FirebaseManager::queueBattery(80 - cycle / 100);
+        if (!FirebaseManager::commitCycle()) failures++;
+        cpu += threadCpuSeconds() - cpuStart;
+        wall += wallSeconds() - wallStart;
+        for (size_t i = sentBefore; i < deviceSent.size(); i++) {
+            if (deviceSent[i].topic == root + "readings") truth.push_back(readings);
+        }
+        NativeClock::advance(CYCLE_MS);
+        app.service();
+    }
+    Uplink::Stats after = mqttUplink.stats();
+    unsigned long messages = (after.commits - before.commits) + (after.requestsSaved - before.requestsSaved);
+    drain(app, deviceSent.size(), 3);
+
+    // Readings in the order sent, each decoding to the values the cycle had
+    std::vector<const Received*> sentReadings, gotReadings;
+    for (const Received& r : deviceSent) if (r.topic == root + "readings") sentReadings.push_back(&r);
+    for (const Received& r : appInbox) if (r.topic == root + "readings") gotReadings.push_back(&r);
+    size_t exact = 0;
+    for (size_t i = 0; i < gotReadings.size() && i < sentReadings.size() && i < truth.size(); i++) {
+        PowerReadings decoded;
+        uint32_t fields = 0;
+        exact += gotReadings[i]->payload == sentReadings[i]->payload &&
+                 ReadingsSchema::fromBinary(gotReadings[i]->payload.data(), gotReadings[i]->payload.size(), decoded,
+                                            &fields) &&
+                 sameFields(decoded, truth[i], fields);
+    }
+    printf("  %lu messages (%zu readings) in %.2f s of cycles: %.0f messages/s, %.1f bytes/message, "
+           "%.2f us cpu/message\n", messages, sentReadings.size(), wall, messages / wall,
+           (double)(socket.bytesSent - bytesBefore) / messages, cpu * 1e6 / messages);
+    printf("  device: %lu packets, %lu bytes out, %lu bytes in\n", socket.packetsSent - packetsBefore,
+           socket.bytesSent - bytesBefore, socket.bytesReceived);
+    printf("  app: %zu of %zu messages, %zu of %zu readings bit-exact in order, %lu failed cycles\n",
+           appInbox.size(), deviceSent.size(), exact, sentReadings.size(), failures);
+
+    // A connection lost in the middle of a cycle: what was in flight is resent
+    const int DROP_MESSAGES = 20;
+    appInbox.clear();
+    unsigned long resentBefore = socket.resent;
+    FirebaseManager::beginCycle();
+    for (int n = 0; n < DROP_MESSAGES; n++) {
+        if (n == DROP_MESSAGES / 2) socket.drop();
+        char path[32], value[8];
+        snprintf(path, sizeof(path), "bench/seq/%d", n);
+        snprintf(value, sizeof(value), "%d", n);
+        mqttUplink.publishStatus(path, value);
+    }
+    bool committed = FirebaseManager::commitCycle();
+    drain(app, SIZE_MAX, 0.5);  // The broker forwarded each before acknowledging it
+    std::vector<int> seen(DROP_MESSAGES, 0);
+    for (const Received& r : appInbox) {
+        if (r.topic.compare(0, root.size() + 10, root + "bench/seq/") != 0) continue;
+        int n = atoi(r.topic.c_str() + root.size() + 10);
+        if (n >= 0 && n < DROP_MESSAGES) seen[n]++;
+    }
+    int delivered = 0, duplicates = 0;
+    for (int n : seen) delivered += n > 0, duplicates += n > 1 ? n - 1 : 0;
+    printf("  dropped mid-cycle: %s after %lu reconnects, %lu resent, %d of %d delivered, %d duplicates "
+           "(QoS 1 is at least once)\n", committed ? "committed" : "not committed", socket.reconnects,
+           socket.resent - resentBefore, delivered, DROP_MESSAGES, duplicates);
+
+    // Leave nothing retained behind on a shared broker
+    for (int n = 0; n < DROP_MESSAGES; n++) {
+        app.publish((root + "bench/seq/" + std::to_string(n)).c_str(), nullptr, 0, 1, true);
+    }
+    app.publish((root + "commands/reset").c_str(), nullptr, 0, 1, true);
+    app.flush(2000);
+    socket.disconnect();
+    app.disconnect();
+    Hal::setMqtt(&fakeMqtt);
+}
+
+}  // namespace
+
+int runUplinkBench(const char* broker, unsigned long rttMs) {
+    runFirmware();
+    runModelled(rttMs);
+    runSocket(broker);
+    return 0;
+}
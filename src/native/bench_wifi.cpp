@@ -0,0 +1,120 @@
+// WiFi reconnect latency: boots the firmware, then takes the access point
+// away for short blips and times how long the link needs once the AP is
+// back. Each blip runs twice, once rejoining from the cached BSSID/channel
+// and lease, once with the cache dropped (scan + DHCP, the old path).
+// Then the DHCP server hands out a different address: how long a cached
+// lease that nothing is routed to survives, and whether a renewed lease
+// makes it into the cache.
+//
+//   .pio/build/native/program --bench wifi
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <algorithm>
+#include <vector>
+#include "credentials.h"
+#include "wifi_link.h"
+#include "boot_sequence.h"
+#include "native/fake_backends.h"
+
+void setup();
+void loop();
+
+static const unsigned long STEP_MS = 10;
+static const unsigned long GIVE_UP_MS = 60000;
+
+static unsigned long stepUntilConnected() {
+    unsigned long start = millis();
+    while (!WifiLink::connected() && millis() - start < GIVE_UP_MS) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    return millis() - start;
+}
+
+// Link down for blipMs, then time from the AP's return to a usable link
+static unsigned long blip(unsigned long blipMs, bool useCache) {
+    if (!useCache) WifiLink::forgetCache();
+    WiFi.setLinkAvailable(false);
+    for (unsigned long t = 0; t < blipMs; t += STEP_MS) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    WiFi.setLinkAvailable(true);
+    return stepUntilConnected();
+}
+
+// Steps with the cloud reachable only from the address DHCP hands out, until it is
+static unsigned long stepUntilRouted() {
+    unsigned long start = millis();
+    while (!WiFi.addressValid() && millis() - start < GIVE_UP_MS) {
+        fakeCloud.online = WiFi.addressValid();
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    fakeCloud.online = true;
+    return millis() - start;
+}
+
+static void printRow(const char* label, std::vector<unsigned long>& ms) {
+    std::sort(ms.begin(), ms.end());
+    printf("%-22s %8lu %8lu %8lu\n", label, ms[ms.size() / 2], ms[(ms.size() * 9) / 10], ms.back());
+}
+
+int runWifiBench() {
+    static const unsigned long BLIPS_MS[] = { 100, 300, 1000, 2500 };
+    static const int REPEATS = 5;
+
+    // A second, stronger AP for the first network: the scan should pick it
+    WiFi.addAccessPoint(WIFI_NETWORKS[0].ssid, 0x40, 11, -48);
+
+    setup();
+    unsigned long coldMs = stepUntilConnected();
+    printf("\n=== WiFi reconnect benchmark (virtual ms) ===\n");
+    printf("cold boot, no cache:   %lu ms to link (%u scan, %d dBm chosen)\n",
+           coldMs, (unsigned)WifiLink::getStats().scans, (int)WiFi.RSSI());
+
+    printf("\n%-22s %8s %8s %8s\n", "AP back -> link up", "p50", "p90", "max");
+    for (unsigned long blipMs : BLIPS_MS) {
+        std::vector<unsigned long> cached, scanned;
+        for (int i = 0; i < REPEATS; i++) {
+            cached.push_back(blip(blipMs, true));
+            scanned.push_back(blip(blipMs, false));
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "%lu ms blip, cached", blipMs);
+        printRow(label, cached);
+        snprintf(label, sizeof(label), "%lu ms blip, scan+DHCP", blipMs);
+        printRow(label, scanned);
+    }
+
+    // The network was renumbered while the cached lease sat unused
+    WiFi.dhcpAddress = IPAddress(192, 168, 4, 57);
+    unsigned long linkMs = blip(300, true);
+    unsigned long routedMs = linkMs + stepUntilRouted();
+    printf("\nstale cached lease:    link in %lu ms, routed in %lu ms (%u lease dropped)\n",
+           linkMs, routedMs, (unsigned)WifiLink::getStats().staleLeases);
+
+    // Renewed with another address while up; the next fast rejoin must use it
+    WiFi.dhcpAddress = IPAddress(192, 168, 4, 80);
+    for (unsigned long t = 0; t < 65000; t += STEP_MS) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    blip(300, true);
+    printf("renewed lease:         rejoined as %s, %s\n", WiFi.localIP().toString().c_str(),
+           WiFi.addressValid() ? "cache followed the renewal" : "cache still holds the old lease");
+
+    // Power cycle: RTC memory is gone, the NVS copy still has the AP and lease
+    WifiLink::forgetCache();
+    WiFi.disconnect(true);
+    WifiLink::start();
+    unsigned long warmMs = stepUntilConnected();
+    const WifiLink::Stats& st = WifiLink::getStats();
+    printf("\nreboot from NVS cache: %lu ms to link\n", warmMs);
+    printf("totals: %u joins, %u scans, %u fast, %u after scan, %u reconnects, %u stale leases, "
+           "worst %lu ms down\n",
+           (unsigned)st.attempts, (unsigned)st.scans, (unsigned)st.fastConnects,
+           (unsigned)st.scanConnects, (unsigned)st.reconnects, (unsigned)st.staleLeases, st.maxReconnectMs);
+    return 0;
+}
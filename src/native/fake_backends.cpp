@@ -0,0 +1,500 @@
+#include "native/fake_backends.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include "credentials.h"
+#include "crc16.h"
+#include <algorithm>
+
+SimulatedPzem simulatedPzem;
+PzemMeter nativeMeter(simulatedPzem);
+FakeAdc fakeAdc;
+FakeCloud fakeCloud;
+FakeMqtt fakeMqtt;
+FakeFlash fakeFlash;
+FakeNvs fakeNvs;
+FakePower fakePower;
+
+MeterBackend* Hal::meterBackend = &nativeMeter;
+AdcBackend* Hal::adcBackend = &fakeAdc;
+CloudBackend* Hal::cloudBackend = &fakeCloud;
+MqttBackend* Hal::mqttBackend = &fakeMqtt;
+FlashBackend* Hal::flashBackend = &fakeFlash;
+NvsBackend* Hal::nvsBackend = &fakeNvs;
+PowerBackend* Hal::powerBackend = &fakePower;
+
+void addConfiguredNetworks() {
+    for (int n = 0; n < NETWORK_COUNT; n++) {
+        WiFi.addAccessPoint(WIFI_NETWORKS[n].ssid, (uint8_t)(n + 1), 1 + (5 * n) % 13, (int8_t)(-70 + 6 * n));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SimulatedPzem
+// ---------------------------------------------------------------------------
+float SimulatedPzem::loadVoltage(uint8_t meter) const {
+    return 230.0f + 4.0f * sinf(millis() / 60000.0f) + 0.3f * meter;
+}
+
+float SimulatedPzem::loadCurrent(uint8_t meter) const {
+    float appliance = meter == 0 && applianceOn() ? applianceAmps : 0;
+    return 4.0f + 1.5f * sinf(millis() / 17000.0f + meter) + appliance;
+}
+
+float SimulatedPzem::loadPower(uint8_t meter) const {
+    return loadVoltage(meter) * loadCurrent(meter) * 0.92f;
+}
+
+void SimulatedPzem::integrateEnergy(uint8_t meter) {
+    unsigned long now = millis();
+    Meter& m = meters[meter];
+    m.energyWh += loadPower(meter) * (now - m.lastIntegration) / 3600000.0;
+    m.lastIntegration = now;
+}
+
+int SimulatedPzem::available() {
+    unsigned long now = micros();
+    size_t ready = rxPos;
+    while (ready < rx.size() && rxReadyAt[ready] <= now) ready++;
+    return (int)(ready - rxPos);
+}
+
+int SimulatedPzem::read() {
+    if (available() == 0) return -1;
+    return rx[rxPos++];
+}
+
+size_t SimulatedPzem::write(const uint8_t* data, size_t len) {
+    if (rxPos == rx.size()) {
+        rx.clear();
+        rxReadyAt.clear();
+        rxPos = 0;
+    }
+    respond(data, len);
+    return len;
+}
+
+void SimulatedPzem::respond(const uint8_t* frame, size_t len) {
+    requests++;
+    if (len < 4 || crc16(frame, len - 2) != (frame[len - 2] | frame[len - 1] << 8)) return;
+    if (dropoutEvery && requests % dropoutEvery == 0) return;
+
+    // Nobody answers an unknown address; several meters on 0xF8 would collide
+    uint8_t meter;
+    if (frame[0] == 0xF8 && meters.size() == 1) meter = 0;
+    else if (frame[0] >= 1 && frame[0] <= meters.size()) meter = frame[0] - 1;
+    else return;
+    integrateEnergy(meter);
+
+    uint8_t reply[32];
+    size_t replyLen = 0;
+    reply[replyLen++] = meter + 1;  // Own address, also used when polled on 0xF8
+    if (frame[1] == 0x04 && len == 8) {
+        uint32_t current = (uint32_t)lroundf(loadCurrent(meter) * 1000.0f);
+        uint32_t power = (uint32_t)lroundf(loadPower(meter) * 10.0f);
+        uint32_t energy = (uint32_t)meters[meter].energyWh;
+        uint16_t regs[10] = {
+            (uint16_t)lroundf(loadVoltage(meter) * 10.0f),
+            (uint16_t)(current & 0xFFFF), (uint16_t)(current >> 16),
+            (uint16_t)(power & 0xFFFF), (uint16_t)(power >> 16),
+            (uint16_t)(energy & 0xFFFF), (uint16_t)(energy >> 16),
+            500, 92, 0
+        };
+        reply[replyLen++] = 0x04;
+        reply[replyLen++] = 20;
+        for (uint16_t r : regs) {
+            reply[replyLen++] = r >> 8;
+            reply[replyLen++] = r & 0xFF;
+        }
+    } else if (frame[1] == 0x42 && len == 4) {
+        meters[meter].energyWh = 0;
+        reply[replyLen++] = 0x42;
+    } else {
+        reply[replyLen++] = frame[1] | 0x80;
+        reply[replyLen++] = 0x01;  // Illegal function
+    }
+    uint16_t crc = crc16(reply, replyLen);
+    reply[replyLen++] = crc & 0xFF;
+    reply[replyLen++] = crc >> 8;
+    if (corruptEvery && requests % corruptEvery == 0) reply[3] ^= 0x10;
+
+    // Request on the wire, ~2 ms turnaround, then 10 bits per reply byte
+    unsigned long byteMicros = 10000000UL / baud;
+    unsigned long t = micros() + len * byteMicros + 2000;
+    for (size_t i = 0; i < replyLen; i++) {
+        t += byteMicros;
+        rx.push_back(reply[i]);
+        rxReadyAt.push_back(t);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// FakeAdc
+// ---------------------------------------------------------------------------
+FakeAdc::FakeAdc() {
+    // 230 V sense and a CT on a drive load: voltage flat-topped, current with
+    // the 6-pulse rectifier's 5th/7th/11th/13th and a little triplen content
+    mainsVoltage.raw = 2048;
+    mainsVoltage.noise = 1.5f;
+    mainsVoltage.hz = 50;
+    mainsVoltage.amplitude[1] = 1400;
+    mainsVoltage.amplitude[3] = 1400 * 0.012f;
+    mainsVoltage.amplitude[5] = 1400 * 0.030f;
+    mainsVoltage.amplitude[7] = 1400 * 0.015f;
+    mainsCurrent.raw = 2048;
+    mainsCurrent.noise = 1.5f;
+    mainsCurrent.hz = 50;
+    const float currentProfile[MAX_ORDER + 1] = {0, 1, 0, 0.04f, 0, 0.38f, 0, 0.18f, 0, 0.02f, 0, 0.07f, 0, 0.05f, 0, 0.01f};
+    for (uint8_t h = 1; h <= MAX_ORDER; h++) {
+        mainsCurrent.amplitude[h] = 900 * currentProfile[h];
+        mainsCurrent.phase[h] = 0.4f * h;
+    }
+}
+
+FakeAdc::Source& FakeAdc::source(uint8_t pin) {
+    switch (pin) {
+        case 34: return battery;
+        case 36: return mainsCurrent;
+        case 39: return mainsVoltage;
+        default: return charging;
+    }
+}
+
+uint16_t FakeAdc::convert(const Source& source, double seconds) {
+    auto uniform = [this]() {
+        rng = rng * 1664525u + 1013904223u;
+        return ((rng >> 8) + 0.5) / 16777216.0;
+    };
+    if (source.spikeRate > 0 && uniform() < source.spikeRate) return uniform() < 0.5 ? 0 : 4095;
+    double value = source.raw;
+    if (source.hz > 0) {
+        double cycles = source.hz * seconds;
+        cycles -= floor(cycles);
+        for (uint8_t h = 1; h <= MAX_ORDER; h++) {
+            if (source.amplitude[h] != 0) value += source.amplitude[h] * sin(2.0 * M_PI * h * cycles + source.phase[h]);
+        }
+    }
+    if (source.noise > 0) {  // Box-Muller
+        value += source.noise * sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+    }
+    if (value < 0) value = 0;
+    if (value > 4095) value = 4095;
+    return (uint16_t)lround(value);
+}
+
+bool FakeAdc::startContinuous(const uint8_t* pinList, uint8_t count, uint32_t sampleRateHz) {
+    if (!continuousSupported || count == 0 || count > sizeof(pins)) return false;
+    memcpy(pins, pinList, count);
+    pinCount = count;
+    nextPin = 0;
+    rateHz = sampleRateHz;
+    readAtMicros = micros();
+    owed = 0;
+    streamSeconds = readAtMicros / 1e6;
+    return true;
+}
+
+size_t FakeAdc::readContinuous(AdcSample* out, size_t max) {
+    if (!pinCount) return 0;
+    unsigned long now = micros();
+    owed += (now - readAtMicros) * (double)rateHz / 1e6;
+    readAtMicros = now;
+    if (owed > DMA_SAMPLES) {  // The DMA ring wrapped; the oldest conversions are gone
+        unsigned long lost = (unsigned long)(owed - DMA_SAMPLES);
+        overruns += lost;
+        streamSeconds += (double)lost / rateHz;
+        nextPin = (nextPin + lost) % pinCount;
+        owed -= lost;
+    }
+    size_t produced = 0;
+    while (owed >= 1 && produced < max) {
+        out[produced].pin = pins[nextPin];
+        out[produced].raw = convert(source(pins[nextPin]), streamSeconds);
+        streamSeconds += 1.0 / rateHz;
+        nextPin = (nextPin + 1) % pinCount;
+        produced++;
+        owed -= 1;
+    }
+    conversions += produced;
+    return produced;
+}
+
+// ---------------------------------------------------------------------------
+// FakeCloud
+// ---------------------------------------------------------------------------
+std::string FakeCloud::normalize(const char* path) {
+    std::string p = path;
+    if (!p.empty() && p[0] == '/') p.erase(0, 1);
+    return p;
+}
+
+bool FakeCloud::write(const char* path, const std::string& value) {
+    requests++;
+    NativeClock::advance(rttMs);
+    if (!online || rejecting) return false;
+    bytesSent += strlen(path) + value.size();
+    if (journal) journal->push_back({path, value, false});
+    store(normalize(path), value);
+    return true;
+}
+
+// Writing a node replaces everything under it, as in the real database
+void FakeCloud::store(const std::string& path, const std::string& value) {
+    std::string prefix = path + "/";
+    for (auto it = nodes.lower_bound(prefix); it != nodes.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+        it = nodes.erase(it);
+    }
+    nodes[path] = value;
+}
+
+bool FakeCloud::setJSON(const char* path, const char* json) {
+    return write(path, json);
+}
+
+// Splits the top-level members of the update object; each key is a path
+// relative to the update location.
+bool FakeCloud::updateJSON(const char* path, const char* json) {
+    requests++;
+    NativeClock::advance(rttMs);
+    if (!online || rejecting) return false;
+    bytesSent += strlen(path) + strlen(json);
+    if (journal) journal->push_back({path, json, true});
+
+    std::string base = normalize(path);
+    if (!base.empty() && base.back() != '/') base += '/';
+    const char* p = json + 1;  // Skip '{'
+    while (*p && *p != '}') {
+        const char* keyStart = strchr(p, '"') + 1;
+        const char* keyEnd = strchr(keyStart, '"');
+        const char* valueStart = keyEnd + 2;  // Skip '":'
+        const char* valueEnd = valueStart;
+        int depth = 0;
+        bool inString = false;
+        for (; *valueEnd; valueEnd++) {
+            char c = *valueEnd;
+            if (inString) { if (c == '"' && valueEnd[-1] != '\\') inString = false; continue; }
+            if (c == '"') inString = true;
+            else if (c == '{' || c == '[') depth++;
+            else if (c == '}' || c == ']') { if (depth == 0) break; depth--; }
+            else if (c == ',' && depth == 0) break;
+        }
+        store(base + std::string(keyStart, keyEnd), std::string(valueStart, valueEnd));
+        p = *valueEnd == ',' ? valueEnd + 1 : valueEnd;
+    }
+    return true;
+}
+
+bool FakeCloud::setInt(const char* path, int value) {
+    return write(path, std::to_string(value));
+}
+
+bool FakeCloud::setBool(const char* path, bool value) {
+    return write(path, value ? "true" : "false");
+}
+
+bool FakeCloud::getBool(const char* path, bool* value) {
+    requests++;
+    if (!online) return false;
+    auto it = nodes.find(normalize(path));
+    *value = it != nodes.end() && it->second == "true";
+    return true;
+}
+
+bool FakeCloud::getFloat(const char* path, float* value) {
+    requests++;
+    if (!online) return false;
+    std::string leaf;
+    if (!lookup(path, leaf)) return false;
+    *value = strtof(leaf.c_str(), nullptr);
+    return true;
+}
+
+bool FakeCloud::lookup(const char* path, std::string& value) const {
+    std::string p = normalize(path);
+    auto it = nodes.find(p);
+    if (it != nodes.end()) {
+        value = it->second;
+        return true;
+    }
+    // A leaf inside an object written in one piece, e.g. readings/energy
+    size_t slash = p.rfind('/');
+    if (slash == std::string::npos) return false;
+    it = nodes.find(p.substr(0, slash));
+    if (it == nodes.end()) return false;
+    std::string key = "\"" + p.substr(slash + 1) + "\":";
+    size_t pos = it->second.find(key);
+    if (pos == std::string::npos) return false;
+    size_t start = pos + key.size();
+    value = it->second.substr(start, it->second.find_first_of(",}", start) - start);
+    return true;
+}
+
+bool FakeCloud::beginStream(const char* path, StreamCallback callback) {
+    requests++;
+    if (!online) return false;
+    streamPath = normalize(path);
+    streamCallback = callback;
+    streamOpen = true;
+
+    // Initial event carries the current node
+    std::string snapshot = "{";
+    for (const auto& node : nodes) {
+        if (node.first.compare(0, streamPath.size() + 1, streamPath + "/") != 0) continue;
+        if (snapshot.size() > 1) snapshot += ",";
+        snapshot += "\"" + node.first.substr(streamPath.size() + 1) + "\":" + node.second;
+    }
+    snapshot += "}";
+    callback("/", snapshot.c_str());
+    return true;
+}
+
+void FakeCloud::pushStreamEvent(const char* path, const char* data) {
+    nodes[streamPath + path] = data;
+    if (streamConnected() && streamCallback) streamCallback(path, data);
+}
+
+// ---------------------------------------------------------------------------
+// FakeMqtt
+// ---------------------------------------------------------------------------
+void FakeMqtt::begin(const char* clientId, MessageCallback callback) {
+    (void)clientId;
+    this->callback = callback;
+    connectAt = millis() + connectDelayMs;
+}
+
+size_t FakeMqtt::packetBytes(size_t topicLength, size_t payloadLength) {
+    size_t remaining = 2 + topicLength + 2 + payloadLength;
+    size_t lengthBytes = remaining < 128 ? 1 : remaining < 16384 ? 2 : 3;
+    return 1 + lengthBytes + remaining;
+}
+
+bool FakeMqtt::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) {
+    if (!connected()) return false;
+    packets++;
+    bytesSent += packetBytes(strlen(topic), length);
+    if (qos > 0) inFlight++;
+    if (journal) journal->push_back({topic, std::vector<uint8_t>(payload, payload + length), retain});
+    if (retain) {
+        if (length == 0) retained.erase(topic);
+        else retained[topic].assign(payload, payload + length);
+    }
+    deliver(topic, payload, length);
+    return true;
+}
+
+// The PUBACKs of everything in flight come back together
+bool FakeMqtt::flush(uint32_t timeoutMs) {
+    if (inFlight == 0) return true;
+    flushes++;
+    NativeClock::advance(online ? rttMs : timeoutMs);
+    if (!connected()) return false;  // Still in the session; resent on reconnect
+    bytesReceived += 4 * inFlight;
+    inFlight = 0;
+    return true;
+}
+
+bool FakeMqtt::subscribe(const char* filter, uint8_t qos) {
+    (void)qos;
+    if (!connected()) return false;
+    NativeClock::advance(rttMs);  // SUBACK
+    packets++;
+    bytesSent += 5 + 2 + strlen(filter) + 1;
+    if (std::find(filters.begin(), filters.end(), filter) == filters.end()) filters.push_back(filter);
+    // The broker hands a new subscription whatever is retained under it
+    for (const auto& message : retained) {
+        if (callback && matches(filter, message.first)) {
+            callback(message.first.c_str(), message.second.data(), message.second.size());
+        }
+    }
+    return true;
+}
+
+void FakeMqtt::pushMessage(const char* topic, const char* payload, bool retain) {
+    size_t length = strlen(payload);
+    if (retain) retained[topic].assign(payload, payload + length);
+    if (connected()) deliver(topic, reinterpret_cast<const uint8_t*>(payload), length);
+}
+
+void FakeMqtt::deliver(const std::string& topic, const uint8_t* payload, size_t length) {
+    if (!callback) return;
+    for (const auto& filter : filters) {
+        if (!matches(filter, topic)) continue;
+        bytesReceived += packetBytes(topic.size(), length);
+        callback(topic.c_str(), payload, length);
+        return;  // Once, however many filters overlap
+    }
+}
+
+// "+" matches one level, a trailing "#" the rest
+bool FakeMqtt::matches(const std::string& filter, const std::string& topic) {
+    size_t f = 0, t = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') return true;
+        if (filter[f] == '+') {
+            while (t < topic.size() && topic[t] != '/') t++;
+            f++;
+            continue;
+        }
+        if (t >= topic.size() || filter[f] != topic[t]) return false;
+        f++;
+        t++;
+    }
+    return t == topic.size();
+}
+
+// ---------------------------------------------------------------------------
+// FakeFlash
+// ---------------------------------------------------------------------------
+bool FakeFlash::begin() {
+    if (memory.empty()) {
+        memory.assign((size_t)sectors * sectorSize(), 0xFF);
+        eraseCounts.assign(sectors, 0);
+    }
+    return true;
+}
+
+bool FakeFlash::read(uint32_t offset, void* data, size_t len) {
+    if (offset + len > memory.size()) return false;
+    memcpy(data, &memory[offset], len);
+    return true;
+}
+
+bool FakeFlash::write(uint32_t offset, const void* data, size_t len) {
+    if (offset + len > memory.size()) return false;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) memory[offset + i] &= bytes[i];
+    bytesWritten += len;
+    return true;
+}
+
+bool FakeFlash::eraseSector(uint32_t sector) {
+    if (sector >= sectors) return false;
+    memset(&memory[(size_t)sector * sectorSize()], 0xFF, sectorSize());
+    eraseCounts[sector]++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// FakeNvs
+// ---------------------------------------------------------------------------
+size_t FakeNvs::read(const char* key, void* data, size_t len) {
+    auto it = blobs.find(key);
+    if (it == blobs.end()) return 0;
+    size_t n = std::min(len, it->second.size());
+    memcpy(data, it->second.data(), n);
+    return n;
+}
+
+bool FakeNvs::write(const char* key, const void* data, size_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    std::vector<uint8_t>& blob = blobs[key];
+    if (tearNextWrite) {
+        tearNextWrite = false;
+        blob.resize(len);
+        memcpy(blob.data(), bytes, len / 2);  // The rest keeps whatever was there
+        return false;
+    }
+    blob.assign(bytes, bytes + len);
+    writes++;
+    bytesWritten += len;
+    return true;
+}
@@ -0,0 +1,48 @@
+#include "native/heap_audit.h"
+#include <atomic>
+#include <stdlib.h>
+
+static std::atomic<bool> counting{false};
+static std::atomic<unsigned long> allocations{0};
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+extern "C" void* malloc(size_t size) {
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    return __libc_realloc(ptr, size);
+}
+#else
+#include <new>
+
+void* operator new(size_t size) {
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+#endif
+
+void HeapAudit::start() {
+    allocations = 0;
+    counting = true;
+}
+
+unsigned long HeapAudit::stop() {
+    counting = false;
+    return allocations.load();
+}
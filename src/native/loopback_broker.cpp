@@ -0,0 +1,173 @@
+#include "native/loopback_broker.h"
+#include "native/fake_backends.h"
+#include "native/mqtt_socket.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool LoopbackBroker::start() {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 8) != 0 ||
+        getsockname(listener, (sockaddr*)&address, &length) != 0) {
+        return false;
+    }
+    boundPort = ntohs(address.sin_port);
+    running = true;
+    thread = std::thread([this] { run(); });
+    return true;
+}
+
+void LoopbackBroker::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+    for (Connection& c : connections) ::close(c.fd);
+    connections.clear();
+    if (listener >= 0) ::close(listener);
+    listener = -1;
+}
+
+void LoopbackBroker::run() {
+    while (running) {
+        std::vector<pollfd> fds = {{listener, POLLIN, 0}};
+        for (const Connection& c : connections) fds.push_back({c.fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), 20) <= 0) continue;
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, nullptr, nullptr);
+            int one = 1;
+            if (fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (fd >= 0) connections.push_back({fd, {}, "", false});
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents) receive(connections[i - 1]);
+        }
+        for (size_t i = 0; i < connections.size();) {
+            if (!connections[i].closed) {
+                i++;
+                continue;
+            }
+            auto session = sessions.find(connections[i].clientId);
+            if (session != sessions.end() && session->second.fd == connections[i].fd) session->second.fd = -1;
+            ::close(connections[i].fd);
+            connections.erase(connections.begin() + i);
+        }
+    }
+}
+
+// What arrived before the connection closed is still handled, as by a real broker
+void LoopbackBroker::receive(Connection& c) {
+    uint8_t chunk[4096];
+    for (;;) {
+        ssize_t n = recv(c.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n > 0) {
+            c.rx.insert(c.rx.end(), chunk, chunk + n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) c.closed = true;
+        if (n < 0 && errno == EINTR) continue;
+        break;
+    }
+    uint8_t header;
+    std::vector<uint8_t> body;
+    while (MqttWire::take(c.rx, header, body)) handle(c, header, body);
+}
+
+void LoopbackBroker::send(int fd, const std::vector<uint8_t>& bytes) {
+    if (fd >= 0) ::send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+}
+
+void LoopbackBroker::handle(Connection& c, uint8_t header, const std::vector<uint8_t>& body) {
+    switch (header >> 4) {
+        case MqttWire::Connect: {
+            // "MQTT", level, flags, keep alive, then the client id
+            if (body.size() < 12) {
+                c.closed = true;
+                return;
+            }
+            bool clean = body[7] & 0x02;
+            size_t idLength = body[10] << 8 | body[11];
+            c.clientId.assign(body.begin() + 12, body.begin() + 12 + std::min(idLength, body.size() - 12));
+            bool present = !clean && sessions.count(c.clientId);
+            if (!present) sessions[c.clientId] = Session();
+            Session& session = sessions[c.clientId];
+            for (Connection& other : connections) {
+                if (other.fd == session.fd && &other != &c) other.closed = true;  // Takeover
+            }
+            session.fd = c.fd;
+            send(c.fd, MqttWire::packet(MqttWire::Connack << 4, {(uint8_t)(present ? 1 : 0), 0}));
+            for (const auto& packet : session.queued) send(c.fd, packet);
+            session.queued.clear();
+            break;
+        }
+        case MqttWire::Publish: {
+            std::string topic;
+            uint16_t id;
+            size_t payloadAt;
+            if (!MqttWire::parsePublish(header, body, topic, id, payloadAt)) return;
+            if (id) send(c.fd, MqttWire::ack(MqttWire::Puback, id));
+            const uint8_t* payload = body.data() + payloadAt;
+            size_t length = body.size() - payloadAt;
+            if (header & 1) {
+                if (length == 0) retained.erase(topic);
+                else retained[topic].assign(payload, payload + length);
+            }
+            uint8_t qos = header >> 1 & 3;
+            for (auto& s : sessions) {
+                for (const auto& filter : s.second.filters) {
+                    if (!FakeMqtt::matches(filter.first, topic)) continue;
+                    deliver(s.second, topic, payload, length, std::min(qos, filter.second), false);
+                    break;
+                }
+            }
+            break;
+        }
+        case MqttWire::Subscribe: {
+            Session& session = sessions[c.clientId];
+            std::vector<uint8_t> granted = {body[0], body[1]};
+            for (size_t at = 2; at + 2 < body.size();) {
+                size_t length = body[at] << 8 | body[at + 1];
+                std::string filter(body.begin() + at + 2, body.begin() + at + 2 + length);
+                uint8_t qos = std::min<uint8_t>(body[at + 2 + length], 1);
+                at += 3 + length;
+                session.filters.push_back({filter, qos});
+                granted.push_back(qos);
+                for (const auto& r : retained) {
+                    if (FakeMqtt::matches(filter, r.first)) {
+                        deliver(session, r.first, r.second.data(), r.second.size(), qos, true);
+                    }
+                }
+            }
+            // SUBACK goes first, the retained messages were only queued behind it
+            std::vector<std::vector<uint8_t>> pending;
+            pending.swap(held);
+            send(c.fd, MqttWire::packet(MqttWire::Suback << 4, granted));
+            for (const auto& packet : pending) send(c.fd, packet);
+            break;
+        }
+        case MqttWire::Pingreq:
+            send(c.fd, MqttWire::packet(MqttWire::Pingresp << 4, {}));
+            break;
+        case MqttWire::Disconnect:
+            c.closed = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void LoopbackBroker::deliver(Session& session, const std::string& topic, const uint8_t* payload, size_t length,
+                             uint8_t qos, bool retain) {
+    if (qos && ++session.nextId == 0) session.nextId = 1;
+    std::vector<uint8_t> packet = MqttWire::publish(topic, payload, length, qos, retain, qos ? session.nextId : 0);
+    if (retain) held.push_back(packet);
+    else if (session.fd >= 0) send(session.fd, packet);
+    else if (qos) session.queued.push_back(packet);
+}
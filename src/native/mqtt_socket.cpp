@@ -0,0 +1,313 @@
+#include "native/mqtt_socket.h"
+#include <Arduino.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// MqttWire
+// ---------------------------------------------------------------------------
+void MqttWire::putLength(std::vector<uint8_t>& out, size_t length) {
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        out.push_back(length ? byte | 0x80 : byte);
+    } while (length);
+}
+
+void MqttWire::putUint16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(value >> 8);
+    out.push_back(value & 0xFF);
+}
+
+void MqttWire::putString(std::vector<uint8_t>& out, const std::string& text) {
+    putUint16(out, (uint16_t)text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+std::vector<uint8_t> MqttWire::packet(uint8_t header, const std::vector<uint8_t>& body) {
+    std::vector<uint8_t> out;
+    out.reserve(body.size() + 5);
+    out.push_back(header);
+    putLength(out, body.size());
+    out.insert(out.end(), body.begin(), body.end());
+    return out;
+}
+
+std::vector<uint8_t> MqttWire::publish(const std::string& topic, const uint8_t* payload, size_t length,
+                                       uint8_t qos, bool retain, uint16_t id) {
+    std::vector<uint8_t> body;
+    body.reserve(topic.size() + length + 4);
+    putString(body, topic);
+    if (qos > 0) putUint16(body, id);
+    body.insert(body.end(), payload, payload + length);
+    return packet(Publish << 4 | qos << 1 | (retain ? 1 : 0), body);
+}
+
+std::vector<uint8_t> MqttWire::ack(Type type, uint16_t id) {
+    std::vector<uint8_t> body;
+    putUint16(body, id);
+    return packet(type << 4, body);
+}
+
+bool MqttWire::take(std::vector<uint8_t>& buffer, uint8_t& header, std::vector<uint8_t>& body) {
+    size_t length = 0, at = 1;
+    for (unsigned shift = 0;; shift += 7, at++) {
+        if (at >= buffer.size()) return false;
+        length |= (size_t)(buffer[at] & 0x7F) << shift;
+        if (!(buffer[at] & 0x80)) break;
+        if (shift >= 21) return false;  // Malformed; the caller drops the connection on timeout
+    }
+    at++;
+    if (buffer.size() < at + length) return false;
+    header = buffer[0];
+    body.assign(buffer.begin() + at, buffer.begin() + at + length);
+    buffer.erase(buffer.begin(), buffer.begin() + at + length);
+    return true;
+}
+
+bool MqttWire::parsePublish(uint8_t header, const std::vector<uint8_t>& body, std::string& topic, uint16_t& id,
+                            size_t& payloadAt) {
+    if (body.size() < 2) return false;
+    size_t topicLength = body[0] << 8 | body[1];
+    size_t at = 2 + topicLength;
+    uint8_t qos = header >> 1 & 3;
+    if (body.size() < at + (qos ? 2 : 0)) return false;
+    topic.assign(body.begin() + 2, body.begin() + at);
+    id = 0;
+    if (qos) {
+        id = body[at] << 8 | body[at + 1];
+        at += 2;
+    }
+    payloadAt = at;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// SocketMqtt
+// ---------------------------------------------------------------------------
+void SocketMqtt::begin(const char* clientId, MessageCallback callback) {
+    this->clientId = clientId;
+    this->callback = callback;
+    open();
+}
+
+bool SocketMqtt::open() {
+    close();
+    retryAt = Clock::now() + std::chrono::seconds(1);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+        error = "cannot resolve " + host;
+        return false;
+    }
+    for (addrinfo* a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        error = "connection refused";
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::vector<uint8_t> body;
+    MqttWire::putString(body, "MQTT");
+    body.push_back(4);     // 3.1.1
+    body.push_back(0x00);  // Clean session off, no will, no credentials
+    MqttWire::putUint16(body, keepAliveS);
+    MqttWire::putString(body, clientId);
+    connackReceived = false;
+    if (!send(MqttWire::packet(MqttWire::Connect << 4, body))) return false;
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+    while (!connackReceived && fd >= 0 && Clock::now() < deadline) receive(50);
+    if (!connackReceived) {
+        if (error.empty() || fd >= 0) error = "no CONNACK";
+        close();
+        return false;
+    }
+
+    // The broker kept the subscriptions if it kept the session
+    if (!sessionPresent) {
+        for (const auto& filter : filters) {
+            std::vector<uint8_t> subscribe;
+            while (nextId == 0 || inFlight.count(nextId)) nextId++;
+            MqttWire::putUint16(subscribe, nextId++);
+            MqttWire::putString(subscribe, filter.first);
+            subscribe.push_back(filter.second);
+            send(MqttWire::packet(MqttWire::Subscribe << 4 | 2, subscribe));
+        }
+    }
+    for (auto& message : inFlight) {
+        message.second[0] |= 0x08;  // DUP
+        resent++;
+        if (!send(message.second)) return false;
+    }
+    return fd >= 0;
+}
+
+void SocketMqtt::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    rx.clear();
+}
+
+void SocketMqtt::drop() {
+    close();
+    error = "dropped";
+}
+
+void SocketMqtt::disconnect() {
+    if (fd >= 0) send(MqttWire::packet(MqttWire::Disconnect << 4, {}));
+    close();
+}
+
+bool SocketMqtt::send(const std::vector<uint8_t>& bytes) {
+    if (fd < 0) return false;
+    size_t sent = 0;
+    while (sent < bytes.size()) {
+        ssize_t n = ::send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            error = "send failed";
+            close();
+            return false;
+        }
+        sent += n;
+    }
+    packetsSent++;
+    bytesSent += bytes.size();
+    lastSend = Clock::now();
+    return true;
+}
+
+bool SocketMqtt::receive(int timeoutMs) {
+    if (fd < 0) return false;
+    pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, timeoutMs) <= 0) return true;
+    uint8_t chunk[4096];
+    for (;;) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n > 0) {
+            bytesReceived += n;
+            rx.insert(rx.end(), chunk, chunk + n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0 && errno == EINTR) continue;
+        error = "connection closed";
+        close();
+        return false;
+    }
+    uint8_t header;
+    std::vector<uint8_t> body;
+    while (fd >= 0 && MqttWire::take(rx, header, body)) handle(header, body);
+    return fd >= 0;
+}
+
+void SocketMqtt::handle(uint8_t header, const std::vector<uint8_t>& body) {
+    switch (header >> 4) {
+        case MqttWire::Connack:
+            if (body.size() < 2 || body[1] != 0) {
+                error = "connection refused, code " + std::to_string(body.size() < 2 ? -1 : body[1]);
+                close();
+                return;
+            }
+            connackReceived = true;
+            sessionPresent = body[0] & 1;
+            break;
+        case MqttWire::Puback:
+            if (body.size() >= 2) inFlight.erase((uint16_t)(body[0] << 8 | body[1]));
+            break;
+        case MqttWire::Suback:
+            subacks++;
+            break;
+        case MqttWire::Publish: {
+            std::string topic;
+            uint16_t id;
+            size_t payloadAt;
+            if (!MqttWire::parsePublish(header, body, topic, id, payloadAt)) return;
+            if (id) send(MqttWire::ack(MqttWire::Puback, id));
+            if (callback) callback(topic.c_str(), body.data() + payloadAt, body.size() - payloadAt);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// QoS 1 publishes are kept until acknowledged, also while disconnected
+bool SocketMqtt::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) {
+    if (clientId.empty()) return false;
+    if (qos == 0) return send(MqttWire::publish(topic, payload, length, 0, retain, 0));
+    if (inFlight.size() >= MAX_IN_FLIGHT) {
+        error = "too many in flight";
+        return false;
+    }
+    while (nextId == 0 || inFlight.count(nextId)) nextId++;
+    uint16_t id = nextId++;
+    std::vector<uint8_t>& packet = inFlight[id] = MqttWire::publish(topic, payload, length, 1, retain, id);
+    send(packet);
+    return true;
+}
+
+// Reconnects and resends as needed until every PUBACK is in
+bool SocketMqtt::flush(uint32_t timeoutMs) {
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (!inFlight.empty() && Clock::now() < deadline) {
+        if (fd < 0) {
+            if (open()) {
+                reconnects++;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+        receive(10);
+    }
+    if (!inFlight.empty() && fd >= 0) error = "acknowledgement timeout";
+    return inFlight.empty();
+}
+
+bool SocketMqtt::subscribe(const char* filter, uint8_t qos) {
+    bool known = false;
+    for (const auto& f : filters) known = known || f.first == filter;
+    if (!known) filters.push_back({filter, qos});
+    if (fd < 0) return false;
+
+    std::vector<uint8_t> body;
+    while (nextId == 0 || inFlight.count(nextId)) nextId++;
+    MqttWire::putUint16(body, nextId++);
+    MqttWire::putString(body, filter);
+    body.push_back(qos);
+    unsigned long before = subacks;
+    if (!send(MqttWire::packet(MqttWire::Subscribe << 4 | 2, body))) return false;
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+    while (subacks == before && fd >= 0 && Clock::now() < deadline) receive(10);
+    return subacks != before;
+}
+
+void SocketMqtt::service() {
+    if (clientId.empty()) return;
+    if (fd < 0) {
+        if (Clock::now() >= retryAt && open()) reconnects++;
+        return;
+    }
+    receive(0);
+    if (fd >= 0 && Clock::now() - lastSend > std::chrono::seconds(keepAliveS / 2)) {
+        send(MqttWire::packet(MqttWire::Pingreq << 4, {}));
+    }
+}
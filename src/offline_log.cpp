@@ -0,0 +1,257 @@
+#include "offline_log.h"
+#include "crc16.h"
+#include "debug_utils.h"
+#include "hal.h"
+#include "system_manager.h"
+#include <stddef.h>
+
+uint32_t OfflineLog::sectorCount = 0;
+uint32_t OfflineLog::headSector = 0;
+uint32_t OfflineLog::headSlot = 0;
+uint32_t OfflineLog::tailSector = 0;
+uint32_t OfflineLog::readSector = 0;
+uint32_t OfflineLog::readSlot = 0;
+uint32_t OfflineLog::nextSequence = 0;
+uint32_t OfflineLog::pending = 0;
+uint32_t OfflineLog::previousBootPending = 0;
+uint32_t OfflineLog::peekedSector = 0;
+uint32_t OfflineLog::peekedSlot = 0;
+size_t OfflineLog::peekedCount = 0;
+bool OfflineLog::ready = false;
+OfflineLog::Stats OfflineLog::stats;
+
+static const size_t CRC_SPAN = offsetof(LogRecord, state);
+
+LogRecord LogRecord::fromReadings(const PowerReadings& readings) {
+    LogRecord record;
+    record.timestamp = readings.timestamp;
+    record.voltage = readings.voltage;
+    record.current = readings.current;
+    record.power = readings.power;
+    record.energy = readings.energy;
+    record.frequency = readings.frequency;
+    record.powerFactor = readings.powerFactor;
+    record.flags = (readings.isValid ? FLAG_VALID : 0) | (readings.isCharging ? FLAG_CHARGING : 0) |
+                   (readings.channel << CHANNEL_SHIFT);
+    record.state = STATE_PENDING;
+    record.crc = crc16(&record, CRC_SPAN);
+    return record;
+}
+
+PowerReadings LogRecord::toReadings() const {
+    PowerReadings readings;
+    readings.timestamp = timestamp;
+    readings.channel = channel();
+    readings.voltage = voltage;
+    readings.current = current;
+    readings.power = power;
+    readings.energy = energy;
+    readings.frequency = frequency;
+    readings.powerFactor = powerFactor;
+    readings.isValid = flags & FLAG_VALID;
+    readings.isCharging = flags & FLAG_CHARGING;
+    return readings;
+}
+
+uint32_t OfflineLog::slotOffset(uint32_t sector, uint32_t slot) {
+    return sector * SECTOR_SIZE + (slot + 1) * sizeof(LogRecord);  // Slot 0 holds the header
+}
+
+bool OfflineLog::readHeader(uint32_t sector, SectorHeader& header) {
+    return Hal::flash().read(sector * SECTOR_SIZE, &header, sizeof(header)) && header.magic == MAGIC;
+}
+
+bool OfflineLog::isErased(const LogRecord& record) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+    for (size_t i = 0; i < sizeof(record); i++) {
+        if (bytes[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+// Erases a sector and stamps it with the next sequence number, carrying its
+// erase count forward so wear survives reboots.
+bool OfflineLog::openSector(uint32_t sector) {
+    SectorHeader header;
+    uint32_t eraseCount = readHeader(sector, header) ? header.eraseCount : 0;
+
+    if (!Hal::flash().eraseSector(sector)) return false;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = MAGIC;
+    header.sequence = nextSequence++;
+    header.eraseCount = eraseCount + 1;
+    stats.erases++;
+    if (header.eraseCount > stats.maxSectorErases) stats.maxSectorErases = header.eraseCount;
+    return Hal::flash().write(sector * SECTOR_SIZE, &header, sizeof(header));
+}
+
+bool OfflineLog::begin(uint32_t maxSectors) {
+    DEBUG_PRINTLN("Initializing offline log...");
+    FlashBackend& flash = Hal::flash();
+    if (!flash.begin() || flash.sectorSize() != SECTOR_SIZE) {
+        DEBUG_PRINTLN("Offline log unavailable");
+        return false;
+    }
+    sectorCount = maxSectors < flash.sectorCount() ? maxSectors : flash.sectorCount();
+    if (sectorCount < 2) return false;
+
+    // Find the oldest and newest live sectors
+    bool found = false;
+    uint32_t minSequence = 0, maxSequence = 0;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        SectorHeader header;
+        if (!readHeader(sector, header)) continue;
+        if (header.eraseCount > stats.maxSectorErases) stats.maxSectorErases = header.eraseCount;
+        if (!found || header.sequence < minSequence) { minSequence = header.sequence; tailSector = sector; }
+        if (!found || header.sequence > maxSequence) { maxSequence = header.sequence; headSector = sector; }
+        found = true;
+    }
+
+    if (!found) {
+        nextSequence = 0;
+        headSector = tailSector = readSector = 0;
+        headSlot = readSlot = 0;
+        pending = 0;
+        ready = openSector(0);
+        DEBUG_PRINTF("Offline log formatted: %lu records\n", (unsigned long)capacity());
+        return ready;
+    }
+    nextSequence = maxSequence + 1;
+
+    // First free slot in the newest sector
+    LogRecord record;
+    for (headSlot = 0; headSlot < RECORDS_PER_SECTOR; headSlot++) {
+        flash.read(slotOffset(headSector, headSlot), &record, sizeof(record));
+        if (isErased(record)) break;
+    }
+
+    // Oldest pending record and the backlog size
+    pending = 0;
+    readSector = headSector;
+    readSlot = headSlot;
+    for (uint32_t sector = tailSector;; sector = (sector + 1) % sectorCount) {
+        uint32_t end = sector == headSector ? headSlot : RECORDS_PER_SECTOR;
+        for (uint32_t slot = 0; slot < end; slot++) {
+            flash.read(slotOffset(sector, slot), &record, sizeof(record));
+            if (record.state != LogRecord::STATE_PENDING) continue;
+            if (pending == 0) { readSector = sector; readSlot = slot; }
+            pending++;
+        }
+        if (sector == headSector) break;
+    }
+
+    previousBootPending = pending;
+    ready = true;
+    DEBUG_PRINTF("Offline log restored: %lu pending of %lu\n",
+                 (unsigned long)pending, (unsigned long)capacity());
+    return true;
+}
+
+uint32_t OfflineLog::unsentInSector(uint32_t sector, uint32_t fromSlot) {
+    uint32_t end = sector == headSector ? headSlot : RECORDS_PER_SECTOR;
+    uint32_t count = 0;
+    uint8_t state;
+    for (uint32_t slot = fromSlot; slot < end; slot++) {
+        Hal::flash().read(slotOffset(sector, slot) + offsetof(LogRecord, state), &state, 1);
+        if (state == LogRecord::STATE_PENDING) count++;
+    }
+    return count;
+}
+
+bool OfflineLog::append(const PowerReadings& readings) {
+    if (!ready) return false;
+
+    if (headSlot >= RECORDS_PER_SECTOR) {
+        uint32_t next = (headSector + 1) % sectorCount;
+        if (next == tailSector) {
+            // Full: evict the oldest sector
+            if (readSector == tailSector) {
+                uint32_t lost = unsentInSector(tailSector, readSlot);
+                pending -= lost;
+                previousBootPending -= lost < previousBootPending ? lost : previousBootPending;
+                stats.evicted += lost;
+                readSector = (tailSector + 1) % sectorCount;
+                readSlot = 0;
+            }
+            tailSector = (tailSector + 1) % sectorCount;
+            peekedCount = 0;
+        }
+        if (!openSector(next)) return false;
+        headSector = next;
+        headSlot = 0;
+    }
+
+    if (pending == 0) {
+        readSector = headSector;
+        readSlot = headSlot;
+    }
+
+    LogRecord record = LogRecord::fromReadings(readings);
+    if (!Hal::flash().write(slotOffset(headSector, headSlot), &record, sizeof(record))) return false;
+    headSlot++;
+    pending++;
+    stats.appended++;
+    return true;
+}
+
+size_t OfflineLog::peek(LogRecord* records, size_t maxRecords) {
+    size_t count = 0;
+    uint32_t older = previousBootPending;
+    uint32_t sector = readSector;
+    uint32_t slot = readSlot;
+    while (ready && count < maxRecords) {
+        if (sector == headSector && slot >= headSlot) break;
+        if (slot >= RECORDS_PER_SECTOR) {
+            sector = (sector + 1) % sectorCount;
+            slot = 0;
+            continue;
+        }
+        LogRecord& record = records[count];
+        Hal::flash().read(slotOffset(sector, slot), &record, sizeof(record));
+        slot++;
+        if (record.state != LogRecord::STATE_PENDING) continue;
+        bool fromEarlierBoot = older > 0;
+        if (older > 0) older--;
+        if (crc16(&record, CRC_SPAN) != record.crc) {
+            stats.corrupt++;  // Consumed with the batch, never uploaded
+            continue;
+        }
+        // Stamped with uptime before NTP answered: only this boot's can be placed
+        if (record.timestamp < SystemManager::MIN_VALID_EPOCH) {
+            if (fromEarlierBoot) {
+                stats.unresolved++;
+                continue;
+            }
+            record.timestamp = SystemManager::resolveTimestamp(record.timestamp);
+        }
+        count++;
+    }
+    peekedSector = sector;
+    peekedSlot = slot;
+    peekedCount = count;
+    return count;
+}
+
+void OfflineLog::markSent(size_t count) {
+    if (count != peekedCount) return;  // A batch of only corrupt records is consumed with 0
+
+    const uint8_t sent = LogRecord::STATE_SENT;
+    uint8_t state;
+    while (readSector != peekedSector || readSlot != peekedSlot) {
+        if (readSlot >= RECORDS_PER_SECTOR) {
+            readSector = (readSector + 1) % sectorCount;
+            readSlot = 0;
+            continue;
+        }
+        uint32_t offset = slotOffset(readSector, readSlot) + offsetof(LogRecord, state);
+        Hal::flash().read(offset, &state, 1);
+        if (state == LogRecord::STATE_PENDING) {
+            Hal::flash().write(offset, &sent, 1);
+            pending--;
+            if (previousBootPending > 0) previousBootPending--;
+        }
+        readSlot++;
+    }
+    stats.sent += count;
+    peekedCount = 0;
+}
@@ -0,0 +1,108 @@
+#include "power_policy.h"
+#include "battery_monitor.h"
+#include "readings_schema.h"
+
+const float PowerPolicy::BASE_MA = 6.0f;
+const float PowerPolicy::RADIO_ON_MA = 115.0f;
+const float PowerPolicy::MODEM_SLEEP_MA = 35.0f;
+const float PowerPolicy::LIGHT_SLEEP_MA = 3.0f;
+const float PowerPolicy::UPLOAD_MA = 80.0f;
+const float PowerPolicy::UPLOAD_MS = 600.0f;
+const float PowerPolicy::TRANSACTION_MA = 30.0f;
+const float PowerPolicy::TRANSACTION_MS = 45.0f;
+
+const PowerPolicy::Settings PowerPolicy::SETTINGS[MODE_COUNT] = {
+    //  upload, snapshot, round gap, modem sleep, light sleep
+    {2000, 2000, 0, false, false},            // External
+    {10000, 5000, 1000, true, false},         // Saver
+    {30000, 15000, 5000, true, true},         // Low
+    {120000, 60000, 15000, true, true},       // Critical
+};
+const char* const PowerPolicy::MODE_NAMES[MODE_COUNT] = {"external", "saver", "low", "critical"};
+
+PowerPolicy::Mode PowerPolicy::active = External;
+uint8_t PowerPolicy::chargePercent = 100;
+bool PowerPolicy::onCharger = true;
+
+PowerPolicy::Mode PowerPolicy::byCharge(uint8_t percent, uint8_t margin) {
+    if (percent >= LOW_PERCENT + margin) return Saver;
+    if (percent >= CRITICAL_PERCENT + margin) return Low;
+    return Critical;
+}
+
+PowerPolicy::Mode PowerPolicy::decide(Mode current, bool charging, uint8_t percent) {
+    if (charging) return External;
+    // Plugged in with the charger done; once on the battery a full reading doesn't bring it back
+    if (current == External && percent >= FULL_PERCENT) return External;
+    Mode target = byCharge(percent, 0);
+    if (current != External && target < current) {
+        // Charge reads higher than before: only step back up with some margin
+        Mode recovered = byCharge(percent, HYSTERESIS_PERCENT);
+        return recovered < current ? recovered : current;
+    }
+    return target;
+}
+
+float PowerPolicy::averageMilliAmps(Mode mode, uint8_t channels, bool lightSleepAvailable) {
+    const Settings& s = SETTINGS[mode];
+    bool sleeping = s.lightSleep && lightSleepAvailable;
+    float ma = BASE_MA + (sleeping ? LIGHT_SLEEP_MA : s.modemSleep ? MODEM_SLEEP_MA : RADIO_ON_MA);
+    ma += UPLOAD_MA * UPLOAD_MS / s.uploadMs;
+    // Awake anyway unless light sleeping; then each meter transaction wakes the CPU
+    if (sleeping && s.roundGapMs) ma += TRANSACTION_MA * TRANSACTION_MS * channels / s.roundGapMs;
+    return ma;
+}
+
+PowerPolicy::Estimate PowerPolicy::estimate(uint8_t percent, uint8_t channels, bool lightSleepAvailable) {
+    // Charge is taken as linear in percent; each band is spent in its own mode
+    const float mahPerPercent = BatteryMonitor::CAPACITY_MAH / 100.0f;
+    const uint8_t bands[][2] = {{Saver, LOW_PERCENT}, {Low, CRITICAL_PERCENT}, {Critical, 0}};
+    Estimate e = {};
+    uint8_t top = percent;
+    for (const auto& band : bands) {
+        if (top <= band[1]) continue;
+        float ma = averageMilliAmps((Mode)band[0], channels, lightSleepAvailable);
+        e.runtimeHours += (top - band[1]) * mahPerPercent / ma;
+        top = band[1];
+    }
+    e.averageMa = e.runtimeHours > 0 ? percent * mahPerPercent / e.runtimeHours : 0;
+    e.fullRateHours = percent * mahPerPercent / averageMilliAmps(External, channels, lightSleepAvailable);
+    e.gainedHours = e.runtimeHours - e.fullRateHours;
+    return e;
+}
+
+void PowerPolicy::begin() {
+    active = External;
+    chargePercent = 100;
+    onCharger = true;
+}
+
+bool PowerPolicy::update(bool charging, uint8_t percent) {
+    onCharger = charging;
+    chargePercent = percent;
+    Mode next = decide(active, charging, percent);
+    if (next == active) return false;
+    active = next;
+    return true;
+}
+
+// Numbers go through the schema's formatter: printf's %f allocates on newlib
+int PowerPolicy::format(char* buffer, size_t size, uint8_t channels, bool lightSleepAvailable) {
+    Estimate e = estimate(chargePercent, channels, lightSleepAvailable);
+    const char* const KEYS[] = { "avgMa", "runtimeH", "fullRateH", "gainedH" };
+    const float values[] = { averageMilliAmps(active, channels, lightSleepAvailable), e.runtimeHours,
+                             e.fullRateHours, e.gainedHours };
+    int length = snprintf(buffer, size, "{\"mode\":\"%s\",\"batteryPct\":%u,\"charging\":%s,\"lightSleep\":%s",
+                          name(active), (unsigned)chargePercent, onCharger ? "true" : "false",
+                          lightSleepAvailable ? "true" : "false");
+    if (length < 0 || length >= (int)size) return -1;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        if ((size_t)length + strlen(KEYS[i]) + ReadingsSchema::MAX_NUMBER_LENGTH + 5 > size) return -1;
+        length += snprintf(buffer + length, size - length, ",\"%s\":", KEYS[i]);
+        length += ReadingsSchema::formatFloat(buffer + length, values[i], 1);
+    }
+    if ((size_t)length + 2 > size) return -1;
+    buffer[length++] = '}';
+    buffer[length] = '\0';
+    return length;
+}
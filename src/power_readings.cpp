@@ -1,4 +1,8 @@
 #include "power_readings.h"
+#include "energy_account.h"
+#include "meter_scheduler.h"
 
-float PowerReadings::accumulatedEnergy = 0;
-unsigned long PowerReadings::lastMeasurementTime = 0;
+void PowerReadings::resetEnergy(uint8_t channel) {
+    EnergyAccount::reset(channel);
+    MeterScheduler::requestEnergyReset(channel);
+}
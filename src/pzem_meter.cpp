@@ -0,0 +1,45 @@
+#include "pzem_meter.h"
+#include <Arduino.h>
+
+void PzemMeter::begin() {
+    modbus.begin(9600);
+}
+
+bool PzemMeter::request(uint8_t address) {
+    if (!modbus.readInputRegisters(address, 0x0000, REGISTER_COUNT)) return false;
+    resetting = false;
+    return true;
+}
+
+MeterBackend::Status PzemMeter::poll(MeterSample& sample) {
+    switch (modbus.poll()) {
+        case ModbusRtuMaster::Status::Busy:
+            return Status::Busy;
+        case ModbusRtuMaster::Status::Done:
+            if (resetting) return Status::Ready;  // Echo received, sample untouched
+            if (modbus.registerCount() != REGISTER_COUNT) return Status::Failed;
+            decode(modbus.registers(), sample);
+            return Status::Ready;
+        default:
+            return Status::Failed;
+    }
+}
+
+// Register map (PZEM-004T v3 datasheet), 32-bit values are low word first:
+//   0 voltage 0.1 V | 1-2 current 1 mA | 3-4 power 0.1 W | 5-6 energy 1 Wh
+//   7 frequency 0.1 Hz | 8 power factor 0.01 | 9 alarm
+void PzemMeter::decode(const uint16_t* regs, MeterSample& sample) {
+    sample.voltage = regs[0];
+    sample.current = (uint32_t)regs[1] | ((uint32_t)regs[2] << 16);
+    sample.power = (uint32_t)regs[3] | ((uint32_t)regs[4] << 16);
+    sample.energy = (uint32_t)regs[5] | ((uint32_t)regs[6] << 16);
+    sample.frequency = regs[7];
+    sample.pf = regs[8];
+    sample.alarm = regs[9];
+}
+
+bool PzemMeter::resetEnergy(uint8_t address) {
+    if (!modbus.sendCommand(address, FN_RESET_ENERGY)) return false;
+    resetting = true;
+    return true;
+}
@@ -0,0 +1,79 @@
+#include "readings_delta.h"
+#include <math.h>
+#include <string.h>
+
+PowerReadings ReadingsDelta::sent[PowerReadings::MAX_CHANNELS];
+unsigned long ReadingsDelta::sentAt[PowerReadings::MAX_CHANNELS][READINGS_FIELD_COUNT];
+bool ReadingsDelta::known[PowerReadings::MAX_CHANNELS];
+PowerReadings ReadingsDelta::staged[PowerReadings::MAX_CHANNELS];
+uint32_t ReadingsDelta::stagedFields[PowerReadings::MAX_CHANNELS];
+unsigned long ReadingsDelta::stagedAt = 0;
+
+static_assert(READINGS_SCHEMA[0].offset == offsetof(PowerReadings, timestamp), "timestamp leads the schema");
+
+bool ReadingsDelta::moved(const ReadingsField& field, const PowerReadings& now, const PowerReadings& last) {
+    const uint8_t* a = reinterpret_cast<const uint8_t*>(&now) + field.offset;
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(&last) + field.offset;
+    switch (field.kind) {
+        case ReadingsField::Uint32:
+            return memcmp(a, b, sizeof(uint32_t)) != 0;
+        case ReadingsField::Bool:
+            return *a != *b;
+        case ReadingsField::Float: {
+            float value = ReadingsSchema::floatAt(now, field);
+            float reference = ReadingsSchema::floatAt(last, field);
+            if (value == reference) return false;
+            if (!isfinite(value) || !isfinite(reference)) return true;  // Into or out of inf/NaN
+            float band = fabsf(reference) * field.relative;
+            if (band < field.deadband) band = field.deadband;
+            return fabsf(value - reference) > band;
+        }
+    }
+    return true;
+}
+
+uint32_t ReadingsDelta::select(const PowerReadings& readings, unsigned long now) {
+    uint8_t channel = readings.channel;
+    if (channel >= PowerReadings::MAX_CHANNELS || !known[channel]) return ALL_FIELDS;
+    uint32_t fields = 0;
+    for (size_t i = 1; i < READINGS_FIELD_COUNT; i++) {
+        if (moved(READINGS_SCHEMA[i], readings, sent[channel]) || now - sentAt[channel][i] >= MAX_STALE_MS) {
+            fields |= 1UL << i;
+        }
+    }
+    return fields ? fields | 1 : 0;
+}
+
+void ReadingsDelta::stage(const PowerReadings& readings, uint32_t fields, unsigned long now) {
+    uint8_t channel = readings.channel;
+    if (channel >= PowerReadings::MAX_CHANNELS) return;
+    staged[channel] = readings;
+    stagedFields[channel] |= fields;
+    stagedAt = now;
+}
+
+void ReadingsDelta::confirm() {
+    for (uint8_t channel = 0; channel < PowerReadings::MAX_CHANNELS; channel++) {
+        uint32_t fields = stagedFields[channel];
+        if (!fields) continue;
+        const uint8_t* from = reinterpret_cast<const uint8_t*>(&staged[channel]);
+        uint8_t* to = reinterpret_cast<uint8_t*>(&sent[channel]);
+        for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+            if (!(fields & (1UL << i))) continue;
+            const ReadingsField& field = READINGS_SCHEMA[i];
+            memcpy(to + field.offset, from + field.offset, field.kind == ReadingsField::Bool ? 1 : 4);
+            sentAt[channel][i] = stagedAt;
+        }
+        if (fields == ALL_FIELDS) known[channel] = true;
+        stagedFields[channel] = 0;
+    }
+}
+
+void ReadingsDelta::discard() {
+    for (uint32_t& fields : stagedFields) fields = 0;
+}
+
+void ReadingsDelta::reset() {
+    discard();
+    for (bool& k : known) k = false;
+}
@@ -0,0 +1,181 @@
+#include "readings_schema.h"
+#include <math.h>
+#include <string.h>
+#include "debug_utils.h"
+
+static const float FLOAT_LIMIT = 1e12f;
+static const uint8_t MAX_DECIMALS = 6;
+
+float ReadingsSchema::floatAt(const PowerReadings& readings, const ReadingsField& field) {
+    float value;
+    memcpy(&value, reinterpret_cast<const uint8_t*>(&readings) + field.offset, sizeof(value));
+    return value;
+}
+
+size_t ReadingsSchema::formatUint(char* out, uint32_t value) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    for (size_t i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+    return n;
+}
+
+size_t ReadingsSchema::formatFloat(char* out, float value, uint8_t decimals) {
+    if (decimals > MAX_DECIMALS) decimals = MAX_DECIMALS;
+    if (isnan(value)) value = 0;  // Never sent: hasNaN() rejects the snapshot first
+    if (value > FLOAT_LIMIT) value = FLOAT_LIMIT;
+    if (value < -FLOAT_LIMIT) value = -FLOAT_LIMIT;
+
+    uint64_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    // Exact in a double for a float and up to six decimals, so ties are
+    // real ties and can be rounded to even the way printf does
+    double scaled = fabs((double)value) * scale;
+    uint64_t fixed = (uint64_t)scaled;
+    double remainder = scaled - (double)fixed;
+    if (remainder > 0.5 || (remainder == 0.5 && (fixed & 1))) fixed++;
+
+    size_t n = 0;
+    if (value < 0 && fixed != 0) out[n++] = '-';
+    uint64_t whole = fixed / scale;
+    uint64_t fraction = fixed % scale;
+    if (whole > 0xFFFFFFFFULL) {
+        n += formatUint(out + n, (uint32_t)(whole / 1000000000ULL));
+        char low[9];
+        uint32_t rest = (uint32_t)(whole % 1000000000ULL);
+        for (int i = 8; i >= 0; i--, rest /= 10) low[i] = '0' + rest % 10;
+        memcpy(out + n, low, 9);
+        n += 9;
+    } else {
+        n += formatUint(out + n, (uint32_t)whole);
+    }
+    if (decimals) {
+        out[n++] = '.';
+        for (int i = decimals - 1; i >= 0; i--, fraction /= 10) out[n + i] = '0' + fraction % 10;
+        n += decimals;
+    }
+    return n;
+}
+
+int ReadingsSchema::toJson(const PowerReadings& readings, char* buffer, size_t size) {
+    if (size < maxJsonLength() + 1) return -1;  // Then no per-field bounds checks are needed
+    size_t n = 0;
+    buffer[n++] = '{';
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        const ReadingsField& field = READINGS_SCHEMA[i];
+        if (i) buffer[n++] = ',';
+        buffer[n++] = '"';
+        size_t nameLength = strlen(field.name);
+        memcpy(buffer + n, field.name, nameLength);
+        n += nameLength;
+        buffer[n++] = '"';
+        buffer[n++] = ':';
+        n += formatField(readings, field, buffer + n);
+    }
+    buffer[n++] = '}';
+    buffer[n] = '\0';
+    return (int)n;
+}
+
+size_t ReadingsSchema::formatField(const PowerReadings& readings, const ReadingsField& field, char* out) {
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(&readings);
+    switch (field.kind) {
+        case ReadingsField::Uint32: {
+            uint32_t value;
+            memcpy(&value, base + field.offset, sizeof(value));
+            return formatUint(out, value);
+        }
+        case ReadingsField::Bool: {
+            const char* text = base[field.offset] ? "true" : "false";
+            size_t textLength = strlen(text);
+            memcpy(out, text, textLength);
+            return textLength;
+        }
+        case ReadingsField::Float:
+            return formatFloat(out, floatAt(readings, field), field.decimals);
+    }
+    return 0;
+}
+
+static void putUint32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t getUint32(const uint8_t* in) {
+    return in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+int ReadingsSchema::toBinary(const PowerReadings& readings, uint32_t fields, uint8_t* buffer, size_t size) {
+    if (size < maxBinaryLength()) return -1;
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(&readings);
+    size_t n = 0;
+    buffer[n++] = BINARY_VERSION;
+    buffer[n++] = readings.channel;
+    fields &= (1UL << READINGS_FIELD_COUNT) - 1;
+    putUint32(buffer + n, fields);
+    n += 4;
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        if (!(fields & (1UL << i))) continue;
+        const ReadingsField& field = READINGS_SCHEMA[i];
+        if (field.kind == ReadingsField::Bool) {
+            buffer[n++] = base[field.offset] ? 1 : 0;
+        } else {
+            uint32_t bits;
+            memcpy(&bits, base + field.offset, sizeof(bits));
+            putUint32(buffer + n, bits);
+            n += 4;
+        }
+    }
+    return (int)n;
+}
+
+bool ReadingsSchema::fromBinary(const uint8_t* data, size_t length, PowerReadings& readings, uint32_t* fields) {
+    if (length < BINARY_HEADER || data[0] != BINARY_VERSION || data[1] >= PowerReadings::MAX_CHANNELS) return false;
+    uint32_t mask = getUint32(data + 2);
+    if (mask >> READINGS_FIELD_COUNT) return false;
+    size_t n = BINARY_HEADER;
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        if (!(mask & (1UL << i))) continue;
+        size_t width = READINGS_SCHEMA[i].kind == ReadingsField::Bool ? 1 : 4;
+        if (n + width > length) return false;
+        n += width;
+    }
+    if (n != length) return false;
+
+    uint8_t* base = reinterpret_cast<uint8_t*>(&readings);
+    readings.channel = data[1];
+    n = BINARY_HEADER;
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        if (!(mask & (1UL << i))) continue;
+        const ReadingsField& field = READINGS_SCHEMA[i];
+        if (field.kind == ReadingsField::Bool) {
+            base[field.offset] = data[n++] != 0;
+        } else {
+            uint32_t bits = getUint32(data + n);
+            memcpy(base + field.offset, &bits, sizeof(bits));
+            n += 4;
+        }
+    }
+    if (fields) *fields = mask;
+    return true;
+}
+
+bool ReadingsSchema::hasNaN(const PowerReadings& readings) {
+    for (const ReadingsField& field : READINGS_SCHEMA) {
+        if (field.kind == ReadingsField::Float && field.validated && isnan(floatAt(readings, field))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ReadingsSchema::dump(const PowerReadings& readings) {
+    DEBUG_PRINTF("=== Channel %u readings ===\n", (unsigned)readings.channel);
+    for (const ReadingsField& field : READINGS_SCHEMA) {
+        if (field.kind != ReadingsField::Float) continue;
+        DEBUG_PRINTF("%s: %.2f %s\n", field.name, floatAt(readings, field), field.unit);
+    }
+}
@@ -0,0 +1,132 @@
+#include "sampling_task.h"
+#include "system_manager.h"
+#include "meter_scheduler.h"
+#include "energy_checkpoint.h"
+#include "energy_account.h"
+#include "boot_sequence.h"
+#include "debug_utils.h"
+
+SpscRing<PowerReadings, SamplingTask::RING_CAPACITY> SamplingTask::ring;
+std::atomic<unsigned long> SamplingTask::interval{2000};
+unsigned long SamplingTask::nextSampleAt = 0;
+#ifdef NATIVE_BUILD
+unsigned long SamplingTask::steppedTo = 0;
+#endif
+std::atomic<bool> SamplingTask::resetPending{false};
+float SamplingTask::seeds[PowerReadings::MAX_CHANNELS];
+std::atomic<uint32_t> SamplingTask::seedsPending{0};
+std::atomic<uint32_t> SamplingTask::samples{0};
+std::atomic<unsigned long> SamplingTask::worstLateness{0};
+
+void SamplingTask::start(unsigned long intervalMs) {
+    interval = intervalMs;
+    nextSampleAt = millis() + FIRST_SAMPLE_DELAY;  // Meters answer well within this
+#ifdef NATIVE_BUILD
+    steppedTo = millis();
+#else
+    DEBUG_PRINTF("Starting sampling task on core %d (%lu ms)\n", SAMPLER_CORE, intervalMs);
+    xTaskCreatePinnedToCore(taskLoop, "sampler", SAMPLER_STACK, nullptr,
+                            SAMPLER_PRIORITY, nullptr, SAMPLER_CORE);
+#endif
+}
+
+#ifndef NATIVE_BUILD
+void SamplingTask::taskLoop(void* arg) {
+    (void)arg;
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        // Wake every tick to keep the bus busy; snapshots stay on the fixed cadence
+        unsigned long idle = idleMs(millis());
+        if (idle > 1) {
+            vTaskDelay(pdMS_TO_TICKS(idle));
+            lastWake = xTaskGetTickCount();
+        } else {
+            vTaskDelayUntil(&lastWake, 1);
+        }
+        tick(millis());
+    }
+}
+#endif
+
+// Nothing to do until the next round or snapshot, if the bus is resting
+unsigned long SamplingTask::idleMs(unsigned long now) {
+    unsigned long untilRound = MeterScheduler::msUntilNextRound();
+    if (untilRound == 0) return 0;
+    long untilSnapshot = (long)(nextSampleAt - now);
+    if (untilSnapshot <= 0) return 0;
+    return untilRound < (unsigned long)untilSnapshot ? untilRound : untilSnapshot;
+}
+
+void SamplingTask::service() {
+#ifdef NATIVE_BUILD
+    // Replay the ticks the RTOS task would have run since the last call
+    unsigned long now = millis();
+    for (unsigned long t = steppedTo + 1; (long)(now - t) >= 0; t++) {
+        NativeClock::set(t);
+        tick(t);
+    }
+    steppedTo = now;
+#endif
+}
+
+// One bus step, plus a snapshot of every channel when the cadence is due
+void SamplingTask::tick(unsigned long now) {
+    MeterScheduler::service();
+    if ((long)(now - nextSampleAt) < 0) return;
+    sampleOnce(nextSampleAt);
+    unsigned long period = interval.load(std::memory_order_relaxed);
+    nextSampleAt += period;
+    if ((long)(now - nextSampleAt) >= 0) nextSampleAt = now + period;  // Don't burst to catch up
+}
+
+void SamplingTask::sampleOnce(unsigned long scheduledAt) {
+    unsigned long lateness = millis() - scheduledAt;
+    if (lateness > worstLateness.load(std::memory_order_relaxed)) {
+        worstLateness.store(lateness, std::memory_order_relaxed);
+    }
+
+    uint8_t channels = MeterScheduler::channelCount();
+    if (resetPending.exchange(false)) {
+        for (uint8_t ch = 0; ch < channels; ch++) PowerReadings::resetEnergy(ch);
+    }
+    uint32_t seeding = seedsPending.exchange(0, std::memory_order_acquire);
+    for (uint8_t ch = 0; seeding && ch < channels; ch++) {
+        if (seeding & (1UL << ch)) EnergyAccount::addOffset(ch, seeds[ch]);
+    }
+    EnergyCheckpoint::service(millis());
+
+    for (uint8_t ch = 0; ch < channels; ch++) {
+        PowerReadings readings = SystemManager::getPowerReadings(ch);
+        if (readings.isValid) BootSequence::markFirstSample();
+        samples.fetch_add(1, std::memory_order_relaxed);
+        if (!ring.push(readings)) {
+            LOG_WARN("Sample ring full, dropping reading");
+        }
+    }
+}
+
+bool SamplingTask::pop(PowerReadings& readings) {
+    return ring.pop(readings);
+}
+
+void SamplingTask::requestEnergyReset() {
+    resetPending.store(true);
+}
+
+void SamplingTask::seedEnergy(uint8_t channel, float wh) {
+    seeds[channel] = wh;
+    seedsPending.fetch_or(1UL << channel, std::memory_order_release);
+}
+
+unsigned long SamplingTask::intervalFor(unsigned long wantedMs, unsigned long uploadMs, uint8_t channels) {
+    unsigned long perUpload = RING_CAPACITY / 2 / (channels ? channels : 1);
+    if (perUpload == 0) perUpload = 1;
+    unsigned long floor = (uploadMs + perUpload - 1) / perUpload;
+    return wantedMs > floor ? wantedMs : floor;
+}
+
+uint32_t SamplingTask::queueDepth() { return ring.depth(); }
+uint32_t SamplingTask::maxQueueDepth() { return ring.maxDepth(); }
+uint32_t SamplingTask::overflowCount() { return ring.overflows(); }
+uint32_t SamplingTask::samplesTaken() { return samples.load(std::memory_order_relaxed); }
+unsigned long SamplingTask::maxLatenessMs() { return worstLateness.load(std::memory_order_relaxed); }
@@ -0,0 +1,80 @@
+#include "telemetry.h"
+#include "debug_utils.h"
+
+// Set from the build, e.g. -DFIRMWARE_BUILD=\"1.4.0-3-gabc123\"
+#ifndef FIRMWARE_BUILD
+#define FIRMWARE_BUILD __DATE__ " " __TIME__
+#endif
+
+const char* const Telemetry::BUILD = FIRMWARE_BUILD;
+const char* const Telemetry::METRIC_NAMES[METRIC_COUNT] = {
+    "pzemReadMs", "cloudRttMs", "wifiReconnectMs", "loopJitterMs", "eventPushMs"
+};
+const char* const Telemetry::COUNTER_NAMES[COUNTER_COUNT] = {
+    "readingsRejected", "uploadFailures", "historyFailures"
+};
+Histogram Telemetry::histograms[METRIC_COUNT];
+std::atomic<uint32_t> Telemetry::counters[COUNTER_COUNT];
+
+uint32_t Histogram::mean() const {
+    uint32_t n = count();
+    return n ? sum.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint32_t Histogram::percentile(float q) const {
+    uint32_t n = count();
+    if (n == 0) return 0;
+    uint32_t rank = (uint32_t)(q * n);
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < BUCKETS - 1; b++) {
+        seen += bucket(b);
+        if (seen > rank) return upperBound(b) < max() ? upperBound(b) : max();
+    }
+    return max();
+}
+
+uint32_t Telemetry::freeHeap() {
+    return ESP.getFreeHeap();
+}
+
+uint32_t Telemetry::minFreeHeap() {
+    return ESP.getMinFreeHeap();
+}
+
+// Buckets are listed up to the last non-empty one; index b covers
+// Histogram::upperBound(b - 1) + 1 .. upperBound(b)
+int Telemetry::format(char* buffer, size_t size) {
+    int length = snprintf(buffer, size, "{\"build\":\"%s\",\"uptimeS\":%lu,\"heapFree\":%u,\"heapMin\":%u",
+                          BUILD, millis() / 1000, (unsigned)freeHeap(), (unsigned)minFreeHeap());
+    for (uint8_t c = 0; c < COUNTER_COUNT && length < (int)size; c++) {
+        length += snprintf(buffer + length, size - length, ",\"%s\":%u", COUNTER_NAMES[c], (unsigned)counter((Counter)c));
+    }
+    for (uint8_t m = 0; m < METRIC_COUNT && length < (int)size; m++) {
+        const Histogram& h = histograms[m];
+        length += snprintf(buffer + length, size - length,
+                           ",\"%s\":{\"n\":%u,\"mean\":%u,\"p50\":%u,\"p95\":%u,\"max\":%u,\"b\":[",
+                           METRIC_NAMES[m], (unsigned)h.count(), (unsigned)h.mean(),
+                           (unsigned)h.percentile(0.5f), (unsigned)h.percentile(0.95f), (unsigned)h.max());
+        uint8_t used = Histogram::BUCKETS;
+        while (used > 0 && h.bucket(used - 1) == 0) used--;
+        for (uint8_t b = 0; b < used && length < (int)size; b++) {
+            length += snprintf(buffer + length, size - length, "%s%u", b ? "," : "", (unsigned)h.bucket(b));
+        }
+        if (length < (int)size) length += snprintf(buffer + length, size - length, "]}");
+    }
+    if (length < (int)size) length += snprintf(buffer + length, size - length, "}");
+    return length < (int)size ? length : -1;
+}
+
+void Telemetry::dump() {
+    LOG_INFO("Telemetry (%s): heap %u free, %u min\n", BUILD, (unsigned)freeHeap(), (unsigned)minFreeHeap());
+    for (uint8_t m = 0; m < METRIC_COUNT; m++) {
+        const Histogram& h = histograms[m];
+        LOG_INFO("  %s: n=%u mean=%u p50=%u p95=%u max=%u\n", METRIC_NAMES[m], (unsigned)h.count(),
+                 (unsigned)h.mean(), (unsigned)h.percentile(0.5f), (unsigned)h.percentile(0.95f),
+                 (unsigned)h.max());
+    }
+    LOG_INFO("  readings rejected %u, upload failures %u, history failures %u\n",
+             (unsigned)counter(ReadingsRejected), (unsigned)counter(UploadFailures),
+             (unsigned)counter(HistoryFailures));
+}
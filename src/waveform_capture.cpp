@@ -0,0 +1,117 @@
+#include "waveform_capture.h"
+#include "adc_sampler.h"
+#include "debug_utils.h"
+
+WaveformCapture::Block WaveformCapture::blocks[2];
+uint8_t WaveformCapture::filling = 0;
+size_t WaveformCapture::voltageCount = 0;
+size_t WaveformCapture::currentCount = 0;
+std::atomic<uint8_t> WaveformCapture::readyBlock{NO_BLOCK};
+HarmonicSpectrum WaveformCapture::spectrum;
+std::atomic<uint32_t> WaveformCapture::sequence{0};
+std::atomic<uint32_t> WaveformCapture::analysed{0};
+std::atomic<uint32_t> WaveformCapture::discarded{0};
+std::atomic<uint32_t> WaveformCapture::noSignal{0};
+std::atomic<uint32_t> WaveformCapture::lastMicros{0};
+
+bool WaveformCapture::begin() {
+    if (!AdcSampler::tap(VOLTAGE_PIN, onSamples) || !AdcSampler::tap(CURRENT_PIN, onSamples)) {
+        LOG_WARN("Waveform capture: no free ADC scan slots");
+        return false;
+    }
+#ifndef NATIVE_BUILD
+    xTaskCreatePinnedToCore(taskLoop, "waveform", TASK_STACK, nullptr, TASK_PRIORITY, nullptr, TASK_CORE);
+#endif
+    return true;
+}
+
+#ifndef NATIVE_BUILD
+void WaveformCapture::taskLoop(void* arg) {
+    (void)arg;
+    for (;;) {
+        analyzeReady();
+        vTaskDelay(pdMS_TO_TICKS(POLL_MS));
+    }
+}
+#endif
+
+void WaveformCapture::service() {
+#ifdef NATIVE_BUILD
+    analyzeReady();
+#endif
+}
+
+// Runs in the ADC drain with each batch off the DMA ring
+void WaveformCapture::onSamples(const AdcSample* samples, size_t count) {
+    Block* block = &blocks[filling];
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].pin == VOLTAGE_PIN) {
+            if (voltageCount < N) block->voltage[voltageCount++] = samples[i].raw;
+        } else if (samples[i].pin == CURRENT_PIN) {
+            if (currentCount < N) block->current[currentCount++] = samples[i].raw;
+        } else {
+            continue;
+        }
+        if (voltageCount < N || currentCount < N) continue;
+
+        // Both halves full: hand over if the analyser took the last one, else start again
+        voltageCount = 0;
+        currentCount = 0;
+        if (readyBlock.load(std::memory_order_acquire) != NO_BLOCK) {
+            discarded.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        block->completedAt = millis();
+        readyBlock.store(filling, std::memory_order_release);
+        filling ^= 1;
+        block = &blocks[filling];  // The rest of this batch goes into the other block
+    }
+}
+
+void WaveformCapture::analyzeReady() {
+    uint8_t index = readyBlock.load(std::memory_order_acquire);
+    if (index == NO_BLOCK) return;
+    const Block& block = blocks[index];
+
+    HarmonicSpectrum result;
+    unsigned long started = micros();
+    bool found = HarmonicAnalyzer::analyze(block.voltage, block.current, AdcSampler::pinRateHz(), result);
+    lastMicros.store(micros() - started, std::memory_order_relaxed);
+    result.capturedAt = block.completedAt;
+    readyBlock.store(NO_BLOCK, std::memory_order_release);
+
+    if (!found) {
+        noSignal.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    result.block = analysed.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    spectrum = result;
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+bool WaveformCapture::latest(HarmonicSpectrum& out) {
+    for (;;) {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before == 0) return false;
+        if (before & 1) continue;
+        out = spectrum;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) return true;
+    }
+}
+
+bool WaveformCapture::fresh(HarmonicSpectrum& out) {
+    return latest(out) && millis() - out.capturedAt <= MAX_AGE_MS;
+}
+
+WaveformCapture::Stats WaveformCapture::stats() {
+    Stats s;
+    s.blocks = analysed.load(std::memory_order_relaxed);
+    s.discarded = discarded.load(std::memory_order_relaxed);
+    s.noSignal = noSignal.load(std::memory_order_relaxed);
+    s.lastMicros = lastMicros.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,301 @@
+#include "wifi_link.h"
+#include "credentials.h"
+#include "crc16.h"
+#include "debug_utils.h"
+#include "hal.h"
+#include "telemetry.h"
+#include <stddef.h>
+
+static const char* CACHE_KEY = "wifi";
+
+const size_t WifiLink::CACHE_CRC_SPAN = offsetof(WifiLink::Cache, crc);
+
+WifiLink::State WifiLink::state = WifiLink::State::Idle;
+RTC_NOINIT_ATTR WifiLink::Cache WifiLink::cache;
+WifiLink::Candidate WifiLink::candidates[WifiLink::MAX_CANDIDATES];
+uint8_t WifiLink::candidateCount = 0;
+uint8_t WifiLink::nextCandidate = 0;
+unsigned long WifiLink::downSince = 0;
+unsigned long WifiLink::attemptAt = 0;
+unsigned long WifiLink::fastUntil = 0;
+unsigned long WifiLink::scanStartedAt = 0;
+unsigned long WifiLink::leaseCheckedAt = 0;
+bool WifiLink::everConnected = false;
+bool WifiLink::leaseFromCache = false;
+std::atomic<uint8_t> WifiLink::cloudFailures{0};
+WifiLink::Stats WifiLink::stats;
+
+void WifiLink::start() {
+    WiFi.persistent(false);        // The cache below is ours; keep the driver off flash
+    WiFi.setAutoReconnect(false);  // Rejoins go through step() so they can skip the scan
+    WiFi.mode(WIFI_STA);
+
+    // RTC memory survives a reset but not a power cycle; NVS covers the latter
+    if (!cacheValid(cache)) {
+        Cache stored;
+        if (Hal::nvs().read(CACHE_KEY, &stored, sizeof(stored)) == sizeof(stored) && cacheValid(stored)) {
+            cache = stored;
+        } else {
+            forgetCache();
+        }
+    }
+    state = State::Idle;
+    downSince = millis();
+#ifndef NATIVE_BUILD
+    xTaskCreatePinnedToCore(taskLoop, "wifi", TASK_STACK, nullptr, TASK_PRIORITY, nullptr, TASK_CORE);
+#endif
+}
+
+#ifndef NATIVE_BUILD
+void WifiLink::taskLoop(void* arg) {
+    (void)arg;
+    for (;;) {
+        step(millis());
+        vTaskDelay(pdMS_TO_TICKS(TASK_PERIOD_MS));
+    }
+}
+#endif
+
+void WifiLink::service() {
+#ifdef NATIVE_BUILD
+    step(millis());
+#endif
+}
+
+void WifiLink::step(unsigned long now) {
+    wl_status_t status = WiFi.status();
+    switch (state) {
+        case State::Idle:
+            if (cacheValid(cache)) startFast(now);
+            else startScan(now);
+            break;
+
+        case State::FastConnect: {
+            if (status == WL_CONNECTED) {
+                stats.fastConnects++;
+                leaseFromCache = true;
+                onConnected(now);
+                break;
+            }
+            if ((long)(now - fastUntil) >= 0) {
+                DEBUG_PRINTLN("Cached AP not answering, scanning");
+                startScan(now);
+                break;
+            }
+            // During a blip the AP is briefly gone; keep knocking on the same door
+            bool failed = status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED;
+            if (failed && now - attemptAt >= FAST_RETRY_MS) joinCached(now);
+            break;
+        }
+
+        case State::Scanning: {
+            int16_t found = WiFi.scanComplete();
+            if (found == WIFI_SCAN_RUNNING) {
+                if (now - scanStartedAt >= SCAN_TIMEOUT_MS) startScan(now);
+                break;
+            }
+            rankScan(found);
+            WiFi.scanDelete();
+            connectCandidate(now);
+            break;
+        }
+
+        case State::Connecting:
+            if (status == WL_CONNECTED) {
+                stats.scanConnects++;
+                leaseFromCache = false;
+                onConnected(now);
+                saveCache(WIFI_NETWORKS[candidates[nextCandidate - 1].network].ssid);
+            } else if (status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED ||
+                       now - attemptAt >= CONNECT_TIMEOUT_MS) {
+                connectCandidate(now);
+            }
+            break;
+
+        case State::Connected:
+            if (status != WL_CONNECTED) {
+                LOG_WARN("WiFi link lost, rejoining");
+                downSince = now;
+                if (cacheValid(cache)) startFast(now);
+                else startScan(now);
+            } else {
+                checkLease(now);
+            }
+            break;
+    }
+}
+
+void WifiLink::reportCloud(bool reached) {
+    if (reached) cloudFailures = 0;
+    else if (cloudFailures < STALE_LEASE_FAILURES) cloudFailures++;
+}
+
+// A cached lease may have been handed to another station, or the network
+// renumbered; the link then comes up but nothing gets through. One that came
+// from DHCP may have been renewed with a different address since it was cached.
+void WifiLink::checkLease(unsigned long now) {
+    if (leaseFromCache) {
+        if (cloudFailures >= STALE_LEASE_FAILURES) rejoinWithDhcp(now);
+        return;
+    }
+    if (now - leaseCheckedAt < LEASE_CHECK_MS) return;
+    leaseCheckedAt = now;
+    if ((uint32_t)WiFi.localIP() != cache.ip || (uint32_t)WiFi.gatewayIP() != cache.gateway ||
+        (uint32_t)WiFi.subnetMask() != cache.subnet || (uint32_t)WiFi.dnsIP() != cache.dns) {
+        DEBUG_PRINTF("DHCP lease renewed as %s, updating cache\n", WiFi.localIP().toString().c_str());
+        char ssid[sizeof(Cache::ssid)];
+        memcpy(ssid, cache.ssid, sizeof(ssid));
+        saveCache(ssid);
+    }
+}
+
+// Drops the lease here and in NVS, so a power cycle doesn't bring it back,
+// and joins the same AP again through DHCP; a scan follows if that fails
+void WifiLink::rejoinWithDhcp(unsigned long now) {
+    LOG_WARN("Cloud unreachable on the cached lease, rejoining with DHCP");
+    stats.staleLeases++;
+    candidateCount = 0;
+    nextCandidate = 0;
+    for (int n = 0; n < NETWORK_COUNT; n++) {
+        if (strncmp(cache.ssid, WIFI_NETWORKS[n].ssid, sizeof(Cache::ssid)) != 0) continue;
+        Candidate& c = candidates[candidateCount++];
+        c.network = (uint8_t)n;
+        memcpy(c.bssid, cache.bssid, sizeof(c.bssid));
+        c.channel = cache.channel;
+        c.rssi = 0;
+        break;
+    }
+    forgetCache();
+    if (!Hal::nvs().write(CACHE_KEY, &cache, sizeof(cache))) {
+        LOG_WARN("Failed to clear WiFi cache");
+    }
+    WiFi.disconnect(false);
+    downSince = now;
+    connectCandidate(now);
+}
+
+void WifiLink::startFast(unsigned long now) {
+    DEBUG_PRINTF("Rejoining %s on channel %u with cached lease\n", cache.ssid, cache.channel);
+    WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    fastUntil = now + FAST_WINDOW_MS;
+    state = State::FastConnect;
+    joinCached(now);
+}
+
+void WifiLink::joinCached(unsigned long now) {
+    WiFi.begin(cache.ssid, passwordFor(cache.ssid), cache.channel, cache.bssid);
+    attemptAt = now;
+    stats.attempts++;
+}
+
+void WifiLink::startScan(unsigned long now) {
+    WiFi.disconnect(false);  // A pending join would make the scan fail
+    WiFi.scanNetworks(true);
+    scanStartedAt = now;
+    state = State::Scanning;
+    stats.scans++;
+}
+
+// Known networks in range, strongest AP first. If none showed up (hidden
+// SSIDs, or the scan failed) every configured network is tried blind.
+void WifiLink::rankScan(int16_t found) {
+    candidateCount = 0;
+    nextCandidate = 0;
+    for (int16_t i = 0; i < found; i++) {
+        int network = -1;
+        for (int n = 0; n < NETWORK_COUNT; n++) {
+            if (strcmp(WiFi.SSID(i).c_str(), WIFI_NETWORKS[n].ssid) == 0) network = n;
+        }
+        if (network < 0) continue;
+
+        Candidate c;
+        c.network = (uint8_t)network;
+        memcpy(c.bssid, WiFi.BSSID(i), sizeof(c.bssid));
+        c.channel = WiFi.channel(i);
+        c.rssi = WiFi.RSSI(i);
+        uint8_t pos = candidateCount < MAX_CANDIDATES ? candidateCount++ : MAX_CANDIDATES;
+        while (pos > 0 && candidates[pos - 1].rssi < c.rssi) {
+            if (pos < MAX_CANDIDATES) candidates[pos] = candidates[pos - 1];
+            pos--;
+        }
+        if (pos < MAX_CANDIDATES) candidates[pos] = c;
+    }
+    if (candidateCount == 0) {
+        for (int n = 0; n < NETWORK_COUNT && n < MAX_CANDIDATES; n++) {
+            candidates[candidateCount++] = { (uint8_t)n, {0}, 0, 0 };
+        }
+    }
+    DEBUG_PRINTF("Scan: %d APs, %u candidate(s)\n", found, candidateCount);
+}
+
+void WifiLink::connectCandidate(unsigned long now) {
+    if (nextCandidate >= candidateCount) {
+        startScan(now);  // Went through the list; the air may look different now
+        return;
+    }
+    const Candidate& c = candidates[nextCandidate++];
+    DEBUG_PRINTF("Attempting connection to: %s (%d dBm, channel %d)\n",
+                 WIFI_NETWORKS[c.network].ssid, (int)c.rssi, (int)c.channel);
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());  // Back to DHCP
+    WiFi.begin(WIFI_NETWORKS[c.network].ssid, WIFI_NETWORKS[c.network].password,
+               c.channel, c.channel ? c.bssid : nullptr);
+    attemptAt = now;
+    state = State::Connecting;
+    stats.attempts++;
+}
+
+void WifiLink::onConnected(unsigned long now) {
+    state = State::Connected;
+    cloudFailures = 0;
+    leaseCheckedAt = now;
+    stats.lastConnectMs = now - downSince;
+    if (everConnected) {
+        stats.reconnects++;
+        Telemetry::record(Telemetry::WifiReconnect, stats.lastConnectMs);
+        if (stats.lastConnectMs > stats.maxReconnectMs) stats.maxReconnectMs = stats.lastConnectMs;
+    }
+    everConnected = true;
+    DEBUG_PRINTF("WiFi up in %lu ms. IP: %s, RSSI: %ddBm\n",
+                 stats.lastConnectMs, WiFi.localIP().toString().c_str(), (int)WiFi.RSSI());
+}
+
+bool WifiLink::cacheValid(const Cache& candidate) {
+    return candidate.magic == CACHE_MAGIC && candidate.crc == crc16(&candidate, CACHE_CRC_SPAN) &&
+           passwordFor(candidate.ssid) != nullptr;
+}
+
+const char* WifiLink::passwordFor(const char* ssid) {
+    for (int n = 0; n < NETWORK_COUNT; n++) {
+        if (strncmp(ssid, WIFI_NETWORKS[n].ssid, sizeof(Cache::ssid)) == 0) return WIFI_NETWORKS[n].password;
+    }
+    return nullptr;  // Network no longer configured
+}
+
+// Remembers the AP and lease just obtained. NVS is only rewritten when they changed.
+void WifiLink::saveCache(const char* ssid) {
+    Cache fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = CACHE_MAGIC;
+    strncpy(fresh.ssid, ssid, sizeof(fresh.ssid) - 1);
+    memcpy(fresh.bssid, WiFi.BSSID(), sizeof(fresh.bssid));
+    fresh.channel = (uint8_t)WiFi.channel();
+    fresh.ip = WiFi.localIP();
+    fresh.gateway = WiFi.gatewayIP();
+    fresh.subnet = WiFi.subnetMask();
+    fresh.dns = WiFi.dnsIP();
+    fresh.crc = crc16(&fresh, CACHE_CRC_SPAN);
+    cache = fresh;
+
+    Cache stored;
+    if (Hal::nvs().read(CACHE_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+        memcmp(&stored, &fresh, sizeof(fresh)) == 0) {
+        return;
+    }
+    if (!Hal::nvs().write(CACHE_KEY, &fresh, sizeof(fresh))) {
+        LOG_WARN("Failed to store WiFi cache");
+    }
+}
+
+void WifiLink::forgetCache() {
+    memset(&cache, 0, sizeof(cache));
+}
@@ -0,0 +1,107 @@
+#include "window_aggregator.h"
+#include <math.h>
+#include "system_manager.h"
+
+const uint32_t WindowAggregator::WINDOW_SECONDS[WINDOW_COUNT] = { 60, 900, 3600 };
+const char* const WindowAggregator::WINDOW_NAMES[WINDOW_COUNT] = { "1m", "15m", "1h" };
+
+WindowAggregator::WindowState WindowAggregator::windows[PowerReadings::MAX_CHANNELS][WINDOW_COUNT];
+float WindowAggregator::minuteSamples[PowerReadings::MAX_CHANNELS][WindowSummary::METRIC_COUNT][MINUTE_SAMPLES];
+SpscRing<WindowSummary, WindowAggregator::QUEUE_CAPACITY> WindowAggregator::finished;
+
+void WindowAggregator::add(const PowerReadings& readings) {
+    if (!readings.isValid || readings.channel >= PowerReadings::MAX_CHANNELS) return;
+    // Still seconds since boot: NTP hasn't answered, so there is no window to put it in
+    if (readings.timestamp < SystemManager::MIN_VALID_EPOCH) return;
+
+    const float values[WindowSummary::METRIC_COUNT] = {
+        readings.voltage, readings.current, readings.power, readings.frequency, readings.powerFactor
+    };
+    for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+        WindowState& state = windows[readings.channel][w];
+        uint32_t start = readings.timestamp - readings.timestamp % WINDOW_SECONDS[w];
+        if (state.open && start != state.start) close(readings.channel, w);
+        if (!state.open) {
+            state.open = true;
+            state.start = start;
+            state.count = 0;
+            // Energy between the previous window's last sample and this one belongs here
+            state.firstEnergy = state.seenEnergy ? state.lastEnergy : readings.energy;
+            state.seenEnergy = true;
+        }
+        if (state.count == UINT16_MAX) continue;  // Sampling far faster than designed for
+
+        for (uint8_t m = 0; m < WindowSummary::METRIC_COUNT; m++) {
+            accumulate(state.metrics[m], values[m], state.count);
+            if (w == Minute && state.count < MINUTE_SAMPLES) {
+                minuteSamples[readings.channel][m][state.count] = values[m];
+            }
+        }
+        state.lastEnergy = readings.energy;
+        state.count++;
+    }
+}
+
+// Welford's update: no running sum of squares to cancel against the mean
+void WindowAggregator::accumulate(MetricState& state, float x, uint16_t count) {
+    if (count == 0) {
+        state.min = state.max = state.mean = x;
+        state.m2 = 0;
+    } else {
+        if (x < state.min) state.min = x;
+        if (x > state.max) state.max = x;
+        float delta = x - state.mean;
+        state.mean += delta / (count + 1);
+        state.m2 += delta * (x - state.mean);
+    }
+    state.p50.add(x, count);
+    state.p95.add(x, count);
+}
+
+// Nearest rank over a sorted copy; insertion sort is plenty for 32
+void WindowAggregator::exactQuantiles(const float* samples, uint16_t count, float& p50, float& p95) {
+    float sorted[MINUTE_SAMPLES];
+    for (uint16_t n = 0; n < count; n++) {
+        uint16_t i = n;
+        while (i > 0 && sorted[i - 1] > samples[n]) {
+            sorted[i] = sorted[i - 1];
+            i--;
+        }
+        sorted[i] = samples[n];
+    }
+    p50 = sorted[(uint16_t)(0.50f * (count - 1) + 0.5f)];
+    p95 = sorted[(uint16_t)(0.95f * (count - 1) + 0.5f)];
+}
+
+void WindowAggregator::close(uint8_t channel, uint8_t window) {
+    WindowState& state = windows[channel][window];
+    state.open = false;
+
+    WindowSummary summary;
+    summary.start = state.start;
+    summary.window = window;
+    summary.channel = channel;
+    summary.count = state.count;
+    // A reset during the window shows as a drop; count what came after it
+    float energy = state.lastEnergy - state.firstEnergy;
+    summary.energyWh = energy >= 0 ? energy : state.lastEnergy;
+    for (uint8_t m = 0; m < WindowSummary::METRIC_COUNT; m++) {
+        const MetricState& ms = state.metrics[m];
+        WindowSummary::Stats& out = summary.metrics[m];
+        out.min = ms.min;
+        out.max = ms.max;
+        out.mean = ms.mean;
+        out.stddev = state.count > 1 ? sqrtf(ms.m2 / (state.count - 1)) : 0;
+        if (window == Minute && state.count <= MINUTE_SAMPLES) {
+            exactQuantiles(minuteSamples[channel][m], state.count, out.p50, out.p95);
+        } else {
+            out.p50 = ms.p50.estimate(state.count);
+            out.p95 = ms.p95.estimate(state.count);
+        }
+    }
+    finished.push(summary);
+}
+
+bool WindowAggregator::pop(WindowSummary& summary) {
+    return finished.pop(summary);
+}
@@ -0,0 +1,112 @@
+// ADC filter chain against the fake ADC: the battery divider with Gaussian
+// noise and rail spikes, and the charge-detect pin stepping from idle to
+// charging. The tests share one running sampler and follow on in time.
+//
+//   pio test -e native -f test_adc_sampler
+
+#include <Arduino.h>
+#include <math.h>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "adc_sampler.h"
+
+static const uint8_t BATTERY_PIN = 34;
+static const uint8_t CHARGING_PIN = 35;
+static const float CHARGING_THRESHOLD_V = 1.3f;
+static const unsigned long POLL_MS = 10;
+
+static bool chargingSeen() {
+    return AdcSampler::milliVolts(CHARGING_PIN) / 1000.0f > CHARGING_THRESHOLD_V;
+}
+
+static float batteryTruthMv() {
+    return fakeAdc.battery.raw * 3300.0f / 4095.0f;
+}
+
+// Moves the clock on one poll and lets the sampler drain
+static void poll() {
+    NativeClock::advance(POLL_MS);
+    AdcSampler::service();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_first_value_within_one_drain() {
+    fakeAdc.battery = {1550, 25, 0.005f};
+    fakeAdc.charging = {40, 30, 0.005f};
+    TEST_ASSERT_TRUE(AdcSampler::watch(BATTERY_PIN, 6));
+    TEST_ASSERT_TRUE(AdcSampler::watch(CHARGING_PIN, 2));
+    AdcSampler::start();
+    TEST_ASSERT_FALSE(AdcSampler::ready(BATTERY_PIN));
+
+    poll();
+    TEST_ASSERT_TRUE(AdcSampler::ready(BATTERY_PIN));
+    TEST_ASSERT_TRUE(AdcSampler::ready(CHARGING_PIN));
+    TEST_ASSERT_TRUE(AdcSampler::stats().continuous);
+}
+
+void test_battery_filter_rejects_noise_and_spikes() {
+    for (int i = 0; i < 200; i++) poll();  // Two seconds, a few EMA time constants
+
+    double sumSq = 0, worst = 0;
+    int n = 0;
+    for (unsigned long t = POLL_MS; t <= 60000; t += POLL_MS) {
+        poll();
+        if (t % 2000) continue;  // loop() reads the battery once a cycle
+        double error = AdcSampler::milliVolts(BATTERY_PIN) - batteryTruthMv();
+        sumSq += error * error;
+        if (fabs(error) > worst) worst = fabs(error);
+        n++;
+    }
+    // A single read has 20 mV of noise and the odd full-scale spike
+    TEST_ASSERT_LESS_THAN_FLOAT(1.0, sqrt(sumSq / n));
+    TEST_ASSERT_LESS_THAN_FLOAT(3.0, worst);
+    TEST_ASSERT_EQUAL_UINT32(0, fakeAdc.overruns);
+}
+
+void test_charge_step_seen_without_wrong_states() {
+    for (int i = 0; i < 1000; i++) {
+        poll();
+        TEST_ASSERT_FALSE(chargingSeen());
+    }
+
+    fakeAdc.charging.raw = 2000;
+    unsigned long detectMs = 0;
+    for (unsigned long t = POLL_MS; t <= 10000; t += POLL_MS) {
+        poll();
+        if (!detectMs && chargingSeen()) detectMs = t;
+        if (t > 200) TEST_ASSERT_TRUE(chargingSeen());
+    }
+    TEST_ASSERT_GREATER_THAN(0, detectMs);
+    TEST_ASSERT_LESS_THAN(200, detectMs);
+}
+
+void test_low_power_bursts_keep_the_values() {
+    AdcSampler::setLowPower(true);
+    for (int i = 0; i < 1000; i++) poll();
+    TEST_ASSERT_TRUE(AdcSampler::lowPower());
+
+    uint32_t blocks = AdcSampler::stats().blocks;
+    for (int i = 0; i < 1000; i++) {
+        poll();
+        TEST_ASSERT_TRUE(chargingSeen());
+    }
+    // One burst a second, one block per pin
+    TEST_ASSERT_UINT32_WITHIN(2, 20, AdcSampler::stats().blocks - blocks);
+    TEST_ASSERT_FLOAT_WITHIN(3.0f, batteryTruthMv(), AdcSampler::milliVolts(BATTERY_PIN));
+
+    AdcSampler::setLowPower(false);
+    poll();
+    TEST_ASSERT_FALSE(AdcSampler::lowPower());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_value_within_one_drain);
+    RUN_TEST(test_battery_filter_rejects_noise_and_spikes);
+    RUN_TEST(test_charge_step_seen_without_wrong_states);
+    RUN_TEST(test_low_power_bursts_keep_the_values);
+    return UNITY_END();
+}
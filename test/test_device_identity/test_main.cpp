@@ -0,0 +1,97 @@
+// Per-device namespacing: the id from the station MAC, the paths built from
+// it, and the firmware on the fakes writing only under its own devices/<id>
+// and fleet/<id> nodes.
+//
+//   pio test -e native -f test_device_identity
+
+#include <Arduino.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "WiFi.h"
+#include "native/fake_backends.h"
+#include "boot_sequence.h"
+#include "device_identity.h"
+
+void setup();
+void loop();
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_id_from_the_station_mac() {
+    const uint8_t mac[6] = {0x24, 0x0A, 0xC4, 0x00, 0xBE, 0xEF};
+    memcpy(WiFi.stationMac, mac, sizeof(mac));
+    DeviceIdentity::begin();
+    TEST_ASSERT_EQUAL_UINT32(DeviceIdentity::ID_LENGTH, strlen(DeviceIdentity::id()));
+    TEST_ASSERT_EQUAL_STRING("240ac400beef", DeviceIdentity::id());
+    TEST_ASSERT_EQUAL_STRING("devices/240ac400beef", DeviceIdentity::root());
+    TEST_ASSERT_EQUAL_STRING("fleet/240ac400beef", DeviceIdentity::fleet());
+}
+
+void test_path_under_the_root_or_nothing() {
+    char buffer[40];
+    TEST_ASSERT_TRUE(DeviceIdentity::path(buffer, sizeof(buffer), "readings"));
+    TEST_ASSERT_EQUAL_STRING("devices/240ac400beef/readings", buffer);
+    TEST_ASSERT_FALSE(DeviceIdentity::path(buffer, sizeof(buffer), "a/leaf/that/does/not/fit"));
+}
+
+void test_channel_zero_keeps_the_single_meter_layout() {
+    char buffer[40];
+    DeviceIdentity::channelPath(buffer, sizeof(buffer), 0, "readings");
+    TEST_ASSERT_EQUAL_STRING("readings", buffer);
+    DeviceIdentity::channelPath(buffer, sizeof(buffer), 3, "readings");
+    TEST_ASSERT_EQUAL_STRING("channels/3/readings", buffer);
+}
+
+void test_day_bucket_is_the_utc_date() {
+    char buffer[9];
+    DeviceIdentity::dayBucket(buffer, sizeof(buffer), 1700000000);  // 2023-11-14 22:13 UTC
+    TEST_ASSERT_EQUAL_STRING("20231114", buffer);
+    DeviceIdentity::dayBucket(buffer, sizeof(buffer), 1704067199);
+    TEST_ASSERT_EQUAL_STRING("20231231", buffer);
+}
+
+// Two minutes of the firmware from boot: every node in the database is
+// under this unit's own nodes, and the fleet index is kept up
+void test_firmware_writes_only_its_own_nodes() {
+    addConfiguredNetworks();
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(10);
+        loop();
+    }
+    TEST_ASSERT_GREATER_THAN(0, BootSequence::metrics().firstUploadMs);
+    std::vector<FakeCloud::Request> recorded;
+    fakeCloud.journal = &recorded;
+    for (unsigned long start = millis(); millis() - start < 120000;) {
+        NativeClock::advance(100);
+        loop();
+    }
+    fakeCloud.journal = nullptr;
+    TEST_ASSERT_GREATER_THAN(0, recorded.size());
+
+    const std::string root = std::string(DeviceIdentity::root()) + "/";
+    const std::string fleet = std::string(DeviceIdentity::fleet()) + "/";
+    TEST_ASSERT_GREATER_THAN(0, fakeCloud.nodes.size());
+    for (const auto& node : fakeCloud.nodes) {
+        bool own = node.first.compare(0, root.size(), root) == 0 || node.first.compare(0, fleet.size(), fleet) == 0;
+        TEST_ASSERT_TRUE_MESSAGE(own, node.first.c_str());
+    }
+    std::string lastSeen;
+    TEST_ASSERT_TRUE(fakeCloud.lookup((fleet + "lastSeen").c_str(), lastSeen));
+    TEST_ASSERT_GREATER_THAN(0, strtoul(lastSeen.c_str(), nullptr, 10));
+    TEST_ASSERT_TRUE(fakeCloud.lookup((root + "readings/voltage").c_str(), lastSeen));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_id_from_the_station_mac);
+    RUN_TEST(test_path_under_the_root_or_nothing);
+    RUN_TEST(test_channel_zero_keeps_the_single_meter_layout);
+    RUN_TEST(test_day_bucket_is_the_utc_date);
+    RUN_TEST(test_firmware_writes_only_its_own_nodes);
+    return UNITY_END();
+}
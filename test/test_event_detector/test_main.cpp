@@ -0,0 +1,272 @@
+// Appliance on/off detection: single steps, inrush, drift and a 15 W floor,
+// then an hour of synthetic household load scored against its true
+// switchings, and finally the firmware pushing each event to the database.
+//
+//   pio test -e native -f test_event_detector
+
+#include <Arduino.h>
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "event_detector.h"
+#include "boot_sequence.h"
+#include "device_identity.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const double SAMPLE_HZ = 24.4;  // One meter on the bus
+const unsigned long MATCH_MS = 250;
+
+struct Switching {
+    unsigned long ms;
+    ApplianceEvent::Kind kind;
+    float watts;
+    bool matched;
+};
+
+struct Appliance {
+    float watts;
+    float powerFactor;
+    float inrush;  // Multiple of the running power in the first samples
+    uint8_t inrushSamples;
+    double minOnS, maxOnS, minOffS, maxOffS;
+};
+
+unsigned long sampleMs(size_t n) {
+    return (unsigned long)(n * 1000 / SAMPLE_HZ);
+}
+
+PowerReadings reading(double power) {
+    PowerReadings r;
+    r.isValid = true;
+    r.voltage = 230;
+    r.power = roundf((float)power * 10) / 10;
+    r.current = roundf((float)(power / 230) * 1000) / 1000;
+    r.powerFactor = 1;
+    r.frequency = 50;
+    return r;
+}
+
+// Feeds `seconds` of load from `power(ms)`, from a zero clock, and collects the events
+template <typename Load>
+void feed(double seconds, Load power, std::vector<ApplianceEvent>& out, uint8_t channel = 0) {
+    std::mt19937 rng(11);
+    std::normal_distribution<double> gauss(0, 1);
+    for (size_t n = 0; n < (size_t)(seconds * SAMPLE_HZ); n++) {
+        unsigned long ms = sampleMs(n);
+        EventDetector::add(channel, reading(power(ms) * (1 + 0.002 * gauss(rng))), ms);
+        ApplianceEvent e;
+        while (EventDetector::pop(e)) out.push_back(e);
+    }
+}
+
+// Drifting base load, fridge and pump with inrush, heater, kettle, TV, a 25 W lamp
+void household(std::vector<Switching>& truth, std::vector<ApplianceEvent>& events) {
+    const double SECONDS = 3600;
+    const Appliance APPLIANCES[] = {
+        {120, 0.80f, 5.0f, 4, 400, 700, 600, 1100},
+        {2000, 1.00f, 1.0f, 0, 300, 900, 600, 1500},
+        {1800, 1.00f, 1.0f, 0, 120, 200, 900, 1800},
+        {750, 0.75f, 4.0f, 5, 90, 300, 400, 900},
+        {90, 0.90f, 1.0f, 0, 900, 1800, 300, 900},
+        {25, 0.95f, 1.0f, 0, 200, 600, 200, 600},
+    };
+    const size_t COUNT = sizeof(APPLIANCES) / sizeof(APPLIANCES[0]);
+    std::mt19937 rng(20201);
+    auto uniform = [&](double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+    std::normal_distribution<double> gauss(0, 1);
+
+    std::vector<std::vector<std::pair<unsigned long, unsigned long>>> onPeriods(COUNT);
+    for (size_t a = 0; a < COUNT; a++) {
+        const Appliance& app = APPLIANCES[a];
+        double t = uniform(30, app.maxOffS);
+        while (t < SECONDS) {
+            double on = uniform(app.minOnS, app.maxOnS);
+            unsigned long start = (unsigned long)(t * 1000), end = (unsigned long)((t + on) * 1000);
+            onPeriods[a].push_back({start, end});
+            truth.push_back({start, ApplianceEvent::On, app.watts, false});
+            if (t + on < SECONDS) truth.push_back({end, ApplianceEvent::Off, app.watts, false});
+            t += on + uniform(app.minOffS, app.maxOffS);
+        }
+    }
+
+    for (size_t n = 0; n < (size_t)(SECONDS * SAMPLE_HZ); n++) {
+        unsigned long ms = sampleMs(n);
+        double voltage = 230 + 3 * sin(ms / 700000.0) + 0.2 * gauss(rng);
+        double base = 180 + 60 * sin(2 * M_PI * ms / 1200000.0);  // Slow 20-minute swing
+        double power = base, apparent = base / 0.95;
+        for (size_t a = 0; a < COUNT; a++) {
+            const Appliance& app = APPLIANCES[a];
+            for (const auto& period : onPeriods[a]) {
+                if (ms < period.first || ms >= period.second) continue;
+                double p = app.watts;
+                if (ms - period.first < app.inrushSamples * 1000 / SAMPLE_HZ) p *= app.inrush;
+                power += p;
+                apparent += p / app.powerFactor;
+                break;
+            }
+        }
+        power *= 1 + 0.002 * gauss(rng);
+        PowerReadings r;
+        r.isValid = true;
+        r.voltage = roundf((float)voltage * 10) / 10;
+        r.power = roundf((float)power * 10) / 10;
+        r.current = roundf((float)(apparent / voltage) * 1000) / 1000;
+        r.powerFactor = roundf((float)(power / apparent) * 100) / 100;
+        r.frequency = 50;
+        EventDetector::add(0, r, ms);
+        ApplianceEvent e;
+        while (EventDetector::pop(e)) events.push_back(e);
+    }
+}
+
+}  // namespace
+
+void setUp() {
+    EventDetector::reset();
+}
+
+void tearDown() {}
+
+void test_step_on_and_off() {
+    std::vector<ApplianceEvent> events;
+    feed(120, [](unsigned long ms) { return ms >= 40000 && ms < 80000 ? 1200.0 : 200.0; }, events);
+    TEST_ASSERT_EQUAL_UINT32(2, events.size());
+    TEST_ASSERT_TRUE(events[0].kind == ApplianceEvent::On);
+    TEST_ASSERT_UINT32_WITHIN(50, 40000, events[0].atMs);
+    TEST_ASSERT_FLOAT_WITHIN(10, 1000, events[0].deltaPower);
+    TEST_ASSERT_FLOAT_WITHIN(5, 200, events[0].before.power);
+    TEST_ASSERT_FLOAT_WITHIN(10, 1200, events[0].after.power);
+    TEST_ASSERT_TRUE(events[1].kind == ApplianceEvent::Off);
+    TEST_ASSERT_UINT32_WITHIN(50, 80000, events[1].atMs);
+    TEST_ASSERT_FLOAT_WITHIN(10, -1000, events[1].deltaPower);
+    TEST_ASSERT_EQUAL_UINT32(events[0].sequence + 1, events[1].sequence);
+}
+
+void test_inrush_settles_to_the_running_power() {
+    std::vector<ApplianceEvent> events;
+    const unsigned long INRUSH_MS = 5 * 1000 / SAMPLE_HZ;
+    feed(60, [=](unsigned long ms) { return ms < 30000 ? 200.0 : ms < 30000 + INRUSH_MS ? 3200.0 : 950.0; },
+         events);
+    TEST_ASSERT_EQUAL_UINT32(1, events.size());
+    TEST_ASSERT_FLOAT_WITHIN(15, 750, events[0].deltaPower);
+}
+
+void test_slow_drift_is_no_event() {
+    std::vector<ApplianceEvent> events;
+    feed(1200, [](unsigned long ms) { return 180 + 60 * sin(2 * M_PI * ms / 1200000.0); }, events);
+    TEST_ASSERT_EQUAL_UINT32(0, events.size());
+}
+
+void test_step_below_the_minimum_is_ignored() {
+    std::vector<ApplianceEvent> events;
+    feed(60, [](unsigned long ms) { return ms >= 30000 ? 110.0 : 100.0; }, events);
+    TEST_ASSERT_EQUAL_UINT32(0, events.size());
+}
+
+void test_channels_keep_their_own_baseline() {
+    std::vector<ApplianceEvent> events;
+    feed(60, [](unsigned long) { return 3000.0; }, events, 1);
+    feed(60, [](unsigned long ms) { return ms >= 30000 ? 60.0 : 20.0; }, events, 0);
+    TEST_ASSERT_EQUAL_UINT32(1, events.size());
+    TEST_ASSERT_EQUAL_UINT8(0, events[0].channel);
+}
+
+void test_household_hour_within_five_percent() {
+    std::vector<Switching> truth;
+    std::vector<ApplianceEvent> events;
+    household(truth, events);
+
+    // Each event matches the nearest unmatched switching of the same direction
+    unsigned long falsePositives = 0;
+    for (const ApplianceEvent& e : events) {
+        Switching* best = nullptr;
+        unsigned long bestDistance = MATCH_MS + 1;
+        for (Switching& s : truth) {
+            if (s.matched || s.kind != e.kind) continue;
+            unsigned long distance = s.ms > e.atMs ? s.ms - e.atMs : e.atMs - s.ms;
+            if (distance < bestDistance) {
+                best = &s;
+                bestDistance = distance;
+            }
+        }
+        if (best) {
+            best->matched = true;
+        } else {
+            falsePositives++;
+        }
+    }
+    unsigned long missed = std::count_if(truth.begin(), truth.end(), [](const Switching& s) { return !s.matched; });
+    TEST_ASSERT_GREATER_THAN(30, truth.size());
+    TEST_ASSERT_LESS_OR_EQUAL(truth.size() / 20, missed);
+    TEST_ASSERT_LESS_OR_EQUAL(truth.size() / 20, falsePositives);
+}
+
+// The firmware itself: boot, then a 690 W load toggling every 30 s, each
+// step in the database within a second
+void test_firmware_pushes_each_event() {
+    const unsigned long PERIOD_MS = 60000;
+    const unsigned long RUN_MS = 300000;
+    const unsigned long STEP_MS = 10;
+
+    addConfiguredNetworks();
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    TEST_ASSERT_GREATER_THAN(0, BootSequence::metrics().firstUploadMs);
+    // Run on to a whole period so the first toggle is half a period away (a clock
+    // jump would be a step in the simulated load)
+    while (millis() % PERIOD_MS >= STEP_MS) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    unsigned long start = millis();
+    fakeCloud.nodes.clear();
+    const std::string eventsPrefix = std::string(DeviceIdentity::root()) + "/events/";
+    simulatedPzem.setAppliance(3.0f, PERIOD_MS);
+
+    size_t seen = 0;
+    unsigned long toggles = 0, toggledAt = 0, worst = 0;
+    bool on = false;
+    // loop() sleeps on the same clock, so go by millis() rather than counting steps
+    while (millis() - start <= RUN_MS + PERIOD_MS / 4) {
+        NativeClock::advance(STEP_MS);
+        if (millis() - start <= RUN_MS && simulatedPzem.applianceOn() != on) {
+            on = !on;
+            toggles++;
+            toggledAt = millis();
+        }
+        loop();
+        size_t events = 0;
+        for (const auto& node : fakeCloud.nodes) {
+            if (node.first.compare(0, eventsPrefix.size(), eventsPrefix) == 0) events++;
+        }
+        for (; seen < events; seen++) worst = std::max(worst, millis() - toggledAt);
+    }
+    simulatedPzem.setAppliance(0, 0);
+
+    TEST_ASSERT_GREATER_THAN(0, toggles);
+    TEST_ASSERT_EQUAL_UINT32(toggles, seen);
+    TEST_ASSERT_LESS_THAN(1000, worst);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_step_on_and_off);
+    RUN_TEST(test_inrush_settles_to_the_running_power);
+    RUN_TEST(test_slow_drift_is_no_event);
+    RUN_TEST(test_step_below_the_minimum_is_ignored);
+    RUN_TEST(test_channels_keep_their_own_baseline);
+    RUN_TEST(test_household_hour_within_five_percent);
+    RUN_TEST(test_firmware_pushes_each_event);
+    return UNITY_END();
+}
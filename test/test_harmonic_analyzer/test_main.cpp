@@ -0,0 +1,136 @@
+// Harmonic analysis against synthetic mains waveforms with known content,
+// quantised to 12-bit counts with noise, then the default fake waveforms
+// through the real path (DMA scan -> tap -> double buffer -> FFT).
+//
+//   pio test -e native -f test_harmonic_analyzer
+
+#include <Arduino.h>
+#include <math.h>
+#include <random>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "adc_sampler.h"
+#include "waveform_capture.h"
+
+static const size_t N = HarmonicAnalyzer::BLOCK_SAMPLES;
+static const uint32_t RATE_HZ = 5000;  // 20 kHz scan over four pins
+static const float HARMONIC_TOLERANCE = 0.3f;  // Percentage points
+static const float THD_TOLERANCE = 0.5f;
+
+static const float MAINS_VOLTAGE[FakeAdc::MAX_ORDER + 1] = {0, 1400, 0, 1400 * 0.012f, 0, 1400 * 0.03f, 0, 1400 * 0.015f};
+static const float SIX_PULSE[FakeAdc::MAX_ORDER + 1] = {0, 900, 0, 36, 0, 342, 0, 162, 0, 18, 0, 63, 0, 45, 0, 9};
+
+static std::mt19937 rng(7);
+static uint16_t voltage[N], current[N];
+
+static void synthesize(uint16_t* out, float hz, const float* amplitude) {
+    std::normal_distribution<double> gauss(0, 1.5);
+    for (size_t n = 0; n < N; n++) {
+        double t = 0.0123 + (double)n / RATE_HZ;
+        double value = 2048 + gauss(rng);
+        for (uint8_t h = 1; h <= FakeAdc::MAX_ORDER; h++) {
+            value += amplitude[h] * sin(2.0 * M_PI * h * hz * t + 0.4 * h);
+        }
+        out[n] = (uint16_t)lround(value < 0 ? 0 : value > 4095 ? 4095 : value);
+    }
+}
+
+static float trueThd(const float* amplitude) {
+    double sum = 0;
+    for (uint8_t h = 2; h <= FakeAdc::MAX_ORDER; h++) sum += amplitude[h] * amplitude[h];
+    return (float)(100.0 * sqrt(sum) / amplitude[1]);
+}
+
+// Every reported order and the THD against the true content
+static void assertContent(const float* amplitude, const float* reported, float reportedThd) {
+    for (uint8_t h = HarmonicSpectrum::FIRST_ORDER; h <= HarmonicSpectrum::LAST_ORDER; h++) {
+        float truth = 100.0f * amplitude[h] / amplitude[1];
+        TEST_ASSERT_FLOAT_WITHIN(HARMONIC_TOLERANCE, truth, reported[h - HarmonicSpectrum::FIRST_ORDER]);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(THD_TOLERANCE, trueThd(amplitude), reportedThd);
+}
+
+static void assertCase(float hz, const float* amplitude) {
+    synthesize(voltage, hz, MAINS_VOLTAGE);
+    synthesize(current, hz, amplitude);
+    HarmonicSpectrum spectrum;
+    TEST_ASSERT_TRUE(HarmonicAnalyzer::analyze(voltage, current, RATE_HZ, spectrum));
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, hz, spectrum.fundamentalHz);
+    TEST_ASSERT_TRUE(spectrum.currentValid);
+    assertContent(MAINS_VOLTAGE, spectrum.voltage, spectrum.thdVoltage);
+    assertContent(amplitude, spectrum.current, spectrum.thdCurrent);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_pure_sine() {
+    const float sine[FakeAdc::MAX_ORDER + 1] = {0, 1400};
+    assertCase(50, sine);
+}
+
+void test_six_pulse_drive() {
+    assertCase(50, SIX_PULSE);
+}
+
+void test_fundamental_off_the_bins() {
+    assertCase(59.7f, SIX_PULSE);
+}
+
+void test_square_wave_odd_orders() {
+    float square[FakeAdc::MAX_ORDER + 1] = {};
+    for (uint8_t h = 1; h <= FakeAdc::MAX_ORDER; h += 2) square[h] = 1000.0f / h;
+    assertCase(50.3f, square);
+}
+
+void test_light_load_current_not_valid() {
+    const float light[FakeAdc::MAX_ORDER + 1] = {0, 6, 0, 0, 0, 2};
+    synthesize(voltage, 50, MAINS_VOLTAGE);
+    synthesize(current, 50, light);
+    HarmonicSpectrum spectrum;
+    TEST_ASSERT_TRUE(HarmonicAnalyzer::analyze(voltage, current, RATE_HZ, spectrum));
+    TEST_ASSERT_FALSE(spectrum.currentValid);
+    assertContent(MAINS_VOLTAGE, spectrum.voltage, spectrum.thdVoltage);
+}
+
+void test_no_voltage_leaves_the_spectrum() {
+    const float none[FakeAdc::MAX_ORDER + 1] = {};
+    synthesize(voltage, 50, none);
+    synthesize(current, 50, SIX_PULSE);
+    HarmonicSpectrum spectrum;
+    spectrum.block = 7;
+    TEST_ASSERT_FALSE(HarmonicAnalyzer::analyze(voltage, current, RATE_HZ, spectrum));
+    TEST_ASSERT_EQUAL_UINT32(7, spectrum.block);
+}
+
+void test_capture_path_on_the_fake_mains() {
+    AdcSampler::watch(34, 5);
+    AdcSampler::watch(35, 1);
+    WaveformCapture::begin();
+    AdcSampler::start();
+    for (int i = 0; i < 500; i++) {
+        NativeClock::advance(20);
+        AdcSampler::service();
+        WaveformCapture::service();
+    }
+
+    HarmonicSpectrum live;
+    TEST_ASSERT_TRUE(WaveformCapture::fresh(live));
+    TEST_ASSERT_GREATER_OR_EQUAL(40, WaveformCapture::stats().blocks);
+    TEST_ASSERT_EQUAL_UINT32(0, fakeAdc.overruns);
+    TEST_ASSERT_TRUE(live.currentValid);
+    assertContent(fakeAdc.mainsCurrent.amplitude, live.current, live.thdCurrent);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pure_sine);
+    RUN_TEST(test_six_pulse_drive);
+    RUN_TEST(test_fundamental_off_the_bins);
+    RUN_TEST(test_square_wave_odd_orders);
+    RUN_TEST(test_light_load_current_not_valid);
+    RUN_TEST(test_no_voltage_leaves_the_spectrum);
+    RUN_TEST(test_capture_path_on_the_fake_mains);
+    return UNITY_END();
+}
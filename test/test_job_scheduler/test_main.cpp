@@ -0,0 +1,173 @@
+// Job scheduler on the virtual clock: run counts and lateness for periods
+// from 10 ms to a minute (longer than a wheel revolution), a job that stalls
+// the loop, trigger() and setPeriod(), then the firmware's own jobs.
+//
+//   pio test -e native -f test_job_scheduler
+
+#include <Arduino.h>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "boot_sequence.h"
+#include "job_scheduler.h"
+
+void setup();
+void loop();
+
+namespace {
+
+unsigned long stallMs = 0;  // How long the next run of the stalling job takes
+
+void idle() {}
+void stall() {
+    NativeClock::advance(stallMs);
+    stallMs = 0;
+}
+
+void runFor(unsigned long ms, unsigned long step = 1) {
+    unsigned long end = millis() + ms;
+    while ((long)(millis() - end) < 0) {
+        NativeClock::advance(step);
+        JobScheduler::service();
+    }
+}
+
+// Every period once per period; service() granularity bounds the lateness
+void assertPeriods(unsigned long step) {
+    const uint32_t PERIODS[] = {10, 100, 1000, 2000, 60000};
+    const unsigned long RUN_MS = 600000;
+    for (uint32_t period : PERIODS) JobScheduler::add("job", idle, period, period);
+    runFor(RUN_MS, step);
+
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) {
+        const JobScheduler::JobStats& s = JobScheduler::stats(id);
+        uint32_t expected = RUN_MS / s.periodMs;
+        if (s.periodMs >= step) {
+            TEST_ASSERT_UINT32_WITHIN(1, expected, s.runs);
+        } else {
+            TEST_ASSERT_GREATER_OR_EQUAL(expected - 1, s.runs + s.skipped);
+        }
+        TEST_ASSERT_LESS_THAN(step, s.maxLateMs);
+    }
+}
+
+}  // namespace
+
+void setUp() {
+    JobScheduler::begin();
+}
+
+void tearDown() {}
+
+void test_periods_serviced_every_millisecond() {
+    assertPeriods(1);
+}
+
+void test_periods_serviced_every_37_ms() {
+    assertPeriods(37);
+}
+
+void test_stall_costs_one_late_run() {
+    uint8_t fast = JobScheduler::add("fast", idle, 100, 50);
+    uint8_t slow = JobScheduler::add("slow", idle, 2000, 2000, 500);
+    uint8_t staller = JobScheduler::add("stall", stall, 200, 200);
+    runFor(5000);
+    stallMs = 250;
+    runFor(5000);
+
+    // The 100 ms job: one late run, the two periods under the stall skipped
+    const JobScheduler::JobStats& f = JobScheduler::stats(fast);
+    TEST_ASSERT_EQUAL_UINT32(1, f.missed);
+    TEST_ASSERT_EQUAL_UINT32(2, f.skipped);
+    TEST_ASSERT_UINT32_WITHIN(5, 205, f.maxLateMs);
+    TEST_ASSERT_EQUAL_UINT32(100, f.runs + f.skipped);  // Back on the fixed rate
+    // The stalling job overran its 200 ms period once
+    const JobScheduler::JobStats& st = JobScheduler::stats(staller);
+    TEST_ASSERT_EQUAL_UINT32(1, st.overruns);
+    TEST_ASSERT_EQUAL_UINT32(250, st.maxRunMs);
+    TEST_ASSERT_EQUAL_UINT32(1, st.skipped);
+    // A 2 s job with a 500 ms deadline doesn't notice
+    const JobScheduler::JobStats& s = JobScheduler::stats(slow);
+    TEST_ASSERT_EQUAL_UINT32(0, s.missed);
+    TEST_ASSERT_EQUAL_UINT32(5, s.runs);
+}
+
+void test_trigger_runs_now_and_restarts_the_period() {
+    uint8_t slow = JobScheduler::add("slow", idle, 2000, 2000, 500);
+    runFor(3000);
+    const JobScheduler::JobStats& s = JobScheduler::stats(slow);
+    TEST_ASSERT_EQUAL_UINT32(1, s.runs);
+
+    JobScheduler::trigger(slow);
+    TEST_ASSERT_EQUAL_UINT32(0, JobScheduler::msUntilNext());
+    runFor(1);
+    TEST_ASSERT_EQUAL_UINT32(2, s.runs);
+    TEST_ASSERT_EQUAL_UINT32(0, s.missed);  // Not counted late
+    runFor(2000 - 2);
+    TEST_ASSERT_EQUAL_UINT32(2, s.runs);  // The old due time passed without a run
+    runFor(2);
+    TEST_ASSERT_EQUAL_UINT32(3, s.runs);
+}
+
+void test_set_period_across_wheel_turns() {
+    uint8_t fast = JobScheduler::add("fast", idle, 100, 50);
+    runFor(1000);
+    const JobScheduler::JobStats& f = JobScheduler::stats(fast);
+    uint32_t before = f.runs;
+
+    JobScheduler::setPeriod(fast, 7000);
+    runFor(6999);
+    TEST_ASSERT_EQUAL_UINT32(before, f.runs);  // Three and a half revolutions
+    runFor(7000 + 1);
+    TEST_ASSERT_EQUAL_UINT32(before + 2, f.runs);
+    TEST_ASSERT_EQUAL_UINT32(0, f.maxLateMs);
+    TEST_ASSERT_EQUAL_UINT32(7000, f.periodMs);
+}
+
+void test_ms_until_next() {
+    JobScheduler::add("a", idle, 1000, 300);
+    JobScheduler::add("b", idle, 1000, 700);
+    TEST_ASSERT_EQUAL_UINT32(300, JobScheduler::msUntilNext());
+    runFor(300);
+    TEST_ASSERT_EQUAL_UINT32(400, JobScheduler::msUntilNext());
+}
+
+// The firmware's jobs over ten minutes, one loop() per 10 ms
+void test_firmware_jobs_keep_their_periods() {
+    const unsigned long RUN_MS = 600000;
+    const unsigned long STEP_MS = 10;
+    addConfiguredNetworks();
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+    TEST_ASSERT_GREATER_THAN(3, JobScheduler::jobCount());
+    uint32_t runsBefore[JobScheduler::MAX_JOBS];
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) runsBefore[id] = JobScheduler::stats(id).runs;
+
+    unsigned long end = millis() + RUN_MS;
+    while ((long)(millis() - end) < 0) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) {
+        const JobScheduler::JobStats& s = JobScheduler::stats(id);
+        TEST_ASSERT_UINT32_WITHIN(1, RUN_MS / s.periodMs, s.runs - runsBefore[id]);
+        TEST_ASSERT_EQUAL_UINT32(0, s.missed);
+    }
+    static char json[JobScheduler::MAX_JOBS * 160];
+    TEST_ASSERT_GREATER_THAN(0, JobScheduler::format(json, sizeof(json)));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_periods_serviced_every_millisecond);
+    RUN_TEST(test_periods_serviced_every_37_ms);
+    RUN_TEST(test_stall_costs_one_late_run);
+    RUN_TEST(test_trigger_runs_now_and_restarts_the_period);
+    RUN_TEST(test_set_period_across_wheel_turns);
+    RUN_TEST(test_ms_until_next);
+    RUN_TEST(test_firmware_jobs_keep_their_periods);
+    return UNITY_END();
+}
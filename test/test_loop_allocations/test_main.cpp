@@ -0,0 +1,104 @@
+// The steady-state loop must not touch the heap: the firmware boots, every
+// periodic job (telemetry, window summaries, debug block) gets to run once,
+// then an hour of upload cycles is counted. Cloud writes go to a sink that
+// keeps nothing, so the fake database's own std::map stays out of the count.
+// This covers the firmware's own code on the host; on the device the JSON
+// writes go out from the same buffers (hal_esp32.cpp), past FirebaseJson.
+//
+//   pio test -e native -f test_loop_allocations
+
+#include <Arduino.h>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "native/heap_audit.h"
+#include "boot_sequence.h"
+#include "readings_delta.h"
+#include "readings_schema.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const unsigned long CYCLE_MS = 2000;
+
+class SinkCloud : public CloudBackend {
+public:
+    void begin() override {}
+    bool authenticated() override { return true; }
+    bool ready() override { return true; }
+    bool setJSON(const char*, const char*) override { return count(); }
+    bool updateJSON(const char*, const char*) override { return count(); }
+    bool setInt(const char*, int) override { return count(); }
+    bool setBool(const char*, bool) override { return count(); }
+    bool getBool(const char*, bool*) override { return false; }
+    bool getFloat(const char*, float*) override { return false; }
+    bool beginStream(const char*, StreamCallback) override { return true; }
+    bool streamConnected() override { return true; }
+    const char* errorReason() override { return ""; }
+    bool answered() override { return true; }
+
+    unsigned long requests = 0;
+
+private:
+    bool count() {
+        requests++;
+        return true;
+    }
+};
+
+SinkCloud sinkCloud;
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_steady_state_loop_does_not_allocate() {
+    addConfiguredNetworks();
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(10);
+        loop();
+    }
+    TEST_ASSERT_TRUE(BootSequence::metrics().firstUploadMs != 0);
+    Hal::setCloud(&sinkCloud);
+    for (int i = 0; i < 1900; i++) {  // Past the first 1 h window and a telemetry push
+        NativeClock::advance(CYCLE_MS);
+        loop();
+    }
+
+    sinkCloud.requests = 0;
+    HeapAudit::start();
+    for (int i = 0; i < 1800; i++) {
+        NativeClock::advance(CYCLE_MS);
+        loop();
+    }
+    unsigned long allocations = HeapAudit::stop();
+    TEST_ASSERT_GREATER_OR_EQUAL(1800, sinkCloud.requests);  // The cycles did upload
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+void test_readings_schema_does_not_allocate() {
+    char json[ReadingsSchema::maxJsonLength() + 1];
+    uint8_t binary[ReadingsSchema::maxBinaryLength()];
+    PowerReadings readings;
+    readings.voltage = 231.4f;
+    readings.power = 1520.5f;
+    HeapAudit::start();
+    int length = ReadingsSchema::toJson(readings, json, sizeof(json));
+    bool nan = ReadingsSchema::hasNaN(readings);
+    int bytes = ReadingsSchema::toBinary(readings, ReadingsDelta::ALL_FIELDS, binary, sizeof(binary));
+    unsigned long allocations = HeapAudit::stop();
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_FALSE(nan);
+    TEST_ASSERT_GREATER_THAN(0, bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_state_loop_does_not_allocate);
+    RUN_TEST(test_readings_schema_does_not_allocate);
+    return UNITY_END();
+}
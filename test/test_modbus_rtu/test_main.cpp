@@ -0,0 +1,188 @@
+// Modbus-RTU master and PZEM driver against the simulated meter: decoding,
+// bus addressing, what timeouts, CRC errors and exceptions cost, and how
+// long the scheduler leaves a meter that stopped answering alone.
+//
+//   pio test -e native -f test_modbus_rtu
+
+#include <Arduino.h>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "meter_scheduler.h"
+#include "pzem_meter.h"
+
+static SimulatedPzem* bus;
+static PzemMeter* meter;
+
+// Polls like the sampling task, one step per millisecond, until the transaction ends
+static MeterBackend::Status finish(MeterSample& sample, unsigned long* tookMs = nullptr) {
+    unsigned long start = millis();
+    MeterBackend::Status status = MeterBackend::Status::Busy;
+    while (status == MeterBackend::Status::Busy && millis() - start < 2000) {
+        NativeClock::advance(1);
+        unsigned long before = millis();
+        status = meter->poll(sample);
+        TEST_ASSERT_EQUAL_UINT32(before, millis());  // poll() never waits
+    }
+    if (tookMs) *tookMs = millis() - start;
+    return status;
+}
+
+void setUp() {
+    bus = new SimulatedPzem();
+    meter = new PzemMeter(*bus);
+    meter->begin();
+    NativeClock::advance(1000);
+}
+
+void tearDown() {
+    delete meter;
+    delete bus;
+}
+
+void test_read_decodes_the_registers() {
+    MeterSample sample = {};
+    unsigned long tookMs = 0;
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample, &tookMs) == MeterBackend::Status::Ready);
+    TEST_ASSERT_UINT32_WITHIN(1, lroundf(bus->loadVoltage(0) * 10), sample.voltage);
+    TEST_ASSERT_UINT32_WITHIN(5, lroundf(bus->loadCurrent(0) * 1000), sample.current);
+    TEST_ASSERT_UINT32_WITHIN(20, lroundf(bus->loadPower(0) * 10), sample.power);
+    TEST_ASSERT_EQUAL_UINT16(500, sample.frequency);
+    TEST_ASSERT_EQUAL_UINT16(92, sample.pf);
+    // Gap, 8 request bytes, turnaround and 25 reply bytes at 9600 baud
+    TEST_ASSERT_UINT32_WITHIN(8, 40, tookMs);
+    const LinkStats& link = meter->linkStats();
+    TEST_ASSERT_EQUAL_UINT32(1, link.completed);
+    TEST_ASSERT_EQUAL_UINT32(0, link.retries);
+}
+
+void test_one_transaction_at_a_time() {
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_FALSE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_FALSE(meter->resetEnergy(PzemMeter::GENERAL_ADDRESS));
+    MeterSample sample;
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+}
+
+void test_meters_addressed_on_a_shared_bus() {
+    bus->setMeterCount(3);
+    for (uint8_t address = 1; address <= 3; address++) {
+        MeterSample sample = {};
+        TEST_ASSERT_TRUE(meter->request(address));
+        TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+        TEST_ASSERT_UINT32_WITHIN(1, lroundf(bus->loadVoltage(address - 1) * 10), sample.voltage);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, meter->linkStats().retries);
+}
+
+void test_silent_address_fails_after_the_retries() {
+    MeterSample sample;
+    TEST_ASSERT_TRUE(meter->request(9));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Failed);
+    const LinkStats& link = meter->linkStats();
+    TEST_ASSERT_EQUAL_UINT32(3, link.timeouts);
+    TEST_ASSERT_EQUAL_UINT32(2, link.retries);
+    TEST_ASSERT_EQUAL_UINT32(1, link.failed);
+}
+
+void test_general_address_collides_with_several_meters() {
+    bus->setMeterCount(2);
+    MeterSample sample;
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Failed);
+}
+
+void test_crc_error_is_retried() {
+    bus->setCorruptEvery(2);  // The first reply intact, the second corrupted
+    MeterSample sample;
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+    const LinkStats& link = meter->linkStats();
+    TEST_ASSERT_EQUAL_UINT32(1, link.crcErrors);
+    TEST_ASSERT_EQUAL_UINT32(1, link.retries);
+    TEST_ASSERT_EQUAL_UINT32(2, link.completed);
+}
+
+void test_dropped_reply_is_retried() {
+    bus->setDropoutEvery(2);
+    MeterSample sample;
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+    const LinkStats& link = meter->linkStats();
+    TEST_ASSERT_EQUAL_UINT32(1, link.timeouts);
+    TEST_ASSERT_EQUAL_UINT32(1, link.retries);
+}
+
+void test_reset_energy_leaves_the_sample_alone() {
+    MeterSample sample = {};
+    NativeClock::advance(3600000);  // An hour of load on the register
+    TEST_ASSERT_TRUE(meter->request(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+    TEST_ASSERT_GREATER_THAN(0, sample.energy);
+
+    MeterSample untouched = sample;
+    TEST_ASSERT_TRUE(meter->resetEnergy(PzemMeter::GENERAL_ADDRESS));
+    TEST_ASSERT_TRUE(finish(sample) == MeterBackend::Status::Ready);
+    TEST_ASSERT_EQUAL_MEMORY(&untouched, &sample, sizeof(sample));
+    TEST_ASSERT_TRUE(bus->energyWh(0) < 1.0);
+}
+
+void test_exception_reply_fails_without_retrying() {
+    ModbusRtuMaster master(*bus);
+    master.begin(9600);
+    TEST_ASSERT_TRUE(master.sendCommand(ModbusRtuMaster::GENERAL_ADDRESS, 0x41));  // Not a PZEM function
+    ModbusRtuMaster::Status status = ModbusRtuMaster::Status::Busy;
+    for (int ms = 0; ms < 2000 && status == ModbusRtuMaster::Status::Busy; ms++) {
+        NativeClock::advance(1);
+        status = master.poll();
+    }
+    TEST_ASSERT_TRUE(status == ModbusRtuMaster::Status::Failed);
+    TEST_ASSERT_EQUAL_UINT32(1, master.getStats().exceptions);
+    TEST_ASSERT_EQUAL_UINT32(0, master.getStats().retries);
+}
+
+// The only meter unplugged, rounds back to back: every pass is empty while it
+// backs off, and the backoff still has to last
+void test_dead_meter_backs_off_by_the_clock() {
+    nativeMeter.begin();
+    simulatedPzem.setMeterCount(0);
+    const uint8_t addresses[] = { 1 };
+    MeterScheduler::setRoundGap(0);
+    MeterScheduler::begin(addresses, 1);
+    for (int ms = 0; ms < 60000; ms++) {
+        NativeClock::advance(1);
+        MeterScheduler::service();
+    }
+    // Each failed read is three timeouts; from the fifth on it waits 31 times that
+    uint32_t failures = MeterScheduler::channelStats(0).failures;
+    TEST_ASSERT_GREATER_OR_EQUAL(5, failures);
+    TEST_ASSERT_LESS_OR_EQUAL(12, failures);
+
+    simulatedPzem.setMeterCount(1);
+    for (int ms = 0; ms < 15000; ms++) {
+        NativeClock::advance(1);
+        MeterScheduler::service();
+    }
+    TEST_ASSERT_EQUAL_UINT8(0, MeterScheduler::channelStats(0).failStreak);
+    TEST_ASSERT_GREATER_THAN(0, MeterScheduler::samplesCompleted());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_read_decodes_the_registers);
+    RUN_TEST(test_one_transaction_at_a_time);
+    RUN_TEST(test_meters_addressed_on_a_shared_bus);
+    RUN_TEST(test_silent_address_fails_after_the_retries);
+    RUN_TEST(test_general_address_collides_with_several_meters);
+    RUN_TEST(test_crc_error_is_retried);
+    RUN_TEST(test_dropped_reply_is_retried);
+    RUN_TEST(test_reset_energy_leaves_the_sample_alone);
+    RUN_TEST(test_exception_reply_fails_without_retrying);
+    RUN_TEST(test_dead_meter_backs_off_by_the_clock);
+    return UNITY_END();
+}
@@ -0,0 +1,302 @@
+// The MQTT uplink: the firmware booted on it against FakeMqtt, then over a
+// real TCP connection to the in-process loopback broker with an app client
+// subscribed to the device's topics: a command set by the app, upload cycles
+// read back bit-exact, and a connection dropped mid-cycle.
+//
+//   pio test -e native -f test_mqtt_uplink
+
+#include <Arduino.h>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "native/loopback_broker.h"
+#include "native/mqtt_socket.h"
+#include "boot_sequence.h"
+#include "device_identity.h"
+#include "firebase_manager.h"
+#include "mqtt_uplink.h"
+#include "readings_delta.h"
+#include "readings_schema.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const unsigned long CYCLE_MS = 2000;
+const uint32_t WAIT_MS = 3000;
+
+LoopbackBroker broker;
+std::string root;
+
+struct Received {
+    std::string topic;
+    std::vector<uint8_t> payload;
+};
+std::vector<Received> appInbox;
+std::vector<Received> deviceSent;
+std::string commandPath, commandData;
+
+void onApp(const char* topic, const uint8_t* payload, size_t length) {
+    appInbox.push_back({topic, std::vector<uint8_t>(payload, payload + length)});
+}
+
+void onCommand(const char* path, const char* data) {
+    commandPath = path;
+    commandData = data;
+}
+
+// Keeps what the firmware handed the transport, in order
+class TapMqtt : public MqttBackend {
+public:
+    explicit TapMqtt(MqttBackend& inner) : inner(inner) {}
+    void begin(const char* clientId, MessageCallback callback) override { inner.begin(clientId, callback); }
+    bool connected() override { return inner.connected(); }
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) override {
+        deviceSent.push_back({topic, std::vector<uint8_t>(payload, payload + length)});
+        return inner.publish(topic, payload, length, qos, retain);
+    }
+    bool flush(uint32_t timeoutMs) override { return inner.flush(timeoutMs); }
+    bool subscribe(const char* filter, uint8_t qos) override { return inner.subscribe(filter, qos); }
+    void service() override { inner.service(); }
+    const char* errorReason() override { return inner.errorReason(); }
+
+private:
+    MqttBackend& inner;
+};
+
+// Wall time: the sockets wait on it, not on the native clock
+long long wallMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Services a client until it has seen `expected` messages or the time is up
+void drain(SocketMqtt& client, size_t expected, uint32_t ms) {
+    long long until = wallMs() + ms;
+    do {
+        client.service();
+    } while (appInbox.size() < expected && wallMs() < until);
+}
+
+// The app subscribed to everything under the device, and the device on the
+// MQTT uplink through a tap, both connected to the loopback broker
+struct Link {
+    SocketMqtt app;
+    SocketMqtt socket;
+    TapMqtt device;
+
+    Link() : app("127.0.0.1", broker.port()), socket("127.0.0.1", broker.port()), device(socket) {
+        app.begin("test-app", onApp);
+        TEST_ASSERT_TRUE_MESSAGE(app.connected(), app.errorReason());
+        TEST_ASSERT_TRUE(app.subscribe((root + "#").c_str(), 1));
+        drain(app, SIZE_MAX, 300);  // Retained status and whatever queued while away
+        appInbox.clear();
+        deviceSent.clear();
+        Hal::setMqtt(&device);
+        FirebaseManager::setUplink(&mqttUplink);
+        mqttUplink.begin();
+        TEST_ASSERT_TRUE_MESSAGE(mqttUplink.ready(), socket.errorReason());
+    }
+
+    ~Link() {
+        socket.disconnect();
+        app.disconnect();
+        Hal::setMqtt(&fakeMqtt);
+    }
+};
+
+// A household load wandering enough for the deadbands to let most cycles through
+PowerReadings readingsAt(unsigned long cycle) {
+    PowerReadings r;
+    double t = cycle * CYCLE_MS / 1000.0;
+    r.timestamp = 1700000000UL + (uint32_t)t;
+    r.voltage = 230 + 2 * sin(t / 300) + 0.2f * sin(t * 1.7);
+    r.power = 400 + 350 * sin(t / 40) + (fmod(t, 600) < 120 ? 2000 : 0);
+    r.powerFactor = 0.85f + 0.1f * sin(t / 90);
+    r.apparentPower = r.power / r.powerFactor;
+    r.current = r.apparentPower / r.voltage;
+    r.energy = 12000 + 400 * t / 3600;
+    r.frequency = 50 + 0.03f * sin(t / 70);
+    r.isValid = true;
+    r.isCharging = (cycle / 150) % 2 == 0;
+    return r;
+}
+
+void assertSameFields(const PowerReadings& expected, const PowerReadings& actual, uint32_t fields) {
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        if (!(fields & (1UL << i))) continue;
+        const ReadingsField& field = READINGS_SCHEMA[i];
+        if (field.kind == ReadingsField::Bool) {
+            TEST_ASSERT_EQUAL(expected.isCharging, actual.isCharging);
+        } else if (field.kind == ReadingsField::Uint32) {
+            TEST_ASSERT_EQUAL_UINT32(expected.timestamp, actual.timestamp);
+        } else {
+            float x = ReadingsSchema::floatAt(expected, field), y = ReadingsSchema::floatAt(actual, field);
+            TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&x, &y, sizeof(x), field.name);
+        }
+    }
+}
+
+}  // namespace
+
+void setUp() {
+    commandPath.clear();
+    commandData.clear();
+}
+
+void tearDown() {
+    Hal::setMqtt(&fakeMqtt);  // Also when a failed assertion skipped ~Link()
+}
+
+// Two minutes of the firmware on the uplink against FakeMqtt, then a reset
+// pushed by the app as it would set the database node
+void test_firmware_on_the_mqtt_uplink() {
+    FirebaseManager::setUplink(&mqttUplink);
+    addConfiguredNetworks();
+    setup();
+    for (unsigned long start = millis(); !BootSequence::metrics().firstUploadMs && millis() - start < 120000;) {
+        NativeClock::advance(10);
+        loop();
+    }
+    TEST_ASSERT_GREATER_THAN(0, BootSequence::metrics().firstUploadMs);
+    std::vector<FakeMqtt::Message> journal;
+    fakeMqtt.journal = &journal;
+    for (unsigned long start = millis(); millis() - start < 120000;) {
+        NativeClock::advance(100);
+        loop();
+    }
+    fakeMqtt.journal = nullptr;
+
+    unsigned long readings = 0, status = 0;
+    for (const FakeMqtt::Message& m : journal) {
+        if (m.topic == root + "readings") {
+            readings++;
+            PowerReadings r;
+            uint32_t fields = 0;
+            TEST_ASSERT_TRUE(ReadingsSchema::fromBinary(m.payload.data(), m.payload.size(), r, &fields));
+            TEST_ASSERT_NOT_EQUAL(0, fields);
+            TEST_ASSERT_FALSE_MESSAGE(m.retain, "readings are a stream");
+        } else {
+            status++;
+            TEST_ASSERT_TRUE_MESSAGE(m.retain, m.topic.c_str());
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(0, readings);
+    TEST_ASSERT_GREATER_THAN(0, status);
+    TEST_ASSERT_EQUAL_UINT32(1, fakeMqtt.retained.count(std::string(DeviceIdentity::fleet()) + "/lastSeen"));
+
+    fakeMqtt.pushMessage((root + "commands/reset").c_str(), "true", true);
+    for (unsigned long start = millis(); millis() - start < 10000;) {
+        NativeClock::advance(100);
+        loop();
+    }
+    auto ack = fakeMqtt.retained.find(root + "commands/reset");
+    TEST_ASSERT_TRUE(ack != fakeMqtt.retained.end());
+    TEST_ASSERT_EQUAL_STRING("false", std::string(ack->second.begin(), ack->second.end()).c_str());
+}
+
+void test_command_set_by_the_app_reaches_the_device() {
+    Link link;
+    TEST_ASSERT_TRUE(mqttUplink.subscribeCommands("commands", onCommand));
+    const char on[] = "true";
+    link.app.publish((root + "commands/reset").c_str(), (const uint8_t*)on, strlen(on), 1, true);
+    TEST_ASSERT_TRUE(link.app.flush(WAIT_MS));
+    for (long long until = wallMs() + WAIT_MS; commandPath.empty() && wallMs() < until;) link.socket.service();
+    TEST_ASSERT_EQUAL_STRING("/reset", commandPath.c_str());
+    TEST_ASSERT_EQUAL_STRING("true", commandData.c_str());
+
+    link.app.publish((root + "commands/reset").c_str(), nullptr, 0, 1, true);  // Clear the retained command
+    TEST_ASSERT_TRUE(link.app.flush(WAIT_MS));
+}
+
+// Every cycle acknowledged, the app receiving every message the device sent,
+// and each readings payload decoding to the values its cycle had
+void test_cycles_arrive_bit_exact_in_order() {
+    const unsigned long CYCLES = 300;
+    Link link;
+    ReadingsDelta::reset();
+    std::vector<PowerReadings> truth;
+    for (unsigned long cycle = 0; cycle < CYCLES; cycle++) {
+        PowerReadings readings = readingsAt(cycle);
+        size_t sentBefore = deviceSent.size();
+        FirebaseManager::beginCycle();
+        FirebaseManager::queueReadings(readings);
+        FirebaseManager::queueBattery(80);
+        TEST_ASSERT_TRUE(FirebaseManager::commitCycle());
+        for (size_t i = sentBefore; i < deviceSent.size(); i++) {
+            if (deviceSent[i].topic == root + "readings") truth.push_back(readings);
+        }
+        NativeClock::advance(CYCLE_MS);
+        link.app.service();
+    }
+    drain(link.app, deviceSent.size(), WAIT_MS);
+    TEST_ASSERT_EQUAL_UINT32(deviceSent.size(), appInbox.size());
+
+    std::vector<const Received*> sent, got;
+    for (const Received& r : deviceSent) if (r.topic == root + "readings") sent.push_back(&r);
+    for (const Received& r : appInbox) if (r.topic == root + "readings") got.push_back(&r);
+    TEST_ASSERT_GREATER_THAN(CYCLES / 2, got.size());
+    TEST_ASSERT_EQUAL_UINT32(sent.size(), got.size());
+    TEST_ASSERT_EQUAL_UINT32(truth.size(), got.size());
+    for (size_t i = 0; i < got.size(); i++) {
+        TEST_ASSERT_TRUE(got[i]->payload == sent[i]->payload);
+        PowerReadings decoded;
+        uint32_t fields = 0;
+        TEST_ASSERT_TRUE(ReadingsSchema::fromBinary(got[i]->payload.data(), got[i]->payload.size(), decoded, &fields));
+        TEST_ASSERT_NOT_EQUAL(0, fields);
+        assertSameFields(truth[i], decoded, fields);
+    }
+}
+
+// The connection lost halfway through a cycle's publishes: the cycle still
+// commits, and what was in flight is resent (QoS 1 is at least once)
+void test_dropped_connection_loses_nothing() {
+    const int MESSAGES = 20;
+    Link link;
+    unsigned long reconnects = link.socket.reconnects;
+    FirebaseManager::beginCycle();
+    for (int n = 0; n < MESSAGES; n++) {
+        if (n == MESSAGES / 2) link.socket.drop();
+        char path[32], value[8];
+        snprintf(path, sizeof(path), "test/seq/%d", n);
+        snprintf(value, sizeof(value), "%d", n);
+        mqttUplink.publishStatus(path, value);
+    }
+    TEST_ASSERT_TRUE(FirebaseManager::commitCycle());
+    TEST_ASSERT_GREATER_THAN(reconnects, link.socket.reconnects);
+    TEST_ASSERT_GREATER_THAN(0, link.socket.resent);
+
+    drain(link.app, SIZE_MAX, 500);
+    const std::string prefix = root + "test/seq/";
+    std::vector<int> seen(MESSAGES, 0);
+    for (const Received& r : appInbox) {
+        if (r.topic.compare(0, prefix.size(), prefix) != 0) continue;
+        int n = atoi(r.topic.c_str() + prefix.size());
+        if (n >= 0 && n < MESSAGES) seen[n]++;
+    }
+    for (int n = 0; n < MESSAGES; n++) TEST_ASSERT_GREATER_THAN(0, seen[n]);
+
+    for (int n = 0; n < MESSAGES; n++) {
+        link.app.publish((prefix + std::to_string(n)).c_str(), nullptr, 0, 1, true);
+    }
+    TEST_ASSERT_TRUE(link.app.flush(WAIT_MS));
+}
+
+int main() {
+    DeviceIdentity::begin();
+    root = std::string(DeviceIdentity::root()) + "/";
+    if (!broker.start()) return 1;
+    UNITY_BEGIN();
+    RUN_TEST(test_firmware_on_the_mqtt_uplink);  // First: the others take over the uplink's subscription
+    RUN_TEST(test_command_set_by_the_app_reaches_the_device);
+    RUN_TEST(test_cycles_arrive_bit_exact_in_order);
+    RUN_TEST(test_dropped_connection_loses_nothing);
+    int failures = UNITY_END();
+    broker.stop();
+    return failures;
+}
@@ -0,0 +1,213 @@
+// Battery-aware power modes: the thresholds and hysteresis of the decision,
+// a simulated discharge of the cell against the same cell at full rate, and
+// the firmware on the fakes taken off the charger and down through the modes.
+//
+//   pio test -e native -f test_power_policy
+
+#include <Arduino.h>
+#include <random>
+#include <string.h>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "adc_sampler.h"
+#include "battery_monitor.h"
+#include "boot_sequence.h"
+#include "device_identity.h"
+#include "job_scheduler.h"
+#include "meter_scheduler.h"
+#include "power_policy.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const uint8_t CHANNELS = 1;
+
+// The cell as the firmware's voltage table has it: the voltage that reads as this charge
+float cellVolts(float soc) {
+    float low = 2.7f, high = 4.2f;
+    for (int i = 0; i < 24; i++) {
+        float mid = (low + high) / 2;
+        if (BatteryMonitor::percentageFor(mid) < soc) low = mid;
+        else high = mid;
+    }
+    return high;
+}
+
+// Hours from full to empty, checking the mode once a minute. The lighter the
+// mode, the less the cell sags under it, so stepping down reads as more charge.
+float discharge(bool adaptive, bool lightSleep, unsigned& switches) {
+    const float INTERNAL_OHMS = 0.15f;
+    const float STEP_H = 1.0f / 60;
+    std::mt19937 rng(22);
+    std::normal_distribution<float> noise(0.0f, 0.003f);  // What is left after the sampler's filter
+    float mah = BatteryMonitor::CAPACITY_MAH;
+    float hours = 0;
+    PowerPolicy::Mode mode = PowerPolicy::External;
+    switches = 0;
+    while (mah > 0) {
+        float ma = PowerPolicy::averageMilliAmps(mode, CHANNELS, lightSleep);
+        float soc = 100.0f * mah / BatteryMonitor::CAPACITY_MAH;
+        float volts = cellVolts(soc) - ma / 1000.0f * INTERNAL_OHMS + noise(rng);
+        uint8_t percent = BatteryMonitor::percentageFor(volts);
+        PowerPolicy::Mode next = adaptive ? PowerPolicy::decide(mode, false, percent) : PowerPolicy::External;
+        if (next != mode) switches++;
+        mode = next;
+        mah -= PowerPolicy::averageMilliAmps(mode, CHANNELS, lightSleep) * STEP_H;
+        hours += STEP_H;
+    }
+    return hours;
+}
+
+void assertDischarge(bool lightSleep) {
+    unsigned switches = 0, none = 0;
+    float fullRate = discharge(false, lightSleep, none);
+    float adaptive = discharge(true, lightSleep, switches);
+    TEST_ASSERT_GREATER_OR_EQUAL_FLOAT(2 * fullRate, adaptive);
+    TEST_ASSERT_EQUAL_UINT32(3, switches);  // One per mode on the way down, sag and noise or not
+    PowerPolicy::Estimate e = PowerPolicy::estimate(100, CHANNELS, lightSleep);
+    TEST_ASSERT_FLOAT_WITHIN(adaptive * 0.3f, adaptive, e.runtimeHours);
+    TEST_ASSERT_FLOAT_WITHIN(fullRate * 0.3f, fullRate, e.fullRateHours);
+}
+
+// Counts of the battery divider for a cell voltage
+float batteryRaw(float volts) {
+    float scaler = (96.5f + 45.5f) / 45.5f;
+    return volts / scaler * 1000.0f * 4095.0f / 3300.0f;
+}
+
+// One loop() per 10 ms, or as long as it asked to block for
+void runFor(unsigned long ms) {
+    unsigned long end = millis() + ms;
+    while ((long)(millis() - end) < 0) {
+        unsigned long idleMs = fakePower.idleMs;
+        loop();
+        unsigned long blocked = fakePower.idleMs - idleMs;
+        NativeClock::advance(blocked ? blocked : 10);
+    }
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_charging_is_external_at_any_charge() {
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::External, PowerPolicy::decide(PowerPolicy::Critical, true, 5));
+}
+
+void test_full_cell_depends_on_where_it_came_from() {
+    // Off the charger at full: the charger is done topping up
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::External, PowerPolicy::decide(PowerPolicy::External, false, 98));
+    // Already on the battery, a full reading stays on the battery
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Saver, PowerPolicy::decide(PowerPolicy::Saver, false, 100));
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Saver, PowerPolicy::decide(PowerPolicy::External, false, 96));
+}
+
+void test_thresholds_with_hysteresis() {
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Low, PowerPolicy::decide(PowerPolicy::Saver, false, 39));
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Critical, PowerPolicy::decide(PowerPolicy::Low, false, 14));
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Low, PowerPolicy::decide(PowerPolicy::Low, false, 44));
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Saver, PowerPolicy::decide(PowerPolicy::Low, false, 45));
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Critical, PowerPolicy::decide(PowerPolicy::Critical, false, 19));
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Low, PowerPolicy::decide(PowerPolicy::Critical, false, 20));
+}
+
+void test_update_reports_only_changes() {
+    PowerPolicy::begin();
+    TEST_ASSERT_FALSE(PowerPolicy::update(true, 80));
+    TEST_ASSERT_TRUE(PowerPolicy::update(false, 80));
+    TEST_ASSERT_EQUAL_UINT8(PowerPolicy::Saver, PowerPolicy::mode());
+    TEST_ASSERT_FALSE(PowerPolicy::update(false, 79));
+    TEST_ASSERT_EQUAL_UINT8(79, PowerPolicy::lastPercent());
+    TEST_ASSERT_FALSE(PowerPolicy::lastCharging());
+}
+
+void test_discharge_with_light_sleep() {
+    assertDischarge(true);
+}
+
+void test_discharge_without_light_sleep() {
+    assertDischarge(false);
+}
+
+// Off the charger and down through the modes: what each one switches, and
+// what it does to the cloud traffic and the meter polling
+void test_firmware_through_the_modes() {
+    struct Phase {
+        bool charging;
+        float volts;
+        PowerPolicy::Mode expected;
+    };
+    const Phase PHASES[] = {
+        {true, 4.10f, PowerPolicy::External},
+        {false, 3.85f, PowerPolicy::Saver},
+        {false, 3.45f, PowerPolicy::Low},
+        {false, 3.20f, PowerPolicy::Critical},
+        {true, 3.60f, PowerPolicy::External},
+    };
+    const unsigned long SETTLE_MS = 60000;
+    const unsigned long MEASURE_MS = 480000;
+
+    addConfiguredNetworks();
+    setup();
+    while (!BootSequence::metrics().firstUploadMs && millis() < 120000) {
+        NativeClock::advance(10);
+        loop();
+    }
+    uint8_t uploadJob = JobScheduler::NO_JOB;
+    for (uint8_t id = 0; id < JobScheduler::jobCount(); id++) {
+        if (!strcmp(JobScheduler::stats(id).name, "upload")) uploadJob = id;
+    }
+    TEST_ASSERT_NOT_EQUAL(JobScheduler::NO_JOB, uploadJob);
+
+    for (const Phase& phase : PHASES) {
+        fakeAdc.charging.raw = phase.charging ? 2000 : 0;
+        fakeAdc.battery.raw = batteryRaw(phase.volts);
+        runFor(SETTLE_MS);
+
+        unsigned long requests = fakeCloud.requests;
+        unsigned long idleMs = fakePower.idleMs;
+        uint32_t reads = MeterScheduler::samplesCompleted();
+        runFor(MEASURE_MS);
+        float perMinute = (fakeCloud.requests - requests) * 60000.0f / MEASURE_MS;
+        float readsPerSecond = (MeterScheduler::samplesCompleted() - reads) * 1000.0f / MEASURE_MS;
+        float idleShare = 100.0f * (fakePower.idleMs - idleMs) / MEASURE_MS;
+
+        const PowerPolicy::Settings& s = PowerPolicy::settings(phase.expected);
+        TEST_ASSERT_EQUAL_UINT8(phase.expected, PowerPolicy::mode());
+        TEST_ASSERT_EQUAL_UINT32(s.uploadMs, JobScheduler::stats(uploadJob).periodMs);
+        TEST_ASSERT_EQUAL(s.modemSleep, fakePower.modemSleep);
+        TEST_ASSERT_EQUAL(s.lightSleep, fakePower.lightSleep);
+        TEST_ASSERT_EQUAL(s.lightSleep, AdcSampler::lowPower());
+        TEST_ASSERT_LESS_OR_EQUAL_FLOAT(1.25f, perMinute * s.uploadMs / 60000.0f);  // About one request a cycle
+        if (phase.expected == PowerPolicy::External) {
+            TEST_ASSERT_EQUAL_FLOAT(0, idleShare);
+        } else {
+            TEST_ASSERT_GREATER_THAN_FLOAT(50, idleShare);
+        }
+        if (s.roundGapMs) TEST_ASSERT_LESS_OR_EQUAL_FLOAT(1000.0f * CHANNELS / s.roundGapMs + 0.05f, readsPerSecond);
+    }
+
+    char powerPath[64];
+    DeviceIdentity::path(powerPath, sizeof(powerPath), "deviceStatus/power");
+    TEST_ASSERT_EQUAL_UINT32(1, fakeCloud.nodes.count(powerPath));
+    static char json[192];
+    int length = PowerPolicy::format(json, sizeof(json), MeterScheduler::channelCount(), fakePower.lightSleepSupported);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_LESS_THAN((int)sizeof(json), length);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_charging_is_external_at_any_charge);
+    RUN_TEST(test_full_cell_depends_on_where_it_came_from);
+    RUN_TEST(test_thresholds_with_hysteresis);
+    RUN_TEST(test_update_reports_only_changes);
+    RUN_TEST(test_discharge_with_light_sleep);
+    RUN_TEST(test_discharge_without_light_sleep);
+    RUN_TEST(test_firmware_through_the_modes);
+    return UNITY_END();
+}
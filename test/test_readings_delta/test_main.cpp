@@ -0,0 +1,242 @@
+// Delta reporting of /readings: which fields select() picks against what the
+// database holds, then six hours of a household load uploaded through the
+// deadbands with the fake database read back after every cycle.
+//
+//   pio test -e native -f test_readings_delta
+
+#include <Arduino.h>
+#include <math.h>
+#include <random>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "derived_metrics.h"
+#include "device_identity.h"
+#include "firebase_manager.h"
+#include "readings_delta.h"
+#include "readings_schema.h"
+
+namespace {
+
+const unsigned long CYCLE_MS = 2000;
+
+uint32_t bit(const char* name) {
+    for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+        if (!strcmp(READINGS_SCHEMA[i].name, name)) return 1UL << i;
+    }
+    TEST_FAIL_MESSAGE("no such field");
+    return 0;
+}
+
+const uint32_t TIMESTAMP = 1;  // Goes with every delta
+
+PowerReadings base(uint8_t channel = 0) {
+    PowerReadings r;
+    r.isValid = true;
+    r.channel = channel;
+    r.timestamp = 1700000000;
+    r.voltage = 230;
+    r.current = 1;
+    r.power = 200;
+    r.energy = 1000;
+    r.frequency = 50;
+    r.powerFactor = 0.87f;
+    return r;
+}
+
+// Commits everything, as the first upload of a channel does
+void sendAll(const PowerReadings& r, unsigned long now) {
+    ReadingsDelta::stage(r, ReadingsDelta::ALL_FIELDS, now);
+    ReadingsDelta::confirm();
+}
+
+struct Snapshot {
+    unsigned long ms;
+    bool online;
+    PowerReadings readings;
+};
+
+// Base load, fridge, TV, kettle, an hour of heater, mains wander and meter
+// noise, unplugged near the end, with the link down for five minutes
+std::vector<Snapshot> household() {
+    const double HOURS = 6;
+    std::mt19937 rng(23);
+    std::normal_distribution<double> gauss(0, 1);
+    std::vector<Snapshot> trace;
+    double wh = 12000;
+    for (unsigned long ms = 0; ms < HOURS * 3600000; ms += CYCLE_MS) {
+        double t = ms / 1000.0;
+        double watts = 60 + 10 * sin(t / 1800), va = watts / 0.6;
+        if (fmod(t, 1800) < 600) watts += 120, va += 150;
+        if (t > 3600 && t < 3 * 3600) watts += 90, va += 100;
+        if (fmod(t + 900, 7200) < 180) watts += 2000, va += 2000;
+        if (t > 4 * 3600 && t < 5 * 3600) watts += 1500, va += 1500;
+        watts *= 1 + 0.003 * gauss(rng);
+        double volts = 230 + 2 * sin(t / 5400) - watts / 1000 * 0.5 + 0.15 * gauss(rng);
+        double hz = 50 + 0.03 * sin(t / 900) + 0.02 * gauss(rng);
+        wh += watts * CYCLE_MS / 3600000.0;
+
+        MeterSample s = {};
+        s.voltage = (uint16_t)lround(volts * 10);
+        s.current = (uint32_t)lround(va / volts * 1000);
+        s.power = (uint32_t)lround(watts * 10);
+        s.energy = (uint32_t)wh;
+        s.frequency = (uint16_t)lround(hz * 10);
+        s.pf = (uint16_t)lround(watts / va * 100);
+        Snapshot snap = {ms, !(t > 3 * 3600 && t < 3 * 3600 + 300), PowerReadings()};
+        DerivedMetrics::compute(s, snap.readings);
+        snap.readings.energy = (float)wh;
+        snap.readings.timestamp = 1700000000UL + ms / 1000;
+        snap.readings.isValid = true;
+        snap.readings.isCharging = ms < HOURS * 3600000 * 0.8;
+        trace.push_back(snap);
+    }
+    return trace;
+}
+
+}  // namespace
+
+void setUp() {
+    ReadingsDelta::reset();
+}
+
+void tearDown() {}
+
+void test_everything_until_a_full_upload_lands() {
+    PowerReadings r = base();
+    TEST_ASSERT_EQUAL_HEX32(ReadingsDelta::ALL_FIELDS, ReadingsDelta::select(r, 0));
+    ReadingsDelta::stage(r, ReadingsDelta::ALL_FIELDS, 0);
+    ReadingsDelta::discard();
+    TEST_ASSERT_EQUAL_HEX32(ReadingsDelta::ALL_FIELDS, ReadingsDelta::select(r, 0));
+    sendAll(r, 0);
+    TEST_ASSERT_EQUAL_HEX32(0, ReadingsDelta::select(r, CYCLE_MS));
+}
+
+void test_move_within_the_deadband_is_held() {
+    PowerReadings r = base();
+    sendAll(r, 0);
+    r.voltage = 230.4f;
+    TEST_ASSERT_EQUAL_HEX32(0, ReadingsDelta::select(r, CYCLE_MS));
+    r.voltage = 230.6f;
+    TEST_ASSERT_EQUAL_HEX32(TIMESTAMP | bit("voltage"), ReadingsDelta::select(r, CYCLE_MS));
+}
+
+void test_relative_deadband_on_large_values() {
+    PowerReadings r = base();
+    r.power = 3000;  // 2%: 60 W
+    sendAll(r, 0);
+    r.power = 3050;
+    TEST_ASSERT_EQUAL_HEX32(0, ReadingsDelta::select(r, CYCLE_MS));
+    r.power = 3070;
+    TEST_ASSERT_EQUAL_HEX32(TIMESTAMP | bit("power"), ReadingsDelta::select(r, CYCLE_MS));
+}
+
+void test_drift_adds_up_against_the_database() {
+    PowerReadings r = base();
+    sendAll(r, 0);
+    r.voltage += 0.3f;
+    TEST_ASSERT_EQUAL_HEX32(0, ReadingsDelta::select(r, CYCLE_MS));
+    r.voltage += 0.3f;  // Each step under the deadband, the sum over it
+    TEST_ASSERT_EQUAL_HEX32(TIMESTAMP | bit("voltage"), ReadingsDelta::select(r, 2 * CYCLE_MS));
+}
+
+void test_changed_bool_and_nan_always_go() {
+    PowerReadings r = base();
+    sendAll(r, 0);
+    r.isCharging = !r.isCharging;
+    TEST_ASSERT_EQUAL_HEX32(TIMESTAMP | bit("isCharging"), ReadingsDelta::select(r, CYCLE_MS));
+    r = base();
+    r.thd = NAN;
+    TEST_ASSERT_EQUAL_HEX32(TIMESTAMP | bit("thd"), ReadingsDelta::select(r, CYCLE_MS));
+}
+
+void test_nothing_held_longer_than_max_stale() {
+    PowerReadings r = base();
+    sendAll(r, 0);
+    TEST_ASSERT_EQUAL_HEX32(0, ReadingsDelta::select(r, ReadingsDelta::MAX_STALE_MS - 1));
+    TEST_ASSERT_EQUAL_HEX32(ReadingsDelta::ALL_FIELDS, ReadingsDelta::select(r, ReadingsDelta::MAX_STALE_MS));
+}
+
+void test_discarded_delta_is_selected_again() {
+    PowerReadings r = base();
+    sendAll(r, 0);
+    r.voltage = 232;
+    uint32_t fields = ReadingsDelta::select(r, CYCLE_MS);
+    ReadingsDelta::stage(r, fields, CYCLE_MS);
+    ReadingsDelta::discard();  // The batch didn't land
+    TEST_ASSERT_EQUAL_HEX32(fields, ReadingsDelta::select(r, 2 * CYCLE_MS));
+    ReadingsDelta::stage(r, fields, 2 * CYCLE_MS);
+    ReadingsDelta::confirm();
+    TEST_ASSERT_EQUAL_HEX32(0, ReadingsDelta::select(r, 3 * CYCLE_MS));
+}
+
+void test_channels_tracked_separately() {
+    sendAll(base(0), 0);
+    TEST_ASSERT_EQUAL_HEX32(ReadingsDelta::ALL_FIELDS, ReadingsDelta::select(base(1), CYCLE_MS));
+    TEST_ASSERT_EQUAL_HEX32(0, ReadingsDelta::select(base(0), CYCLE_MS));
+}
+
+// What the app reads back after every cycle stays within each field's
+// deadband (plus the rounding to the decimals sent) and is never staler than
+// MAX_STALE_MS, for fewer bytes than sending every field
+void test_household_trace_through_the_deadbands() {
+    std::vector<Snapshot> trace = household();
+    DeviceIdentity::begin();
+    const std::string root = std::string(DeviceIdentity::root()) + "/readings/";
+    unsigned long bytes[2] = {};
+    for (int delta = 0; delta < 2; delta++) {
+        fakeCloud.nodes.clear();
+        ReadingsDelta::reset();
+        unsigned long start = millis();
+        unsigned long sentBefore = fakeCloud.bytesSent;
+        unsigned long stalest = 0;
+        for (const Snapshot& snap : trace) {
+            NativeClock::set(start + snap.ms);
+            if (!delta) ReadingsDelta::reset();
+            fakeCloud.online = snap.online;
+            FirebaseManager::beginCycle();
+            FirebaseManager::queueReadings(snap.readings);
+            FirebaseManager::commitCycle();
+            if (!delta || !snap.online) continue;
+
+            const PowerReadings& truth = snap.readings;
+            for (size_t i = 0; i < READINGS_FIELD_COUNT; i++) {
+                const ReadingsField& field = READINGS_SCHEMA[i];
+                std::string value;
+                TEST_ASSERT_TRUE(fakeCloud.lookup((root + field.name).c_str(), value));
+                if (field.kind == ReadingsField::Bool) {
+                    TEST_ASSERT_EQUAL(truth.isCharging, value == "true");
+                } else if (field.kind == ReadingsField::Uint32) {
+                    unsigned long stored = strtoul(value.c_str(), nullptr, 10);
+                    TEST_ASSERT_LESS_OR_EQUAL(truth.timestamp, stored);
+                    stalest = std::max(stalest, (unsigned long)(truth.timestamp - stored));
+                } else {
+                    double stored = strtod(value.c_str(), nullptr);
+                    double band = std::max((double)field.deadband, fabs(stored) * field.relative);
+                    TEST_ASSERT_FLOAT_WITHIN(band + 0.5 * pow(10, -field.decimals) + 1e-6,
+                                             ReadingsSchema::floatAt(truth, field), stored);
+                }
+            }
+        }
+        fakeCloud.online = true;
+        bytes[delta] = fakeCloud.bytesSent - sentBefore;
+        if (delta) TEST_ASSERT_LESS_OR_EQUAL((ReadingsDelta::MAX_STALE_MS + CYCLE_MS) / 1000, stalest);
+    }
+    TEST_ASSERT_LESS_THAN(bytes[0] / 2, bytes[1]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_everything_until_a_full_upload_lands);
+    RUN_TEST(test_move_within_the_deadband_is_held);
+    RUN_TEST(test_relative_deadband_on_large_values);
+    RUN_TEST(test_drift_adds_up_against_the_database);
+    RUN_TEST(test_changed_bool_and_nan_always_go);
+    RUN_TEST(test_nothing_held_longer_than_max_stale);
+    RUN_TEST(test_discarded_delta_is_selected_again);
+    RUN_TEST(test_channels_tracked_separately);
+    RUN_TEST(test_household_trace_through_the_deadbands);
+    return UNITY_END();
+}
@@ -0,0 +1,76 @@
+// Stale cached leases: the firmware on the fakes rejoins through DHCP when
+// nothing gets through a fast-rejoined link, and keeps the link when the
+// server is reached but turns the writes away.
+//
+//   pio test -e native -f test_wifi_link
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "boot_sequence.h"
+#include "wifi_link.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const unsigned long STEP_MS = 10;
+
+void step(unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += STEP_MS) {
+        NativeClock::advance(STEP_MS);
+        loop();
+    }
+}
+
+// AP away briefly, then back: the link comes up again from the cache
+void blip() {
+    WiFi.setLinkAvailable(false);
+    step(300);
+    WiFi.setLinkAvailable(true);
+    for (unsigned long start = millis(); !WifiLink::connected() && millis() - start < 60000;) step(STEP_MS);
+}
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_firmware_rejoins_when_the_cloud_is_unreachable_and_not_when_rejected() {
+    addConfiguredNetworks();
+    setup();
+    for (unsigned long start = millis(); !BootSequence::metrics().firstUploadMs && millis() - start < 300000;) {
+        step(STEP_MS);
+    }
+    TEST_ASSERT_GREATER_THAN(0, BootSequence::metrics().firstUploadMs);
+
+    // Writes refused for 30 s over a fast-rejoined link: the lease is fine
+    blip();
+    TEST_ASSERT_TRUE(WifiLink::connected());
+    uint32_t stale = WifiLink::getStats().staleLeases;
+    unsigned long requestsBefore = fakeCloud.requests;
+    fakeCloud.rejecting = true;
+    step(30000);
+    fakeCloud.rejecting = false;
+    TEST_ASSERT_GREATER_THAN(requestsBefore, fakeCloud.requests);
+    TEST_ASSERT_EQUAL_UINT32(stale, WifiLink::getStats().staleLeases);
+
+    // Renumbered network: nothing routed to the cached address, so it is dropped
+    WiFi.dhcpAddress = IPAddress(192, 168, 4, 57);
+    blip();
+    for (unsigned long start = millis(); !WiFi.addressValid() && millis() - start < 60000;) {
+        fakeCloud.online = WiFi.addressValid();
+        step(STEP_MS);
+    }
+    fakeCloud.online = true;
+    TEST_ASSERT_TRUE(WiFi.addressValid());
+    TEST_ASSERT_EQUAL_UINT32(stale + 1, WifiLink::getStats().staleLeases);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_firmware_rejoins_when_the_cloud_is_unreachable_and_not_when_rejected);
+    return UNITY_END();
+}
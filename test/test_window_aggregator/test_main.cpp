@@ -0,0 +1,148 @@
+// Rolling-window statistics: windows aligned to wall-clock multiples of their
+// length, exact minute quantiles, readings still stamped with uptime left
+// out, and the firmware on the fakes booted with NTP answering late
+// publishing only aligned windows.
+//
+//   pio test -e native -f test_window_aggregator
+
+#include <Arduino.h>
+#include <map>
+#include <set>
+#include <stdlib.h>
+#include <string>
+#include <unity.h>
+#include "native/fake_backends.h"
+#include "boot_sequence.h"
+#include "system_manager.h"
+#include "window_aggregator.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const uint32_t HOUR_START = 1700002800;  // A multiple of 3600
+
+// The firmware below uploads channel 0; each test here keeps to its own
+PowerReadings reading(uint8_t channel, uint32_t timestamp, float power) {
+    PowerReadings r;
+    r.isValid = true;
+    r.channel = channel;
+    r.timestamp = timestamp;
+    r.voltage = 230;
+    r.current = power / 230;
+    r.power = power;
+    r.frequency = 50;
+    r.powerFactor = 1;
+    r.energy = timestamp / 36.0f;
+    return r;
+}
+
+void drainSummaries() {
+    WindowSummary summary;
+    while (WindowAggregator::pop(summary)) {}
+}
+
+}  // namespace
+
+void setUp() {
+    drainSummaries();
+}
+
+void tearDown() {}
+
+void test_minute_closes_on_the_next_sample() {
+    for (uint32_t t = HOUR_START; t < HOUR_START + 60; t += 2) WindowAggregator::add(reading(1, t, 100 + t % 7));
+    WindowSummary summary;
+    TEST_ASSERT_FALSE(WindowAggregator::pop(summary));
+    WindowAggregator::add(reading(1, HOUR_START + 60, 100));
+
+    TEST_ASSERT_TRUE(WindowAggregator::pop(summary));
+    TEST_ASSERT_EQUAL_UINT8(WindowAggregator::Minute, summary.window);
+    TEST_ASSERT_EQUAL_UINT32(HOUR_START, summary.start);
+    TEST_ASSERT_EQUAL_UINT16(30, summary.count);
+    TEST_ASSERT_EQUAL_FLOAT(100, summary.metrics[WindowSummary::Power].min);
+    TEST_ASSERT_EQUAL_FLOAT(106, summary.metrics[WindowSummary::Power].max);
+    TEST_ASSERT_FALSE(WindowAggregator::pop(summary));
+}
+
+// 30 samples at the 2 s cycle: p50/p95 are the samples at those ranks
+void test_minute_quantiles_are_exact() {
+    uint32_t start = HOUR_START + 7200;
+    for (uint32_t n = 0; n < 30; n++) {
+        float power = 1 + (n * 7) % 30;  // 1..30, shuffled
+        WindowAggregator::add(reading(3, start + 2 * n, power));
+    }
+    WindowAggregator::add(reading(3, start + 60, 1));
+    WindowSummary summary;
+    TEST_ASSERT_TRUE(WindowAggregator::pop(summary));
+    TEST_ASSERT_EQUAL_UINT8(WindowAggregator::Minute, summary.window);
+    TEST_ASSERT_EQUAL_UINT16(30, summary.count);
+    TEST_ASSERT_EQUAL_FLOAT(16, summary.metrics[WindowSummary::Power].p50);
+    TEST_ASSERT_EQUAL_FLOAT(29, summary.metrics[WindowSummary::Power].p95);
+}
+
+void test_uptime_readings_left_out() {
+    for (uint32_t t = 0; t < 300; t += 2) WindowAggregator::add(reading(2, t, 500));
+    WindowSummary summary;
+    TEST_ASSERT_FALSE(WindowAggregator::pop(summary));
+
+    // Nothing of them shows in the first wall-clock windows either
+    uint32_t start = HOUR_START + 3600;
+    for (uint32_t t = start; t <= start + 60; t += 2) WindowAggregator::add(reading(2, t, 100));
+    bool minute = false;
+    while (WindowAggregator::pop(summary)) {
+        TEST_ASSERT_GREATER_OR_EQUAL(SystemManager::MIN_VALID_EPOCH, summary.start);
+        TEST_ASSERT_EQUAL_UINT32(0, summary.start % WindowAggregator::WINDOW_SECONDS[summary.window]);
+        TEST_ASSERT_EQUAL_FLOAT(100, summary.metrics[WindowSummary::Power].max);
+        if (summary.window == WindowAggregator::Minute && summary.start == start) minute = true;
+    }
+    TEST_ASSERT_TRUE(minute);
+}
+
+// NTP answering 150 s after the link came up: the windows published are all
+// aligned to their length, none of them from before the sync
+void test_firmware_with_late_ntp_publishes_aligned_windows() {
+    NativeClock::ntpDelayMs = 150000;
+    fakeCloud.nodes.clear();
+    addConfiguredNetworks();
+    setup();
+    for (unsigned long start = millis(); !BootSequence::metrics().firstUploadMs && millis() - start < 300000;) {
+        NativeClock::advance(10);
+        loop();
+    }
+    TEST_ASSERT_GREATER_THAN(0, BootSequence::metrics().firstUploadMs);
+    // Past the first hour boundary after the sync, and a few cycles to send it
+    while (time(nullptr) < (time_t)HOUR_START + 60) {
+        NativeClock::advance(100);
+        loop();
+    }
+
+    std::map<std::string, std::set<unsigned long>> published;
+    for (const auto& node : fakeCloud.nodes) {
+        size_t at = node.first.find("aggregates/");
+        if (at == std::string::npos) continue;
+        std::string rest = node.first.substr(at + 11);  // <window>/<day>/<start>/<key>
+        size_t day = rest.find('/'), start = rest.find('/', day + 1);
+        TEST_ASSERT_TRUE_MESSAGE(day != std::string::npos && start != std::string::npos, node.first.c_str());
+        published[rest.substr(0, day)].insert(strtoul(rest.c_str() + start + 1, nullptr, 10));
+    }
+    for (uint8_t w = 0; w < WindowAggregator::WINDOW_COUNT; w++) {
+        const std::set<unsigned long>& starts = published[WindowAggregator::WINDOW_NAMES[w]];
+        TEST_ASSERT_FALSE_MESSAGE(starts.empty(), WindowAggregator::WINDOW_NAMES[w]);
+        for (unsigned long start : starts) {
+            TEST_ASSERT_EQUAL_UINT32(0, start % WindowAggregator::WINDOW_SECONDS[w]);
+            // The first window may start before the sync, but no sample before it went in
+            TEST_ASSERT_GREATER_THAN(NativeClock::EPOCH_AT_BOOT + 150 - WindowAggregator::WINDOW_SECONDS[w], start);
+        }
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_minute_closes_on_the_next_sample);
+    RUN_TEST(test_minute_quantiles_are_exact);
+    RUN_TEST(test_uptime_readings_left_out);
+    RUN_TEST(test_firmware_with_late_ntp_publishes_aligned_windows);
+    return UNITY_END();
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Reference decoder for the device's history blocks (include/history_codec.h).
+
+Reads a JSON export of the database (or of any subtree) from a file or stdin,
+finds every string under a "historyBlocks" key, decodes it and prints one CSV
+row per record, oldest first per channel:
+
+    python3 tools/decode_history.py export.json > history.csv
+
+Keys of the form "a/b/c" (multi-location update payloads) are treated like
+nested objects, so the bench's --export output can be fed in directly.
+"""
+
+import base64
+import json
+import struct
+import sys
+
+VERSION = 1
+HEADER_BYTES = 4
+CHANNEL_SHIFT = 4
+FLOAT_COLUMNS = ("voltage", "current", "power", "energy", "frequency", "powerFactor")
+DOD_BUCKETS = ((2, 7), (3, 9), (4, 12))  # prefix length, value bits
+
+
+class BitReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def read(self, bits):
+        value = 0
+        for _ in range(bits):
+            if self.pos >= len(self.data) * 8:
+                raise ValueError("block truncated")
+            byte = self.data[self.pos // 8]
+            value = (value << 1) | ((byte >> (7 - self.pos % 8)) & 1)
+            self.pos += 1
+        return value
+
+
+def to_signed32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def read_dod(reader):
+    if not reader.read(1):
+        return 0
+    for prefix_bits, value_bits in DOD_BUCKETS:
+        if not reader.read(1):
+            half = 1 << (value_bits - 1)
+            return reader.read(value_bits) - half + 1
+    return to_signed32(reader.read(32))
+
+
+def read_floats(reader, count):
+    values = []
+    previous = leading = trailing = 0
+    have_window = False
+    for i in range(count):
+        if i == 0:
+            previous = reader.read(32)
+        elif reader.read(1):
+            if reader.read(1):
+                leading = reader.read(5)
+                meaningful = reader.read(5) + 1
+                trailing = 32 - leading - meaningful
+                if trailing < 0:
+                    raise ValueError("bad XOR window")
+                have_window = True
+            elif not have_window:
+                raise ValueError("XOR window used before being set")
+            meaningful = 32 - leading - trailing
+            previous ^= reader.read(meaningful) << trailing
+        values.append(struct.unpack("<f", struct.pack("<I", previous))[0])
+    return values
+
+
+def decode_block(data):
+    """Returns (channel, list of record dicts)."""
+    if len(data) < HEADER_BYTES or data[0] != VERSION:
+        raise ValueError("unsupported block version")
+    channel = data[1]
+    count = data[2] | (data[3] << 8)
+    reader = BitReader(data[HEADER_BYTES:])
+
+    timestamps = [reader.read(32)]
+    delta = 0
+    for _ in range(1, count):
+        delta += read_dod(reader)
+        timestamps.append((timestamps[-1] + delta) & 0xFFFFFFFF)
+
+    flags = []
+    current = 0
+    for i in range(count):
+        if i == 0 or reader.read(1):
+            current = reader.read(4)
+        flags.append(current)
+
+    columns = [read_floats(reader, count) for _ in FLOAT_COLUMNS]
+    records = []
+    for i in range(count):
+        record = {"timestamp": timestamps[i], "flags": flags[i] | (channel << CHANNEL_SHIFT)}
+        for name, column in zip(FLOAT_COLUMNS, columns):
+            record[name] = column[i]
+        records.append(record)
+    return channel, records
+
+
+def find_blocks(node, path=()):
+    """Yields (path, base64 text) for every string below a historyBlocks key."""
+    if isinstance(node, dict):
+        for key, value in node.items():
+            parts = tuple(p for p in key.split("/") if p)
+            yield from find_blocks(value, path + parts)
+    elif isinstance(node, str) and "historyBlocks" in path[:-1]:
+        yield path, node
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    tree = json.load(source)
+    rows = []
+    for path, text in find_blocks(tree):
+        try:
+            channel, records = decode_block(base64.b64decode(text))
+        except ValueError as error:
+            print("skipping %s: %s" % ("/".join(path), error), file=sys.stderr)
+            continue
+        for record in records:
+            rows.append((channel, record))
+
+    rows.sort(key=lambda row: (row[0], row[1]["timestamp"]))
+    print("channel,timestamp,valid,charging," + ",".join(FLOAT_COLUMNS))
+    for channel, r in rows:
+        print("%d,%d,%d,%d,%s" % (channel, r["timestamp"], r["flags"] & 1, (r["flags"] >> 1) & 1,
+                                  ",".join("%.9g" % r[name] for name in FLOAT_COLUMNS)))
+
+
+if __name__ == "__main__":
+    main()
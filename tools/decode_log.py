@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Decoder for the firmware's binary serial log (include/logger.h).
+
+The device writes each log record as a frame holding a hash of the format
+literal and the raw argument values. This script rebuilds the hash -> format
+table from the sources, so it must be run against the same tree the firmware
+was built from:
+
+    python3 tools/decode_log.py serial.bin > serial.txt
+    python3 tools/decode_log.py --src path/to/repo capture.bin
+
+Frame: 0xA5, length, then `length` bytes of format id (u32), time ms (u32),
+level (u8) and tagged arguments, then CRC-16/MODBUS over length..arguments.
+Bytes outside valid frames (boot ROM chatter, a text-mode build) are skipped.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+FRAME_SYNC = 0xA5
+LEVELS = "-EWID"
+MACRO = re.compile(rb'\b(?:LOG_(?:ERROR|WARN|INFO|DEBUG)|DEBUG_PRINT(?:F|LN)?)\s*\(\s*((?:"(?:[^"\\]|\\.)*"\s*)+)')
+LITERAL = re.compile(rb'"((?:[^"\\]|\\.)*)"')
+SPEC = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|L|z|j|t)?([diouxXcsfeEgG%])')
+ESCAPES = {b"n": b"\n", b"t": b"\t", b"r": b"\r", b"0": b"\0", b'"': b'"', b"\\": b"\\", b"'": b"'"}
+
+
+def fnv1a(data):
+    h = 2166136261
+    for byte in data:
+        h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def unescape(raw):
+    out = bytearray()
+    i = 0
+    while i < len(raw):
+        if raw[i:i + 1] == b"\\" and i + 1 < len(raw):
+            nxt = raw[i + 1:i + 2]
+            if nxt == b"x":
+                digits = re.match(rb"[0-9a-fA-F]{1,2}", raw[i + 2:]).group(0)
+                out.append(int(digits, 16))
+                i += 2 + len(digits)
+                continue
+            out += ESCAPES.get(nxt, nxt)
+            i += 2
+        else:
+            out.append(raw[i])
+            i += 1
+    return bytes(out)
+
+
+def load_formats(root):
+    formats = {}
+    for folder in ("src", "include"):
+        for dirpath, _, files in os.walk(os.path.join(root, folder)):
+            for name in files:
+                if not name.endswith((".cpp", ".h")):
+                    continue
+                with open(os.path.join(dirpath, name), "rb") as f:
+                    source = f.read()
+                for match in MACRO.finditer(source):
+                    literal = b"".join(unescape(m.group(1)) for m in LITERAL.finditer(match.group(1)))
+                    key = fnv1a(literal)
+                    if key in formats and formats[key] != literal:
+                        print("warning: format id collision 0x%08X" % key, file=sys.stderr)
+                    formats[key] = literal
+    return formats
+
+
+def read_args(data):
+    args = []
+    i = 0
+    while i < len(data):
+        tag = chr(data[i])
+        i += 1
+        if tag == "i":
+            args.append(struct.unpack_from("<i", data, i)[0]); i += 4
+        elif tag == "u":
+            args.append(struct.unpack_from("<I", data, i)[0]); i += 4
+        elif tag == "I":
+            args.append(struct.unpack_from("<q", data, i)[0]); i += 8
+        elif tag == "U":
+            args.append(struct.unpack_from("<Q", data, i)[0]); i += 8
+        elif tag == "f":
+            args.append(struct.unpack_from("<f", data, i)[0]); i += 4
+        elif tag == "s":
+            length = data[i]
+            args.append(data[i + 1:i + 1 + length].decode("utf-8", "replace")); i += 1 + length
+        else:  # '~': the rest didn't fit in the slot
+            break
+    return args
+
+
+def render(fmt, args):
+    remaining = iter(args)
+
+    def substitute(match):
+        flags, conversion = match.group(1), match.group(2)
+        if conversion == "%":
+            return "%"
+        value = next(remaining, None)
+        if value is None:
+            return "<?>"
+        if conversion in "diu":
+            conversion = "d"
+        if conversion in "fFeEgG" and not isinstance(value, float):
+            value = float(value)
+        elif conversion in "doxXc" and isinstance(value, float):
+            value = int(value)
+        elif conversion == "s":
+            value = str(value)
+        return ("%" + flags + conversion) % value
+
+    return SPEC.sub(substitute, fmt)
+
+
+def decode(stream, formats, out):
+    i = 0
+    frames = skipped = unknown = 0
+    while i + 2 <= len(stream):
+        if stream[i] != FRAME_SYNC:
+            i += 1
+            skipped += 1
+            continue
+        length = stream[i + 1]
+        end = i + 2 + length + 2
+        if length < 9 or end > len(stream) or \
+                crc16(stream[i + 1:end - 2]) != struct.unpack_from("<H", stream, end - 2)[0]:
+            i += 1
+            skipped += 1
+            continue
+        format_id, time_ms, level = struct.unpack_from("<IIB", stream, i + 2)
+        args = read_args(stream[i + 11:end - 2])
+        fmt = formats.get(format_id)
+        if fmt is None:
+            unknown += 1
+            text = "<unknown format 0x%08X> %r" % (format_id, args)
+        else:
+            text = render(fmt.decode("utf-8", "replace"), args)
+        level_char = LEVELS[level] if level < len(LEVELS) else "?"
+        out.write("[%u] %s %s\n" % (time_ms, level_char, text.rstrip("\n")))
+        frames += 1
+        i = end
+    return frames, skipped, unknown
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", help="raw serial capture (default: stdin)")
+    parser.add_argument("--src", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."),
+                        help="repository root the firmware was built from")
+    options = parser.parse_args()
+
+    formats = load_formats(options.src)
+    if options.capture:
+        with open(options.capture, "rb") as f:
+            stream = f.read()
+    else:
+        stream = sys.stdin.buffer.read()
+    frames, skipped, unknown = decode(stream, formats, sys.stdout)
+    print("%d records, %d bytes skipped, %d unknown formats" % (frames, skipped, unknown), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()